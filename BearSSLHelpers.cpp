@@ -839,7 +839,7 @@ bool X509List::append(const uint8_t *derCert, size_t derLen) {
 
 ServerSessions::~ServerSessions() {
   if (_isDynamic && _store != nullptr)
-    delete _store;
+    delete [] _store;
 }
 
 ServerSessions::ServerSessions(ServerSession *sessions, uint32_t size, bool isDynamic) :
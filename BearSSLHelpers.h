@@ -164,12 +164,13 @@ namespace BearSSL {
 		// Returns the number of sessions the cache can hold.
 		uint32_t size() { return _size; }
 
-		private:
-		ServerSessions(ServerSession *sessions, uint32_t size, bool isDynamic);
-
 		// Returns the cache's vtable or null if the cache has no capacity.
+		// Not thread safe: the caller serializes handshakes using it.
 		const br_ssl_session_cache_class **getCache();
 
+		private:
+		ServerSessions(ServerSession *sessions, uint32_t size, bool isDynamic);
+
 		// Size of the store in sessions.
 		uint32_t _size;
 		// Store where the information for the sessions are stored.
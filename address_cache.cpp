@@ -9,9 +9,12 @@
 #include "time.h"
 
 
-std::shared_mutex address_cache::cache_lock;
-std::map<any_addr, address_cache::address_entry_t> address_cache::cache;
-std::map<any_addr, phys *> address_cache::mac_cache;
+address_table address_cache::cache;
+address_table address_cache::mac_cache;
+
+// a dynamic entry is only rewritten (which takes the lock of its shard)
+// when it changed or when it is older than this; they expire after an hour
+constexpr uint64_t refresh_interval = 60000000ll;
 
 address_cache::address_cache(stats *const s)
 {
@@ -22,6 +25,9 @@ address_cache::address_cache(stats *const s)
 	address_cache_hit      = s->register_stat("address_cache_hit", "1.3.6.1.4.1.57850.1.7.4");
 	address_cache_store    = s->register_stat("address_cache_store", "1.3.6.1.4.1.57850.1.7.5");
 	address_cache_update   = s->register_stat("address_cache_cache_update", "1.3.6.1.4.1.57850.1.7.6");
+	address_cache_miss     = s->register_stat("address_cache_miss", "1.3.6.1.4.1.57850.1.7.7");
+	address_cache_refresh_skip = s->register_stat("address_cache_refresh_skip", "1.3.6.1.4.1.57850.1.7.8");
+	address_cache_full     = s->register_stat("address_cache_full", "1.3.6.1.4.1.57850.1.7.9");
 
 	cleaner_th = new std::thread(&address_cache::cache_cleaner, this);
 }
@@ -36,28 +42,40 @@ address_cache::~address_cache()
 
 void address_cache::update_cache(const any_addr & mac, const any_addr & ip, phys *const interface, const bool static_entry)
 {
-	const std::lock_guard<std::shared_mutex> lock(cache_lock);
-
 	assert(mac.get_family() == any_addr::mac  || mac.get_family() == any_addr::ax25);
 	assert(ip.get_family()  == any_addr::ipv4 || ip.get_family()  == any_addr::ipv6);
 
-	auto it = cache.find(ip);
+	const uint64_t now = get_us();
 
-	if (it == cache.end()) {
-		cache.insert({ ip, { static_entry ? 0 : get_us(), mac, interface } });
-		stats_inc_counter(address_cache_store);
+	// called for every received packet: usually nothing changed
+	auto cur_mac = mac_cache.find(mac);
+
+	if (static_entry || !cur_mac.has_value() || (cur_mac.value().ts != 0 && (cur_mac.value().interface != interface || now - cur_mac.value().ts >= refresh_interval))) {
+		if (mac_cache.put(mac, mac, interface, static_entry ? 0 : now) == address_table::pr_full) {
+			stats_inc_counter(address_cache_full);
+			DOLOG(ll_warning, "address_cache: no room for MAC %s\n", mac.to_str().c_str());
+		}
 	}
-	else {
-		if (it->second.ts != 0) {  // do not overwrite static entries
-			it->second = { static_entry ? 0 : get_us(), mac, interface };
-			stats_inc_counter(address_cache_update);
+
+	if (!static_entry) {
+		auto cur = cache.find(ip);
+
+		if (cur.has_value() && (cur.value().ts == 0 || (cur.value().interface == interface && cur.value().addr == mac && now - cur.value().ts < refresh_interval))) {
+			stats_inc_counter(address_cache_refresh_skip);
+			return;
 		}
 	}
 
-	auto it_mac = mac_cache.find(mac);
+	auto rc = cache.put(ip, mac, interface, static_entry ? 0 : now);
 
-	if (it_mac == mac_cache.end())  // TODO cleanup, like regular cache
-		mac_cache.insert({ mac, interface });
+	if (rc == address_table::pr_stored)
+		stats_inc_counter(address_cache_store);
+	else if (rc == address_table::pr_updated)
+		stats_inc_counter(address_cache_update);
+	else if (rc == address_table::pr_full) {
+		stats_inc_counter(address_cache_full);
+		DOLOG(ll_warning, "address_cache: no room for %s\n", ip.to_str().c_str());
+	}
 }
 
 void address_cache::add_static_entry(phys *const interface, const any_addr & mac, const any_addr & ip)
@@ -67,39 +85,40 @@ void address_cache::add_static_entry(phys *const interface, const any_addr & mac
 
 std::pair<phys *, any_addr *> address_cache::query_cache(const any_addr & ip, const bool static_entry)
 {
-	const std::shared_lock<std::shared_mutex> lock(cache_lock);
-
 	stats_inc_counter(address_cache_req);
 
 	auto it = cache.find(ip);
-	if (it == cache.end()) {
+	if (it.has_value() == false) {
+		stats_inc_counter(address_cache_miss);
 		DOLOG(ll_warning, "address_cache: %s is not in the cache\n", ip.to_str().c_str());
 		return { nullptr, nullptr };
 	}
 
-	if (static_entry && it->second.ts != 0) {
+	if (static_entry && it.value().ts != 0) {
+		stats_inc_counter(address_cache_miss);
 		DOLOG(ll_warning, "address_cache: %s is not a static entry\n", ip.to_str().c_str());
 		return { nullptr, nullptr };
 	}
 
 	stats_inc_counter(address_cache_hit);
 
-	return { it->second.interface, new any_addr(it->second.addr) };
+	return { it.value().interface, new any_addr(it.value().addr) };
 }
 
 phys * address_cache::query_mac_cache(const any_addr & mac)
 {
-	const std::shared_lock<std::shared_mutex> lock(cache_lock);
-
 	stats_inc_counter(address_cache_req);
 
 	auto it = mac_cache.find(mac);
-	if (it == mac_cache.end()) {
+	if (it.has_value() == false) {
+		stats_inc_counter(address_cache_miss);
 		DOLOG(ll_warning, "address_cache: MAC %s is not in the cache\n", mac.to_str().c_str());
 		return nullptr;
 	}
 
-	return it->second;
+	stats_inc_counter(address_cache_hit);
+
+	return it.value().interface;
 }
 
 void address_cache::cache_cleaner()
@@ -112,25 +131,23 @@ void address_cache::cache_cleaner()
 
 		uint64_t now = get_us();
 
-		std::vector<any_addr> delete_;
+		auto expired = [now](const any_addr & key, const address_table::entry_t & e) {
+			if (e.ts == 0)  // some are meant to stay forever
+				return false;
 
-		const std::lock_guard<std::shared_mutex> lock(cache_lock);
+			uint64_t age = now - e.ts;
 
-		for(auto & e : cache) {
-			if (e.second.ts == 0)  // some are meant to stay forever
-				continue;
+			if (age < 3600000000ll)  // older than an hour?
+				return false;
 
-			uint64_t age = now - e.second.ts;
+			DOLOG(ll_debug, "address_cache: forgetting %s\n", key.to_str().c_str());
 
-			if (age >= 3600000000ll)  // older than an hour?
-				delete_.push_back(e.first);
-		}
+			return true;
+		};
 
-		for(auto & e : delete_) {
-			DOLOG(ll_debug, "address_cache: forgetting %s\n", e.to_str().c_str());
+		cache.erase_if(expired);
 
-			cache.erase(e);
-		}
+		mac_cache.erase_if(expired);
 	}
 }
 
@@ -138,12 +155,10 @@ void address_cache::dump_cache()
 {
 	uint64_t now = get_us();
 
-	const std::shared_lock<std::shared_mutex> lock(cache_lock);
-
-	for(auto & e : cache) {
-		if (e.second.ts)
-			DOLOG(ll_debug, "address_cache: %s (%.3f) %s %s\n", e.first.to_str().c_str(), (now - e.second.ts) / 1000000., e.second.addr.to_str().c_str(), e.second.interface->to_str().c_str());
+	cache.for_each([now](const any_addr & ip, const address_table::entry_t & e) {
+		if (e.ts)
+			DOLOG(ll_debug, "address_cache: %s (%.3f) %s %s\n", ip.to_str().c_str(), (now - e.ts) / 1000000., e.addr.to_str().c_str(), e.interface->to_str().c_str());
 		else
-			DOLOG(ll_debug, "address_cache: %s %s %s\n", e.first.to_str().c_str(), e.second.addr.to_str().c_str(), e.second.interface->to_str().c_str());
-	}
+			DOLOG(ll_debug, "address_cache: %s %s %s\n", ip.to_str().c_str(), e.addr.to_str().c_str(), e.interface->to_str().c_str());
+	});
 }
@@ -2,9 +2,8 @@
 #pragma once
 
 #include <atomic>
-#include <map>
-#include <shared_mutex>
 
+#include "address_table.h"
 #include "phys.h"
 #include "network_layer.h"
 #include "stats.h"
@@ -14,15 +13,8 @@
 class address_cache
 {
 protected:
-	typedef struct {
-		uint64_t ts;
-		any_addr addr;
-		phys    *interface;
-	} address_entry_t;
-
-	static std::shared_mutex cache_lock;
-	static std::map<any_addr, address_entry_t> cache;
-	static std::map<any_addr, phys *> mac_cache;
+	static address_table cache;
+	static address_table mac_cache;  // MAC -> interface, refreshed and aged like cache
 
 	interruptable_sleep cleaner_stop;
 	std::thread        *cleaner_th   { nullptr };
@@ -30,6 +22,8 @@ protected:
 	uint64_t *address_cache_requests { nullptr }, *address_cache_for_me { nullptr };
 	uint64_t *address_cache_req      { nullptr }, *address_cache_hit    { nullptr };
         uint64_t *address_cache_store    { nullptr }, *address_cache_update { nullptr };
+	uint64_t *address_cache_miss     { nullptr }, *address_cache_refresh_skip { nullptr };
+	uint64_t *address_cache_full     { nullptr };  // no room in a shard (only static entries)
 
 	void cache_cleaner();
 
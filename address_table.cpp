@@ -0,0 +1,174 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#include <cstring>
+
+#include "address_table.h"
+
+
+address_table::address_table()
+{
+}
+
+address_table::~address_table()
+{
+}
+
+uint64_t address_table::get_hash(const any_addr & a)
+{
+	uint64_t hash = a.get_hash();
+
+	return hash ? hash : 1;  // 0 marks a free slot
+}
+
+address_table::raw_addr_t address_table::to_raw(const any_addr & a)
+{
+	raw_addr_t out { a.get_family(), { 0 } };
+
+	a.get(out.bytes, a.get_len());
+
+	return out;
+}
+
+bool address_table::equal(const raw_addr_t & a, const raw_addr_t & b)
+{
+	return a.af == b.af && memcmp(a.bytes, b.bytes, sizeof a.bytes) == 0;
+}
+
+void address_table::write_begin(shard & sh)
+{
+	sh.seq.store(sh.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+void address_table::write_end(shard & sh)
+{
+	sh.seq.store(sh.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+std::optional<address_table::entry_t> address_table::find(const any_addr & key)
+{
+	const uint64_t   hash    = get_hash(key);
+	const raw_addr_t raw_key = to_raw(key);
+	shard          & sh      = get_shard(hash);
+
+	for(;;) {
+		const uint32_t seq_begin = sh.seq.load(std::memory_order_acquire);
+
+		if (seq_begin & 1)  // writer active
+			continue;
+
+		bool   found = false;
+		slot_t copy;
+
+		for(int i=0; i<address_table_shard_slots; i++) {
+			if (__atomic_load_n(&sh.hashes[i], __ATOMIC_RELAXED) != hash)
+				continue;
+
+			memcpy(&copy, &sh.slots[i], sizeof copy);
+
+			if (equal(copy.key, raw_key)) {
+				found = true;
+				break;
+			}
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (sh.seq.load(std::memory_order_relaxed) != seq_begin)  // changed while reading
+			continue;
+
+		if (!found)
+			return { };
+
+		return entry_t { any_addr(copy.value.af, copy.value.bytes), copy.interface, copy.ts };
+	}
+}
+
+address_table::put_result_t address_table::put(const any_addr & key, const any_addr & value, phys *const interface, const uint64_t ts)
+{
+	const uint64_t   hash    = get_hash(key);
+	const raw_addr_t raw_key = to_raw(key);
+	shard          & sh      = get_shard(hash);
+
+	std::lock_guard<std::mutex> lck(sh.lock);
+
+	int slot   = -1;
+	int free_  = -1;
+	int oldest = -1;
+
+	for(int i=0; i<address_table_shard_slots; i++) {
+		if (sh.hashes[i] == 0) {
+			if (free_ == -1)
+				free_ = i;
+
+			continue;
+		}
+
+		if (sh.hashes[i] == hash && equal(sh.slots[i].key, raw_key)) {
+			slot = i;
+			break;
+		}
+
+		if (sh.slots[i].ts && (oldest == -1 || sh.slots[i].ts < sh.slots[oldest].ts))
+			oldest = i;
+	}
+
+	put_result_t rc = pr_updated;
+
+	if (slot == -1) {
+		slot = free_ != -1 ? free_ : oldest;
+
+		if (slot == -1)
+			return pr_full;
+
+		rc = pr_stored;
+	}
+	else if (sh.slots[slot].ts == 0 && ts != 0) {
+		return pr_static;
+	}
+
+	write_begin(sh);
+
+	__atomic_store_n(&sh.hashes[slot], hash, __ATOMIC_RELAXED);
+	sh.slots[slot] = { raw_key, to_raw(value), interface, ts };
+
+	write_end(sh);
+
+	return rc;
+}
+
+void address_table::erase_if(const std::function<bool(const any_addr & key, const entry_t & e)> & f)
+{
+	for(auto & sh : shards) {
+		std::lock_guard<std::mutex> lck(sh.lock);
+
+		for(int i=0; i<address_table_shard_slots; i++) {
+			if (sh.hashes[i] == 0)
+				continue;
+
+			const slot_t & s = sh.slots[i];
+
+			if (f(any_addr(s.key.af, s.key.bytes), { any_addr(s.value.af, s.value.bytes), s.interface, s.ts })) {
+				write_begin(sh);
+				__atomic_store_n(&sh.hashes[i], 0, __ATOMIC_RELAXED);
+				write_end(sh);
+			}
+		}
+	}
+}
+
+void address_table::for_each(const std::function<void(const any_addr & key, const entry_t & e)> & f)
+{
+	for(auto & sh : shards) {
+		std::lock_guard<std::mutex> lck(sh.lock);
+
+		for(int i=0; i<address_table_shard_slots; i++) {
+			if (sh.hashes[i] == 0)
+				continue;
+
+			const slot_t & s = sh.slots[i];
+
+			f(any_addr(s.key.af, s.key.bytes), { any_addr(s.value.af, s.value.bytes), s.interface, s.ts });
+		}
+	}
+}
@@ -0,0 +1,84 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#pragma once
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+
+#include "any_addr.h"
+
+
+class phys;
+
+constexpr int address_table_n_shards    { 64 };  // must be a power of 2
+constexpr int address_table_shard_slots { 32 };
+
+/* any_addr -> (any_addr, interface, timestamp), e.g. IP -> MAC
+ * spread over shards (by any_addr::get_hash()) with a fixed number of
+ * slots each; the hashes of a shard are kept together so that a lookup
+ * touches only a few cache lines
+ * lookups do not lock: every shard has a sequence lock, a reader copies
+ * the entry and retries when a writer changed the shard meanwhile
+ * writers serialize on a mutex per shard
+ */
+class address_table
+{
+public:
+	typedef struct {
+		any_addr addr;
+		phys    *interface;
+		uint64_t ts;  // 0: static entry
+	} entry_t;
+
+	typedef enum { pr_stored, pr_updated, pr_static, pr_full } put_result_t;
+
+private:
+	// any_addr has a vtable: store the plain bytes instead
+	typedef struct {
+		any_addr::addr_family af;
+		uint8_t               bytes[ANY_ADDR_SIZE];  // zero padded
+	} raw_addr_t;
+
+	typedef struct {
+		raw_addr_t key;
+		raw_addr_t value;
+		phys      *interface;
+		uint64_t   ts;
+	} slot_t;
+
+	struct alignas(64) shard {
+		std::atomic<uint32_t> seq { 0 };  // odd: being written
+		std::mutex            lock;
+		uint64_t              hashes[address_table_shard_slots] { 0 };  // 0: free slot
+		slot_t                slots [address_table_shard_slots] { };
+	};
+
+	shard shards[address_table_n_shards];
+
+	static uint64_t   get_hash(const any_addr & a);
+	static raw_addr_t to_raw(const any_addr & a);
+	static bool       equal(const raw_addr_t & a, const raw_addr_t & b);
+
+	shard & get_shard(const uint64_t hash) { return shards[hash & (address_table_n_shards - 1)]; }
+
+	// the caller holds the lock of the shard
+	static void write_begin(shard & sh);
+	static void write_end  (shard & sh);
+
+public:
+	address_table();
+	address_table(const address_table &) = delete;
+	virtual ~address_table();
+
+	std::optional<entry_t> find(const any_addr & key);
+
+	// static entries (ts == 0) are not overwritten by dynamic ones; when
+	// the shard is full, the least recently refreshed dynamic entry goes
+	put_result_t put(const any_addr & key, const any_addr & value, phys *const interface, const uint64_t ts);
+
+	// removes the entries for which 'f' returns true
+	void erase_if(const std::function<bool(const any_addr & key, const entry_t & e)> & f);
+
+	void for_each(const std::function<void(const any_addr & key, const entry_t & e)> & f);
+};
@@ -0,0 +1,121 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#include <string.h>
+
+#include "buffer_chain.h"
+
+
+buffer_chain::buffer_chain()
+{
+}
+
+buffer_chain::buffer_chain(pool_block_t *const block, const uint8_t *const data, const size_t size)
+{
+	append(block, data, size);
+}
+
+buffer_chain::buffer_chain(const buffer_chain & other) :
+	n_segments(other.n_segments),
+	total_size(other.total_size)
+{
+	for(int i=0; i<n_segments; i++) {
+		segments[i] = other.segments[i];
+
+		if (segments[i].block)
+			pool_block_ref(segments[i].block);
+	}
+}
+
+buffer_chain::~buffer_chain()
+{
+	for(int i=0; i<n_segments; i++) {
+		if (segments[i].block)
+			pool_block_unref(segments[i].block);
+	}
+}
+
+bool buffer_chain::prepend(pool_block_t *const block, const uint8_t *const data, const size_t size)
+{
+	if (n_segments == max_chain_segments)
+		return false;
+
+	memmove(&segments[1], &segments[0], n_segments * sizeof(segment_t));
+
+	if (block)
+		pool_block_ref(block);
+
+	segments[0] = { block, data, size };
+	n_segments++;
+
+	total_size += size;
+
+	return true;
+}
+
+bool buffer_chain::append(pool_block_t *const block, const uint8_t *const data, const size_t size)
+{
+	if (n_segments == max_chain_segments)
+		return false;
+
+	if (block)
+		pool_block_ref(block);
+
+	segments[n_segments++] = { block, data, size };
+
+	total_size += size;
+
+	return true;
+}
+
+uint8_t *buffer_chain::prepend_new(buffer_pool *const pool, const size_t size)
+{
+	if (n_segments == max_chain_segments)
+		return nullptr;
+
+	pool_block_t *block = pool_allocate(pool, size);
+	uint8_t      *data  = pool_block_data(block);
+
+	prepend(block, data, size);
+
+	pool_block_unref(block);  // the chain now holds the only reference
+
+	return data;
+}
+
+void buffer_chain::make_owned()
+{
+	for(int i=0; i<n_segments; i++) {
+		if (segments[i].block)
+			continue;
+
+		pool_block_t *block = pool_allocate(nullptr, segments[i].size);
+		uint8_t      *data  = pool_block_data(block);
+
+		if (segments[i].size)
+			memcpy(data, segments[i].data, segments[i].size);
+
+		segments[i].block = block;
+		segments[i].data  = data;
+	}
+}
+
+int buffer_chain::to_iovec(struct iovec *const iov) const
+{
+	for(int i=0; i<n_segments; i++) {
+		iov[i].iov_base = const_cast<uint8_t *>(segments[i].data);
+		iov[i].iov_len  = segments[i].size;
+	}
+
+	return n_segments;
+}
+
+void buffer_chain::copy_to(uint8_t *const out) const
+{
+	size_t offset = 0;
+
+	for(int i=0; i<n_segments; i++) {
+		if (segments[i].size)
+			memcpy(&out[offset], segments[i].data, segments[i].size);
+
+		offset += segments[i].size;
+	}
+}
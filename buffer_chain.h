@@ -0,0 +1,59 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#pragma once
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "buffer_pool.h"
+
+
+// maximum number of segments: payload, transport header, IP header, padding
+constexpr int max_chain_segments { 8 };
+
+// a packet made of multiple buffer segments; each layer prepends its header
+// as a new segment so that the payload is never copied on the way down
+// segments without a block are borrowed: they are only valid during the
+// call they were passed to (the router copies those before queuing)
+class buffer_chain
+{
+private:
+	typedef struct {
+		pool_block_t  *block;
+		const uint8_t *data;
+		size_t         size;
+	} segment_t;
+
+	segment_t segments[max_chain_segments];
+	int       n_segments { 0 };
+	size_t    total_size { 0 };
+
+public:
+	buffer_chain();
+	buffer_chain(pool_block_t *const block, const uint8_t *const data, const size_t size);
+	buffer_chain(const buffer_chain & other);
+	buffer_chain & operator=(const buffer_chain &) = delete;
+	virtual ~buffer_chain();
+
+	// takes its own reference on 'block' (if any)
+	bool prepend(pool_block_t *const block, const uint8_t *const data, const size_t size);
+	bool append (pool_block_t *const block, const uint8_t *const data, const size_t size);
+
+	// allocates a new block of 'size' bytes in front of the chain and
+	// returns where the caller should put the header (nullptr when full)
+	uint8_t *prepend_new(buffer_pool *const pool, const size_t size);
+
+	// replaces borrowed segments by (heap) copies
+	void make_owned();
+
+	size_t get_size() const { return total_size; }
+
+	int get_n_segments() const { return n_segments; }
+
+	const uint8_t *get_segment_data(const int nr) const { return segments[nr].data; }
+	size_t         get_segment_size(const int nr) const { return segments[nr].size; }
+
+	// returns the number of entries filled in (at most max_chain_segments)
+	int to_iovec(struct iovec *const iov) const;
+
+	// 'out' must have room for get_size() bytes
+	void copy_to(uint8_t *const out) const;
+};
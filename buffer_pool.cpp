@@ -0,0 +1,210 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#include <map>
+#include <new>
+
+#include "buffer_pool.h"
+#include "log.h"
+
+
+constexpr int cache_slots      { 4  };  // number of pools a thread keeps a cache for
+constexpr int cache_max_blocks { 32 };
+
+typedef struct {
+	uint64_t      pool_id;  // 0: slot not in use
+	int           n;
+	pool_block_t *blocks[cache_max_blocks];
+} thread_cache_t;
+
+// pools that still exist, so that a thread that ends can return its cached
+// blocks to them
+static std::mutex                        pools_lock;
+static std::map<uint64_t, buffer_pool *> pools;
+
+class buffer_pool_thread_caches
+{
+public:
+	thread_cache_t caches[cache_slots] { };
+
+	// without this, short-lived threads (that transmit packets) would drain
+	// the pools
+	~buffer_pool_thread_caches() {
+		std::unique_lock<std::mutex> lck(pools_lock);
+
+		for(auto & c : caches) {
+			auto it = pools.find(c.pool_id);
+
+			if (it != pools.end())
+				it->second->put_back(c.blocks, c.n);
+		}
+	}
+};
+
+static thread_local buffer_pool_thread_caches thread_caches;
+
+static std::atomic<uint64_t> pool_id_counter { 1 };
+
+static thread_cache_t *get_thread_cache(const uint64_t pool_id)
+{
+	for(auto & c : thread_caches.caches) {
+		if (c.pool_id == pool_id)
+			return &c;
+	}
+
+	for(auto & c : thread_caches.caches) {
+		if (c.pool_id == 0) {
+			c.pool_id = pool_id;
+			c.n       = 0;
+
+			return &c;
+		}
+	}
+
+	return nullptr;
+}
+
+buffer_pool::buffer_pool(stats *const s, const std::string & name, const size_t block_size, const int n_blocks) :
+	block_size(block_size),
+	n_blocks(n_blocks),
+	pool_id(pool_id_counter++)
+{
+	pool_hit       = s->register_stat(name + "_pool_hit");
+	pool_miss      = s->register_stat(name + "_pool_miss");
+	pool_exhausted = s->register_stat(name + "_pool_exhausted");
+
+	// keep every block cache-line aligned
+	const size_t stride = (sizeof(pool_block_t) + block_size + 63) & ~size_t(63);
+
+	slab = new (std::align_val_t(64)) uint8_t[stride * n_blocks];
+
+	free_list.reserve(n_blocks);
+
+	for(int i=0; i<n_blocks; i++) {
+		pool_block_t *b = new (&slab[i * stride]) pool_block_t;
+		b->pool = this;
+		b->size = block_size;
+
+		free_list.push_back(b);
+	}
+
+	std::unique_lock<std::mutex> lck(pools_lock);
+	pools.insert({ pool_id, this });
+	lck.unlock();
+
+	DOLOG(ll_debug, "buffer_pool(%s): %d blocks of %zu bytes\n", name.c_str(), n_blocks, block_size);
+}
+
+buffer_pool::~buffer_pool()
+{
+	std::unique_lock<std::mutex> lck(pools_lock);
+	pools.erase(pool_id);
+	lck.unlock();
+
+	operator delete [](slab, std::align_val_t(64));
+}
+
+pool_block_t *buffer_pool::allocate()
+{
+	thread_cache_t *cache = get_thread_cache(pool_id);
+
+	if (cache && cache->n > 0)
+		return cache->blocks[--cache->n];
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	if (free_list.empty())
+		return nullptr;
+
+	// refill (half of) the local cache while the lock is held anyway
+	if (cache) {
+		while(cache->n < cache_max_blocks / 2 && free_list.size() > 1) {
+			cache->blocks[cache->n++] = free_list.back();
+			free_list.pop_back();
+		}
+	}
+
+	pool_block_t *b = free_list.back();
+	free_list.pop_back();
+
+	return b;
+}
+
+void buffer_pool::free_block(pool_block_t *const b)
+{
+	thread_cache_t *cache = get_thread_cache(pool_id);
+
+	if (cache) {
+		if (cache->n < cache_max_blocks) {
+			cache->blocks[cache->n++] = b;
+			return;
+		}
+
+		// cache full: move half of it back to the shared list
+		std::unique_lock<std::mutex> lck(lock);
+
+		while(cache->n > cache_max_blocks / 2)
+			free_list.push_back(cache->blocks[--cache->n]);
+
+		cache->blocks[cache->n++] = b;
+
+		return;
+	}
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	free_list.push_back(b);
+}
+
+void buffer_pool::put_back(pool_block_t *const *const blocks, const int n)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	free_list.insert(free_list.end(), blocks, blocks + n);
+}
+
+pool_block_t *pool_allocate(buffer_pool *const pool, const size_t size)
+{
+	if (pool) {
+		if (size > pool->block_size) {
+			stats_inc_counter(pool->pool_miss);
+		}
+		else {
+			pool_block_t *b = pool->allocate();
+
+			if (b) {
+				stats_inc_counter(pool->pool_hit);
+
+				b->ref_count.store(1, std::memory_order_relaxed);
+
+				return b;
+			}
+
+			stats_inc_counter(pool->pool_exhausted);
+		}
+	}
+
+	uint8_t      *mem = new uint8_t[sizeof(pool_block_t) + size];
+	pool_block_t *b   = new (mem) pool_block_t;
+	b->size = size;
+
+	return b;
+}
+
+void pool_block_ref(pool_block_t *const b)
+{
+	b->ref_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void pool_block_unref(pool_block_t *const b)
+{
+	if (b->ref_count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+
+	if (b->pool) {
+		b->pool->free_block(b);
+	}
+	else {
+		b->~pool_block_t();
+
+		delete [] reinterpret_cast<uint8_t *>(b);
+	}
+}
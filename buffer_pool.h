@@ -0,0 +1,64 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "stats.h"
+
+
+class buffer_pool;
+
+// header in front of every packet buffer, the payload directly follows it
+typedef struct _pool_block_ {
+	std::atomic_int ref_count { 1 };
+	buffer_pool    *pool      { nullptr };  // nullptr: allocated on the heap
+	size_t          size      { 0 };  // capacity of the payload
+} pool_block_t;
+
+// fixed size (MTU sized) packet buffers, carved from one slab
+// each thread keeps a small cache of free blocks so that the
+// shared free-list (and its lock) is only touched once per batch
+class buffer_pool
+{
+private:
+	const size_t   block_size { 0 };
+	const int      n_blocks   { 0 };
+	const uint64_t pool_id    { 0 };
+
+	uint8_t       *slab       { nullptr };
+
+	std::mutex     lock;
+	std::vector<pool_block_t *> free_list;
+
+	uint64_t      *pool_hit       { nullptr };
+	uint64_t      *pool_miss      { nullptr };  // request too big for a block
+	uint64_t      *pool_exhausted { nullptr };  // no free block left
+
+	pool_block_t *allocate();
+	void          free_block(pool_block_t *const b);
+	void          put_back(pool_block_t *const *const blocks, const int n);
+
+	friend pool_block_t *pool_allocate(buffer_pool *const pool, const size_t size);
+	friend void          pool_block_unref(pool_block_t *const b);
+	friend class         buffer_pool_thread_caches;  // returns the cache of a thread that ends
+
+public:
+	buffer_pool(stats *const s, const std::string & name, const size_t block_size, const int n_blocks);
+	buffer_pool(const buffer_pool &) = delete;
+	virtual ~buffer_pool();
+
+	size_t get_block_size() const { return block_size; }
+};
+
+// returns a block with a reference count of 1 and room for at least 'size'
+// bytes; falls back to the heap when 'pool' is nullptr, is exhausted or
+// the request does not fit in one of its blocks
+pool_block_t *pool_allocate(buffer_pool *const pool, const size_t size);
+
+void pool_block_ref(pool_block_t *const b);
+void pool_block_unref(pool_block_t *const b);
+
+inline uint8_t *pool_block_data(pool_block_t *const b) { return reinterpret_cast<uint8_t *>(b + 1); }
@@ -0,0 +1,275 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#include <algorithm>
+#include <string.h>
+#include <vector>
+#include <arpa/inet.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "checksum.h"
+
+
+// adds 'v' to 'sum' with end-around carry
+static inline uint64_t add_carry64(uint64_t sum, const uint64_t v)
+{
+	sum += v;
+
+	return sum + (sum < v);
+}
+
+static inline uint16_t fold64(uint64_t sum)
+{
+	sum = (sum >> 32) + (sum & 0xffffffff);
+	sum = (sum >> 32) + (sum & 0xffffffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+
+	return sum;
+}
+
+// the tail (< 8 bytes) of a buffer; an odd last byte is padded with a zero
+static uint64_t sum_tail(const uint8_t *p, size_t len)
+{
+	uint64_t v = 0;
+
+	memcpy(&v, p, len);
+
+	return v;
+}
+
+static uint64_t sum_scalar(const uint8_t *p, size_t len)
+{
+	uint64_t sum = 0;
+
+	while(len >= 32) {
+		uint64_t v[4];
+		memcpy(v, p, sizeof v);
+
+		sum = add_carry64(sum, v[0]);
+		sum = add_carry64(sum, v[1]);
+		sum = add_carry64(sum, v[2]);
+		sum = add_carry64(sum, v[3]);
+
+		p   += 32;
+		len -= 32;
+	}
+
+	while(len >= 8) {
+		uint64_t v = 0;
+		memcpy(&v, p, sizeof v);
+
+		sum = add_carry64(sum, v);
+
+		p   += 8;
+		len -= 8;
+	}
+
+	return add_carry64(sum, sum_tail(p, len));
+}
+
+#if defined(__x86_64__)
+// 16 bit words are widened to 32 bit lanes; a lane can take 65536 of them
+// before it could overflow, so the lanes are flushed well before that
+constexpr size_t simd_flush_bytes { 32768 };
+
+static uint64_t sum_sse2(const uint8_t *p, size_t len)
+{
+	uint64_t sum = 0;
+
+	const __m128i zero = _mm_setzero_si128();
+
+	while(len >= 16) {
+		size_t chunk = std::min(len & ~size_t(15), simd_flush_bytes);
+
+		__m128i acc = _mm_setzero_si128();
+
+		for(size_t i=0; i<chunk; i += 16) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+
+			acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+			acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+		}
+
+		uint32_t lanes[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+
+		for(int i=0; i<4; i++)
+			sum += lanes[i];
+
+		p   += chunk;
+		len -= chunk;
+	}
+
+	return add_carry64(sum, sum_scalar(p, len));
+}
+
+__attribute__((target("avx2")))
+static uint64_t sum_avx2(const uint8_t *p, size_t len)
+{
+	uint64_t sum = 0;
+
+	const __m256i zero = _mm256_setzero_si256();
+
+	while(len >= 32) {
+		size_t chunk = std::min(len & ~size_t(31), simd_flush_bytes);
+
+		__m256i acc = _mm256_setzero_si256();
+
+		for(size_t i=0; i<chunk; i += 32) {
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+
+			acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+			acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+		}
+
+		uint32_t lanes[8];
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+
+		for(int i=0; i<8; i++)
+			sum += lanes[i];
+
+		p   += chunk;
+		len -= chunk;
+	}
+
+	// avoid the AVX/SSE transition penalty in the (non-VEX) code that follows
+	_mm256_zeroupper();
+
+	return add_carry64(sum, sum_scalar(p, len));
+}
+#endif
+
+typedef uint64_t (*sum_kernel_t)(const uint8_t *p, size_t len);
+
+typedef struct {
+	const char  *name;
+	sum_kernel_t kernel;
+} sum_kernel_info_t;
+
+// best first
+static std::vector<sum_kernel_info_t> get_kernels()
+{
+	std::vector<sum_kernel_info_t> out;
+
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		out.push_back({ "avx2", sum_avx2 });
+
+	// SSE2 is part of the x86-64 base line
+	out.push_back({ "sse2", sum_sse2 });
+#endif
+
+	out.push_back({ "scalar", sum_scalar });
+
+	return out;
+}
+
+static sum_kernel_info_t sum_kernel = get_kernels().front();
+
+const char *checksum_kernel_name()
+{
+	return sum_kernel.name;
+}
+
+std::vector<std::string> checksum_kernels()
+{
+	std::vector<std::string> out;
+
+	for(auto & k : get_kernels())
+		out.push_back(k.name);
+
+	return out;
+}
+
+bool checksum_select_kernel(const std::string & name)
+{
+	for(auto & k : get_kernels()) {
+		if (k.name == name) {
+			sum_kernel = k;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void checksum_init(checksum_state_t *const state)
+{
+	state->sum = 0;
+	state->odd = false;
+}
+
+void checksum_add(checksum_state_t *const state, const uint8_t *const data, const size_t len)
+{
+	uint64_t sum = sum_kernel.kernel(data, len);
+
+	// data starting at an odd offset has its bytes swapped in every word;
+	// a one's complement sum can be swapped afterwards instead (RFC 1071)
+	if (state->odd) {
+		uint16_t folded = fold64(sum);
+
+		sum = uint16_t((folded << 8) | (folded >> 8));
+	}
+
+	state->sum  = add_carry64(state->sum, sum);
+	state->odd ^= len & 1;
+}
+
+void checksum_add_pseudo_header(checksum_state_t *const state, const any_addr & src_addr, const any_addr & dst_addr, const uint8_t protocol, const size_t len)
+{
+	uint8_t temp[40] { 0 };
+
+	if (dst_addr.get_family() == any_addr::ipv6) {
+		src_addr.get(&temp[0], 16);
+
+		dst_addr.get(&temp[16], 16);
+
+		temp[32] = len >> 24;
+		temp[33] = len >> 16;
+		temp[34] = len >>  8;
+		temp[35] = len;
+
+		temp[39] = protocol;
+
+		checksum_add(state, temp, 40);
+	}
+	else {
+		src_addr.get(&temp[0], 4);
+
+		dst_addr.get(&temp[4], 4);
+
+		temp[9]  = protocol;
+
+		temp[10] = len >> 8;
+		temp[11] = len;
+
+		checksum_add(state, temp, 12);
+	}
+}
+
+uint16_t checksum_finish(const checksum_state_t *const state)
+{
+	return ntohs(uint16_t(~fold64(state->sum)));
+}
+
+uint16_t checksum_update16(const uint16_t checksum, const uint16_t old_value, const uint16_t new_value)
+{
+	// HC' = ~(~HC + ~m + m')
+	uint32_t sum = uint16_t(~checksum) + uint16_t(~old_value) + new_value;
+
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+
+	return ~sum;
+}
+
+uint16_t checksum_update32(const uint16_t checksum, const uint32_t old_value, const uint32_t new_value)
+{
+	uint16_t temp = checksum_update16(checksum, old_value >> 16, new_value >> 16);
+
+	return checksum_update16(temp, old_value & 0xffff, new_value & 0xffff);
+}
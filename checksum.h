@@ -0,0 +1,47 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "any_addr.h"
+
+
+/* internet checksum (RFC 1071) engine
+ * data is summed in place (no copies) with 64 bit accumulation; on x86-64
+ * an SSE2 or AVX2 kernel is selected at runtime
+ * sums are kept in native byte order and only converted when finished
+ */
+
+typedef struct {
+	uint64_t sum;
+	bool     odd;  // an odd number of bytes was added so far
+} checksum_state_t;
+
+void checksum_init(checksum_state_t *const state);
+
+// may be called for consecutive pieces of a packet, of any length
+void checksum_add(checksum_state_t *const state, const uint8_t *const data, const size_t len);
+
+// TCP/UDP pseudo header (IPv4 or IPv6, depending on the addresses)
+void checksum_add_pseudo_header(checksum_state_t *const state, const any_addr & src_addr, const any_addr & dst_addr, const uint8_t protocol, const size_t len);
+
+// returns the checksum in host order
+uint16_t checksum_finish(const checksum_state_t *const state);
+
+// RFC 1624 (eqn. 3): checksum (host order) after one 16 bit word of the
+// summed data changed from 'old_value' to 'new_value'
+uint16_t checksum_update16(const uint16_t checksum, const uint16_t old_value, const uint16_t new_value);
+
+// same for a 32 bit field (e.g. an IPv4 address)
+uint16_t checksum_update32(const uint16_t checksum, const uint32_t old_value, const uint32_t new_value);
+
+// name of the kernel in use ("avx2", "sse2" or "scalar")
+const char *checksum_kernel_name();
+
+// the kernels this CPU can run, best first
+std::vector<std::string> checksum_kernels();
+
+// for tests and benchmarks (not thread safe); false if 'name' is not available
+bool checksum_select_kernel(const std::string & name);
@@ -0,0 +1,343 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#include <string.h>
+#include <vector>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "crc.h"
+
+
+typedef struct {
+	uint32_t t[8][256];
+} slice8_table_t;
+
+static void build_slice8_table(slice8_table_t *const table, const uint32_t polynomial)
+{
+	for(uint32_t i=0; i<256; i++) {
+		uint32_t crc = i;
+
+		for(int j=0; j<8; j++)
+			crc = (crc >> 1) ^ (polynomial & (0 - (crc & 1)));
+
+		table->t[0][i] = crc;
+	}
+
+	for(uint32_t i=0; i<256; i++) {
+		for(int k=1; k<8; k++)
+			table->t[k][i] = (table->t[k - 1][i] >> 8) ^ table->t[0][table->t[k - 1][i] & 0xff];
+	}
+}
+
+static const slice8_table_t *get_slice8_table(const uint32_t polynomial)
+{
+	static const slice8_table_t *crc32_table = [] {
+		slice8_table_t *table = new slice8_table_t;
+		build_slice8_table(table, crc32_polynomial);
+		return table;
+	}();
+
+	static const slice8_table_t *crc32c_table = [] {
+		slice8_table_t *table = new slice8_table_t;
+		build_slice8_table(table, crc32c_polynomial);
+		return table;
+	}();
+
+	if (polynomial == crc32_polynomial)
+		return crc32_table;
+
+	if (polynomial == crc32c_polynomial)
+		return crc32c_table;
+
+	return nullptr;
+}
+
+// 'crc' is the running (inverted) state
+static uint32_t crc_slice8(const slice8_table_t *const table, uint32_t crc, const uint8_t *p, size_t n)
+{
+	while(n >= 8) {
+		uint32_t low  = 0;
+		uint32_t high = 0;
+		memcpy(&low,  &p[0], 4);
+		memcpy(&high, &p[4], 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		low  = __builtin_bswap32(low);
+		high = __builtin_bswap32(high);
+#endif
+		low ^= crc;
+
+		crc = table->t[7][ low         & 0xff] ^ table->t[6][(low  >>  8) & 0xff] ^
+		      table->t[5][(low  >> 16) & 0xff] ^ table->t[4][ low  >> 24        ] ^
+		      table->t[3][ high        & 0xff] ^ table->t[2][(high >>  8) & 0xff] ^
+		      table->t[1][(high >> 16) & 0xff] ^ table->t[0][ high >> 24        ];
+
+		p += 8;
+		n -= 8;
+	}
+
+	while(n--)
+		crc = (crc >> 8) ^ table->t[0][(crc ^ *p++) & 0xff];
+
+	return crc;
+}
+
+static uint32_t crc_bitwise(uint32_t crc, const uint8_t *const data, const size_t n, const uint32_t polynomial)
+{
+	const uint32_t p[] = { 0, polynomial };
+
+	for(size_t i=0; i<n; i++) {
+		uint8_t ch = data[i];
+
+		for(size_t j=0; j<8; j++) {
+			bool b = (ch ^ crc) & 1;
+
+			crc >>= 1;
+
+			crc ^= p[b];
+
+			ch >>= 1;
+		}
+	}
+
+	return crc;
+}
+
+#if defined(__x86_64__)
+/* the hardware path computes three independent streams at a time (the
+ * crc32 instruction has a latency of 3 cycles but a throughput of 1) and
+ * then combines them by "appending" the zeros the streams skipped; that
+ * is a linear operation on the crc, done with 4 lookup tables
+ * (after Mark Adler's crc32c.c)
+ */
+constexpr size_t hw_long  { 8192 };
+constexpr size_t hw_short { 256  };
+
+typedef struct {
+	uint32_t t[4][256];
+} zeros_table_t;
+
+static uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec)
+{
+	uint32_t sum = 0;
+
+	while(vec) {
+		if (vec & 1)
+			sum ^= *mat;
+
+		vec >>= 1;
+		mat++;
+	}
+
+	return sum;
+}
+
+static void gf2_matrix_square(uint32_t *const square, const uint32_t *const mat)
+{
+	for(int n=0; n<32; n++)
+		square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+// operator that appends 'len' zero bytes to a crc
+static void crc32c_zeros_op(uint32_t *const even, size_t len)
+{
+	uint32_t odd[32];
+
+	odd[0] = crc32c_polynomial;  // operator for one zero bit
+
+	uint32_t row = 1;
+	for(int n=1; n<32; n++) {
+		odd[n] = row;
+		row <<= 1;
+	}
+
+	gf2_matrix_square(even, odd);  // 2 zero bits
+	gf2_matrix_square(odd, even);  // 4 zero bits
+
+	// the first square puts the operator for one zero byte (8 bits) in even
+	do {
+		gf2_matrix_square(even, odd);
+
+		len >>= 1;
+		if (len == 0)
+			return;
+
+		gf2_matrix_square(odd, even);
+
+		len >>= 1;
+	}
+	while(len);
+
+	memcpy(even, odd, sizeof odd);
+}
+
+static void build_zeros_table(zeros_table_t *const table, const size_t len)
+{
+	uint32_t op[32];
+	crc32c_zeros_op(op, len);
+
+	for(uint32_t n=0; n<256; n++) {
+		table->t[0][n] = gf2_matrix_times(op, n);
+		table->t[1][n] = gf2_matrix_times(op, n << 8);
+		table->t[2][n] = gf2_matrix_times(op, n << 16);
+		table->t[3][n] = gf2_matrix_times(op, n << 24);
+	}
+}
+
+static zeros_table_t zeros_long;
+static zeros_table_t zeros_short;
+
+static inline uint32_t crc32c_shift(const zeros_table_t & zeros, const uint32_t crc)
+{
+	return zeros.t[0][crc & 0xff] ^ zeros.t[1][(crc >> 8) & 0xff] ^ zeros.t[2][(crc >> 16) & 0xff] ^ zeros.t[3][crc >> 24];
+}
+
+static inline uint64_t load64(const uint8_t *const p)
+{
+	uint64_t v = 0;
+	memcpy(&v, p, sizeof v);
+
+	return v;
+}
+
+__attribute__((target("sse4.2")))
+static void crc32c_hw_streams(uint64_t *const crc0_in, const uint8_t **const next_in, size_t *const n_in, const size_t block, const zeros_table_t & zeros)
+{
+	uint64_t       crc0 = *crc0_in;
+	const uint8_t *next = *next_in;
+	size_t         n    = *n_in;
+
+	while(n >= block * 3) {
+		uint64_t crc1 = 0;
+		uint64_t crc2 = 0;
+
+		const uint8_t *const end = next + block;
+
+		do {
+			crc0 = _mm_crc32_u64(crc0, load64(next));
+			crc1 = _mm_crc32_u64(crc1, load64(next + block));
+			crc2 = _mm_crc32_u64(crc2, load64(next + block * 2));
+
+			next += 8;
+		}
+		while(next < end);
+
+		crc0 = crc32c_shift(zeros, crc0) ^ crc1;
+		crc0 = crc32c_shift(zeros, crc0) ^ crc2;
+
+		next += block * 2;
+		n    -= block * 3;
+	}
+
+	*crc0_in = crc0;
+	*next_in = next;
+	*n_in    = n;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(const uint32_t crc, const uint8_t *next, size_t n)
+{
+	uint64_t crc0 = crc;
+
+	crc32c_hw_streams(&crc0, &next, &n, hw_long,  zeros_long );
+	crc32c_hw_streams(&crc0, &next, &n, hw_short, zeros_short);
+
+	while(n >= 8) {
+		crc0 = _mm_crc32_u64(crc0, load64(next));
+
+		next += 8;
+		n    -= 8;
+	}
+
+	while(n) {
+		crc0 = _mm_crc32_u8(crc0, *next++);
+
+		n--;
+	}
+
+	return crc0;
+}
+#endif
+
+static uint32_t crc32c_sw(const uint32_t crc, const uint8_t *const data, const size_t n)
+{
+	return crc_slice8(get_slice8_table(crc32c_polynomial), crc, data, n);
+}
+
+typedef uint32_t (*crc32c_kernel_t)(const uint32_t crc, const uint8_t *const data, const size_t n);
+
+typedef struct {
+	const char     *name;
+	crc32c_kernel_t kernel;
+} crc32c_kernel_info_t;
+
+// best first
+static std::vector<crc32c_kernel_info_t> get_kernels()
+{
+	std::vector<crc32c_kernel_info_t> out;
+
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("sse4.2")) {
+		static bool tables_built = [] {
+			build_zeros_table(&zeros_long,  hw_long );
+			build_zeros_table(&zeros_short, hw_short);
+
+			return true;
+		}();
+
+		(void)tables_built;
+
+		out.push_back({ "sse4.2", crc32c_hw });
+	}
+#endif
+
+	out.push_back({ "slicing-by-8", crc32c_sw });
+
+	return out;
+}
+
+static crc32c_kernel_info_t crc32c_kernel = get_kernels().front();
+
+const char *crc32c_kernel_name()
+{
+	return crc32c_kernel.name;
+}
+
+std::vector<std::string> crc32c_kernels()
+{
+	std::vector<std::string> out;
+
+	for(auto & k : get_kernels())
+		out.push_back(k.name);
+
+	return out;
+}
+
+bool crc32c_select_kernel(const std::string & name)
+{
+	for(auto & k : get_kernels()) {
+		if (k.name == name) {
+			crc32c_kernel = k;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+uint32_t crc32c(const uint8_t *const data, const size_t n)
+{
+	return ~crc32c_kernel.kernel(0xffffffff, data, n);
+}
+
+uint32_t crc32_generic(const uint8_t *const data, const size_t n, const uint32_t polynomial)
+{
+	const slice8_table_t *table = get_slice8_table(polynomial);
+
+	if (table)
+		return ~crc_slice8(table, 0xffffffff, data, n);
+
+	return ~crc_bitwise(0xffffffff, data, n, polynomial);
+}
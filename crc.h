@@ -0,0 +1,29 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+// reflected polynomials
+constexpr uint32_t crc32_polynomial  { 0xedb88320 };  // ethernet, zip, etc.
+constexpr uint32_t crc32c_polynomial { 0x82f63b78 };  // Castagnoli (SCTP, iSCSI)
+
+/* CRC-32C (pre- and post-inverted, as used by SCTP)
+ * uses the SSE4.2 crc32 instruction when the CPU has it (3 streams in
+ * parallel for larger buffers), slicing-by-8 otherwise
+ */
+uint32_t crc32c(const uint8_t *const data, const size_t n);
+
+// any reflected polynomial: slicing-by-8 for the two above, bitwise for others
+uint32_t crc32_generic(const uint8_t *const data, const size_t n, const uint32_t polynomial);
+
+// name of the CRC-32C implementation in use ("sse4.2" or "slicing-by-8")
+const char *crc32c_kernel_name();
+
+// the CRC-32C implementations this CPU can run, best first
+std::vector<std::string> crc32c_kernels();
+
+// for tests and benchmarks (not thread safe); false if 'name' is not available
+bool crc32c_select_kernel(const std::string & name);
@@ -1,6 +1,10 @@
 #include <chrono>
+#include <cstring>
+#include <memory>
+#include <set>
 #include <string>
 #include <thread>
+#include <tuple>
 #include <vector>
 #include <arpa/inet.h>
 
@@ -14,6 +18,11 @@
 
 using namespace std::chrono_literals;
 
+constexpr int dns_retransmit_ms    = 1000;
+constexpr int dns_max_sends        = 2;     // after that the lookup failed
+constexpr int dns_max_cname_depth  = 8;
+constexpr int dns_max_negative_ttl = 3600;
+
 dns::dns(stats *const s, udp *const u, const any_addr & my_ip, const any_addr & dns_ip) : u(u), my_ip(my_ip), dns_ip(dns_ip)
 {
 	dns_queries             = s->register_stat("dns_queries",       "1.3.6.1.4.1.57850.1.12.1");
@@ -21,6 +30,9 @@ dns::dns(stats *const s, udp *const u, const any_addr & my_ip, const any_addr &
 	dns_queries_miss        = s->register_stat("dns_queries_miss",  "1.3.6.1.4.1.57850.1.12.3");
 	dns_queries_alien_reply = s->register_stat("dns_queries_alien", "1.3.6.1.4.1.57850.1.12.4");
 	dns_queries_to          = s->register_stat("dns_queries_to",    "1.3.6.1.4.1.57850.1.12.5");
+	dns_queries_coalesced   = s->register_stat("dns_queries_coalesced", "1.3.6.1.4.1.57850.1.12.6");
+	dns_queries_neg_hit     = s->register_stat("dns_queries_neg_hit",   "1.3.6.1.4.1.57850.1.12.7");
+	dns_queries_ignored     = s->register_stat("dns_queries_ignored",   "1.3.6.1.4.1.57850.1.12.8");
 
 	th = new std::thread(std::ref(*this));
 }
@@ -31,40 +43,148 @@ dns::~dns()
 	delete th;
 }
 
-std::pair<std::string, int> get_name(const uint8_t *const base, const uint8_t *const buffer, const bool first)
+// returns the name (lower case, without trailing '.') at 'offset' and the
+// offset of what follows it in the record
+static std::optional<std::pair<std::string, int> > get_name(const uint8_t *const base, const int size, int offset)
 {
 	std::string name;
-	int         tl   = 0;  // total len
+	int         end   = -1;
+	int         jumps = 0;
 
 	for(;;) {
-		uint8_t len = buffer[tl++];
+		if (offset >= size)
+			return { };
+
+		uint8_t len = base[offset++];
 
 		if (len == 0)
 			break;
 
-		if (len & 0xc0) {  // "compression"
-			uint16_t offset = ((len & ~0xc0) << 8) | buffer[tl++];
-			printf("offset %d, len: %d\n", offset, base[offset]);
+		if ((len & 0xc0) == 0xc0) {  // "compression": pointer to an earlier name
+			if (offset >= size || ++jumps > 16)
+				return { };
 
-			// apparently it is only 1 level deep, this compression
-			if (first) {
-				auto sub = get_name(base, &base[offset], false);
+			if (end == -1)
+				end = offset + 1;
 
-				name += sub.first;
-			}
+			offset = ((len & 0x3f) << 8) | base[offset];
 
-			break;
+			continue;
 		}
-		else {
-			std::string out = std::string((const char *)&buffer[tl], len);
-			printf("sub[%d]: %s\n", len, out.c_str());
-			tl += len;
 
-			name += out + ".";
-		}
+		if (offset + len > size)
+			return { };
+
+		if (name.empty() == false)
+			name += ".";
+
+		name += std::string(reinterpret_cast<const char *>(&base[offset]), len);
+
+		offset += len;
+	}
+
+	return { { str_tolower(name), end == -1 ? offset : end } };
+}
+
+static uint16_t get_u16(const uint8_t *const p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static uint32_t get_u32(const uint8_t *const p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// has_value() == false: unknown, has_value() with an empty address: the
+// name is known not to exist
+// 'name' is replaced by the end of the CNAME chain
+std::optional<std::optional<any_addr> > dns::lookup_cache(std::string *const name, const dns_type_t type, const time_t now)
+{
+	for(int i=0; i<dns_max_cname_depth; i++) {
+		auto itc = cname_cache.find(*name);
+
+		if (itc == cname_cache.end() || now - itc->second.t >= itc->second.max_age)
+			break;
+
+		DOLOG(ll_debug, "DNS: %s maps to %s\n", name->c_str(), itc->second.name.c_str());
+
+		*name = itc->second.name;
+	}
+
+	auto itn = negative_cache.find({ *name, type });
+
+	if (itn != negative_cache.end() && now < itn->second)
+		return std::optional<any_addr>();
+
+	auto ita = a_aaaa_cache.find({ *name, type });
+
+	if (ita != a_aaaa_cache.end() && now - ita->second.t < ita->second.max_age)
+		return std::optional<any_addr>(ita->second.a);
+
+	return { };
+}
+
+uint16_t dns::start_request(const std::string & name, const dns_type_t type, const int depth, std::vector<dns_callback_t> && callbacks)
+{
+	uint16_t id = 0;
+
+	// a random transaction id makes spoofing replies harder
+	do {
+		get_random(reinterpret_cast<uint8_t *>(&id), sizeof id);
+	}
+	while(pending.find(id) != pending.end());
+
+	pending.insert({ id, { name, type, get_ms(), 1, depth, std::move(callbacks) } });
+
+	pending_by_name.insert({ { name, type }, id });
+
+	return id;
+}
+
+void dns::transmit_request(const uint16_t id, const std::string & name, const dns_type_t type)
+{
+	DOLOG(ll_debug, "Sending DNS resolve request %04x for \"%s\" (type %d)\n", id, name.c_str(), type);
+
+	uint8_t buffer[512] { 0 };
+	int     offset      { 0 };
+
+	buffer[offset++] = id >> 8;  // transaction id
+	buffer[offset++] = id;
+
+	buffer[offset++] = 1;  // request with recursion
+	buffer[offset++] = 0;
+
+	buffer[offset++] = 0;  // 1 query
+	buffer[offset++] = 1;
+
+	buffer[offset++] = 0;  // answer rr
+	buffer[offset++] = 0;
+
+	buffer[offset++] = 0;  // authority rr
+	buffer[offset++] = 0;
+
+	buffer[offset++] = 0;  // additional rr
+	buffer[offset++] = 0;
+
+	// name (checked by query_async)
+	std::vector<std::string> parts = split(name, ".");
+	for(auto & p : parts) {
+		buffer[offset++] = p.size();
+		memcpy(&buffer[offset], p.data(), p.size());
+		offset += p.size();
 	}
+	buffer[offset++] = 0;  // no more address parts
+
+	// qtype
+	buffer[offset++] = type >> 8;
+	buffer[offset++] = type;
 
-	return { name, tl };
+	// qclass
+	buffer[offset++] = 0;  // internet
+	buffer[offset++] = 1;
+
+	u->transmit_packet(dns_ip, 53, my_ip, 53, buffer, offset);
 }
 
 void dns::input(const any_addr & src_ip, int src_port, const any_addr & dst_ip, int dst_port, packet *p, session_data *const pd)
@@ -75,241 +195,375 @@ void dns::input(const any_addr & src_ip, int src_port, const any_addr & dst_ip,
 		return;
 	}
 
-	const uint16_t *const header = (const uint16_t *)p->get_data();
+	const uint8_t *const data = p->get_data();
+	const int            size = p->get_size();
 
-	if (ntohs(header[1]) == 0x8400) {  // standard query response, no error
-		DOLOG(ll_debug, "DNS query response: %04x\n", ntohs(header[1]));
+	if (size < 12) {
+		DOLOG(ll_debug, "DNS: reply too short\n");
 		return;
 	}
 
-	uint16_t qdcount = ntohs(header[2]);  // query count
-	uint16_t ancount = ntohs(header[3]);  // answers
-	//uint16_t nscount = ntohs(header[4]);  // nameservers
-	//uint16_t arcount = ntohs(header[5]);  // additional information
+	uint16_t id      = get_u16(&data[0]);
+	uint16_t flags   = get_u16(&data[2]);
+	uint16_t qdcount = get_u16(&data[4]);  // query count
+	uint16_t ancount = get_u16(&data[6]);  // answers
+	uint16_t nscount = get_u16(&data[8]);  // nameservers
+	int      rcode   = flags & 0x000f;
 
-	const uint8_t *work_p = (const uint8_t *)&header[6];
+	if ((flags & 0x8000) == 0 || qdcount != 1) {
+		DOLOG(ll_debug, "DNS: not a reply to a single query (flags %04x, %d queries)\n", flags, qdcount);
+		return;
+	}
 
-	DOLOG(ll_debug, "DNS QDCOUNT: %d\n", qdcount);
+	auto q_name = get_name(data, size, 12);
 
-	for(int i=0; i<qdcount; i++) {
-		auto name_len = get_name(p->get_data(), work_p, true);
-		work_p += name_len.second;
+	if (q_name.has_value() == false || q_name.value().second + 4 > size) {
+		DOLOG(ll_debug, "DNS: query section invalid\n");
+		return;
+	}
 
-		uint16_t type = (work_p[0] << 8) | work_p[1];
-		work_p += 2;
+	dns_type_t q_type = dns_type_t(get_u16(&data[q_name.value().second]));
+	int        offset = q_name.value().second + 4;
 
-		uint16_t class_ = (work_p[0] << 8) | work_p[1];
-		work_p += 2;
+	time_t     now    = p->get_recv_ts().tv_sec;
 
-		DOLOG(ll_debug, "DNS QD name: %s / qtype: %04x / class: %04x\n", name_len.first.c_str(), type, class_);
-	}
+	std::unique_lock<std::mutex> lck(lock);
 
-	DOLOG(ll_debug, "DNS ANCOUNT: %d\n", ancount);
+	// only replies to a request that is outstanding, for the same question
+	auto it = pending.find(id);
 
-	for(int i=0; i<ancount; i++) {
-		auto name_len = get_name(p->get_data(), work_p, true);
-		work_p += name_len.second;
+	if (it == pending.end() || it->second.name != q_name.value().first || it->second.type != q_type) {
+		DOLOG(ll_info, "DNS: unexpected reply %04x for %s\n", id, q_name.value().first.c_str());
+		stats_inc_counter(dns_queries_alien_reply);
+		return;
+	}
 
-		uint16_t type = (work_p[0] << 8) | work_p[1];
-		work_p += 2;
+	DOLOG(ll_debug, "DNS reply %04x for %s, rcode %d, ANCOUNT: %d, NSCOUNT: %d\n", id, q_name.value().first.c_str(), rcode, ancount, nscount);
 
-		uint16_t class_ = (work_p[0] << 8) | work_p[1];
-		work_p += 2;
+	int negative_ttl = -1;  // from the SOA record in the authority section
 
-		int ttl = (work_p[0] << 24) | (work_p[1] << 16) | (work_p[2] << 8) | work_p[3];
-		work_p += 4;
+	// answers are cached only when they are about the name that was asked
+	// or a name it is a CNAME of, so that a reply cannot plant records for
+	// other names
+	std::map<std::string, dns_cname_rec_t> cnames;
+	std::vector<std::pair<std::pair<std::string, dns_type_t>, dns_a_rec_t> > addresses;  // A and AAAA
 
-		uint16_t len = (work_p[0] << 8) | work_p[1];
-		work_p += 2;
+	for(int i=0; i<ancount + nscount; i++) {
+		auto name_len = get_name(data, size, offset);
 
-		if (len == 4 && type == 0x0001 /* type A */) {
-			any_addr    a  (any_addr::ipv4, work_p);
-			dns_a_rec_t dr { a, p->get_recv_ts().tv_sec, ttl };
+		if (name_len.has_value() == false || name_len.value().second + 10 > size) {
+			DOLOG(ll_debug, "DNS: resource record %d invalid\n", i);
+			break;
+		}
 
-			std::string name = name_len.first.substr(0, name_len.first.size() - 1);  // remove '.'
+		const std::string & name = name_len.value().first;
 
-			DOLOG(ll_debug, "DNS: A record for %s to %s\n", name.c_str(), a.to_str().c_str());
+		offset = name_len.value().second;
 
-			std::unique_lock<std::mutex> lck(lock);
+		uint16_t type   = get_u16(&data[offset + 0]);
+		uint16_t class_ = get_u16(&data[offset + 2]);
+		int      ttl    = get_u32(&data[offset + 4]) & 0x7fffffff;
+		uint16_t len    = get_u16(&data[offset + 8]);
 
-			a_aaaa_cache.insert_or_assign(name, dr);
+		offset += 10;
 
-			updated.notify_all();
+		if (offset + len > size) {
+			DOLOG(ll_debug, "DNS: resource record %d truncated\n", i);
+			break;
 		}
-		else if (type == 0x0005 /* CNAME */) {
-			auto cname_len = get_name(p->get_data(), work_p, true);
-			auto cname     = cname_len.first.substr(0, cname_len.first.size() - 1);  // remove '.'
 
-			dns_cname_rec_t dr { cname, p->get_recv_ts().tv_sec, ttl };
+		const uint8_t *const rdata = &data[offset];
 
-			std::string name = name_len.first.substr(0, name_len.first.size() - 1);  // remove '.'
+		if (len == 4 && type == dns_a && i < ancount) {
+			any_addr a(any_addr::ipv4, rdata);
 
-			DOLOG(ll_debug, "DNS: CNAME record for %s to %s\n", name.c_str(), cname.c_str());
+			DOLOG(ll_debug, "DNS: A record for %s to %s\n", name.c_str(), a.to_str().c_str());
 
-			std::unique_lock<std::mutex> lck(lock);
+			addresses.push_back({ { name, dns_a }, dns_a_rec_t { a, now, ttl } });
+		}
+		else if (len == 16 && type == dns_aaaa && i < ancount) {
+			any_addr a(any_addr::ipv6, rdata);
 
-			cname_cache.insert_or_assign(name, dr);
+			DOLOG(ll_debug, "DNS: AAAA record for %s to %s\n", name.c_str(), a.to_str().c_str());
 
-			updated.notify_all();
+			addresses.push_back({ { name, dns_aaaa }, dns_a_rec_t { a, now, ttl } });
 		}
-		else if (len == 16 && type == 0x001c /* type AAAA (28 decimal) */) {
-			any_addr    a  (any_addr::ipv6, work_p);
-			dns_a_rec_t dr { a, p->get_recv_ts().tv_sec, ttl };
+		else if (type == dns_cname && i < ancount) {
+			auto cname = get_name(data, size, offset);
 
-			std::string name = name_len.first.substr(0, name_len.first.size() - 1);  // remove '.'
+			if (cname.has_value()) {
+				DOLOG(ll_debug, "DNS: CNAME record for %s to %s\n", name.c_str(), cname.value().first.c_str());
 
-			DOLOG(ll_debug, "DNS: AAAA record for %s to %s\n", name.c_str(), a.to_str().c_str());
-
-			std::unique_lock<std::mutex> lck(lock);
+				cnames.insert_or_assign(name, dns_cname_rec_t { cname.value().first, now, ttl });
+			}
+		}
+		else if (type == dns_soa && i >= ancount) {
+			// mname, rname, serial, refresh, retry, expire, minimum
+			auto mname = get_name(data, size, offset);
+			auto rname = mname.has_value() ? get_name(data, size, mname.value().second) : std::nullopt;
 
-			a_aaaa_cache.insert_or_assign(name, dr);
+			if (rname.has_value() && rname.value().second + 20 <= offset + len) {
+				int minimum = get_u32(&data[rname.value().second + 16]) & 0x7fffffff;
 
-			updated.notify_all();
+				negative_ttl = std::min(ttl, minimum);
+			}
 		}
 		else {
-			DOLOG(ll_debug, "DNS: type: %04x, class: %04x, len: %d for %s\n", type, class_, len, name_len.first.c_str());
+			DOLOG(ll_debug, "DNS: type: %04x, class: %04x, len: %d for %s\n", type, class_, len, name.c_str());
 		}
+
+		offset += len;
 	}
 
-	DOLOG(ll_debug, "DNS input processing finished\n");
-}
+	std::set<std::string> chain     { it->second.name };
+	size_t                n_ignored { cnames.size() + addresses.size() };
 
-using namespace std::chrono_literals;
+	for(std::string work = it->second.name; chain.size() <= size_t(dns_max_cname_depth);) {
+		auto itc = cnames.find(work);
 
-// send query to dns, wait for 'updated' and then
-// check if set in chache. if not, wait. upto to ms.
-std::optional<any_addr> dns::query(const std::string & name, const int to)
-{
-	DOLOG(ll_debug, "DNS: search for \"%s\" with timeout %d\n", name.c_str(), to);
+		if (itc == cnames.end() || chain.find(itc->second.name) != chain.end())
+			break;
 
-	std::string work = str_tolower(name);
+		cname_cache.insert_or_assign(work, itc->second);
+		n_ignored--;
 
-	stats_inc_counter(dns_queries);
+		work = itc->second.name;
+
+		chain.insert(work);
+	}
 
-	auto wait_until  = std::chrono::system_clock::now() + 1ms * to;
+	for(auto & a : addresses) {
+		if (a.first.second != it->second.type || chain.find(a.first.first) == chain.end())
+			continue;
 
-	bool send_req    = true;
+		a_aaaa_cache.insert_or_assign(a.first, a.second);
+		n_ignored--;
+	}
 
-	std::unique_lock<std::mutex> lck(lock);
+	if (n_ignored) {
+		DOLOG(ll_info, "DNS: %zu records in reply %04x not about %s\n", n_ignored, id, it->second.name.c_str());
+		stats_add_counter(dns_queries_ignored, n_ignored);
+	}
 
-	do {
-		time_t now = time(nullptr);
+	dns_pending_t request = std::move(it->second);
 
-		for(int i=0; i<8; i++) {  // cname max depth is 8 here
-			auto itc = cname_cache.find(work);
+	pending.erase(it);
+	pending_by_name.erase({ request.name, request.type });
 
-			if (itc == cname_cache.end() || now - itc->second.t >= itc->second.max_age)
-				break;
+	std::string work   = request.name;
+	auto        result = lookup_cache(&work, request.type, now);
 
-			DOLOG(ll_debug, "DNS resolve for \"%s\": %s maps to %s\n", name.c_str(), work.c_str(), itc->second.name.c_str());
+	std::optional<any_addr> answer;
 
-			work = itc->second.name;
+	if (result.has_value())
+		answer = result.value();
+	else if (rcode == 0 && work != request.name && request.depth < dns_max_cname_depth) {
+		// only the CNAME was in the reply: ask for where it points to
+		auto itp = pending_by_name.find({ work, request.type });
 
-			send_req = true;
+		if (itp != pending_by_name.end()) {
+			auto & callbacks = pending.find(itp->second)->second.callbacks;
+
+			callbacks.insert(callbacks.end(), request.callbacks.begin(), request.callbacks.end());
+
+			return;
 		}
 
-		DOLOG(ll_debug, "DNS: iterate %s, cache entries: %zu\n", work.c_str(), a_aaaa_cache.size());
+		uint16_t new_id = start_request(work, request.type, request.depth + 1, std::move(request.callbacks));
 
-		auto ita = a_aaaa_cache.find(work);
+		lck.unlock();
 
-		if (ita != a_aaaa_cache.end()) {
-			int age = now - ita->second.t;
+		transmit_request(new_id, work, request.type);
 
-			if (age < ita->second.max_age) {
-				stats_inc_counter(dns_queries_hit);
+		return;
+	}
+	else if ((rcode == 0 || rcode == 3 /* NXDOMAIN */) && negative_ttl >= 0) {
+		time_t until = now + std::min(negative_ttl, dns_max_negative_ttl);
 
-				DOLOG(ll_debug, "DNS succeeded to resolve %s\n", work.c_str());
+		DOLOG(ll_debug, "DNS: %s (type %d) does not exist, for %d seconds\n", work.c_str(), request.type, int(until - now));
 
-				return ita->second.a;
-			}
+		negative_cache.insert_or_assign({ work, request.type }, until);
+	}
 
-			DOLOG(ll_debug, "DNS: record for %s too old (%d > %d)\n", work.c_str(), age, ita->second.max_age);
-		}
+	lck.unlock();
 
-		if (send_req) {
-			send_req = false;
+	for(auto & cb : request.callbacks)
+		cb(answer);
 
-			DOLOG(ll_debug, "Sending DNS resolve request for \"%s\"\n", work.c_str());
+	DOLOG(ll_debug, "DNS input processing finished\n");
+}
 
-			uint8_t buffer[256] { 0 };
-			int     offset      { 0 };
+void dns::query_async(const std::string & name, const dns_type_t type, const dns_callback_t & cb)
+{
+	DOLOG(ll_debug, "DNS: search for \"%s\" (type %d)\n", name.c_str(), type);
 
-			buffer[offset++] = 0;  // transaction id
-			buffer[offset++] = 0;
+	stats_inc_counter(dns_queries);
 
-			buffer[offset++] = 1;  // request with recursion
-			buffer[offset++] = 0;
+	std::string work = str_tolower(name);
 
-			buffer[offset++] = 0;  // 1 query
-			buffer[offset++] = 1;
+	while(work.empty() == false && work.back() == '.')
+		work.pop_back();
 
-			buffer[offset++] = 0;  // answer rr
-			buffer[offset++] = 0;
+	bool valid = work.empty() == false && work.size() <= 253;
 
-			buffer[offset++] = 0;  // authority rr
-			buffer[offset++] = 0;
+	for(auto & label : split(work, "."))
+		valid &= label.empty() == false && label.size() <= 63;
 
-			buffer[offset++] = 0;  // additional rr
-			buffer[offset++] = 0;
+	if (!valid) {
+		DOLOG(ll_debug, "DNS: \"%s\" is not a valid hostname\n", name.c_str());
 
-			// name
-			std::vector<std::string> parts = split(work, ".");
-			for(auto & p : parts) {
-				buffer[offset++] = p.size();
-				memcpy(&buffer[offset], p.data(), p.size());
-				offset += p.size();
-			}
-			buffer[offset++] = 0;  // no more address parts
+		cb({ });
+
+		return;
+	}
 
-			// qtype
-			buffer[offset++] = 0;  // host address
-			buffer[offset++] = 1;
+	std::unique_lock<std::mutex> lck(lock);
 
-			// qclass
-			buffer[offset++] = 0;  // host address
-			buffer[offset++] = 1;
+	auto cached = lookup_cache(&work, type, time(nullptr));
 
-			u->transmit_packet(dns_ip, 53, my_ip, 53, buffer, offset);
-		}
+	if (cached.has_value()) {
+		stats_inc_counter(cached.value().has_value() ? dns_queries_hit : dns_queries_neg_hit);
+
+		lck.unlock();
+
+		cb(cached.value());
+
+		return;
+	}
+
+	stats_inc_counter(dns_queries_miss);
+
+	// someone else asked for it already
+	auto itp = pending_by_name.find({ work, type });
+
+	if (itp != pending_by_name.end()) {
+		stats_inc_counter(dns_queries_coalesced);
+
+		pending.find(itp->second)->second.callbacks.push_back(cb);
+
+		return;
 	}
-	while(updated.wait_until(lck, wait_until) != std::cv_status::timeout);
 
-	stats_inc_counter(dns_queries_to);
+	uint16_t id = start_request(work, type, 0, { cb });
 
-	DOLOG(ll_debug, "DNS: no result for %s\n", name.c_str());
+	lck.unlock();
+
+	transmit_request(id, work, type);
+}
+
+std::future<std::optional<any_addr> > dns::query_future(const std::string & name, const dns_type_t type)
+{
+	auto promise = std::make_shared<std::promise<std::optional<any_addr> > >();
+
+	query_async(name, type, [promise](const std::optional<any_addr> & a) { promise->set_value(a); });
+
+	return promise->get_future();
+}
+
+std::optional<any_addr> dns::query(const std::string & name, const int to, const dns_type_t type)
+{
+	auto result = query_future(name, type);
+
+	if (result.wait_for(1ms * to) == std::future_status::ready) {
+		auto a = result.get();
+
+		if (a.has_value())
+			DOLOG(ll_debug, "DNS succeeded to resolve %s\n", name.c_str());
+		else
+			DOLOG(ll_debug, "DNS: no result for %s\n", name.c_str());
+
+		return a;
+	}
+
+	DOLOG(ll_debug, "DNS: no result for %s within %d ms\n", name.c_str(), to);
 
 	return { };
 }
 
-// flush cache periodically
+// retransmits, time-outs and flushing the cache periodically
 void dns::operator()()
 {
 	set_thread_name("myip-dns");
 
+	uint64_t last_clean = get_ms();
+
 	for(;;) {
-		if (stop_flag.sleep(30000))
+		if (stop_flag.sleep(250))
 			break;
 
+		std::vector<std::tuple<uint16_t, std::string, dns_type_t> > retransmit;
+		std::vector<dns_callback_t> failed;
+
 		std::unique_lock<std::mutex> lck(lock);
 
-		DOLOG(ll_debug, "DNS cache clean\n");
+		uint64_t now_ms = get_ms();
+
+		for(auto it = pending.begin(); it != pending.end();) {
+			if (now_ms - it->second.sent_ts < dns_retransmit_ms) {
+				it++;
+				continue;
+			}
+
+			if (it->second.n_sent < dns_max_sends) {
+				it->second.n_sent++;
+				it->second.sent_ts = now_ms;
 
-		// clean A cache
-		time_t now = time(nullptr);
+				retransmit.push_back({ it->first, it->second.name, it->second.type });
 
-		for(auto it = a_aaaa_cache.begin(); it != a_aaaa_cache.end();) {
-			if (now - it->second.t >= it->second.max_age)
-				it = a_aaaa_cache.erase(it);
-			else
 				it++;
+
+				continue;
+			}
+
+			DOLOG(ll_debug, "DNS: no reply for %s\n", it->second.name.c_str());
+
+			stats_inc_counter(dns_queries_to);
+
+			failed.insert(failed.end(), it->second.callbacks.begin(), it->second.callbacks.end());
+
+			pending_by_name.erase({ it->second.name, it->second.type });
+
+			it = pending.erase(it);
 		}
 
-		// clean CNAME cache
-		for(auto it = cname_cache.begin(); it != cname_cache.end();) {
-			if (now - it->second.t >= it->second.max_age)
-				it = cname_cache.erase(it);
-			else
-				it++;
+		if (now_ms - last_clean >= 30000) {
+			last_clean = now_ms;
+
+			DOLOG(ll_debug, "DNS cache clean\n");
+
+			time_t now = time(nullptr);
+
+			// clean A/AAAA cache
+			for(auto it = a_aaaa_cache.begin(); it != a_aaaa_cache.end();) {
+				if (now - it->second.t >= it->second.max_age)
+					it = a_aaaa_cache.erase(it);
+				else
+					it++;
+			}
+
+			// clean CNAME cache
+			for(auto it = cname_cache.begin(); it != cname_cache.end();) {
+				if (now - it->second.t >= it->second.max_age)
+					it = cname_cache.erase(it);
+				else
+					it++;
+			}
+
+			// clean negative cache
+			for(auto it = negative_cache.begin(); it != negative_cache.end();) {
+				if (now >= it->second)
+					it = negative_cache.erase(it);
+				else
+					it++;
+			}
 		}
+
+		lck.unlock();
+
+		for(auto & r : retransmit)
+			transmit_request(std::get<0>(r), std::get<1>(r), std::get<2>(r));
+
+		for(auto & cb : failed)
+			cb({ });
 	}
 }
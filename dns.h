@@ -1,14 +1,19 @@
 #pragma once
 
-#include <condition_variable>
+#include <functional>
+#include <future>
 #include <map>
 #include <mutex>
+#include <optional>
+#include <vector>
 
 #include "any_addr.h"
 #include "application.h"
 #include "udp.h"
 
 
+typedef enum { dns_a = 0x0001, dns_cname = 0x0005, dns_soa = 0x0006, dns_aaaa = 0x001c } dns_type_t;
+
 typedef struct {
 	any_addr a;
 	time_t   t;
@@ -21,6 +26,20 @@ typedef struct {
 	int         max_age;
 } dns_cname_rec_t;
 
+// invoked with the address or, on failure or time-out, without
+typedef std::function<void(const std::optional<any_addr> & a)> dns_callback_t;
+
+// an outstanding request to the upstream server; lookups for the same name
+// and type while it is pending only add their callback to it
+typedef struct {
+	std::string                 name;
+	dns_type_t                  type;
+	uint64_t                    sent_ts;    // ms
+	int                         n_sent;
+	int                         depth;      // number of CNAMEs followed
+	std::vector<dns_callback_t> callbacks;
+} dns_pending_t;
+
 class dns : public application
 {
 private:
@@ -36,11 +55,23 @@ private:
 	uint64_t *dns_queries_miss        { nullptr };
 	uint64_t *dns_queries_alien_reply { nullptr };
 	uint64_t *dns_queries_to          { nullptr };
+	uint64_t *dns_queries_coalesced   { nullptr };
+	uint64_t *dns_queries_neg_hit     { nullptr };
+	uint64_t *dns_queries_ignored     { nullptr };  // answer records not about the asked name
 
 	std::mutex                         lock;
-	std::map<std::string, dns_a_rec_t> a_aaaa_cache;
+	std::map<std::pair<std::string, dns_type_t>, dns_a_rec_t> a_aaaa_cache;
 	std::map<std::string, dns_cname_rec_t> cname_cache;
-	std::condition_variable            updated;
+	// names that do not exist (or have no record of the type): expiry time
+	std::map<std::pair<std::string, dns_type_t>, time_t> negative_cache;
+
+	std::map<uint16_t, dns_pending_t>  pending;  // by transaction id
+	std::map<std::pair<std::string, dns_type_t>, uint16_t> pending_by_name;
+
+	// lock must be held
+	std::optional<std::optional<any_addr> > lookup_cache(std::string *const name, const dns_type_t type, const time_t now);
+	uint16_t start_request(const std::string & name, const dns_type_t type, const int depth, std::vector<dns_callback_t> && callbacks);
+	void     transmit_request(const uint16_t id, const std::string & name, const dns_type_t type);
 
 public:
 	dns(stats *const s, udp *const u, const any_addr & my_ip, const any_addr & dns_ip);
@@ -49,10 +80,16 @@ public:
 	// verify if packet comes from 'dns_a'!
 	void input(const any_addr & src_ip, int src_port, const any_addr & dst_ip, int dst_port, packet *p, session_data *const pd);
 
-	// send query to dns, wait for 'updated' and then
-	// check if set in chache. if not, wait. upto to ms.
-	std::optional<any_addr> query(const std::string & hostname, const int to);
+	// does not block: 'cb' is invoked when the answer is there, which is
+	// immediately (in this thread) when it is in a cache, else from the
+	// thread that processes the replies (so it must not block either)
+	void query_async(const std::string & hostname, const dns_type_t type, const dns_callback_t & cb);
+
+	std::future<std::optional<any_addr> > query_future(const std::string & hostname, const dns_type_t type);
+
+	// waits upto 'to' ms
+	std::optional<any_addr> query(const std::string & hostname, const int to, const dns_type_t type = dns_a);
 
-	// flush cache periodically
+	// time-outs, retransmits and flushing the cache
 	void operator()();
 };
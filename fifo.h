@@ -1,212 +1,360 @@
 // (C) 2022 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
 #pragma once
+#include <atomic>
+#include <climits>
+#include <errno.h>
 #include <optional>
-#include <pthread.h>
 #include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 #include "fifo_stats.h"
 #include "stats.h"
 
+/* bounded multi-producer/multi-consumer queue (Dmitry Vyukov's design)
+ * every cell has a sequence number telling whether it is free for the
+ * producer at 'pos' (seq == pos) or filled for the consumer at 'pos'
+ * (seq == pos + 1); no locks are taken on the put/get path
+ * idle consumers (and producers waiting on a full fifo) are parked on a
+ * futex
+ */
 template <typename T>
 class fifo
 {
 private:
-	T        *data       { nullptr };
-	const int n_elements { 0       };
+	struct cell {
+		std::atomic<size_t> seq;
+		T                   data;
+	};
 
-	int  read_pointer    { 0       };
-	int  write_pointer   { 0       };
-	bool full            { false   };
+	cell       *data       { nullptr };
+	const int   n_elements { 0       };
+	size_t      mask       { 0       };
 
-	bool interrupted     { false   };
+	alignas(64) std::atomic<size_t> write_pointer { 0 };
+	alignas(64) std::atomic<size_t> read_pointer  { 0 };
 
-	pthread_mutex_t lock;
-
-	/* cond_push is signalled when a new item is pushed
-	 * cond_pull is signalled when an item is removed
+	/* push_seq is bumped when a new item is pushed
+	 * pull_seq is bumped when an item is removed
+	 * the n_waiting_* counters allow skipping the wake-up syscall
 	 */
-	pthread_cond_t cond_push;
-	pthread_cond_t cond_pull;
+	alignas(64) std::atomic<uint32_t> push_seq           { 0 };
+	std::atomic<uint32_t>             pull_seq           { 0 };
+	std::atomic_int                   n_waiting_consumers{ 0 };
+	std::atomic_int                   n_waiting_producers{ 0 };
+
+	std::atomic_bool interrupted { false   };
 
-	fifo_stats *fs   { nullptr };
-	uint64_t    n_in { 0       };
+	fifo_stats *fs       { nullptr };
+	fifo_stats *fs_batch { nullptr };  // number of elements per get_bulk
+	std::atomic_int n_in { 0 };
 
 	uint64_t   *fifo_n_in_stats { nullptr };
 	uint64_t   *fifo_full_count { nullptr };
 
-public:
-	fifo(stats *const s, const std::string & name, const int n_elements) : n_elements(n_elements)
+	static void futex_wait(std::atomic<uint32_t> *const word, const uint32_t expected, const timespec *const timeout)
 	{
-		data = new T[n_elements];
+		syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+	}
 
-		fifo_n_in_stats = s->register_stat(name + "_n_in");
-		fifo_full_count = s->register_stat(name + "_full");
+	static void futex_wake(std::atomic<uint32_t> *const word, const int n)
+	{
+		syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE_PRIVATE, n, nullptr, nullptr, 0);
+	}
 
-		fs = new fifo_stats(n_elements);
-		s->register_fifo_stats(name, fs);
+	bool enqueue(const T & element)
+	{
+		size_t pos = write_pointer.load(std::memory_order_relaxed);
+
+		for(;;) {
+			cell    *c   = &data[pos & mask];
+			size_t   seq = c->seq.load(std::memory_order_acquire);
+			intptr_t dif = intptr_t(seq) - intptr_t(pos);
+
+			if (dif == 0) {
+				if (write_pointer.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					c->data = element;
+					c->seq.store(pos + 1, std::memory_order_release);
+					break;
+				}
+			}
+			else if (dif < 0) {
+				return false;  // full
+			}
+			else {
+				pos = write_pointer.load(std::memory_order_relaxed);
+			}
+		}
+
+		int n = n_in.fetch_add(1) + 1;
+
+		fs->count(n);
 
-		pthread_mutex_init(&lock, NULL);
+		stats_set(fifo_n_in_stats, n);
 
-		pthread_cond_init(&cond_push, NULL);
-		pthread_cond_init(&cond_pull, NULL);
+		return true;
 	}
 
-	~fifo()
+	void signal_pushed(const int n)
 	{
-		delete fs;
+		push_seq.fetch_add(1);
 
-		delete [] data;
+		if (n_waiting_consumers.load())
+			futex_wake(&push_seq, n);
 	}
 
-	void interrupt()
+	bool dequeue(T *const out)
 	{
-		pthread_mutex_lock(&lock);
+		size_t pos = read_pointer.load(std::memory_order_relaxed);
+
+		for(;;) {
+			cell    *c   = &data[pos & mask];
+			size_t   seq = c->seq.load(std::memory_order_acquire);
+			intptr_t dif = intptr_t(seq) - intptr_t(pos + 1);
+
+			if (dif == 0) {
+				if (read_pointer.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					*out = std::move(c->data);
+					c->seq.store(pos + mask + 1, std::memory_order_release);
+					break;
+				}
+			}
+			else if (dif < 0) {
+				return false;  // empty
+			}
+			else {
+				pos = read_pointer.load(std::memory_order_relaxed);
+			}
+		}
 
-		interrupted = true;
+		n_in.fetch_sub(1);
+
+		pull_seq.fetch_add(1);
 
-		pthread_cond_broadcast(&cond_push);
+		if (n_waiting_producers.load())
+			futex_wake(&pull_seq, 1);
 
-		pthread_mutex_unlock(&lock);
+		return true;
 	}
 
-	void put(const T & element)
+	// returns false when the deadline passed
+	static bool remaining_time(const timespec & deadline, timespec *const out)
 	{
-		pthread_mutex_lock(&lock);
+		timespec now { 0, 0 };
+		clock_gettime(CLOCK_MONOTONIC, &now);
 
-		if (full)
-			stats_inc_counter(fifo_full_count);
+		out->tv_sec  = deadline.tv_sec  - now.tv_sec;
+		out->tv_nsec = deadline.tv_nsec - now.tv_nsec;
 
-		while(full)
-			pthread_cond_wait(&cond_pull, &lock);
+		if (out->tv_nsec < 0) {
+			out->tv_nsec += 1000000000ll;
+			out->tv_sec--;
+		}
 
-		data[write_pointer] = element;
+		return out->tv_sec >= 0;
+	}
 
-		write_pointer++;
-		write_pointer %= n_elements;
+public:
+	fifo(stats *const s, const std::string & name, const int n_elements) : n_elements(n_elements)
+	{
+		size_t n_cells = 1;
+		while(n_cells < size_t(n_elements))
+			n_cells <<= 1;
 
-		n_in++;
+		mask = n_cells - 1;
 
-		fs->count(n_in);
+		data = new cell[n_cells];
 
-		stats_set(fifo_n_in_stats, n_in);
+		for(size_t i=0; i<n_cells; i++)
+			data[i].seq.store(i, std::memory_order_relaxed);
 
-		full = write_pointer == read_pointer;
+		fifo_n_in_stats = s->register_stat(name + "_n_in");
+		fifo_full_count = s->register_stat(name + "_full");
 
-		pthread_cond_signal(&cond_push);
+		fs = new fifo_stats(n_cells);
+		s->register_fifo_stats(name, fs);
 
-		pthread_mutex_unlock(&lock);
+		fs_batch = new fifo_stats(n_cells);
+		s->register_fifo_stats(name + "-batch", fs_batch);
 	}
 
-	bool try_put(const T & element)
+	~fifo()
 	{
-		bool have_put = false;
+		delete fs_batch;
+		delete fs;
 
-		pthread_mutex_lock(&lock);
+		delete [] data;
+	}
 
-		if (full)
-			stats_inc_counter(fifo_full_count);
-		else {
-			data[write_pointer] = element;
+	void interrupt()
+	{
+		interrupted = true;
 
-			write_pointer++;
-			write_pointer %= n_elements;
+		push_seq.fetch_add(1);
+		pull_seq.fetch_add(1);
 
-			n_in++;
+		futex_wake(&push_seq, INT_MAX);
+		futex_wake(&pull_seq, INT_MAX);
+	}
 
-			fs->count(n_in);
+	void put(const T & element)
+	{
+		if (enqueue(element)) {
+			signal_pushed(1);
+			return;
+		}
+
+		stats_inc_counter(fifo_full_count);
 
-			stats_set(fifo_n_in_stats, n_in);
+		while(!interrupted) {
+			uint32_t seq = pull_seq.load();
 
-			full = write_pointer == read_pointer;
+			n_waiting_producers++;
 
-			have_put = true;
+			if (enqueue(element)) {
+				n_waiting_producers--;
+				signal_pushed(1);
+				break;
+			}
 
-			pthread_cond_signal(&cond_push);
+			futex_wait(&pull_seq, seq, nullptr);
+
+			n_waiting_producers--;
+		}
+	}
+
+	bool try_put(const T & element)
+	{
+		if (enqueue(element)) {
+			signal_pushed(1);
+			return true;
 		}
 
-		pthread_mutex_unlock(&lock);
+		stats_inc_counter(fifo_full_count);
 
-		return have_put;
+		return false;
 	}
 
-	std::optional<T> get(const int ms)
+	// does not block; returns the number of elements that were queued
+	// consumers are woken once for the whole batch
+	int put_bulk(const T *const in, const int n)
 	{
-		struct timespec ts { 0, 0 };
-		clock_gettime(CLOCK_REALTIME, &ts);
+		int n_put = 0;
 
-		ts.tv_nsec += (ms % 1000) * 1000000ll;
-		ts.tv_sec += ms / 1000;
+		while(n_put < n && enqueue(in[n_put]))
+			n_put++;
 
-		if (ts.tv_nsec >= 1000000000ll) {
-			ts.tv_nsec -= 1000000000ll;
-			ts.tv_sec++;
-		}
+		if (n_put < n)
+			stats_inc_counter(fifo_full_count);
+
+		if (n_put)
+			signal_pushed(n_put);
 
-		pthread_mutex_lock(&lock);
+		return n_put;
+	}
+
+	std::optional<T> get(const int ms)
+	{
+		timespec deadline { 0, 0 };
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
 
-		bool ok = true;
+		deadline.tv_nsec += (ms % 1000) * 1000000ll;
+		deadline.tv_sec += ms / 1000;
 
-		while(read_pointer == write_pointer && !full && !interrupted) {
-			if (pthread_cond_timedwait(&cond_push, &lock, &ts)) {
-				ok = false;
-				break;
-			}
+		if (deadline.tv_nsec >= 1000000000ll) {
+			deadline.tv_nsec -= 1000000000ll;
+			deadline.tv_sec++;
 		}
 
-		if (interrupted) {
-			pthread_mutex_unlock(&lock);
+		T copy;
 
-			return { };
-		}
+		for(;;) {
+			if (interrupted)
+				return { };
 
-		if (ok) {
-			T copy = data[read_pointer];
+			if (dequeue(&copy))
+				return copy;
 
-			read_pointer++;
-			read_pointer %= n_elements;
+			uint32_t seq = push_seq.load();
 
-			n_in--;
+			n_waiting_consumers++;
 
-			full = 0;
+			// re-check: a producer may have pushed before it saw us waiting
+			if (dequeue(&copy)) {
+				n_waiting_consumers--;
+				return copy;
+			}
 
-			pthread_cond_signal(&cond_pull);
+			timespec timeout { 0, 0 };
+			if (remaining_time(deadline, &timeout) == false || interrupted) {
+				n_waiting_consumers--;
+				break;
+			}
 
-			pthread_mutex_unlock(&lock);
+			futex_wait(&push_seq, seq, &timeout);
 
-			return copy;
+			n_waiting_consumers--;
 		}
 
-		pthread_mutex_unlock(&lock);
-
 		return { };
 	}
 
 	std::optional<T> get()
 	{
-		pthread_mutex_lock(&lock);
+		T copy;
 
-		while(read_pointer == write_pointer && !full && !interrupted)
-			pthread_cond_wait(&cond_push, &lock);
+		for(;;) {
+			if (interrupted)
+				return { };
 
-		if (interrupted) {
-			pthread_mutex_unlock(&lock);
+			if (dequeue(&copy))
+				return copy;
 
-			return { };
+			uint32_t seq = push_seq.load();
+
+			n_waiting_consumers++;
+
+			if (dequeue(&copy)) {
+				n_waiting_consumers--;
+				return copy;
+			}
+
+			if (!interrupted)
+				futex_wait(&push_seq, seq, nullptr);
+
+			n_waiting_consumers--;
 		}
+	}
 
-		T copy = data[read_pointer];
+	// waits (ms < 0: indefinitely) for at least one element and then
+	// takes up to 'max' elements without waiting any further
+	// returns 0 on time-out or when interrupted
+	int get_bulk(T *const out, const int max, const int ms)
+	{
+		if (ms < 0) {
+			auto first = get();
+			if (!first.has_value())
+				return 0;
 
-		read_pointer++;
-		read_pointer %= n_elements;
+			out[0] = std::move(first.value());
+		}
+		else {
+			auto first = get(ms);
+			if (!first.has_value())
+				return 0;
 
-		n_in--;
+			out[0] = std::move(first.value());
+		}
 
-		full = 0;
+		int n = 1;
 
-		pthread_cond_signal(&cond_pull);
+		while(n < max && dequeue(&out[n]))
+			n++;
 
-		pthread_mutex_unlock(&lock);
+		fs_batch->count(n);
 
-		return copy;
+		return n;
 	}
 };
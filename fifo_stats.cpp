@@ -1,9 +1,13 @@
 // (C) 2022 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
 #include "fifo_stats.h"
+#include "stats.h"
 
 fifo_stats::fifo_stats(const int range_max)
 {
 	divider = (range_max + 1) / up_size;
+
+	if (divider < 1)
+		divider = 1;
 }
 
 fifo_stats::~fifo_stats()
@@ -12,5 +16,6 @@ fifo_stats::~fifo_stats()
 
 void fifo_stats::count(const int value)
 {
-	counters[value / divider]++;
+	// called concurrently by the (lock-free) fifo producers
+	stats_inc_counter(&counters[std::min(value / divider, up_size - 1)]);
 }
@@ -1,5 +1,6 @@
 // (C) 2022 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
 #pragma once
+#include <algorithm>
 #include <stdint.h>
 
 static constexpr int up_size = 100;
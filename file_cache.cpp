@@ -0,0 +1,411 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "file_cache.h"
+#include "log.h"
+#include "str.h"
+#include "utils.h"
+
+
+constexpr uint32_t inotify_mask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+const std::vector<uint8_t> & file_cache_entry::get_content(const file_encoding_t fe) const
+{
+	if (fe == fe_gzip)
+		return gzip;
+
+	if (fe == fe_deflate)
+		return deflate;
+
+	return data;
+}
+
+file_cache::file_cache(stats *const s, const std::string & name, const size_t max_size) :
+	max_size(max_size),
+	max_file_size(max_size / 16)
+{
+	file_cache_size        = s->register_stat(name + "_file_cache_size");
+	file_cache_entries     = s->register_stat(name + "_file_cache_entries");
+	file_cache_hit_ratio   = s->register_stat(name + "_file_cache_hit_ratio");  // average
+	file_cache_bytes_saved = s->register_stat(name + "_file_cache_bytes_saved");
+	file_cache_invalidated = s->register_stat(name + "_file_cache_invalidated");
+
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (inotify_fd == -1)
+		DOLOG(ll_warning, "file_cache: inotify not available (%s), checking modification times instead\n", strerror(errno));
+	else
+		th = new std::thread(&file_cache::inotify_thread, this);
+}
+
+file_cache::~file_cache()
+{
+	stop = true;
+
+	if (th) {
+		th->join();
+		delete th;
+	}
+
+	if (inotify_fd != -1)
+		close(inotify_fd);
+}
+
+// window_bits: 15 gives a zlib stream ("deflate" encoding), + 16 a gzip stream
+static std::vector<uint8_t> compress_buffer(const std::vector<uint8_t> & in, const int window_bits)
+{
+	z_stream strm { 0 };
+
+	if (deflateInit2(&strm, Z_BEST_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return { };
+
+	std::vector<uint8_t> out(deflateBound(&strm, in.size()));
+
+	strm.next_in   = const_cast<Bytef *>(in.data());
+	strm.avail_in  = in.size();
+	strm.next_out  = out.data();
+	strm.avail_out = out.size();
+
+	int    rc = deflate(&strm, Z_FINISH);
+	size_t n  = out.size() - strm.avail_out;
+
+	deflateEnd(&strm);
+
+	// not worth it
+	if (rc != Z_STREAM_END || n >= in.size())
+		return { };
+
+	out.resize(n);
+
+	return out;
+}
+
+static bool is_compressible(const std::string & mime_type)
+{
+	return mime_type.substr(0, 5) == "text/" || mime_type == "application/json" || mime_type == "application/javascript" || mime_type == "image/svg+xml";
+}
+
+std::shared_ptr<file_cache_entry> file_cache::load(const std::string & path, const std::string & mime_type) const
+{
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		DOLOG(ll_debug, "file_cache: cannot open %s: %s\n", path.c_str(), strerror(errno));
+
+		return nullptr;
+	}
+
+	struct stat st { 0 };
+
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+
+		return nullptr;
+	}
+
+	auto e = std::make_shared<file_cache_entry>();
+
+	e->path  = path;
+	e->mtime = st.st_mtim;
+	e->size  = st.st_size;
+
+	e->data.resize(e->size);
+
+	bool ok = READ(fd, e->data.data(), e->size) == ssize_t(e->size);
+
+	close(fd);
+
+	if (!ok) {
+		DOLOG(ll_debug, "file_cache: short read on %s\n", path.c_str());
+
+		return nullptr;
+	}
+
+	// files too large to be cached are not compressed either
+	if (e->size >= 256 && e->size <= max_file_size && is_compressible(mime_type)) {
+		e->gzip    = compress_buffer(e->data, 15 + 16);
+		e->deflate = compress_buffer(e->data, 15);
+	}
+
+	e->etag = myformat("\"%zx-%lx.%lx\"", e->size, long(e->mtime.tv_sec), long(e->mtime.tv_nsec));
+
+	tm tm { 0 };
+	gmtime_r(&e->mtime.tv_sec, &tm);
+
+	char buffer[64] { 0 };
+	strftime(buffer, sizeof buffer, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+	e->last_modified = buffer;
+
+	std::string vary = e->gzip.empty() && e->deflate.empty() ? "" : "Vary: Accept-Encoding\r\n";
+	std::string validators = "ETag: " + e->etag + "\r\nLast-Modified: " + e->last_modified + "\r\n" + vary;
+
+	constexpr const char *const encodings[] = { "", "Content-Encoding: gzip\r\n", "Content-Encoding: deflate\r\n" };
+
+	for(int i=0; i<3; i++)
+		e->headers[i] = myformat("Content-Type: %s\r\nContent-Length: %zu\r\n%s", mime_type.c_str(), e->get_content(file_encoding_t(i)).size(), encodings[i]) + validators;
+
+	e->headers_304 = validators;
+
+	return e;
+}
+
+// watches the directory of 'path'; returns false if changes to it won't be
+// reported
+bool file_cache::watch(const std::string & path)
+{
+	if (inotify_fd == -1)
+		return false;
+
+	std::size_t slash = path.rfind('/');
+	std::string dir   = slash == std::string::npos ? "." : path.substr(0, slash);
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	if (watched_dirs.find(dir) != watched_dirs.end())
+		return true;
+
+	int wd = inotify_add_watch(inotify_fd, dir.empty() ? "/" : dir.c_str(), inotify_mask);
+
+	if (wd == -1) {
+		DOLOG(ll_debug, "file_cache: cannot watch %s: %s\n", dir.c_str(), strerror(errno));
+
+		return false;
+	}
+
+	watches[wd].insert(dir);
+	watched_dirs.insert({ dir, wd });
+
+	return true;
+}
+
+void file_cache::erase(const std::string & path)
+{
+	auto it = index.find(path);
+
+	if (it == index.end())
+		return;
+
+	cur_size -= (*it->second)->get_memory_usage();
+
+	lru.erase(it->second);
+	index.erase(it);
+}
+
+void file_cache::erase_directory(const std::string & dir)
+{
+	for(auto it = lru.begin(); it != lru.end();) {
+		const std::string & path = (*it)->path;
+
+		if (path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 && path.at(dir.size()) == '/') {
+			cur_size -= (*it)->get_memory_usage();
+
+			index.erase(path);
+			it = lru.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	watched_dirs.erase(dir);
+}
+
+void file_cache::inotify_thread()
+{
+	set_thread_name("myip-filecache");
+
+	while(!stop) {
+		pollfd fds[] { { inotify_fd, POLLIN, 0 } };
+
+		if (poll(fds, 1, 500) <= 0)
+			continue;
+
+		char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+		ssize_t n = read(inotify_fd, buffer, sizeof buffer);
+
+		if (n <= 0)
+			continue;
+
+		std::unique_lock<std::mutex> lck(lock);
+
+		for(ssize_t offset = 0; offset < n;) {
+			const inotify_event *ev = reinterpret_cast<const inotify_event *>(&buffer[offset]);
+
+			offset += sizeof(inotify_event) + ev->len;
+
+			n_invalidations++;
+
+			if (ev->mask & IN_Q_OVERFLOW) {
+				DOLOG(ll_info, "file_cache: inotify queue overflow, flushing cache\n");
+
+				lru.clear();
+				index.clear();
+				cur_size = 0;
+
+				continue;
+			}
+
+			auto it = watches.find(ev->wd);
+
+			if (it == watches.end())
+				continue;
+
+			if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+				for(auto & dir : it->second)
+					erase_directory(dir);
+
+				if (ev->mask & IN_IGNORED)
+					watches.erase(it);
+				else
+					inotify_rm_watch(inotify_fd, ev->wd);  // results in an IN_IGNORED
+			}
+			else if (ev->len) {
+				for(auto & dir : it->second) {
+					if (index.find(dir + "/" + ev->name) != index.end())
+						stats_inc_counter(file_cache_invalidated);
+
+					erase(dir + "/" + ev->name);
+				}
+			}
+		}
+
+		stats_set(file_cache_size, cur_size);
+		stats_set(file_cache_entries, index.size());
+	}
+}
+
+std::shared_ptr<const file_cache_entry> file_cache::get(const std::string & path, const std::string & mime_type)
+{
+	uint64_t invalidations_before = 0;
+
+	{
+		std::unique_lock<std::mutex> lck(lock);
+
+		auto it = index.find(path);
+
+		if (it != index.end()) {
+			std::shared_ptr<const file_cache_entry> e = *it->second;
+
+			bool valid = e->watched;
+
+			if (!valid) {
+				struct stat st { 0 };
+
+				valid = stat(path.c_str(), &st) == 0 && st.st_mtim.tv_sec == e->mtime.tv_sec && st.st_mtim.tv_nsec == e->mtime.tv_nsec && size_t(st.st_size) == e->size;
+			}
+
+			if (valid) {
+				lru.splice(lru.begin(), lru, it->second);
+
+				stats_add_average(file_cache_hit_ratio, 100);
+
+				return e;
+			}
+
+			erase(path);
+
+			stats_inc_counter(file_cache_invalidated);
+		}
+
+		invalidations_before = n_invalidations;
+	}
+
+	stats_add_average(file_cache_hit_ratio, 0);
+
+	// watch before reading so that a change during the read is not missed
+	bool watched = watch(path);
+
+	auto e = load(path, mime_type);
+
+	if (!e || e->size > max_file_size)
+		return e;
+
+	std::unique_lock<std::mutex> lck(lock);
+
+	// something changed in between: keep it, but check the mtime when used
+	e->watched = watched && invalidations_before == n_invalidations;
+
+	erase(path);  // may have been added by an other thread
+
+	lru.push_front(e);
+	index.insert({ path, lru.begin() });
+	cur_size += e->get_memory_usage();
+
+	while(cur_size > max_size && lru.size() > 1) {
+		auto & oldest = lru.back();
+
+		cur_size -= oldest->get_memory_usage();
+
+		index.erase(oldest->path);
+		lru.pop_back();
+	}
+
+	stats_set(file_cache_size, cur_size);
+	stats_set(file_cache_entries, index.size());
+
+	return e;
+}
+
+void file_cache::add_bytes_saved(const size_t n)
+{
+	stats_add_counter(file_cache_bytes_saved, n);
+}
+
+file_encoding_t select_file_encoding(const file_cache_entry & e, const std::optional<std::string> & accept_encoding)
+{
+	if (accept_encoding.has_value() == false)
+		return fe_identity;
+
+	bool gzip    = false;
+	bool deflate = false;
+
+	for(auto & part : split(str_tolower(accept_encoding.value()), ",")) {
+		auto parameters = split(part, ";");
+
+		if (parameters.empty())
+			continue;
+
+		std::string coding = parameters.at(0);
+
+		while(coding.empty() == false && coding.at(0) == ' ')
+			coding.erase(0, 1);
+
+		while(coding.empty() == false && coding.back() == ' ')
+			coding.pop_back();
+
+		// "gzip;q=0" means: not gzip
+		if (parameters.size() >= 2) {
+			std::size_t q = parameters.at(1).find("q=");
+
+			if (q != std::string::npos && atof(parameters.at(1).substr(q + 2).c_str()) <= 0.)
+				continue;
+		}
+
+		if (coding == "gzip" || coding == "*")
+			gzip = true;
+
+		if (coding == "deflate" || coding == "*")
+			deflate = true;
+	}
+
+	gzip    = gzip    && e.gzip.empty()    == false;
+	deflate = deflate && e.deflate.empty() == false;
+
+	if (gzip && (deflate == false || e.gzip.size() <= e.deflate.size()))
+		return fe_gzip;
+
+	if (deflate)
+		return fe_deflate;
+
+	return fe_identity;
+}
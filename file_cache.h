@@ -0,0 +1,95 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <unordered_map>
+#include <vector>
+
+#include "stats.h"
+
+
+typedef enum { fe_identity, fe_gzip, fe_deflate } file_encoding_t;
+
+// a file as it is sent by the web server; never changed after it was
+// constructed so it can be used without holding the lock of the cache
+class file_cache_entry
+{
+public:
+	std::string          path;
+
+	timespec             mtime   { 0, 0 };
+	size_t               size    { 0 };
+	bool                 watched { false };  // invalidated by inotify, else by an mtime check
+
+	std::vector<uint8_t> data;
+	std::vector<uint8_t> gzip;     // empty when compression did not help
+	std::vector<uint8_t> deflate;
+
+	std::string          etag;
+	std::string          last_modified;
+
+	// precomputed response headers, one per encoding, and for a 304 reply
+	std::string          headers[3];
+	std::string          headers_304;
+
+	size_t get_memory_usage() const { return data.size() + gzip.size() + deflate.size(); }
+
+	const std::vector<uint8_t> & get_content(const file_encoding_t fe) const;
+};
+
+// LRU cache of static files for the web server
+class file_cache
+{
+private:
+	typedef std::list<std::shared_ptr<const file_cache_entry> > lru_t;
+
+	const size_t max_size      { 0 };
+	const size_t max_file_size { 0 };
+
+	std::mutex   lock;
+	lru_t        lru;  // most recently used in front
+	std::unordered_map<std::string, lru_t::iterator> index;
+	size_t       cur_size      { 0 };
+
+	int          inotify_fd    { -1 };
+	// watch descriptor -> directory; "dir" and "dir/" give the same descriptor
+	std::map<int, std::set<std::string> > watches;
+	std::map<std::string, int> watched_dirs;
+	uint64_t     n_invalidations { 0 };  // detects changes while a file is being loaded
+
+	std::atomic_bool stop      { false };
+	std::thread     *th        { nullptr };
+
+	uint64_t *file_cache_size        { nullptr };
+	uint64_t *file_cache_entries     { nullptr };
+	uint64_t *file_cache_hit_ratio   { nullptr };  // average of 0 (miss) and 100 (hit)
+	uint64_t *file_cache_bytes_saved { nullptr };
+	uint64_t *file_cache_invalidated { nullptr };
+
+	std::shared_ptr<file_cache_entry> load(const std::string & path, const std::string & mime_type) const;
+	bool watch(const std::string & path);
+	void erase(const std::string & path);  // lock must be held
+	void erase_directory(const std::string & dir);
+	void inotify_thread();
+
+public:
+	file_cache(stats *const s, const std::string & name, const size_t max_size);
+	virtual ~file_cache();
+
+	// nullptr if the file cannot be read
+	std::shared_ptr<const file_cache_entry> get(const std::string & path, const std::string & mime_type);
+
+	void add_bytes_saved(const size_t n);
+};
+
+// picks the smallest variant the client accepts (Accept-Encoding header)
+file_encoding_t select_file_encoding(const file_cache_entry & e, const std::optional<std::string> & accept_encoding);
@@ -1,6 +1,7 @@
 // (C) 2020-2023 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
 #include <ctype.h>
 #include <errno.h>
+#include <functional>
 #include <optional>
 #include <signal.h>
 #include <stdexcept>
@@ -14,18 +15,46 @@
 #include <sys/types.h>
 
 #include "BearSSLHelpers.h"
+#include "fifo_stats.h"
+#include "file_cache.h"
 #include "ipv4.h"
 #include "log.h"
 #include "proc.h"
 #include "stats_utils.h"
 #include "str.h"
 #include "tcp.h"
+#include "time.h"
 #include "types.h"
 #include "utils.h"
 
 
 using namespace std::chrono_literals;
 
+constexpr int    http_keepalive_timeout      = 15;  // seconds a persistent connection may be idle
+constexpr int    http_request_timeout        = 5;  // seconds a new session has to send its request
+// seconds a worker waits for a client that does not read; shorter than
+// http_request_timeout so that sessions that wait for a worker get one
+constexpr int    http_send_timeout           = 3;
+constexpr int    http_max_keepalive_requests = 100;
+constexpr size_t http_max_request_size       = 65536;
+
+typedef std::function<bool(const uint8_t *const data, const size_t len)> http_send_t;
+
+std::string get_connection_header(const bool keep_alive)
+{
+	if (keep_alive)
+		return myformat("Connection: keep-alive\r\nKeep-Alive: timeout=%d, max=%d\r\n", http_keepalive_timeout, http_max_keepalive_requests);
+
+	return "Connection: close\r\n";
+}
+
+std::string http_cgi_response_header(const std::string & version, const bool keep_alive, const bool chunked, const std::string & cgi_header)
+{
+	std::string cgi_lines = cgi_header.empty() ? "" : cgi_header + "\r\n";
+
+	return myformat("%s 200 OK\r\nServer: MyIP\r\n%s%s%s\r\n", version.c_str(), get_connection_header(keep_alive).c_str(), chunked ? "Transfer-Encoding: chunked\r\n" : "", cgi_lines.c_str());
+}
+
 std::vector<uint8_t> str_to_vector(const std::string & in)
 {
 	return std::vector<uint8_t>(reinterpret_cast<const uint8_t *>(in.c_str()), reinterpret_cast<const uint8_t *>(in.c_str() + in.size()));
@@ -67,19 +96,20 @@ std::vector<std::string> request_to_env(const std::string & request)
 	return out;
 }
 
-std::optional<std::string> invoke_cgi(const std::string & bin, const std::string & path, const std::string & request)
+// output is called for every block read from the CGI binary
+bool invoke_cgi(const std::string & bin, const std::string & path, const std::string & request, const std::function<bool(const char *const data, const size_t len)> & output)
 {
 	std::vector<std::string> env = request_to_env(request);
 
 	// TODO: send vector of strings because of potential spaces in path names
 	auto proc = exec_with_pipe(bin + " -e " + path, "", env);
 
-	std::string out;
+	bool ok = true;
 
 	for(;;) {
-		char buffer[4097] { 0 };
+		char buffer[4096];
 
-		int rc = read(std::get<1>(proc), buffer, sizeof buffer - 1);
+		int rc = read(std::get<1>(proc), buffer, sizeof buffer);
 
 		if (rc == 0 || (rc == -1 && errno == EIO))
 			break;
@@ -87,22 +117,72 @@ std::optional<std::string> invoke_cgi(const std::string & bin, const std::string
 		if (rc == -1) {
 			DOLOG(ll_info, "invoke_cgi(%s): %s\n", bin.c_str(), strerror(errno));
 
-			close(std::get<1>(proc));
+			ok = false;
 
-			return { };
+			break;
 		}
 
-		out += buffer;
+		if (!output(buffer, rc)) {
+			ok = false;
+
+			break;
+		}
 	}
 
 	close(std::get<1>(proc));
 
 	kill(std::get<0>(proc), SIGTERM);
 
-	return out;
+	return ok;
+}
+
+// length of the first request (header + body) in 'data', if it is complete
+std::optional<size_t> http_request_length(const char *const data, const size_t len)
+{
+	const char *end_marker = strstr(data, "\r\n\r\n");
+
+	if (!end_marker)
+		return { };
+
+	size_t header_len = end_marker - data + 4;
+
+	std::vector<std::string> lines = split(std::string(data, header_len - 4), "\r\n");
+
+	auto content_length = find_header(&lines, "Content-Length", ":");
+
+	size_t body_len = content_length.has_value() ? strtoul(content_length.value().c_str(), nullptr, 10) : 0;
+
+	if (header_len + body_len > len)
+		return { };
+
+	return header_len + body_len;
+}
+
+// conditional request (If-None-Match or If-Modified-Since) for an unchanged file?
+bool is_not_modified(const std::vector<std::string> & lines, const file_cache_entry & file)
+{
+	auto if_none_match = find_header(&lines, "If-None-Match", ":");
+
+	// If-Modified-Since is ignored when there's an If-None-Match
+	if (if_none_match.has_value())
+		return if_none_match.value() == "*" || if_none_match.value().find(file.etag) != std::string::npos;
+
+	auto if_modified_since = find_header(&lines, "If-Modified-Since", ":");
+
+	if (if_modified_since.has_value() == false)
+		return false;
+
+	tm tm { 0 };
+
+	if (strptime(if_modified_since.value().c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm) == nullptr)
+		return false;
+
+	return file.mtime.tv_sec <= timegm(&tm);
 }
 
-std::optional<std::pair<std::string, std::vector<uint8_t> > > generate_response(session *const ts, const std::string & request)
+// n_requests: number of requests handled before on this connection
+// returns true if the connection can be kept open for the next request
+bool generate_response(session *const ts, const std::string & request, const int n_requests, const http_send_t & send)
 {
 	http_session_data *hs  = dynamic_cast<http_session_data *>(ts->get_callback_private_data());
 	http_private_data *hpd = dynamic_cast<http_private_data *>(ts->get_application_private_data());
@@ -118,7 +198,7 @@ std::optional<std::pair<std::string, std::vector<uint8_t> > > generate_response(
 
 		stats_inc_counter(hpd->http_r_err);
 
-		return { };
+		return false;
 	}
 
 	std::vector<std::string> lines = split(request.substr(0, end_marker), "\r\n");
@@ -128,7 +208,7 @@ std::optional<std::pair<std::string, std::vector<uint8_t> > > generate_response(
 
 		stats_inc_counter(hpd->http_r_err);
 
-		return { };
+		return false;
 	}
 
 	auto parts = split(lines.at(0), " ");
@@ -138,9 +218,19 @@ std::optional<std::pair<std::string, std::vector<uint8_t> > > generate_response(
 
 		stats_inc_counter(hpd->http_r_err);
 
-		return { };
+		return false;
 	}
 
+	// HTTP/1.1 keeps the connection open unless asked otherwise, 1.0 only when asked
+	const bool  http_11    = parts.at(2) == "HTTP/1.1";
+	auto        connection = find_header(&lines, "Connection", ":");
+	bool        keep_alive = connection.has_value() ? str_tolower(connection.value()) == "keep-alive" : http_11;
+
+	if (n_requests + 1 >= http_max_keepalive_requests || hs->terminate)
+		keep_alive = false;
+
+	std::string version    = http_11 ? "HTTP/1.1" : "HTTP/1.0";
+
 	std::string url  = parts.at(1);
 
 	int         rc   = 200;
@@ -160,14 +250,22 @@ std::optional<std::pair<std::string, std::vector<uint8_t> > > generate_response(
 		mime_type = "text/html";
 	else if (ext == ".ico")
 		mime_type = "image/x-icon";
+	else if (ext == ".css")
+		mime_type = "text/css";
+	else if (ext == ".js")
+		mime_type = "application/javascript";
+	else if (ext == ".svg")
+		mime_type = "image/svg+xml";
 
 	std::size_t php_extension = url.rfind(".php");
 
-	std::string header;
-
 	std::vector<uint8_t> content;
 
-	size_t file_size = 0;
+	size_t file_size  = 0;
+	size_t bytes_sent = 0;
+	bool   sent       = false;  // response already sent (CGI, static files)
+	bool   send_ok    = true;
+
 	if (url.find("..") != std::string::npos) {
 		rc      = 500;
 		content = str_to_vector("Server error.");
@@ -182,76 +280,155 @@ std::optional<std::pair<std::string, std::vector<uint8_t> > > generate_response(
 		DOLOG(ll_debug, "HTTP: requested file \"%s\" does not exist\n", path.c_str());
 	}
 	else if (php_extension != std::string::npos && php_cgi.empty() == false) {
-		auto reply = invoke_cgi(php_cgi, path, request);
+		// the output is sent while the CGI binary produces it: in chunks for
+		// HTTP/1.1 clients, else as is and the end of the connection marks
+		// the end of the reply
+		std::string cgi_header;
+		bool        chunked = false;
 
-		if (reply.has_value() == false) {
-			rc = 500;
-			DOLOG(ll_debug, "HTTP: failed invoking %s for %s\n", php_cgi.c_str(), path.c_str());
-		}
-		else {
-			std::string text = reply.value();
+		auto send_body = [&](const char *const data, const size_t len) {
+			if (len == 0)
+				return true;
+
+			bytes_sent += len;
+
+			if (chunked) {
+				std::string chunk_header = myformat("%zx\r\n", len);
+
+				return send(reinterpret_cast<const uint8_t *>(chunk_header.c_str()), chunk_header.size()) &&
+					send(reinterpret_cast<const uint8_t *>(data), len) &&
+					send(reinterpret_cast<const uint8_t *>("\r\n"), 2);
+			}
+
+			return send(reinterpret_cast<const uint8_t *>(data), len);
+		};
+
+		auto output = [&](const char *const data, const size_t len) {
+			if (hs->terminate)
+				return false;
+
+			if (sent)
+				return send_ok = send_body(data, len);
+
+			cgi_header.append(data, len);
 
 			int cr = 0;
 			int lf = 0;
 
-			for(size_t i=0; i<text.size(); i++) {
-				if (text.at(i) == '\r')
+			for(size_t i=0; i<cgi_header.size(); i++) {
+				if (cgi_header.at(i) == '\r')
 					cr++;
-				else if (text.at(i) == '\n') 
+				else if (cgi_header.at(i) == '\n') 
 					lf++;
 				else
 					cr = lf = 0;
 
 				if (cr >= 2 && lf >= 2) {
-					header  = text.substr(0, i);
-					content = str_to_vector(text.substr(i));
-					break;
+					std::string header = cgi_header.substr(0, i - 3);
+					std::string body   = cgi_header.substr(i + 1);
+
+					// the CGI binary may give the length itself
+					bool has_length = str_tolower(header).find("content-length:") != std::string::npos;
+
+					chunked = http_11 && !has_length;
+
+					if (!has_length && !http_11)
+						keep_alive = false;
+
+					header = http_cgi_response_header(version, keep_alive, chunked, header);
+
+					sent    = true;
+					send_ok = send(reinterpret_cast<const uint8_t *>(header.c_str()), header.size()) && send_body(body.c_str(), body.size());
+
+					stats_inc_counter(hpd->http_r_200);
+
+					return send_ok;
 				}
 			}
 
-			if (content.empty() && header.empty()) {
-				rc = 500;
-				DOLOG(ll_debug, "HTTP: no response headers in PHP-CGI output\n");
-			}
+			return true;
+		};
+
+		if (invoke_cgi(php_cgi, path, request, output) == false && !sent) {
+			rc = 500;
+			content = str_to_vector("Cannot invoke CGI.");
+			DOLOG(ll_debug, "HTTP: failed invoking %s for %s\n", php_cgi.c_str(), path.c_str());
+		}
+		else if (!sent) {
+			rc = 500;
+			content = str_to_vector("No headers in CGI output.");
+			DOLOG(ll_debug, "HTTP: no response headers in PHP-CGI output\n");
+		}
+		else if (chunked && send_ok) {
+			send_ok = send(reinterpret_cast<const uint8_t *>("0\r\n\r\n"), 5);
 		}
 	}
 	else {
-		content.resize(file_size);
-
-		FILE *fh = fopen(path.c_str(), "rb");
-		if (fh) {
-			int frc = fread(content.data(), 1, file_size, fh);
-			fclose(fh);
+		auto file = hpd->fc->get(path, mime_type);
 
-			if (size_t(frc) != file_size) {
-				rc      = 500;
-				content = str_to_vector("Cannot read file.");
-			}
+		if (!file) {
+			rc      = 500;
+			content = str_to_vector("Cannot read file.");
 		}
 		else {
-			rc      = 500;
-			content = str_to_vector("File disappeared before it could be read.");
+			std::string header;
+
+			if (is_not_modified(lines, *file)) {
+				rc     = 304;
+				header = version + " 304 Not Modified\r\nServer: MyIP\r\n" + file->headers_304 + get_connection_header(keep_alive) + "\r\n";
+
+				send_ok = send(reinterpret_cast<const uint8_t *>(header.c_str()), header.size());
+
+				hpd->fc->add_bytes_saved(file->size);
+
+				stats_inc_counter(hpd->http_r_304);
+			}
+			else {
+				file_encoding_t fe   = select_file_encoding(*file, find_header(&lines, "Accept-Encoding", ":"));
+				auto          & body = file->get_content(fe);
+
+				header = version + " 200 OK\r\nServer: MyIP\r\n" + file->headers[fe] + get_connection_header(keep_alive) + "\r\n";
+
+				send_ok = send(reinterpret_cast<const uint8_t *>(header.c_str()), header.size()) && send(body.data(), body.size());
+
+				bytes_sent = body.size();
+
+				hpd->fc->add_bytes_saved(file->size - body.size());
+
+				stats_inc_counter(hpd->http_r_200);
+			}
+
+			sent = true;
 		}
 	}
 
-	if (rc == 200) {
-		if (header.empty()) {
-			header = myformat("HTTP/1.0 %d OK\r\nServer: MyIP\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", rc, mime_type.c_str(), content.size());
+	if (!sent) {
+		std::string header;
+
+		if (rc == 200) {
+			header = myformat("%s %d OK\r\nServer: MyIP\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%s\r\n", version.c_str(), rc, mime_type.c_str(), content.size(), get_connection_header(keep_alive).c_str());
 			stats_inc_counter(hpd->http_r_200);
 		}
 		else {
-			header = myformat("HTTP/1.0 %d OK\r\nServer: MyIP\r\nConnection: close\r\n%s\r\n", rc, header.c_str());
+			header = myformat("%s %d Something is wrong\r\nServer: MyIP\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n%s\r\n", version.c_str(), rc, content.size(), get_connection_header(keep_alive).c_str());
+
+			if (rc == 404)
+				stats_inc_counter(hpd->http_r_404);
+			else if (rc == 500)
+				stats_inc_counter(hpd->http_r_500);
 		}
-	}
-	else {
-		header = myformat("HTTP/1.0 %d Something is wrong\r\nServer: MyIP\r\nConnection: close\r\n\r\n", rc);
 
-		if (rc == 404)
-			stats_inc_counter(hpd->http_r_404);
-		else if (rc == 500)
-			stats_inc_counter(hpd->http_r_500);
+		send_ok = send(reinterpret_cast<const uint8_t *>(header.c_str()), header.size());
+
+		if (send_ok && content.empty() == false)
+			send_ok = send(content.data(), content.size());
+
+		bytes_sent = content.size();
 	}
 
+	if (n_requests > 0)
+		stats_inc_counter(hpd->http_r_keepalive);
+
 	DOLOG(ll_debug, "HTTP: Send response %d for %s: %s\n", rc, hs->client_addr.c_str(), url.c_str());
 
 	FILE *fh = fopen(logfile.c_str(), "a+");
@@ -266,12 +443,12 @@ std::optional<std::pair<std::string, std::vector<uint8_t> > > generate_response(
 		auto referer    = find_header(&lines, "Referer",    ":");
 		auto user_agent = find_header(&lines, "User-Agent", ":");
 
-		fprintf(fh, "%s - - [%02d/%s/%04d:%02d:%02d:%02d +0000] \"%s\" %d %ld \"%s\" \"%s\"\n",
+		fprintf(fh, "%s - - [%02d/%s/%04d:%02d:%02d:%02d +0000] \"%s\" %d %zu \"%s\" \"%s\"\n",
 				hs->client_addr.c_str(),
 				tm.tm_mday, month[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec,
 				(parts.at(0) + " " + parts.at(1) + " " + parts.at(2)).c_str(),
 				rc,
-				content.size(),
+				bytes_sent,
 				(referer.has_value()    ? referer.value()    : "-").c_str(),
 				(user_agent.has_value() ? user_agent.value() : "-").c_str());
 
@@ -281,230 +458,483 @@ std::optional<std::pair<std::string, std::vector<uint8_t> > > generate_response(
 		DOLOG(ll_error, "HTTP: Cannot access log file (%s): %s\n", logfile.c_str(), strerror(errno));
 	}
 
-	return { { header, content } };
+	return send_ok && keep_alive;
 }
 
-void http_thread(session *ts)
+// requests that were received completely are removed from 'buffer', in order
+std::optional<std::string> http_take_request(std::string *const buffer)
 {
-	try {
-		set_thread_name("myip-http");
+	if (buffer->empty())
+		return { };
 
-		http_session_data *hs = dynamic_cast<http_session_data *>(ts->get_callback_private_data());
+	auto len = http_request_length(buffer->c_str(), buffer->size());
 
-		std::unique_lock<std::mutex> lck(hs->r_lock);
+	if (len.has_value() == false)
+		return { };
 
-		for(;hs->terminate == false;) {
-			if (hs->req_data) {
-				char *end_marker = strstr(hs->req_data, "\r\n\r\n");
-				if (end_marker) {
-					auto rc = generate_response(ts, hs->req_data);
+	std::string request = buffer->substr(0, len.value());
 
-					lck.unlock();
+	buffer->erase(0, len.value());
 
-					if (rc.has_value()) {
-						if (ts->get_stream_target()->send_data(ts, reinterpret_cast<const uint8_t *>(rc.value().first.c_str()), rc.value().first.size())) {
-							if (rc.value().second.empty() == false)
-								ts->get_stream_target()->send_data(ts, rc.value().second.data(), rc.value().second.size());
-						}
-					}
+	return request;
+}
 
-					ts->get_stream_target()->end_session(ts);
+// BearSSL's LRU session cache is not thread safe; the workers do handshakes
+// concurrently so this wrapper serializes the accesses
+typedef struct {
+	const br_ssl_session_cache_class  *vtable;  // must be the first member
+	const br_ssl_session_cache_class **lru;
+	std::mutex                         lock;
 
-					DOLOG(ll_debug, "http session finished\n");
+	uint64_t *https_tls_full;
+	uint64_t *https_tls_resumed;
+} https_session_cache;
 
-					break;
-				}
-			}
+static void https_session_cache_save(const br_ssl_session_cache_class **ctx, br_ssl_server_context *server_ctx, const br_ssl_session_parameters *params)
+{
+	https_session_cache *const c = reinterpret_cast<https_session_cache *>(ctx);
 
-			hs->r_cond.wait_for(lck, 500ms);
-		}
+	const std::lock_guard<std::mutex> lck(c->lock);
 
-		if (hs->terminate)
-			DOLOG(ll_debug, "http_thread: terminate flag set\n");
-	}
-	catch(const std::runtime_error & error) {
-		DOLOG(ll_error, myformat("http: thread error \"%s\"", error.what()).c_str());
-	}
-	catch(...) {
-		DOLOG(ll_error, "http: generic thread error");
-	}
+	(*c->lru)->save(c->lru, server_ctx, params);
+
+	stats_inc_counter(c->https_tls_full);
 }
 
-typedef struct {
-	http_session_data *hs;
-	session           *s;
-} https_ctx;
+static int https_session_cache_load(const br_ssl_session_cache_class **ctx, br_ssl_server_context *server_ctx, br_ssl_session_parameters *params)
+{
+	https_session_cache *const c = reinterpret_cast<https_session_cache *>(ctx);
+
+	const std::lock_guard<std::mutex> lck(c->lock);
+
+	int rc = (*c->lru)->load(c->lru, server_ctx, params);
+
+	if (rc)
+		stats_inc_counter(c->https_tls_resumed);
+
+	return rc;
+}
+
+static const br_ssl_session_cache_class https_session_cache_vtable {
+	sizeof(https_session_cache),
+	https_session_cache_save,
+	https_session_cache_load
+};
 
-int sock_read(void *ctx, unsigned char *buf, size_t len)
+// state shared by all sessions of an HTTPS handler: the certificate and key
+// are parsed once, sessions can be resumed on a new connection
+class https_context
 {
-	https_ctx *const hc = reinterpret_cast<https_ctx *>(ctx);
+public:
+	https_context(stats *const s, const std::string & certificate, const std::string & private_key, const int n_sessions) :
+		c(certificate.c_str()),
+		pk(private_key.c_str()),
+		sessions(n_sessions),
+		handshake_ms(1000)
+	{
+		cache.vtable            = &https_session_cache_vtable;
+		cache.lru               = sessions.getCache();
+		cache.https_tls_full    = s->register_stat("https_tls_full");
+		cache.https_tls_resumed = s->register_stat("https_tls_resumed");
+
+		https_handshake_us      = s->register_stat("https_handshake_us");  // average
+
+		s->register_fifo_stats("https-handshake-ms", &handshake_ms);  // histogram, 10 ms buckets
+	}
 
-	std::unique_lock<std::mutex> lck(hc->hs->r_lock);
+	BearSSL::X509List        c;
+	BearSSL::PrivateKey      pk;
+	BearSSL::ServerSessions  sessions;
+	https_session_cache      cache;
 
-	while(!hc->s->get_is_terminating()) {
-		if (hc->hs->req_len > 0) {
-			size_t n_todo = std::min(len, hc->hs->req_len);
+	fifo_stats               handshake_ms;
+	uint64_t                *https_handshake_us { nullptr };
+};
 
-			memcpy(buf, hc->hs->req_data, n_todo);
+// BearSSL server state of one HTTPS session, driven without blocking I/O
+class https_engine
+{
+public:
+	https_context        *ctx { nullptr };
 
-			size_t left = hc->hs->req_len - n_todo;
+	br_ssl_server_context sc { 0 };
+	unsigned char         iobuf[BR_SSL_BUFSIZE_BIDI] { 0 };
 
-			if (left > 0)
-				memmove(&hc->hs->req_data[0], &hc->hs->req_data[n_todo], left);
+	uint64_t              handshake_start { 0 };  // first record received
+	bool                  handshake_done  { false };
 
-			hc->hs->req_len -= n_todo;
+	std::string           app_data;  // decrypted, not yet processed
+};
 
-			return n_todo;
-		}
+bool https_load_credentials(http_private_data *const hpd, const int n_tls_sessions)
+{
+	https_context *ctx = new https_context(hpd->s, hpd->certificate, hpd->private_key, n_tls_sessions);
 
-		if (hc->hs->terminate)
-			break;
+	if (ctx->c.getCount() == 0 || (ctx->pk.isRSA() == false && ctx->pk.isEC() == false)) {
+		DOLOG(ll_error, "https: certificate or private key (RSA or EC) is invalid\n");
 
-		hc->hs->r_cond.wait_for(lck, 250ms);
+		delete ctx;
+
+		return false;
 	}
 
-	DOLOG(ll_debug, "sock_read fail return\n");
+	DOLOG(ll_debug, "https: private key is an %s key, session cache for %u sessions\n", ctx->pk.isRSA() ? "RSA" : "EC", ctx->sessions.size());
 
-	return -1;
+	delete hpd->tls;
+
+	hpd->tls = ctx;
+
+	return true;
 }
 
-int sock_write(void *ctx, const unsigned char *buf, size_t len)
+https_engine *https_engine_new(const http_private_data *const hpd)
 {
-	https_ctx *const hc = reinterpret_cast<https_ctx *>(ctx);
+	https_context *ctx = hpd->tls;
+
+	if (!ctx)
+		error_exit(false, "https_engine_new: no certificate and private key loaded");
+
+	https_engine *e = new https_engine();
+
+	e->ctx = ctx;
+
+	const br_x509_certificate *br_c       = ctx->c.getX509Certs();
+	size_t                     br_c_count = ctx->c.getCount();
+
+	if (ctx->pk.isRSA())
+		br_ssl_server_init_full_rsa(&e->sc, br_c, br_c_count, ctx->pk.getRSA());
+	else
+		br_ssl_server_init_full_ec(&e->sc, br_c, br_c_count, BR_KEYTYPE_EC, ctx->pk.getEC());
 
-	if (hc->s->get_stream_target()->send_data(hc->s, buf, len))
-		return len;
+	if (ctx->cache.lru)
+		br_ssl_server_set_cache(&e->sc, &ctx->cache.vtable);
 
-	return -1;
+	br_ssl_engine_set_buffer(&e->sc.eng, e->iobuf, sizeof e->iobuf, 1);
+
+	if (br_ssl_server_reset(&e->sc) == 0)
+		DOLOG(ll_error, "https_engine_new: br_ssl_server_reset failed\n");
+
+	return e;
 }
 
-void https_thread(session *ts)
+// feeds the received records in 'in' to the engine until it needs more,
+// decrypted data goes to app_data, records to transmit are added to 'out'
+// returns false when the TLS session has ended
+bool https_pump(https_engine *const e, std::string *const in, std::string *const out)
 {
-        set_thread_name("myip-https");
+	br_ssl_engine_context *eng = &e->sc.eng;
 
-	try {
-		http_session_data *hs  = dynamic_cast<http_session_data *>(ts->get_callback_private_data());
-		http_private_data *hpd = dynamic_cast<http_private_data *>(ts->get_application_private_data());
+	for(;;) {
+		unsigned state = br_ssl_engine_current_state(eng);
 
-		https_ctx             hc  { hs, ts };
+		if (state & BR_SSL_CLOSED) {
+			int err = br_ssl_engine_last_error(eng);
 
-		br_ssl_server_context sc  { 0 };
-		unsigned char         iobuf[BR_SSL_BUFSIZE_BIDI] { 0 };
-		br_sslio_context      ioc { 0 };
+			if (err != BR_ERR_OK)
+				DOLOG(ll_debug, "https: TLS session ended with error %d\n", err);
+
+			return false;
+		}
 
-		BearSSL::X509List c(hpd->certificate.c_str());
-		const br_x509_certificate *br_c       = c.getX509Certs();
-		size_t                     br_c_count = c.getCount();
+		// application data can be sent once the handshake has finished
+		if ((state & BR_SSL_SENDAPP) && e->handshake_done == false) {
+			e->handshake_done = true;
 
-		BearSSL::PrivateKey pk(hpd->private_key.c_str());
+			uint64_t took = get_us() - e->handshake_start;
 
-		if (pk.isRSA()) {
-			DOLOG(ll_debug, "https: private key is an RSA key\n");
-			const br_rsa_private_key *br_pk = pk.getRSA();
+			stats_add_average(e->ctx->https_handshake_us, took);
 
-			br_ssl_server_init_full_rsa(&sc, br_c, br_c_count, br_pk);
+			e->ctx->handshake_ms.count(took / 1000);
 		}
-		else if (pk.isEC()) {
-			DOLOG(ll_debug, "https: private key is an EC key\n");
-			const br_ec_private_key *br_pk = pk.getEC();
 
-			br_ssl_server_init_full_ec(&sc, br_c, br_c_count, BR_KEYTYPE_EC, br_pk);
+		size_t len = 0;
+
+		if (state & BR_SSL_SENDREC) {
+			unsigned char *buf = br_ssl_engine_sendrec_buf(eng, &len);
+
+			out->append(reinterpret_cast<const char *>(buf), len);
+
+			br_ssl_engine_sendrec_ack(eng, len);
+		}
+		else if (state & BR_SSL_RECVAPP) {
+			unsigned char *buf = br_ssl_engine_recvapp_buf(eng, &len);
+
+			e->app_data.append(reinterpret_cast<const char *>(buf), len);
+
+			br_ssl_engine_recvapp_ack(eng, len);
+		}
+		else if ((state & BR_SSL_RECVREC) && in->empty() == false) {
+			if (e->handshake_start == 0)
+				e->handshake_start = get_us();
+
+			unsigned char *buf = br_ssl_engine_recvrec_buf(eng, &len);
+
+			size_t n = std::min(len, in->size());
+
+			memcpy(buf, in->data(), n);
+
+			in->erase(0, n);
+
+			br_ssl_engine_recvrec_ack(eng, n);
 		}
 		else {
-			error_exit(false, "https_thread: private key is not RSA or EC");
+			break;
 		}
+	}
 
-		br_ssl_engine_set_buffer(&sc.eng, iobuf, sizeof iobuf, 1);
+	return true;
+}
 
-		if (br_ssl_server_reset(&sc) == 0)
-			DOLOG(ll_error, "https_thread: br_ssl_server_reset failed\n");
+// encrypts 'data' (if any) and transmits the resulting records
+// r_lock must not be held: it is only taken while the engine is used, not
+// while sending
+bool https_write(session *const ts, http_session_data *const hs, const uint8_t *data, size_t len, const bool flush)
+{
+	br_ssl_engine_context *eng = &hs->tls->sc.eng;
 
-		br_sslio_init(&ioc, &sc.eng, sock_read, &hc, sock_write, &hc);
+	bool need_flush = flush;
 
-		std::string headers;
+	for(;;) {
+		std::string records;
+		bool        ok = true;
 
-		bool        ok      = true;
+		{
+			const std::lock_guard<std::mutex> lck(hs->r_lock);
 
-		for(;hs->terminate == false;) {
-			char buffer[4096] { 0 };
+			// send in blocks of about the size of a record
+			while(records.size() < 16384) {
+				unsigned state = br_ssl_engine_current_state(eng);
 
-			if (br_sslio_read(&ioc, buffer, sizeof(buffer) - 1) < 0) {
-				ok = false;
-				break;
-			}
+				if (state & BR_SSL_CLOSED) {
+					ok = false;
+					break;
+				}
+
+				size_t n = 0;
+
+				if (state & BR_SSL_SENDREC) {
+					unsigned char *buf = br_ssl_engine_sendrec_buf(eng, &n);
 
-			headers += buffer;
+					records.append(reinterpret_cast<const char *>(buf), n);
 
-			if (headers.find("\r\n\r\n") != std::string::npos) {
-				auto rc = generate_response(ts, headers);
+					br_ssl_engine_sendrec_ack(eng, n);
+				}
+				else if (len > 0 && (state & BR_SSL_SENDAPP)) {
+					unsigned char *buf = br_ssl_engine_sendapp_buf(eng, &n);
+
+					n = std::min(n, len);
 
-				if (rc.has_value()) {
-					if (br_sslio_write_all(&ioc, reinterpret_cast<const uint8_t *>(rc.value().first.c_str()), rc.value().first.size()) == -1) {
-						ok = false;
+					memcpy(buf, data, n);
 
-						DOLOG(ll_debug, "https_thread: br_sslio_write_all failed\n");
-					}
-					else if (rc.value().second.empty() == false) {
-						ok = br_sslio_write_all(&ioc, rc.value().second.data(), rc.value().second.size()) == 0;
+					br_ssl_engine_sendapp_ack(eng, n);
+
+					data += n;
+					len  -= n;
+				}
+				else if (len == 0 && need_flush) {
+					br_ssl_engine_flush(eng, 0);
 
-						if (!ok)
-							DOLOG(ll_debug, "https_thread: br_sslio_write_all failed\n");
-					}
+					need_flush = false;
 				}
 				else {
-					ok = false;
+					// either done or the engine waits for the peer
+					ok = len == 0;
+					break;
 				}
+			}
+		}
+
+		if (records.empty() == false && ts->get_stream_target()->send_data(ts, reinterpret_cast<const uint8_t *>(records.data()), records.size()) == false)
+			return false;
+
+		if (ok == false || (len == 0 && need_flush == false && records.empty()))
+			return ok;
+	}
+}
+
+// received bytes that were not answered yet; r_lock must be held
+static size_t http_backlog(const http_session_data *const hs)
+{
+	return hs->req_data.size() + (hs->tls ? hs->tls->app_data.size() : 0);
+}
+
+// does all that can be done for a session right now: decrypting, answering
+// complete requests, ending the session
+// runs in one of the worker threads; a session is handled by at most one
+// worker at a time ('scheduled')
+void http_process(session *const ts)
+{
+	http_session_data *hs  = dynamic_cast<http_session_data *>(ts->get_callback_private_data());
+	http_private_data *hpd = dynamic_cast<http_private_data *>(ts->get_application_private_data());
+
+	bool close     = false;
+	bool tls_ended = false;
+
+	std::unique_lock<std::mutex> lck(hs->r_lock);
 
+	while(hs->terminate == false && hs->closing == false) {
+		std::string *requests = &hs->req_data;
+
+		if (hs->tls) {
+			std::string records;
+
+			tls_ended = !https_pump(hs->tls, &hs->req_data, &records);
+
+			if (records.empty() == false) {
+				lck.unlock();
+
+				if (ts->get_stream_target()->send_data(ts, reinterpret_cast<const uint8_t *>(records.data()), records.size()) == false)
+					tls_ended = true;  // the client does not read
+
+				lck.lock();
+			}
+
+			if (tls_ended) {
+				close = true;
 				break;
 			}
+
+			requests = &hs->tls->app_data;
 		}
 
-		if (ok && hs->terminate == false) {
-			ts->set_is_terminating();
+		// pipelined requests are answered one after the other
+		auto request = http_take_request(requests);
+
+		if (request.has_value() == false) {
+			if (requests->size() > http_max_request_size) {
+				DOLOG(ll_info, "http: request too large\n");
 
-			// this often ends in a busy loop in bearssl
-			br_sslio_close(&ioc);
+				stats_inc_counter(hpd->http_r_err);
+
+				close = true;
+			}
+
+			break;
 		}
 
-		ts->get_stream_target()->end_session(ts);
+		const size_t backlog = http_backlog(hs);
+
+		lck.unlock();
+
+		// the locking order is session -> r_lock
+		ts->get_stream_target()->set_receive_backlog(ts, backlog);
+
+		bool keep_alive = false;
+
+		try {
+			// header and body in as few segments as possible
+			pstream_cork cork(ts);
+
+			if (hs->tls) {
+				auto send = [ts, hs](const uint8_t *const data, const size_t len) {
+					return https_write(ts, hs, data, len, false);
+				};
+
+				keep_alive = generate_response(ts, request.value(), hs->n_requests, send);
+
+				// the response may still be in the buffers of the TLS engine
+				if (https_write(ts, hs, nullptr, 0, true) == false)
+					keep_alive = false;
+			}
+			else {
+				auto send = [ts](const uint8_t *const data, const size_t len) {
+					return ts->get_stream_target()->send_data(ts, data, len);
+				};
+
+				keep_alive = generate_response(ts, request.value(), hs->n_requests, send);
+			}
+		}
+		catch(const std::runtime_error & error) {
+			DOLOG(ll_error, "http: error \"%s\"\n", error.what());
+		}
+
+		hs->n_requests++;
+
+		// from now on the time-out is the keep-alive idle time
+		ts->set_session_timeout(http_keepalive_timeout);
+
+		lck.lock();
+
+		if (keep_alive == false) {
+			close = true;
+			break;
+		}
 	}
-	catch(const std::runtime_error & error) {
-		DOLOG(ll_error, myformat("https: thread error \"%s\"", error.what()).c_str());
+
+	if (close && hs->terminate == false) {
+		hs->closing = true;
+
+		lck.unlock();
+
+		if (hs->tls && tls_ended == false) {
+			{
+				const std::lock_guard<std::mutex> tls_lck(hs->r_lock);
+
+				br_ssl_engine_close(&hs->tls->sc.eng);
+			}
+
+			// sends the close_notify
+			https_write(ts, hs, nullptr, 0, false);
+		}
+
+		ts->get_stream_target()->end_session(ts);
+
+		DOLOG(ll_debug, "http session finished after %d request(s)\n", hs->n_requests);
+
+		lck.lock();
 	}
-	catch(...) {
-		DOLOG(ll_error, "https: generic thread error");
+
+	hs->scheduled = false;
+
+	hs->r_cond.notify_all();
+}
+
+void http_worker(http_private_data *const hpd)
+{
+	set_thread_name(hpd->is_https ? "myip-https" : "myip-http");
+
+	for(;;) {
+		auto ts = hpd->work->get();
+
+		if (ts.has_value() == false)
+			break;
+
+		http_process(ts.value());
 	}
 }
 
 bool http_new_session(pstream *const t, session *ts)
 {
-	http_session_data *hs = new http_session_data();
-	hs->req_data = nullptr;
-	hs->req_len  = 0;
+	http_session_data *hs  = new http_session_data();
+	http_private_data *hpd = dynamic_cast<http_private_data *>(ts->get_application_private_data());
 
 	any_addr src_addr = ts->get_their_addr();
 	hs->client_addr   = src_addr.to_str();
 
-	ts->set_callback_private_data(hs);
+	if (hpd->is_https)
+		hs->tls = https_engine_new(hpd);
 
-	ts->set_session_timeout(5);  // 5 seconds should be enough to transmit the request
+	ts->set_callback_private_data(hs);
 
-	stats_inc_counter(dynamic_cast<http_private_data *>(ts->get_application_private_data())->http_requests);
+	ts->set_session_timeout(http_request_timeout);
 
-	http_private_data *hpd = dynamic_cast<http_private_data *>(ts->get_application_private_data());
+	// the workers send blocking: a client that stops reading must not
+	// keep one for long, the session is closed instead
+	ts->set_send_timeout(http_send_timeout);
 
-	hs->th = new std::thread(hpd->is_https ? https_thread : http_thread, ts);
+	stats_inc_counter(hpd->http_requests);
 
 	return true;
 }
 
 bool http_new_data(pstream *ps, session *ts, buffer_in b)
 {
-	http_session_data *hs = dynamic_cast<http_session_data *>(ts->get_callback_private_data());
+	http_session_data *hs  = dynamic_cast<http_session_data *>(ts->get_callback_private_data());
+	http_private_data *hpd = dynamic_cast<http_private_data *>(ts->get_application_private_data());
 
 	if (!hs) {
 		DOLOG(ll_info, "HTTP: Data for a non-existing session\n");
-		stats_inc_counter(dynamic_cast<http_private_data *>(ts->get_application_private_data())->http_r_err);
+		stats_inc_counter(hpd->http_r_err);
 		return false;
 	}
 
@@ -515,15 +945,26 @@ bool http_new_data(pstream *ps, session *ts, buffer_in b)
 		return true;
 	}
 
-	const std::lock_guard<std::mutex> lck(hs->r_lock);
+	std::unique_lock<std::mutex> lck(hs->r_lock);
+
+	if (hs->closing)  // anything after the last request is ignored
+		return true;
 
-	hs->req_data = (char *)realloc(hs->req_data, hs->req_len + data_len + 1);
+	hs->req_data.append(reinterpret_cast<const char *>(b.get_bytes(data_len)), data_len);
 
-	memcpy(&hs->req_data[hs->req_len], b.get_bytes(data_len), data_len);
-	hs->req_len += data_len;
-	hs->req_data[hs->req_len] = 0x00;
+	ps->set_receive_backlog(ts, http_backlog(hs));
 
-	hs->r_cond.notify_all();
+	// any TLS record may move the handshake forward; plain requests are
+	// only handed to a worker when complete (or when too large)
+	bool work = hs->tls != nullptr || hs->req_data.size() > http_max_request_size || http_request_length(hs->req_data.c_str(), hs->req_data.size()).has_value();
+
+	if (work && hs->scheduled == false) {
+		hs->scheduled = true;
+
+		lck.unlock();
+
+		hpd->work->put(ts);
+	}
 
 	return true;
 }
@@ -536,15 +977,24 @@ bool http_close_session_1(pstream *const ps, session *const ts)
 bool http_close_session_2(pstream *const ps, session *ts)
 {
 	http_session_data *hs  = dynamic_cast<http_session_data *>(ts->get_callback_private_data());
+	http_private_data *hpd = dynamic_cast<http_private_data *>(ts->get_application_private_data());
 
 	if (hs) {
+		std::unique_lock<std::mutex> lck(hs->r_lock);
+
 		hs->terminate = true;
 
-		hs->th->join();
-		delete hs->th;
-		hs->th = nullptr;
+		// a worker may still be busy with this session (or the session waits
+		// for one); not for long: sends fail at once when the session is
+		// terminating, else after http_send_timeout
+		while(hs->scheduled)
+			hs->r_cond.wait(lck);
+
+		lck.unlock();
+
+		stats_add_average(hpd->http_r_per_conn, hs->n_requests);
 
-		free(hs->req_data);
+		delete hs->tls;
 
 		delete hs;
 
@@ -554,7 +1004,25 @@ bool http_close_session_2(pstream *const ps, session *ts)
 	return true;
 }
 
-port_handler_t http_get_handler(stats *const s, const std::string & web_root, const std::string & logfile, const bool is_https, const std::string & php_cgi)
+http_private_data::~http_private_data()
+{
+	if (work) {
+		work->interrupt();
+
+		for(auto & th : workers) {
+			th->join();
+			delete th;
+		}
+
+		delete work;
+	}
+
+	delete fc;
+
+	delete tls;
+}
+
+port_handler_t http_get_handler(stats *const s, const std::string & web_root, const std::string & logfile, const bool is_https, const std::string & php_cgi, const int n_workers, const size_t file_cache_size)
 {
 	port_handler_t http { 0 };
 
@@ -580,6 +1048,18 @@ port_handler_t http_get_handler(stats *const s, const std::string & web_root, co
 	hpd->http_r_404        = s->register_stat("http_r_404", "1.3.6.1.4.1.57850.1.1.3");
 	hpd->http_r_500        = s->register_stat("http_r_500", "1.3.6.1.4.1.57850.1.1.4");
 	hpd->http_r_err        = s->register_stat("http_r_err", "1.3.6.1.4.1.57850.1.1.5");
+	hpd->http_r_keepalive  = s->register_stat("http_r_keepalive", "1.3.6.1.4.1.57850.1.1.6");
+	hpd->http_r_per_conn   = s->register_stat("http_r_per_conn");  // average
+	hpd->http_r_304        = s->register_stat("http_r_304", "1.3.6.1.4.1.57850.1.1.7");
+
+	hpd->fc                = new file_cache(s, is_https ? "https" : "http", file_cache_size);
+
+	// sessions with work to do (complete requests, TLS records) are queued
+	// here; the number of threads does not depend on the number of sessions
+	hpd->work              = new fifo<session *>(s, is_https ? "https-work" : "http-work", 1024);
+
+	for(int i=0; i<n_workers; i++)
+		hpd->workers.push_back(new std::thread(http_worker, hpd));
 
 	http.pd                = hpd;
 
@@ -3,5 +3,13 @@
 #include "application.h"
 #include "stats.h"
 
+class http_private_data;
 
-port_handler_t http_get_handler(stats *const s, const std::string & web_root, const std::string & log_file, const bool is_https, const std::string & php_cgi);
+port_handler_t http_get_handler(stats *const s, const std::string & web_root, const std::string & log_file, const bool is_https, const std::string & php_cgi, const int n_workers, const size_t file_cache_size);
+
+// parses the certificate and private key in 'hpd' once for all sessions
+bool https_load_credentials(http_private_data *const hpd, const int n_tls_sessions);
+
+// the header of a reply to a CGI request; 'cgi_header' are the header
+// lines of the CGI binary, without the empty line that ends them
+std::string http_cgi_response_header(const std::string & version, const bool keep_alive, const bool chunked, const std::string & cgi_header);
@@ -8,7 +8,7 @@
 #include "utils.h"
 
 
-icmp::icmp(stats *const s) : transport_layer(s, "icmp")
+icmp::icmp(stats *const s) : transport_layer(s, "icmp", 1)
 {
 }
 
@@ -5,6 +5,7 @@
 #include "icmp4.h"
 #include "ipv4.h"
 #include "log.h"
+#include "router.h"
 #include "time.h"
 #include "utils.h"
 
@@ -14,6 +15,7 @@ icmp4::icmp4(stats *const s, const int n_threads) : icmp(s)
 	icmp_requests = s->register_stat("icmp_requests");
 	icmp_req_ping = s->register_stat("icmp_req_ping");
 	icmp_transmit = s->register_stat("icmp_transmit");
+	icmp_frag_needed = s->register_stat("icmp_frag_needed");
 
 	for(int i=0; i<n_threads; i++)
 		ths.push_back(new std::thread(std::ref(*this)));
@@ -21,7 +23,7 @@ icmp4::icmp4(stats *const s, const int n_threads) : icmp(s)
 
 icmp4::~icmp4()
 {
-	pkts->interrupt();
+	interrupt_queues();
 
 	for(auto & th : ths) {
 		th->join();
@@ -34,8 +36,10 @@ void icmp4::operator()()
 {
 	set_thread_name("myip-icmp4");
 
+	fifo<packet *> *const queue = claim_queue();
+
 	for(;;) {
-		auto po = pkts->get();
+		auto po = queue->get();
 		if (!po.has_value())
 			break;
 
@@ -55,6 +59,12 @@ void icmp4::operator()()
 		const any_addr src_ip = pkt->get_src_addr();
 		DOLOG(ll_debug, "ICMP: request %d/%d by %s\n", p[0], p[1], src_ip.to_str().c_str());
 
+		if (p[0] == 3 && p[1] == 4) {  // destination unreachable, fragmentation needed
+			process_fragmentation_needed(pkt);
+			delete pkt;
+			continue;
+		}
+
 		uint8_t *reply = duplicate(p, size);
 
 		if (p[0] == 8) {  // echo request
@@ -124,6 +134,51 @@ void icmp4::operator()()
 	}
 }
 
+// RFC 1191: a packet of ours did not fit in the MTU of a link on the path
+void icmp4::process_fragmentation_needed(const packet *const pkt)
+{
+	const uint8_t *const p    = pkt->get_data();
+	const int            size = pkt->get_size();
+
+	stats_inc_counter(icmp_frag_needed);
+
+	// the icmp header is followed by the ip header of the dropped packet
+	if (size < 8 + 20 || (p[8] >> 4) != 4) {
+		DOLOG(ll_debug, "ICMP: fragmentation needed message is invalid\n");
+		return;
+	}
+
+	const uint8_t *const org = &p[8];
+
+	any_addr org_src(any_addr::ipv4, &org[12]);
+	any_addr org_dst(any_addr::ipv4, &org[16]);
+
+	if (!idev || org_src != idev->get_addr() || !idev->get_router()) {
+		DOLOG(ll_debug, "ICMP: fragmentation needed for a packet not sent by us\n");
+		return;
+	}
+
+	int mtu = (p[6] << 8) | p[7];
+
+	// not filled in by old routers: take the next lower plateau (RFC 1191, 7)
+	if (mtu == 0) {
+		constexpr int plateaus[] { 32000, 17914, 8166, 4352, 2002, 1492, 1006, 508, 296, 68 };
+
+		int org_size = (org[2] << 8) | org[3];
+
+		for(int plateau : plateaus) {
+			mtu = plateau;
+
+			if (plateau < org_size)
+				break;
+		}
+	}
+
+	DOLOG(ll_debug, "ICMP: fragmentation needed for packets to %s, mtu: %d\n", org_dst.to_str().c_str(), mtu);
+
+	idev->get_router()->update_pmtu(org_dst, mtu);
+}
+
 void icmp4::send_packet(const any_addr & dst_ip, const any_addr & src_ip, const uint8_t type, const uint8_t code, const packet *const p) const
 {
 	if (!idev)
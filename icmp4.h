@@ -11,8 +11,12 @@ private:
 	uint64_t *icmp_requests { nullptr }, *icmp_req_ping { nullptr };
 	uint64_t *icmp_transmit { nullptr };
 
+	uint64_t *icmp_frag_needed { nullptr };
+
 	void send_packet(const any_addr & dst_ip, const any_addr & src_ip, const uint8_t type, const uint8_t code, const packet *const p) const;
 
+	void process_fragmentation_needed(const packet *const pkt);
+
 public:
 	icmp4(stats *const s, const int n_threads);
 	virtual ~icmp4();
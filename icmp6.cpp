@@ -17,6 +17,7 @@ icmp6::icmp6(stats *const s, const any_addr & my_mac, const any_addr & my_ip, ro
 	icmp6_requests = s->register_stat("icmp6_requests");
 	icmp6_transmit = s->register_stat("icmp6_transmit");
 	icmp6_error    = s->register_stat("icmp6_error");
+	icmp6_too_big  = s->register_stat("icmp6_too_big");
 
 	constexpr const char rs_addr[] = "FF02:0000:0000:0000:000:0000:0000:0002";
 	all_router_multicast_addr = parse_address(rs_addr, 16, ":", 16);
@@ -27,7 +28,7 @@ icmp6::icmp6(stats *const s, const any_addr & my_mac, const any_addr & my_ip, ro
 
 icmp6::~icmp6()
 {
-	pkts->interrupt();
+	interrupt_queues();
 
 	for(auto & th : ths) {
 		th->join();
@@ -40,8 +41,10 @@ void icmp6::operator()()
 {
 	set_thread_name("myip-icmp6");
 
+	fifo<packet *> *const queue = claim_queue();
+
 	for(;;) {
-		auto po = pkts->get();
+		auto po = queue->get();
 		if (!po.has_value())
 			break;
 
@@ -58,6 +61,9 @@ void icmp6::operator()()
 		if (type == 128) {  // echo request (PING)
 			send_ping_reply(pkt);
 		}
+		else if (type == 2) {  // packet too big
+			process_packet_too_big(pkt);
+		}
 		else if (type == 133) {  // router soliciation
 			// can be ignored
 		}
@@ -112,6 +118,37 @@ void icmp6::process_router_advertisement(const packet *const pkt)
 	}
 }
 
+// RFC 8201: a packet of ours did not fit in the MTU of a link on the path
+void icmp6::process_packet_too_big(const packet *const pkt)
+{
+	const uint8_t *const p    = pkt->get_data();
+	const int            size = pkt->get_size();
+
+	stats_inc_counter(icmp6_too_big);
+
+	// the icmp header is followed by (the start of) the dropped packet
+	if (size < 8 + 40 || (p[8] >> 4) != 6) {
+		DOLOG(ll_debug, "ICMP6: packet too big message is invalid\n");
+		return;
+	}
+
+	const uint8_t *const org = &p[8];
+
+	any_addr org_src(any_addr::ipv6, &org[8]);
+	any_addr org_dst(any_addr::ipv6, &org[24]);
+
+	if (org_src != my_ip) {
+		DOLOG(ll_debug, "ICMP6: packet too big for a packet not sent by us\n");
+		return;
+	}
+
+	int mtu = (p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+
+	DOLOG(ll_debug, "ICMP6: packet too big for packets to %s, mtu: %d\n", org_dst.to_str().c_str(), mtu);
+
+	r->update_pmtu(org_dst, mtu);
+}
+
 // TODO: std::optional for dst_mac
 void icmp6::send_packet(const any_addr *const dst_mac, const any_addr & dst_ip, const any_addr & src_ip, const uint8_t type, const uint8_t code, const uint32_t reserved, const uint8_t *const payload, const int payload_size) const
 {
@@ -26,12 +26,14 @@ private:
 	uint64_t *icmp6_requests { nullptr };
 	uint64_t *icmp6_transmit { nullptr };
 	uint64_t *icmp6_error    { nullptr };
+	uint64_t *icmp6_too_big  { nullptr };
 
 	any_addr all_router_multicast_addr;
 
 	ndp      *indp           { nullptr };
 
 	void process_router_advertisement(const packet *const pkt);
+	void process_packet_too_big(const packet *const pkt);
 
 	void send_packet(const any_addr *const dst_mac, const any_addr & dst_ip, const any_addr & src_ip, const uint8_t type, const uint8_t code, const uint32_t reserved, const uint8_t *const payload, const int payload_size) const;
 
@@ -7,6 +7,7 @@
 #include <arpa/inet.h>
 
 #include "arp.h"
+#include "checksum.h"
 #include "icmp.h"
 #include "ipv4.h"
 #include "log.h"
@@ -46,6 +47,21 @@ ipv4::~ipv4()
 }
 
 bool ipv4::transmit_packet(const std::optional<any_addr> & dst_mac, const any_addr & dst_ip, const any_addr & src_ip, const uint8_t protocol, const uint8_t *payload, const size_t pl_size, const uint8_t *const header_template)
+{
+	// one copy, in a buffer that the router can keep a reference to
+	pool_block_t *block = pool_allocate(default_pdev ? default_pdev->get_buffer_pool() : nullptr, pl_size);
+
+	if (pl_size)
+		memcpy(pool_block_data(block), payload, pl_size);
+
+	bool rc = transmit_packet(dst_mac, dst_ip, src_ip, protocol, buffer_chain(block, pool_block_data(block), pl_size), header_template);
+
+	pool_block_unref(block);
+
+	return rc;
+}
+
+bool ipv4::transmit_packet(const std::optional<any_addr> & dst_mac, const any_addr & dst_ip, const any_addr & src_ip, const uint8_t protocol, const buffer_chain & payload, const uint8_t *const header_template)
 {
 	uint64_t start = get_us();
 
@@ -55,8 +71,16 @@ bool ipv4::transmit_packet(const std::optional<any_addr> & dst_mac, const any_ad
 	stats_inc_counter(ipv4_n_tx);
 	stats_inc_counter(ip_n_out_req);
 
-	size_t out_size = 20 + pl_size;
-	uint8_t *out = new uint8_t[out_size];
+	size_t out_size = 20 + payload.get_size();
+
+	// the IP header is a segment in front of the payload; the payload is not copied
+	buffer_chain chain(payload);
+
+	uint8_t *out = chain.prepend_new(default_pdev ? default_pdev->get_buffer_pool() : nullptr, 20);
+	if (!out) {
+		stats_inc_counter(ipv4_tx_err);
+		return false;
+	}
 
 	out[0] = 0x45; // ipv4, 5 words
 	out[1] = header_template ? header_template[1] : 0; // qos, ecn
@@ -79,8 +103,6 @@ bool ipv4::transmit_packet(const std::optional<any_addr> & dst_mac, const any_ad
 	// destination IPv4 address
 	dst_ip.get(&out[16], 4);
 
-	memcpy(&out[20], payload, pl_size);
-
 	uint16_t checksum = ip_checksum((const uint16_t *)&out[0], 10);
 	out[10] = checksum >> 8;
 	out[11] = checksum;
@@ -91,9 +113,7 @@ bool ipv4::transmit_packet(const std::optional<any_addr> & dst_mac, const any_ad
 
 	DOLOG(ll_debug, "[IPv4:%04x]: transmit packet %s -> %s\n", ip_id, src_ip.to_str().c_str(), dst_ip.to_str().c_str());
 
-	bool rc = r->route_packet(dst_mac, 0x0800, dst_ip, { }, q_addr, out, out_size);
-
-	delete [] out;
+	bool rc = r->route_packet(dst_mac, 0x0800, dst_ip, { }, q_addr, chain);
 
 	transmit_packet_de.insert(get_us() - start);
 
@@ -104,138 +124,166 @@ void ipv4::operator()()
 {
 	set_thread_name("myip-ipv4");
 
+	fifo_element_t batch[pkts_batch_size];
+
 	for(;;) {
-		auto po = pkts->get();
-		if (!po.has_value())
+		int n = pkts->get_bulk(batch, pkts_batch_size, -1);
+		if (n == 0)
 			break;
-		
-		uint64_t start = get_us();
-
-		packet *pkt = po.value().p;
 
-		const uint8_t *const p = pkt->get_data();
-		int size = pkt->get_size();
+		transport_layer *deliver_to[pkts_batch_size];
+		packet          *deliver   [pkts_batch_size];
+		int              n_deliver = 0;
 
-		if (size < 20) {
-			DOLOG(ll_info, "IPv4: not an IPv4 packet (size: %d)\n", size);
-			delete pkt;
-			receive_packet_de.insert(get_us() - start);
-			continue;
-		}
-
-		// assuming link layer takes care of corruptions so no checksum verification
+		for(int i=0; i<n; i++) {
+			uint64_t start = get_us();
 
-		stats_inc_counter(ip_n_pkt);
+			packet *pkt = batch[i].p;
 
-		const uint8_t *const payload_header = &p[0];
+			const uint8_t *const p = pkt->get_data();
+			int size = pkt->get_size();
 
-		// const uint16_t id = (payload_header[4] << 8) | payload_header[5];
+			if (size < 20) {
+				DOLOG(ll_info, "IPv4: not an IPv4 packet (size: %d)\n", size);
+				delete pkt;
+				receive_packet_de.insert(get_us() - start);
+				continue;
+			}
 
-		stats_inc_counter(ipv4_n_pkt);
+			// assuming link layer takes care of corruptions so no checksum verification
 
-		uint8_t version = payload_header[0] >> 4;
-		if (version != 0x04) {
-			stats_inc_counter(ip_n_disc);
-			CDOLOG(ll_info, pkt->get_log_prefix().c_str(), "not an IPv4 packet (version: %d)\n", version);
-			delete pkt;
-			receive_packet_de.insert(get_us() - start);
-			continue;
-		}
+			stats_inc_counter(ip_n_pkt);
 
-		any_addr pkt_dst(any_addr::ipv4, &payload_header[16]);
-		any_addr pkt_src(any_addr::ipv4, &payload_header[12]);
+			const uint8_t *const payload_header = &p[0];
 
-		pkt->add_to_log_prefix(myformat("[IPv4:%s]", pkt_src.to_str().c_str()));
+			// const uint16_t id = (payload_header[4] << 8) | payload_header[5];
 
-		if (pkt->get_is_forwarded() == false)
-			iarp->update_cache(pkt->get_src_addr(), pkt_src, po.value().interface);
+			stats_inc_counter(ipv4_n_pkt);
 
-		CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "packet %s => %s\n", pkt_src.to_str().c_str(), pkt_dst.to_str().c_str());
+			uint8_t version = payload_header[0] >> 4;
+			if (version != 0x04) {
+				stats_inc_counter(ip_n_disc);
+				CDOLOG(ll_info, pkt->get_log_prefix().c_str(), "not an IPv4 packet (version: %d)\n", version);
+				delete pkt;
+				receive_packet_de.insert(get_us() - start);
+				continue;
+			}
 
-		if (payload_header[8] <= 1) {  // TTL exceeded?
-			CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "TTL exceeded\n");
+			any_addr pkt_dst(any_addr::ipv4, &payload_header[16]);
+			any_addr pkt_src(any_addr::ipv4, &payload_header[12]);
 
-			delete pkt;
+			pkt->get_log_context().add_addr("IPv4", pkt_src);
 
-			stats_inc_counter(ip_n_disc);
-			stats_inc_counter(ipv4_ttl_ex);
+			if (pkt->get_is_forwarded() == false)
+				iarp->update_cache(pkt->get_src_addr(), pkt_src, batch[i].interface);
 
-			receive_packet_de.insert(get_us() - start);
+			CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "packet %s => %s\n", pkt_src.to_str().c_str(), pkt_dst.to_str().c_str());
 
-			continue;
-		}
+			if (payload_header[8] <= 1) {  // TTL exceeded?
+				CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "TTL exceeded\n");
 
-		int header_size = (payload_header[0] & 15) * 4;
-		int ip_size     = (payload_header[2] << 8) | payload_header[3];
-		CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "total packet size: %d, IP header says: %d, header size: %d\n", size, ip_size, header_size);
+				delete pkt;
 
-		if (ip_size > size) {
-			CDOLOG(ll_info, pkt->get_log_prefix().c_str(), "size (%d) > Ethernet size (%d)\n", ip_size, size);
-			delete pkt;
-			stats_inc_counter(ip_n_disc);
-			receive_packet_de.insert(get_us() - start);
-			continue;
-		}
+				stats_inc_counter(ip_n_disc);
+				stats_inc_counter(ipv4_ttl_ex);
 
-		// adjust size indication to what IP-header says; Ethernet adds padding for small packets (< 60 bytes)
-		size = ip_size;
+				receive_packet_de.insert(get_us() - start);
 
-		if (header_size > size) {
-			CDOLOG(ll_info, pkt->get_log_prefix().c_str(), "Header size (%d) > size (%d)\n", header_size, size);
-			delete pkt;
-			stats_inc_counter(ip_n_disc);
-			receive_packet_de.insert(get_us() - start);
-			continue;
-		}
+				continue;
+			}
 
-		const uint8_t *payload_data = &payload_header[header_size];
+			int header_size = (payload_header[0] & 15) * 4;
+			int ip_size     = (payload_header[2] << 8) | payload_header[3];
+			CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "total packet size: %d, IP header says: %d, header size: %d\n", size, ip_size, header_size);
 
-		const uint8_t protocol = payload_header[9];
+			if (ip_size > size) {
+				CDOLOG(ll_info, pkt->get_log_prefix().c_str(), "size (%d) > Ethernet size (%d)\n", ip_size, size);
+				delete pkt;
+				stats_inc_counter(ip_n_disc);
+				receive_packet_de.insert(get_us() - start);
+				continue;
+			}
 
-		auto it = prot_map.find(protocol);
-		if (it == prot_map.end()) {
-			CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "dropping packet %02x (= unknown protocol) and size %d\n", protocol, size);
-			delete pkt;
-			stats_inc_counter(ipv4_unk_prot);
-			stats_inc_counter(ip_n_disc);
-			receive_packet_de.insert(get_us() - start);
-			continue;
-		}
+			// adjust size indication to what IP-header says; Ethernet adds padding for small packets (< 60 bytes)
+			size = ip_size;
 
-		int payload_size = size - header_size;
+			if (header_size > size) {
+				CDOLOG(ll_info, pkt->get_log_prefix().c_str(), "Header size (%d) > size (%d)\n", header_size, size);
+				delete pkt;
+				stats_inc_counter(ip_n_disc);
+				receive_packet_de.insert(get_us() - start);
+				continue;
+			}
 
-		if (pkt_dst != myip) {
-			// do not forward multicast
-			if (forward && (pkt_dst[0] & 0xf0) != 224) {
-				CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "forwarding packet to router\n");
+			const uint8_t *payload_data = &payload_header[header_size];
 
-				r->route_packet({ }, 0x0800, pkt_dst, pkt->get_src_mac_addr(), pkt_src, p, size);
-			}
-			else {
-				CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "dropping packet (not forwarding)\n");
+			const uint8_t protocol = payload_header[9];
 
+			auto it = prot_map.find(protocol);
+			if (it == prot_map.end()) {
+				CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "dropping packet %02x (= unknown protocol) and size %d\n", protocol, size);
+				delete pkt;
+				stats_inc_counter(ipv4_unk_prot);
 				stats_inc_counter(ip_n_disc);
+				receive_packet_de.insert(get_us() - start);
+				continue;
 			}
 
-			stats_inc_counter(ipv4_not_me);
+			int payload_size = size - header_size;
 
-			delete pkt;
+			if (pkt_dst != myip) {
+				// do not forward multicast
+				if (forward && (pkt_dst[0] & 0xf0) != 224) {
+					CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "forwarding packet to router\n");
 
-			receive_packet_de.insert(get_us() - start);
-			continue;
-		}
+					// the received frame is shared: the header is copied to decrement
+					// the TTL, the payload is referenced
+					buffer_chain chain(pkt->get_block(), payload_data, payload_size);
+
+					uint8_t *header = chain.prepend_new(pkt->get_buffer_pool(), header_size);
+					memcpy(header, payload_header, header_size);
+
+					// RFC 1624: adjust the checksum for the TTL/protocol word
+					uint16_t old_word = (header[8] << 8) | header[9];
+					header[8]--;
+					uint16_t new_word = (header[8] << 8) | header[9];
 
-		packet *ip_p = new packet(pkt->get_recv_ts(), pkt->get_src_mac_addr(), pkt_src, pkt_dst, payload_data, payload_size, payload_header, header_size, pkt->get_log_prefix());
+					uint16_t checksum = checksum_update16((header[10] << 8) | header[11], old_word, new_word);
+					header[10] = checksum >> 8;
+					header[11] = checksum;
 
-		CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "queing packet protocol %02x and size %d\n", protocol, payload_size);
+					r->route_packet({ }, 0x0800, pkt_dst, pkt->get_src_mac_addr(), pkt_src, chain);
+				}
+				else {
+					CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "dropping packet (not forwarding)\n");
 
-		it->second->queue_packet(ip_p);
+					stats_inc_counter(ip_n_disc);
+				}
+
+				stats_inc_counter(ipv4_not_me);
+
+				delete pkt;
+
+				receive_packet_de.insert(get_us() - start);
+				continue;
+			}
 
-		stats_inc_counter(ip_n_del);
+			packet *ip_p = pkt->view(pkt_src, pkt_dst, payload_data, payload_size, payload_header, header_size);
 
-		delete pkt;
+			CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "queing packet protocol %02x and size %d\n", protocol, payload_size);
+
+			deliver_to[n_deliver] = it->second;
+			deliver   [n_deliver] = ip_p;
+			n_deliver++;
+
+			stats_inc_counter(ip_n_del);
+
+			delete pkt;
+
+			receive_packet_de.insert(get_us() - start);
+		}
 
-		receive_packet_de.insert(get_us() - start);
+		deliver_batch(deliver_to, deliver, n_deliver);
 	}
 }
 
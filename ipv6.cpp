@@ -46,12 +46,35 @@ ipv6::~ipv6()
 }
 
 bool ipv6::transmit_packet(const std::optional<any_addr> & dst_mac, const any_addr & dst_ip, const any_addr & src_ip, const uint8_t protocol, const uint8_t *payload, const size_t pl_size, const uint8_t *const header_template)
+{
+	// one copy, in a buffer that the router can keep a reference to
+	pool_block_t *block = pool_allocate(default_pdev ? default_pdev->get_buffer_pool() : nullptr, pl_size);
+
+	if (pl_size)
+		memcpy(pool_block_data(block), payload, pl_size);
+
+	bool rc = transmit_packet(dst_mac, dst_ip, src_ip, protocol, buffer_chain(block, pool_block_data(block), pl_size), header_template);
+
+	pool_block_unref(block);
+
+	return rc;
+}
+
+bool ipv6::transmit_packet(const std::optional<any_addr> & dst_mac, const any_addr & dst_ip, const any_addr & src_ip, const uint8_t protocol, const buffer_chain & payload, const uint8_t *const header_template)
 {
 	stats_inc_counter(ipv6_n_tx);
 	stats_inc_counter(ip_n_out_req);
 
-	size_t out_size = 40 + pl_size;
-	uint8_t *out = new uint8_t[out_size];
+	size_t pl_size = payload.get_size();
+
+	// the IP header is a segment in front of the payload; the payload is not copied
+	buffer_chain chain(payload);
+
+	uint8_t *out = chain.prepend_new(default_pdev ? default_pdev->get_buffer_pool() : nullptr, 40);
+	if (!out) {
+		stats_inc_counter(ipv6_tx_err);
+		return false;
+	}
 
 	out[0] = 0x60;  // IPv6
 
@@ -72,123 +95,128 @@ bool ipv6::transmit_packet(const std::optional<any_addr> & dst_mac, const any_ad
 
 	dst_ip.get(&out[24], 16);
 
-	if (pl_size)
-		memcpy(&out[40], payload, pl_size);
-
-	bool rc = r->route_packet(dst_mac, 0x86dd, dst_ip, { }, src_ip, out, out_size);
-
-	delete [] out;
-
-	return rc;
+	return r->route_packet(dst_mac, 0x86dd, dst_ip, { }, src_ip, chain);
 }
 
 void ipv6::operator()()
 {
 	set_thread_name("myip-ipv6");
 
+	fifo_element_t batch[pkts_batch_size];
+
 	for(;;) {
-		auto po = pkts->get();
-		if (!po.has_value())
+		int n = pkts->get_bulk(batch, pkts_batch_size, -1);
+		if (n == 0)
 			break;
 
-		packet *pkt = po.value().p;
+		transport_layer *deliver_to[pkts_batch_size];
+		packet          *deliver   [pkts_batch_size];
+		int              n_deliver = 0;
 
-		stats_inc_counter(ip_n_pkt);
+		for(int i=0; i<n; i++) {
+			packet *pkt = batch[i].p;
 
-		const uint8_t *const p = pkt->get_data();
-		int size = pkt->get_size();
+			stats_inc_counter(ip_n_pkt);
 
-		if (size < 40) {
-			DOLOG(ll_info, "IPv6: not an IPv6 packet (size: %d)\n", size);
-			stats_inc_counter(ip_n_disc);
-			delete pkt;
-			continue;
-		}
+			const uint8_t *const p = pkt->get_data();
+			int size = pkt->get_size();
 
-		const uint8_t *const payload_header = &p[0];
+			if (size < 40) {
+				DOLOG(ll_info, "IPv6: not an IPv6 packet (size: %d)\n", size);
+				stats_inc_counter(ip_n_disc);
+				delete pkt;
+				continue;
+			}
 
-		//const uint32_t flow_label = ((payload_header[1] & 15) << 16) | (payload_header[2] << 8) | payload_header[3];
+			const uint8_t *const payload_header = &p[0];
 
-		uint8_t version = payload_header[0] >> 4;
-		if (version != 0x06) {
-			CDOLOG(ll_info, pkt->get_log_prefix().c_str(), "not an IPv6 packet (version: %d)\n", version);
-			stats_inc_counter(ip_n_disc);
-			delete pkt;
-			continue;
-		}
+			//const uint32_t flow_label = ((payload_header[1] & 15) << 16) | (payload_header[2] << 8) | payload_header[3];
 
-		stats_inc_counter(ipv6_n_pkt);
+			uint8_t version = payload_header[0] >> 4;
+			if (version != 0x06) {
+				CDOLOG(ll_info, pkt->get_log_prefix().c_str(), "not an IPv6 packet (version: %d)\n", version);
+				stats_inc_counter(ip_n_disc);
+				delete pkt;
+				continue;
+			}
 
-		any_addr pkt_dst(any_addr::ipv6, &payload_header[24]);
-		any_addr pkt_src(any_addr::ipv6, &payload_header[8]);
+			stats_inc_counter(ipv6_n_pkt);
 
-		pkt->add_to_log_prefix(myformat("[IPv6:%s]", pkt_src.to_str().c_str()));
+			any_addr pkt_dst(any_addr::ipv6, &payload_header[24]);
+			any_addr pkt_src(any_addr::ipv6, &payload_header[8]);
 
-		CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "packet %s => %s\n", pkt_src.to_str().c_str(), pkt_dst.to_str().c_str());
+			pkt->get_log_context().add_addr("IPv6", pkt_src);
 
-		bool link_local_scope_multicast_adress = pkt_dst[0] == 0xff && pkt_dst[1] == 0x02;
+			CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "packet %s => %s\n", pkt_src.to_str().c_str(), pkt_dst.to_str().c_str());
 
-		if (pkt_dst != myip && !link_local_scope_multicast_adress) {
-			CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "packet (%s) not for me (=%s)\n", pkt_src.to_str().c_str(), myip.to_str().c_str());
-			delete pkt;
-			stats_inc_counter(ipv6_not_me);
-			stats_inc_counter(ip_n_disc);
-			continue;
-		}
+			bool link_local_scope_multicast_adress = pkt_dst[0] == 0xff && pkt_dst[1] == 0x02;
 
-		if (pkt->get_is_forwarded() == false)
-			indp->update_cache(pkt->get_src_addr(), pkt_src, po.value().interface);
+			if (pkt_dst != myip && !link_local_scope_multicast_adress) {
+				CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "packet (%s) not for me (=%s)\n", pkt_src.to_str().c_str(), myip.to_str().c_str());
+				delete pkt;
+				stats_inc_counter(ipv6_not_me);
+				stats_inc_counter(ip_n_disc);
+				continue;
+			}
 
-		int ip_size = (payload_header[4] << 8) | payload_header[5];
+			if (pkt->get_is_forwarded() == false)
+				indp->update_cache(pkt->get_src_addr(), pkt_src, batch[i].interface);
 
-		if (ip_size > size) {
-			CDOLOG(ll_info, pkt->get_log_prefix().c_str(), "packet is bigger on the inside (%d) than on the outside (%d)\n", ip_size, size);
-			ip_size = size;
-		}
+			int ip_size = (payload_header[4] << 8) | payload_header[5];
+
+			if (ip_size > size) {
+				CDOLOG(ll_info, pkt->get_log_prefix().c_str(), "packet is bigger on the inside (%d) than on the outside (%d)\n", ip_size, size);
+				ip_size = size;
+			}
 
-		uint8_t protocol = payload_header[6];
-		const uint8_t *nh = &payload_header[40], *const eh = &payload_header[size - ip_size];
+			uint8_t protocol = payload_header[6];
+			const uint8_t *nh = &payload_header[40], *const eh = &payload_header[size - ip_size];
 		
-		while(eh - nh >= 8) {
-			protocol = nh[0];
-			nh += (nh[1] + 1) * 8;
-		}
+			while(eh - nh >= 8) {
+				protocol = nh[0];
+				nh += (nh[1] + 1) * 8;
+			}
 
-		int header_size = nh - payload_header;
+			int header_size = nh - payload_header;
 
-		CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "total packet size: %d, IP header says: %d, header size: %d\n", size, ip_size, header_size);
+			CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "total packet size: %d, IP header says: %d, header size: %d\n", size, ip_size, header_size);
 
-		if (ip_size > size) {
-			CDOLOG(ll_info, pkt->get_log_prefix().c_str(), "size (%d) > Ethernet size (%d)\n", ip_size, size);
-			delete pkt;
-			stats_inc_counter(ip_n_disc);
-			continue;
-		}
+			if (ip_size > size) {
+				CDOLOG(ll_info, pkt->get_log_prefix().c_str(), "size (%d) > Ethernet size (%d)\n", ip_size, size);
+				delete pkt;
+				stats_inc_counter(ip_n_disc);
+				continue;
+			}
 
-		// adjust size indication to what IP-header says; Ethernet adds padding for small packets (< 60 bytes)
-		size = ip_size;
+			// adjust size indication to what IP-header says; Ethernet adds padding for small packets (< 60 bytes)
+			size = ip_size;
 
-		const uint8_t *payload_data = &payload_header[header_size];
+			const uint8_t *payload_data = &payload_header[header_size];
 
-		int payload_size = size;
+			int payload_size = size;
 
-		auto it = prot_map.find(protocol);
-		if (it == prot_map.end()) {
-			CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "dropping packet %02x (= unknown protocol) and size %d\n", protocol, size);
-			delete pkt;
-			stats_inc_counter(ipv6_unk_prot);
-			stats_inc_counter(ip_n_disc);
-			continue;
-		}
+			auto it = prot_map.find(protocol);
+			if (it == prot_map.end()) {
+				CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "dropping packet %02x (= unknown protocol) and size %d\n", protocol, size);
+				delete pkt;
+				stats_inc_counter(ipv6_unk_prot);
+				stats_inc_counter(ip_n_disc);
+				continue;
+			}
+
+			CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "queing packet protocol %02x and size %d\n", protocol, payload_size);
 
-		CDOLOG(ll_debug, pkt->get_log_prefix().c_str(), "queing packet protocol %02x and size %d\n", protocol, payload_size);
+			packet *ip_p = pkt->view(pkt_src, pkt_dst, payload_data, payload_size, payload_header, header_size);
 
-		packet *ip_p = new packet(pkt->get_recv_ts(), pkt->get_src_mac_addr(), pkt_src, pkt_dst, payload_data, payload_size, payload_header, header_size, pkt->get_log_prefix());
+			deliver_to[n_deliver] = it->second;
+			deliver   [n_deliver] = ip_p;
+			n_deliver++;
 
-		it->second->queue_packet(ip_p);
+			stats_inc_counter(ip_n_del);
 
-		stats_inc_counter(ip_n_del);
+			delete pkt;
+		}
 
-		delete pkt;
+		deliver_batch(deliver_to, deliver, n_deliver);
 	}
 }
@@ -260,6 +260,8 @@ static bool process_line(session *const tcp_session, bool *const seen_nick, bool
 				": 376 " + isd->nick + " :End of message of the day.\r\n"
 			};
 
+			pstream_cork cork(tcp_session);
+
 			for(auto & line : welcome) {
 				if (transmit_to_client(tcp_session, line) == false)
 					return false;
@@ -388,6 +390,8 @@ static bool process_line(session *const tcp_session, bool *const seen_nick, bool
 
 		std::string start_line = ":" + local_host + " 321 " + isd->nick + " Channel :Users Name\r\n";
 
+		pstream_cork cork(tcp_session);
+
 		if (transmit_to_client(tcp_session, start_line) == false)
 			return false;
 
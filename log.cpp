@@ -1,12 +1,19 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <errno.h>
 #include <fcntl.h>
+#include <mutex>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <thread>
 #include <time.h>
 #include <unistd.h>
+#include <vector>
 
 #include "log.h"
 #include "time.h"
@@ -19,11 +26,658 @@ log_level_t        log_level_screen = ll_warning;
 static FILE       *lfh              = nullptr;
 static int         lf_uid           = 0;
 static int         lf_gid           = 0;
+static std::mutex  file_lock;  // lfh & friends
 
-void setlog(const char *lf, const log_level_t ll_file, const log_level_t ll_screen)
+static size_t      ring_size        = 256 * 1024;
+static bool        drop_when_full   = true;
+static uint64_t   *dropped_counter  = nullptr;
+static std::atomic<uint64_t> n_dropped { 0 };
+
+constexpr uint64_t log_flush_max_ms = 500;  // on shutdown: wait for records in progress
+
+// 'size' is a multiple of 8, 0 means: continue at the start of the ring
+typedef struct {
+	uint32_t    size;
+	uint8_t     ll;
+	uint8_t     n_args;
+	uint64_t    ts;
+	const char *fmt;
+	char        thread_name[16];
+} log_record_t;
+
+// single producer (the thread it belongs to), single consumer (the writer)
+class log_ring
+{
+public:
+	uint8_t     *const buffer;
+	const size_t size;
+	const pid_t  tid;
+
+	alignas(64) std::atomic<size_t> head { 0 };
+	alignas(64) std::atomic<size_t> tail { 0 };
+	std::atomic_bool orphaned { false };  // thread went away, free when empty
+	std::atomic_bool in_reserve { false };  // producer is between reserve() and commit()
+
+	size_t       pending_head { 0 };  // producer only: head after the record being written
+
+	log_ring(const size_t size, const pid_t tid) : buffer(reinterpret_cast<uint8_t *>(malloc(size))), size(size), tid(tid) {
+	}
+
+	~log_ring() {
+		free(buffer);
+	}
+};
+
+typedef enum { ws_idle, ws_running, ws_stopped } writer_state_t;
+
+static std::atomic<writer_state_t> writer_state { ws_idle };
+static std::thread                *writer       { nullptr };
+static std::mutex                  writer_lock;  // start/stop
+// never destroyed: in a forked child the writer still appears to be a
+// waiter and the destructor would wait for it forever
+static std::condition_variable    &writer_cv    = *new std::condition_variable();
+static std::mutex                  writer_cv_lock;
+static std::atomic_bool            writer_stop  { false };
+
+static std::mutex                  rings_lock;
+static std::vector<log_ring *>     rings;
+
+// held while the writer formats; formatting takes libc-internal locks
+// (e.g. in localtime_r) that must not be held by anyone while forking
+static std::mutex                  drain_lock;
+
+typedef struct _log_thread_ {
+	log_ring *ring { nullptr };
+	char      name[16] { 0 };
+	bool      name_set { false };
+
+	bool      pending_sync { false };
+	std::vector<uint8_t> sync_buffer;
+
+	~_log_thread_() {
+		if (ring) {
+			ring->orphaned = true;
+			ring = nullptr;
+		}
+	}
+} log_thread_t;
+
+static thread_local log_thread_t log_thread;
+
+static const char *const ll_names[] = { "debug  ", "info   ", "warning", "error  " };
+
+static void append_formatted(std::string *const out, const char *const spec, ...)
+{
+	char buffer[256];
+
+	va_list ap;
+	va_start(ap, spec);
+	int rc = vsnprintf(buffer, sizeof buffer, spec, ap);
+	va_end(ap);
+
+	if (rc < 0)
+		return;
+
+	if (size_t(rc) < sizeof buffer) {
+		out->append(buffer, rc);
+		return;
+	}
+
+	std::string temp(rc + 1, 0);
+
+	va_start(ap, spec);
+	vsnprintf(temp.data(), temp.size(), spec, ap);
+	va_end(ap);
+
+	out->append(temp.data(), rc);
+}
+
+typedef struct {
+	log_async::arg_type_t type;
+	int                   size;
+	uint64_t              value;
+	const char           *str;
+	uint32_t              str_len;
+} decoded_arg_t;
+
+static const uint8_t *decode_arg(const uint8_t *p, decoded_arg_t *const a)
+{
+	a->type = log_async::arg_type_t(*p++);
+	a->size = *p++;
+
+	if (a->type == log_async::at_string) {
+		memcpy(&a->str_len, p, sizeof a->str_len);
+		a->str = reinterpret_cast<const char *>(p + sizeof a->str_len);
+
+		return p + sizeof a->str_len + a->str_len;
+	}
+
+	memcpy(&a->value, p, sizeof a->value);
+
+	return p + sizeof a->value;
+}
+
+// walk the format string and let printf handle one conversion at a time
+// integers are stored as 64 bit: the length modifier is replaced by "ll"
+// and the value is cut back to the size of the original argument
+static void format_args(std::string *const out, const char *fmt, const uint8_t *p, int n_args)
+{
+	auto next_arg = [&](decoded_arg_t *const a) {
+		if (n_args == 0)
+			return false;
+
+		p = decode_arg(p, a);
+		n_args--;
+
+		return true;
+	};
+
+	while(*fmt) {
+		const char *percent = strchr(fmt, '%');
+		if (!percent) {
+			out->append(fmt);
+			break;
+		}
+
+		out->append(fmt, percent - fmt);
+		fmt = percent + 1;
+
+		if (*fmt == '%') {
+			*out += '%';
+			fmt++;
+			continue;
+		}
+
+		std::string spec = "%";
+
+		while(*fmt && strchr("-+ #0'", *fmt))
+			spec += *fmt++;
+
+		for(int wp=0; wp<2; wp++) {  // width, precision
+			if (wp == 1) {
+				if (*fmt != '.')
+					break;
+
+				spec += *fmt++;
+			}
+
+			if (*fmt == '*') {
+				decoded_arg_t a { };
+				if (next_arg(&a))
+					spec += std::to_string(int(a.value));
+				fmt++;
+			}
+			else {
+				while(*fmt >= '0' && *fmt <= '9')
+					spec += *fmt++;
+			}
+		}
+
+		int h_bits = 0;
+		while(*fmt && strchr("hlLqjzZt", *fmt)) {
+			if (*fmt == 'h')
+				h_bits = h_bits ? 8 : 16;
+			fmt++;
+		}
+
+		const char conversion = *fmt;
+		if (!conversion)
+			break;
+		fmt++;
+
+		decoded_arg_t a { };
+		if (!next_arg(&a)) {
+			out->append("(missing)");
+			continue;
+		}
+
+		int bits = a.size * 8;
+		if (h_bits && h_bits < bits)
+			bits = h_bits;
+		const uint64_t mask = bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+
+		switch(conversion) {
+			case 'd':
+			case 'i':
+				if (a.type == log_async::at_signed || a.type == log_async::at_unsigned) {
+					int64_t v = int64_t(a.value & mask);
+					if (bits < 64 && (v & (int64_t(1) << (bits - 1))))
+						v |= ~int64_t(mask);  // sign extend
+					append_formatted(out, (spec + "ll" + conversion).c_str(), (long long)v);
+				}
+				else {
+					out->append("(?)");
+				}
+				break;
+
+			case 'o':
+			case 'u':
+			case 'x':
+			case 'X':
+				if (a.type == log_async::at_signed || a.type == log_async::at_unsigned)
+					append_formatted(out, (spec + "ll" + conversion).c_str(), (unsigned long long)(a.value & mask));
+				else
+					out->append("(?)");
+				break;
+
+			case 'c':
+				append_formatted(out, (spec + conversion).c_str(), int(a.value));
+				break;
+
+			case 'e': case 'E':
+			case 'f': case 'F':
+			case 'g': case 'G':
+			case 'a': case 'A':
+				if (a.type == log_async::at_double) {
+					double v = 0.;
+					memcpy(&v, &a.value, sizeof v);
+					append_formatted(out, (spec + conversion).c_str(), v);
+				}
+				else {
+					out->append("(?)");
+				}
+				break;
+
+			case 's':
+				if (a.type == log_async::at_string)
+					append_formatted(out, (spec + conversion).c_str(), std::string(a.str, a.str_len).c_str());
+				else
+					out->append("(?)");
+				break;
+
+			case 'p':
+				append_formatted(out, (spec + conversion).c_str(), reinterpret_cast<void *>(uintptr_t(a.value)));
+				break;
+
+			default:  // %n and unknown conversions
+				break;
+		}
+	}
+}
+
+static std::string format_record(const log_record_t *const r, const pid_t tid)
+{
+	time_t t_now = r->ts / 1000000;
+
+	struct tm tm { 0 };
+	if (!localtime_r(&t_now, &tm))
+		fprintf(stderr, "localtime_r: %s\n", strerror(errno));
+
+	std::string out;
+
+	append_formatted(&out, "%04d-%02d-%02d %02d:%02d:%02d.%06d %d] %s %-15s ",
+			tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, int(r->ts % 1000000),
+			tid, ll_names[r->ll], r->thread_name);
+
+	format_args(&out, r->fmt, reinterpret_cast<const uint8_t *>(r + 1), r->n_args);
+
+	return out;
+}
+
+// file_lock must be held
+static void open_logfile()
 {
 	if (lfh)
+		return;
+
+	lfh = fopen(logfile, "a+");
+	if (!lfh) {
+		fprintf(stderr, "Cannot access log-file %s: %s\n", logfile, strerror(errno));
+		exit(1);
+	}
+
+	if (fchown(fileno(lfh), lf_uid, lf_gid) == -1)
+		fprintf(stderr, "Cannot change logfile (%s) ownership: %s\n", logfile, strerror(errno));
+
+	if (fcntl(fileno(lfh), F_SETFD, FD_CLOEXEC) == -1) {
+		fprintf(stderr, "fcntl(FD_CLOEXEC): %s\n", strerror(errno));
+		exit(1);
+	}
+}
+
+typedef struct {
+	uint64_t    ts;
+	log_level_t ll;
+	std::string text;
+} log_line_t;
+
+static void write_lines(const std::vector<log_line_t> & lines)
+{
+	std::unique_lock<std::mutex> lck(file_lock);
+
+	bool to_file   = false;
+	bool to_screen = false;
+
+	for(auto & line : lines) {
+		if (line.ll >= log_level_file) {
+			open_logfile();
+			fputs(line.text.c_str(), lfh);
+			to_file = true;
+		}
+
+		if (line.ll >= log_level_screen) {
+			fputs(line.text.c_str(), stdout);
+			to_screen = true;
+		}
+	}
+
+	if (to_file)
+		fflush(lfh);
+
+	if (to_screen)
+		fflush(stdout);
+}
+
+static void drain_rings()
+{
+	std::unique_lock<std::mutex> drain_lck(drain_lock);
+
+	std::vector<log_ring *> work;
+
+	{
+		std::unique_lock<std::mutex> lck(rings_lock);
+		work = rings;
+	}
+
+	std::vector<log_line_t>  lines;
+	std::vector<log_ring *>  empty_orphans;
+
+	for(auto & ring : work) {
+		const bool   orphaned = ring->orphaned;  // before reading head: no records can follow
+		const size_t head     = ring->head.load(std::memory_order_acquire);
+		size_t       tail     = ring->tail.load(std::memory_order_relaxed);
+
+		while(tail < head) {
+			const size_t       offset = tail & (ring->size - 1);
+			const log_record_t *r     = reinterpret_cast<const log_record_t *>(&ring->buffer[offset]);
+
+			if (r->size == 0) {  // wrap
+				tail += ring->size - offset;
+				continue;
+			}
+
+			lines.push_back({ r->ts, log_level_t(r->ll), format_record(r, ring->tid) });
+
+			tail += r->size;
+		}
+
+		ring->tail.store(tail, std::memory_order_release);
+
+		if (orphaned)
+			empty_orphans.push_back(ring);
+	}
+
+	if (empty_orphans.empty() == false) {
+		std::unique_lock<std::mutex> lck(rings_lock);
+
+		for(auto & ring : empty_orphans) {
+			rings.erase(std::find(rings.begin(), rings.end(), ring));
+			delete ring;
+		}
+	}
+
+	static uint64_t prev_dropped = 0;
+	uint64_t        cur_dropped  = n_dropped;
+
+	if (cur_dropped != prev_dropped) {
+		uint64_t now = get_us();
+		log_record_t r { 0, ll_warning, 0, now, "%lu log-message(s) dropped (log ring buffer full)\n", "log" };
+
+		// the argument directly follows the record
+		uint8_t temp[sizeof r + 2 + sizeof(uint64_t)];
+		memcpy(temp, &r, sizeof r);
+		uint8_t *p = temp + sizeof r;
+		uint64_t n = cur_dropped - prev_dropped;
+		log_async::put_arg(&p, n);
+		reinterpret_cast<log_record_t *>(temp)->n_args = 1;
+
+		lines.push_back({ now, ll_warning, format_record(reinterpret_cast<log_record_t *>(temp), gettid()) });
+
+		prev_dropped = cur_dropped;
+
+		if (dropped_counter)
+			__atomic_store_n(dropped_counter, cur_dropped, __ATOMIC_RELAXED);
+	}
+
+	if (lines.empty())
+		return;
+
+	// merge the threads
+	std::stable_sort(lines.begin(), lines.end(), [](const log_line_t & a, const log_line_t & b) { return a.ts < b.ts; });
+
+	write_lines(lines);
+}
+
+// true when every record that was stored has been written and no thread
+// is in the middle of storing one
+static bool rings_idle()
+{
+	std::unique_lock<std::mutex> lck(rings_lock);
+
+	for(auto & ring : rings) {
+		// in_reserve first: when it is false, the head of that record is visible
+		if (ring->in_reserve || ring->tail.load(std::memory_order_acquire) != ring->head.load(std::memory_order_acquire))
+			return false;
+	}
+
+	return true;
+}
+
+static void log_writer()
+{
+	pthread_setname_np(pthread_self(), "log-writer");
+
+	for(;;) {
+		{
+			std::unique_lock<std::mutex> lck(writer_cv_lock);
+
+			if (!writer_stop)
+				writer_cv.wait_for(lck, std::chrono::milliseconds(50));
+		}
+
+		if (writer_stop)
+			break;
+
+		drain_rings();
+	}
+
+	// new records are now written synchronously (see reserve()); flush
+	// until the threads that were in the middle of storing a record have
+	// committed it, for at most log_flush_max_ms
+	writer_state = ws_stopped;
+
+	const uint64_t until = get_ms() + log_flush_max_ms;
+
+	for(;;) {
+		drain_rings();
+
+		if (rings_idle() || get_ms() >= until)
+			break;
+
+		myusleep(1000);
+	}
+}
+
+static void fork_prepare()
+{
+	drain_lock.lock();
+	file_lock.lock();
+	rings_lock.lock();
+}
+
+static void fork_parent()
+{
+	rings_lock.unlock();
+	file_lock.unlock();
+	drain_lock.unlock();
+}
+
+static void fork_child()
+{
+	rings_lock.unlock();
+	file_lock.unlock();
+	drain_lock.unlock();
+
+	// the writer thread does not exist in the child
+	writer       = nullptr;
+	writer_state = ws_stopped;
+
+	// what is still in the rings is written by the parent
+	for(auto & ring : rings)
+		ring->tail.store(ring->head.load());
+}
+
+static void start_writer()
+{
+	std::unique_lock<std::mutex> lck(writer_lock);
+
+	if (writer_state != ws_idle)
+		return;
+
+	pthread_atfork(fork_prepare, fork_parent, fork_child);
+
+	atexit(closelog);
+
+	writer_state = ws_running;
+
+	writer = new std::thread(log_writer);
+}
+
+static void wake_writer()
+{
+	writer_cv.notify_one();
+}
+
+static log_ring *get_ring()
+{
+	if (!log_thread.ring) {
+		log_thread.ring = new log_ring(ring_size, gettid());
+
+		std::unique_lock<std::mutex> lck(rings_lock);
+		rings.push_back(log_thread.ring);
+	}
+
+	return log_thread.ring;
+}
+
+static void fill_record(uint8_t *const p, const size_t n, const log_level_t ll, const char *const fmt, const int n_args)
+{
+	if (!log_thread.name_set) {
+		pthread_getname_np(pthread_self(), log_thread.name, sizeof log_thread.name);
+		log_thread.name_set = true;
+	}
+
+	log_record_t *r = reinterpret_cast<log_record_t *>(p);
+
+	r->size   = n;
+	r->ll     = ll;
+	r->n_args = n_args;
+	r->ts     = get_us();
+	r->fmt    = fmt;
+	memcpy(r->thread_name, log_thread.name, sizeof r->thread_name);
+}
+
+uint8_t *log_async::reserve(const log_level_t ll, const char *const fmt, const int n_args, const size_t args_size)
+{
+	const size_t n = (sizeof(log_record_t) + args_size + 7) & ~size_t(7);
+
+	if (writer_state == ws_idle)
+		start_writer();
+
+	if (writer_state != ws_stopped) {
+		log_ring *ring = get_ring();
+
+		// set before looking at writer_state: a writer that stops after
+		// that waits for commit() (see log_writer())
+		ring->in_reserve = true;
+
+		while(writer_state != ws_stopped) {
+			if (n > ring->size / 2) {
+				if (drop_when_full) {
+					ring->in_reserve = false;
+					n_dropped++;
+					return nullptr;
+				}
+
+				// does not fit: write it directly, after what this
+				// thread has in the ring
+				drain_rings();
+				break;
+			}
+
+			size_t       pos    = ring->head.load(std::memory_order_relaxed);
+			const size_t tail   = ring->tail.load(std::memory_order_acquire);
+			size_t       offset = pos & (ring->size - 1);
+			size_t       pad    = offset + n > ring->size ? ring->size - offset : 0;
+
+			if (pos + pad + n - tail <= ring->size) {
+				if (pad) {
+					reinterpret_cast<log_record_t *>(&ring->buffer[offset])->size = 0;
+					pos += pad;
+					offset = 0;
+				}
+
+				ring->pending_head = pos + n;
+
+				fill_record(&ring->buffer[offset], n, ll, fmt, n_args);
+
+				return &ring->buffer[offset] + sizeof(log_record_t);
+			}
+
+			wake_writer();
+
+			if (drop_when_full) {
+				ring->in_reserve = false;
+				n_dropped++;
+				return nullptr;
+			}
+
+			myusleep(1000);
+		}
+
+		ring->in_reserve = false;
+	}
+
+	log_thread.sync_buffer.resize(n);
+	log_thread.pending_sync = true;
+
+	fill_record(log_thread.sync_buffer.data(), n, ll, fmt, n_args);
+
+	return log_thread.sync_buffer.data() + sizeof(log_record_t);
+}
+
+void log_async::commit()
+{
+	if (log_thread.pending_sync) {
+		log_thread.pending_sync = false;
+
+		const log_record_t *r = reinterpret_cast<const log_record_t *>(log_thread.sync_buffer.data());
+
+		write_lines({ { r->ts, log_level_t(r->ll), format_record(r, gettid()) } });
+
+		return;
+	}
+
+	log_ring *ring = log_thread.ring;
+
+	ring->head.store(ring->pending_head, std::memory_order_release);
+
+	ring->in_reserve = false;
+
+	if (writer_state == ws_stopped)  // the writer gave up waiting for this record
+		drain_rings();
+	else if (ring->pending_head - ring->tail.load(std::memory_order_relaxed) > ring->size / 2)
+		wake_writer();
+}
+
+void setlog(const char *lf, const log_level_t ll_file, const log_level_t ll_screen)
+{
+	std::unique_lock<std::mutex> lck(file_lock);
+
+	if (lfh) {
 		fclose(lfh);
+		lfh = nullptr;
+	}
 
 	free((void *)logfile);
 
@@ -35,65 +689,64 @@ void setlog(const char *lf, const log_level_t ll_file, const log_level_t ll_scre
 
 void setloguid(const int uid, const int gid)
 {
+	std::unique_lock<std::mutex> lck(file_lock);
+
 	lf_uid = uid;
 	lf_gid = gid;
 }
 
-void closelog()
+void setlog_async(const size_t ring_size_in, const bool drop_when_full_in, uint64_t *const dropped_counter_in)
 {
-	fclose(lfh);
-	lfh = nullptr;
+	// power of 2 so that the positions can wrap
+	size_t size = 4096;
+	while(size < ring_size_in)
+		size <<= 1;
+
+	ring_size       = size;  // for threads that did not log yet
+	drop_when_full  = drop_when_full_in;
+	dropped_counter = dropped_counter_in;
 }
 
-void dolog(const log_level_t ll, const char *fmt, ...)
+void setlog_thread_name(const char *const name)
 {
-	if (ll < log_level_file && ll < log_level_screen)
-		return;
+	strncpy(log_thread.name, name, sizeof log_thread.name - 1);
+	log_thread.name_set = true;
+}
 
-	if (!lfh) {
-		lfh = fopen(logfile, "a+");
-		if (!lfh) {
-			fprintf(stderr, "Cannot access log-file %s: %s\n", logfile, strerror(errno));
-			exit(1);
-		}
+// stops the writer: everything that was logged until now is written
+void closelog()
+{
+	std::thread *w = nullptr;
+
+	{
+		std::unique_lock<std::mutex> lck(writer_lock);
 
-		if (fchown(fileno(lfh), lf_uid, lf_gid) == -1)
-			fprintf(stderr, "Cannot change logfile (%s) ownership: %s\n", logfile, strerror(errno));
+		if (writer_state == ws_running) {
+			w = writer;
+			writer = nullptr;
 
-		if (fcntl(fileno(lfh), F_SETFD, FD_CLOEXEC) == -1) {
-			fprintf(stderr, "fcntl(FD_CLOEXEC): %s\n", strerror(errno));
-			exit(1);
+			std::unique_lock<std::mutex> cv_lck(writer_cv_lock);
+			writer_stop = true;
+			writer_cv.notify_one();
 		}
 	}
 
-	uint64_t now = get_us();
-	time_t t_now = now / 1000000;
-
-	struct tm tm { 0 };
-	if (!localtime_r(&t_now, &tm))
-		fprintf(stderr, "localtime_r: %s\n", strerror(errno));
-
-	char *ts_str = nullptr;
-
-	const char *const ll_names[] = { "debug  ", "info   ", "warning", "error  " };
+	if (w) {
+		if (w->get_id() == std::this_thread::get_id())  // exit() from within the writer
+			w->detach();
+		else {
+			w->join();
 
-	asprintf(&ts_str, "%04d-%02d-%02d %02d:%02d:%02d.%06d %d] %s %-15s ",
-			tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, int(now % 1000000),
-			gettid(), ll_names[ll], get_thread_name().c_str());
-
-	char *str = nullptr;
-
-	va_list ap;
-	va_start(ap, fmt);
-	(void)vasprintf(&str, fmt, ap);
-	va_end(ap);
+			drain_rings();  // records the writer did not wait for
+		}
 
-	if (ll >= log_level_file)
-		fprintf(lfh, "%s%s", ts_str, str);
+		delete w;
+	}
 
-	if (ll >= log_level_screen)
-		printf("%s%s", ts_str, str);
+	std::unique_lock<std::mutex> lck(file_lock);
 
-	free(str);
-	free(ts_str);
+	if (lfh) {
+		fclose(lfh);
+		lfh = nullptr;
+	}
 }
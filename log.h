@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstring>
+#include <stdint.h>
 #include <string>
+#include <type_traits>
 
 #include "str.h"
 
@@ -9,21 +12,116 @@ typedef enum { ll_debug, ll_info, ll_warning, ll_error } log_level_t;
 
 void setlog(const char *lf, const log_level_t ll_file, const log_level_t ll_screen);
 void setloguid(const int uid, const int gid);
+// ring_size: bytes per thread, drop_when_full: false means wait for the writer
+void setlog_async(const size_t ring_size, const bool drop_when_full, uint64_t *const dropped_counter);
+void setlog_thread_name(const char *const name);
 void closelog();
-void dolog(const log_level_t ll, const char *fmt, ...);
 
+/* dolog does not format: it stores the (pointer to the) format string and
+ * the raw arguments (strings are copied) in a lock-free ring buffer of the
+ * calling thread. A background thread formats these records and writes
+ * them in batches.
+ * For that reason the format must be a string literal.
+ */
+namespace log_async {
+	enum arg_type_t : uint8_t { at_signed, at_unsigned, at_double, at_string, at_pointer };
+
+	// returns where the arguments are to be stored, nullptr if the record was dropped
+	uint8_t *reserve(const log_level_t ll, const char *const fmt, const int n_args, const size_t args_size);
+	void     commit();
+
+	template<typename T>
+	size_t arg_size(const T v)
+	{
+		static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_pointer_v<T> || std::is_null_pointer_v<T>, "log arguments must be numbers, pointers or C-strings");
+
+		if constexpr (std::is_same_v<T, char *> || std::is_same_v<T, const char *>)
+			return 2 + sizeof(uint32_t) + (v ? strlen(v) : 6);
+
+		return 2 + sizeof(uint64_t);
+	}
+
+	template<typename T>
+	void put_arg(uint8_t **const p, const T v)
+	{
+		uint8_t *work = *p;
+
+		if constexpr (std::is_same_v<T, char *> || std::is_same_v<T, const char *>) {
+			const char *s   = v ? v : "(null)";
+			uint32_t    len = strlen(s);
+
+			*work++ = at_string;
+			*work++ = 0;
+			memcpy(work, &len, sizeof len);
+			memcpy(work + sizeof len, s, len);
+
+			*p = work + sizeof len + len;
+
+			return;
+		}
+		else if constexpr (std::is_pointer_v<T> || std::is_null_pointer_v<T>) {
+			uint64_t temp = uint64_t(uintptr_t(v));
+
+			*work++ = at_pointer;
+			*work++ = sizeof(void *);
+			memcpy(work, &temp, sizeof temp);
+		}
+		else if constexpr (std::is_floating_point_v<T>) {
+			double temp = v;
+
+			*work++ = at_double;
+			*work++ = sizeof(double);
+			memcpy(work, &temp, sizeof temp);
+		}
+		else if constexpr (std::is_enum_v<T> || std::is_signed_v<T>) {
+			int64_t temp = int64_t(v);
+
+			*work++ = at_signed;
+			*work++ = sizeof(T) < sizeof(int) ? sizeof(int) : sizeof(T);  // varargs promote to int
+			memcpy(work, &temp, sizeof temp);
+		}
+		else {
+			uint64_t temp = uint64_t(v);
+
+			*work++ = at_unsigned;
+			*work++ = sizeof(T) < sizeof(int) ? sizeof(int) : sizeof(T);
+			memcpy(work, &temp, sizeof temp);
+		}
+
+		*p = work + sizeof(uint64_t);
+	}
+}
+
+template<typename... Args>
+void dolog(const log_level_t ll, const char *const fmt, const Args... args)
+{
+	extern log_level_t log_level_file, log_level_screen;
+
+	if (ll < log_level_file && ll < log_level_screen)
+		return;
+
+	const size_t args_size = (size_t(0) + ... + log_async::arg_size(args));
+
+	uint8_t *p = log_async::reserve(ll, fmt, sizeof...(args), args_size);
+	if (!p)
+		return;
+
+	(log_async::put_arg(&p, args), ...);
+
+	log_async::commit();
+}
+
+// "" fmt: refuses to compile when fmt is not a string literal
 #define DOLOG(ll, fmt, ...) do {				\
 	extern log_level_t log_level_file, log_level_screen;	\
 								\
 	if (ll >= log_level_file || ll >= log_level_screen)	\
-		dolog(ll, fmt, ##__VA_ARGS__);			\
+		dolog(ll, "" fmt, ##__VA_ARGS__);		\
 } while(0)
 
 #define CDOLOG(ll, context, fmt, ...) do {			\
 	extern log_level_t log_level_file, log_level_screen;	\
 								\
-	if (ll >= log_level_file || ll >= log_level_screen) {	\
-		std::string __log_temp = myformat(fmt, ##__VA_ARGS__);\
-		dolog(ll, "%s %s", context, __log_temp.c_str()); \
-	}							\
+	if (ll >= log_level_file || ll >= log_level_screen)	\
+		dolog(ll, "%s " fmt, context, ##__VA_ARGS__);	\
 } while(0)
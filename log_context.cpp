@@ -0,0 +1,121 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#include <cstdio>
+#include <cstring>
+
+#include "log_context.h"
+#include "str.h"
+
+
+log_context::log_context()
+{
+}
+
+log_context::log_context(const char *const label)
+{
+	add_label(label);
+}
+
+log_context::log_context(const log_context & other) :
+	n_tags(other.n_tags)
+{
+	memcpy(tags, other.tags, n_tags * sizeof(tag_t));
+}
+
+log_context & log_context::operator =(const log_context & other)
+{
+	n_tags = other.n_tags;
+
+	memcpy(tags, other.tags, n_tags * sizeof(tag_t));
+
+	return *this;
+}
+
+log_context::tag_t *log_context::add(const tag_type_t type, const char *const name)
+{
+	// when full, the outer layers are kept: they identify the source
+	if (n_tags == max_tags)
+		return nullptr;
+
+	tag_t *t = &tags[n_tags++];
+
+	t->type = type;
+	t->name = name;
+
+	return t;
+}
+
+void log_context::add_label(const char *const name)
+{
+	add(tt_label, name);
+}
+
+void log_context::add_text(const char *const name, const char *const text)
+{
+	tag_t *t = add(tt_text, name);
+
+	if (t)
+		snprintf(t->text, sizeof t->text, "%s", text);
+}
+
+void log_context::add_mac(const char *const name, const uint8_t *const mac)
+{
+	tag_t *t = add(tt_mac, name);
+
+	if (t) {
+		t->addr.af = any_addr::mac;
+		memcpy(t->addr.bytes, mac, 6);
+	}
+}
+
+void log_context::add_addr(const char *const name, const any_addr & a)
+{
+	tag_t *t = add(tt_addr, name);
+
+	if (t) {
+		t->addr.af = a.get_family();
+		a.get(t->addr.bytes, a.get_len());
+	}
+}
+
+void log_context::add_ports(const char *const name, const int src_port, const int dst_port)
+{
+	tag_t *t = add(tt_ports, name);
+
+	if (t) {
+		t->ports.src = src_port;
+		t->ports.dst = dst_port;
+	}
+}
+
+std::string log_context::to_str() const
+{
+	std::string out;
+
+	for(int i=0; i<n_tags; i++) {
+		const tag_t & t = tags[i];
+
+		switch(t.type) {
+			case tt_label:
+				out += t.name;
+				break;
+
+			case tt_text:
+				out += myformat("%s[%s]", t.name, t.text);
+				break;
+
+			case tt_mac:
+				out += myformat("[%s:%02x%02x%02x%02x%02x%02x]", t.name, t.addr.bytes[0], t.addr.bytes[1], t.addr.bytes[2], t.addr.bytes[3], t.addr.bytes[4], t.addr.bytes[5]);
+				break;
+
+			case tt_addr:
+				out += myformat("[%s:%s]", t.name, any_addr(t.addr.af, t.addr.bytes).to_str().c_str());
+				break;
+
+			case tt_ports:
+				out += myformat("%s[%d->%d]", t.name, t.ports.src, t.ports.dst);
+				break;
+		}
+	}
+
+	return out;
+}
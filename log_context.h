@@ -0,0 +1,65 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#pragma once
+#include <stdint.h>
+#include <string>
+
+#include "any_addr.h"
+
+
+// where a packet came from (interface, addresses, ports), for log-messages
+// only the raw fields are stored while the packet travels through the
+// layers; they are turned into text when a log-message is actually emitted
+class log_context
+{
+public:
+	static constexpr int max_tags = 6;
+	static constexpr int max_text = 31;
+
+private:
+	enum tag_type_t { tt_label, tt_text, tt_mac, tt_addr, tt_ports };
+
+	typedef struct {
+		any_addr::addr_family af;
+		uint8_t               bytes[ANY_ADDR_SIZE];
+	} tag_addr_t;
+
+	typedef struct {
+		int src;
+		int dst;
+	} tag_ports_t;
+
+	typedef struct {
+		tag_type_t  type;
+		const char *name;  // must be a string literal (or otherwise outlive the packet)
+		union {
+			tag_addr_t  addr;
+			tag_ports_t ports;
+			char        text[max_text + 1];
+		};
+	} tag_t;
+
+	tag_t tags[max_tags];
+	int   n_tags { 0 };
+
+	tag_t *add(const tag_type_t type, const char *const name);
+
+public:
+	log_context();
+	log_context(const char *const label);
+	log_context(const log_context & other);
+
+	log_context & operator =(const log_context & other);
+
+	// label: "name"
+	void add_label(const char *const name);
+	// "name[text]", text is copied (and truncated to max_text)
+	void add_text(const char *const name, const char *const text);
+	// "[name:001122334455]"
+	void add_mac(const char *const name, const uint8_t *const mac);
+	// "[name:address]"
+	void add_addr(const char *const name, const any_addr & a);
+	// "name[src->dst]"
+	void add_ports(const char *const name, const int src_port, const int dst_port);
+
+	std::string to_str() const;
+};
@@ -21,6 +21,8 @@
 #include "phys_slip.h"
 #include "phys_vpn_insertion_point.h"
 #include "arp.h"
+#include "checksum.h"
+#include "crc.h"
 #include "dns.h"
 #include "graphviz.h"
 #include "ipv4.h"
@@ -243,7 +245,11 @@ std::pair<port_handler_t, int> get_http_handler(stats *const s, const libconfig:
 
 	bool        is_https    = cfg_bool(s_http, "is-https",    "Set to true if https (e.g. port 443)", true, false);
 
-	return { http_get_handler(s, web_root, web_logfile, is_https, php_cgi_bin), port };
+	int         n_workers   = cfg_int(s_http,  "worker-threads", "number of threads handling requests", true, 4);
+
+	int         cache_size  = cfg_int(s_http,  "file-cache-size", "static file cache size in kB", true, 16384);
+
+	return { http_get_handler(s, web_root, web_logfile, is_https, php_cgi_bin, n_workers, size_t(cache_size) * 1024), port };
 }
 
 void progress(const int cur, const int total)
@@ -305,6 +311,9 @@ int main(int argc, char *argv[])
 	const libconfig::Setting & root = lc_cfg.getRoot();
 
 	/// logging
+	int  log_ring_size      = 256;
+	bool log_drop_when_full = true;
+
 	{
 		const libconfig::Setting & logging = root.lookup("logging");
 
@@ -314,10 +323,16 @@ int main(int argc, char *argv[])
 		std::string log_file = cfg_str(logging, "file", "log file", true, "/tmp/myip.log");
 
 		setlog(log_file.c_str(), parse_ll(llf), parse_ll(lls));
+
+		// log-messages are stored per thread in a ring buffer and written by a background thread
+		log_ring_size      = cfg_int(logging, "ring-size", "size of the per-thread log buffer (kB)", true, 256);
+		log_drop_when_full = cfg_bool(logging, "drop-when-full", "drop log-messages when the buffer is full (else wait)", true, true);
 	}
 
 	DOLOG(ll_info, "*** START ***\n");
 
+	DOLOG(ll_info, "checksum kernel: %s, CRC-32C kernel: %s\n", checksum_kernel_name(), crc32c_kernel_name());
+
 	signal(SIGINT, ss);
 
 	snmp_data_type_running_since running_since;
@@ -334,6 +349,8 @@ int main(int argc, char *argv[])
 
 	stats s(16384, &sd);
 
+	setlog_async(log_ring_size * 1024, log_drop_when_full, s.register_stat("log_dropped"));
+
 	/// environment
 	int uid = 1000, gid = 1000;
 	std::string run_at_started;
@@ -585,8 +602,18 @@ int main(int argc, char *argv[])
 			bool use_tcp = cfg_bool(ipv4_, "use-tcp", "wether to enable tcp", true, true);
 			if (use_tcp) {
 				int n_threads = cfg_int(ipv4_, "n-tcp-threads", "number of tcp threads", true, 8);
+				int max_sessions = cfg_int(ipv4_, "max-tcp-sessions", "maximum number of concurrent tcp sessions", true, 128);
+				int send_buffer = std::max(1, cfg_int(ipv4_, "tcp-send-buffer", "maximum number of unacknowledged bytes per tcp session", true, 1048576));
+				int recv_buffer = std::max(1, cfg_int(ipv4_, "tcp-receive-buffer", "tcp receive window size", true, 262144));
+				std::string cc_name = cfg_str(ipv4_, "tcp-congestion-control", "newreno or cubic", true, "cubic");
 
-				tcp *t = new tcp(&s, icmp_, n_threads);
+				auto cc_algorithm = tcp_cc_from_name(cc_name);
+				if (cc_algorithm.has_value() == false)
+					error_exit(false, "Unknown tcp congestion control algorithm \"%s\"", cc_name.c_str());
+
+				int delayed_ack = std::max(0, cfg_int(ipv4_, "tcp-delayed-ack", "delayed ack time-out in milliseconds (0 = disabled)", true, 40));
+
+				tcp *t = new tcp(&s, icmp_, n_threads, max_sessions, send_buffer, recv_buffer, cc_algorithm.value(), std::min(uint64_t(delayed_ack) * 1000, tcp_delayed_ack_max_us));
 				ipv4_instance->register_protocol(0x06, t);
 
 				g->add_connection(g->add_node("tcp " + my_ipv4_address.to_str(), "TCP"), ma_str);
@@ -684,8 +711,18 @@ int main(int argc, char *argv[])
 			bool use_tcp = cfg_bool(ipv6_, "use-tcp", "wether to enable tcp", true, true);
 			if (use_tcp) {
 				int n_threads = cfg_int(ipv6_, "n-tcp-threads", "number of tcp threads", true, 8);
+				int max_sessions = cfg_int(ipv6_, "max-tcp-sessions", "maximum number of concurrent tcp sessions", true, 128);
+				int send_buffer = std::max(1, cfg_int(ipv6_, "tcp-send-buffer", "maximum number of unacknowledged bytes per tcp session", true, 1048576));
+				int recv_buffer = std::max(1, cfg_int(ipv6_, "tcp-receive-buffer", "tcp receive window size", true, 262144));
+				std::string cc_name = cfg_str(ipv6_, "tcp-congestion-control", "newreno or cubic", true, "cubic");
+
+				auto cc_algorithm = tcp_cc_from_name(cc_name);
+				if (cc_algorithm.has_value() == false)
+					error_exit(false, "Unknown tcp congestion control algorithm \"%s\"", cc_name.c_str());
 
-				tcp *t6 = new tcp(&s, icmp6_, n_threads);
+				int delayed_ack = std::max(0, cfg_int(ipv6_, "tcp-delayed-ack", "delayed ack time-out in milliseconds (0 = disabled)", true, 40));
+
+				tcp *t6 = new tcp(&s, icmp6_, n_threads, max_sessions, send_buffer, recv_buffer, cc_algorithm.value(), std::min(uint64_t(delayed_ack) * 1000, tcp_delayed_ack_max_us));
 				ipv6_instance->register_protocol(0x06, t6);  // TCP
 				transport_layers.push_back(t6);
 
@@ -1008,6 +1045,11 @@ int main(int argc, char *argv[])
 
 		hpd->certificate = c_str.value();
 
+		int n_tls_sessions = cfg_int(s_http, "tls-session-cache", "number of TLS sessions that can be resumed", true, 256);
+
+		if (https_load_credentials(hpd, n_tls_sessions) == false)
+			error_exit(false, "Failed to parse certificate and/or private key");
+
 		register_tcp_service(&devs, rc.first, rc.second);
 
 		register_sctp_service(&devs, rc.first, rc.second);
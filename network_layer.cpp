@@ -2,9 +2,11 @@
 #include <chrono>
 #include <arpa/inet.h>
 
+#include "checksum.h"
 #include "transport_layer.h"
 #include "log.h"
 #include "network_layer.h"
+#include "phys.h"
 
 
 constexpr size_t pkts_max_size { 128 };
@@ -35,6 +37,42 @@ transport_layer *network_layer::get_transport_layer(const uint8_t protocol)
 	return it->second;
 }
 
+buffer_pool *network_layer::get_buffer_pool() const
+{
+	return default_pdev ? default_pdev->get_buffer_pool() : nullptr;
+}
+
+int network_layer::get_path_max_packet_size(const any_addr & dst_ip) const
+{
+	int size = get_max_packet_size();
+
+	if (r) {
+		auto pmtu = r->get_pmtu(dst_ip);
+
+		if (pmtu.has_value())  // the ip header is not part of it
+			size = std::min(size, pmtu.value() - (dst_ip.get_family() == any_addr::ipv6 ? 40 : 20));
+	}
+
+	return size;
+}
+
+bool network_layer::transmit_packet(const std::optional<any_addr> & dst_mac, const any_addr & dst_ip, const any_addr & src_ip, const uint8_t protocol, const buffer_chain & payload, const uint8_t *const header_template)
+{
+	if (payload.get_n_segments() == 1)
+		return transmit_packet(dst_mac, dst_ip, src_ip, protocol, payload.get_segment_data(0), payload.get_segment_size(0), header_template);
+
+	size_t   out_size = payload.get_size();
+	uint8_t *out      = new uint8_t[out_size + 1];
+
+	payload.copy_to(out);
+
+	bool rc = transmit_packet(dst_mac, dst_ip, src_ip, protocol, out, out_size, header_template);
+
+	delete [] out;
+
+	return rc;
+}
+
 void network_layer::queue_incoming_packet(phys *const interface, packet *p)
 {
 	if (pkts->try_put({ interface, p }) == false) {
@@ -44,15 +82,36 @@ void network_layer::queue_incoming_packet(phys *const interface, packet *p)
 	}
 }
 
-uint16_t ip_checksum(const uint16_t *const p, const size_t n)
+// hands the packets of one batch to the transport layers, one put_bulk
+// (and thus one wake-up) per transport layer
+void network_layer::deliver_batch(transport_layer *const *const targets, packet *const *const packets, const int n)
 {
-        uint32_t cksum = 0;
+	bool    done[pkts_batch_size] { false };
+	packet *group[pkts_batch_size];
+
+	for(int i=0; i<n; i++) {
+		if (done[i])
+			continue;
+
+		int n_group = 0;
 
-        for(size_t i=0; i<n; i++) 
-                cksum += htons(p[i]);
+		for(int j=i; j<n; j++) {
+			if (targets[j] == targets[i]) {
+				group[n_group++] = packets[j];
+				done[j] = true;
+			}
+		}
+
+		targets[i]->queue_packets(group, n_group);
+	}
+}
+
+uint16_t ip_checksum(const uint16_t *const p, const size_t n)
+{
+	checksum_state_t state;
+	checksum_init(&state);
 
-	cksum = (cksum >> 16) + (cksum & 0xffff);
-	cksum += cksum >> 16;
+	checksum_add(&state, reinterpret_cast<const uint8_t *>(p), n * 2);
 
-        return ~cksum;
+	return checksum_finish(&state);
 }
@@ -9,6 +9,7 @@
 #include <thread>
 #include <vector>
 
+#include "buffer_chain.h"
 #include "fifo.h"
 #include "packet.h"
 #include "router.h"
@@ -18,6 +19,9 @@ class icmp;
 class transport_layer;
 class phys;
 
+// maximum number of packets a worker takes from its fifo per wake-up
+constexpr int pkts_batch_size { 16 };
+
 typedef struct {
 	phys *interface;
 	packet *p;
@@ -37,6 +41,8 @@ protected:
 
 	router               *r            { nullptr };
 
+	void deliver_batch(transport_layer *const *const targets, packet *const *const packets, const int n);
+
 public:
 	network_layer(stats *const s, const std::string & stats_name, router *const r);
 	virtual ~network_layer();
@@ -47,6 +53,9 @@ public:
 
 	void register_default_phys(phys *const p) { default_pdev = p; }
 
+	// packet buffers of the default interface (nullptr if there's none yet)
+	buffer_pool *get_buffer_pool() const;
+
 	void register_protocol(const uint8_t protocol, transport_layer *const p);
 
 	transport_layer *get_transport_layer(const uint8_t protocol);
@@ -56,9 +65,17 @@ public:
 	virtual void queue_incoming_packet(phys *const interface, packet *p);
 
 	virtual bool transmit_packet(const std::optional<any_addr> & dst_mac, const any_addr & dst_ip, const any_addr & src_ip, const uint8_t protocol, const uint8_t *payload, const size_t pl_size, const uint8_t *const header_template) = 0;
+	// the network layer prepends its header as a new segment; the default
+	// implementation flattens the chain
+	virtual bool transmit_packet(const std::optional<any_addr> & dst_mac, const any_addr & dst_ip, const any_addr & src_ip, const uint8_t protocol, const buffer_chain & payload, const uint8_t *const header_template);
 
 	virtual int get_max_packet_size() const = 0;
 
+	// same, but for packets to 'dst_ip' (takes the path MTU into account)
+	int get_path_max_packet_size(const any_addr & dst_ip) const;
+
+	router *get_router() const { return r; }
+
 	virtual void operator()() = 0;
 };
 
@@ -4,39 +4,95 @@
 #include "utils.h"
 
 
-packet::packet(const timespec & ts_in, const any_addr & src_mac_addr, const any_addr & src_addr, const any_addr & dst_addr, const uint8_t *const in, const int size, const uint8_t *const header, const int header_size, const std::string & log_prefix, const bool is_forwarded) :
+packet::packet(const timespec & ts_in, const any_addr & src_mac_addr, const any_addr & src_addr, const any_addr & dst_addr, const uint8_t *const in, const int size, const uint8_t *const header, const int header_size, const log_context & log_prefix, const bool is_forwarded, buffer_pool *const pool) :
 	ts(ts_in),
 	src_mac_addr(src_mac_addr), src_addr(src_addr), dst_addr(dst_addr),
+	size(size),
 	log_prefix(log_prefix),
+	header_size(header_size),
 	is_forwarded(is_forwarded)
 {
-	this->size = size;
-	data = ::duplicate(in, size);
-
-	this->header_size = header_size;
-	this->header = header_size ? ::duplicate(header, header_size) : nullptr;
+	fill(pool, in, header);
 }
 
-packet::packet(const timespec & ts_in, const any_addr & src_addr, const any_addr & dst_addr, const uint8_t *const in, const int size, const uint8_t *const header, const int header_size, const std::string & log_prefix, const bool is_forwarded) :
+packet::packet(const timespec & ts_in, const any_addr & src_addr, const any_addr & dst_addr, const uint8_t *const in, const int size, const uint8_t *const header, const int header_size, const log_context & log_prefix, const bool is_forwarded, buffer_pool *const pool) :
 	ts(ts_in),
 	src_mac_addr(src_addr), src_addr(src_addr), dst_addr(dst_addr),
+	size(size),
+	log_prefix(log_prefix),
+	header_size(header_size),
+	is_forwarded(is_forwarded)
+{
+	fill(pool, in, header);
+}
+
+packet::packet(const timespec & ts_in, const any_addr & src_mac_addr, const any_addr & src_addr, const any_addr & dst_addr, pool_block_t *const block, const uint8_t *const in, const int size, const uint8_t *const header, const int header_size, const log_context & log_prefix, const bool is_forwarded) :
+	ts(ts_in),
+	src_mac_addr(src_mac_addr), src_addr(src_addr), dst_addr(dst_addr),
+	block(block),
+	data(const_cast<uint8_t *>(in)),
+	size(size),
 	log_prefix(log_prefix),
+	header(const_cast<uint8_t *>(header)),
+	header_size(header_size),
 	is_forwarded(is_forwarded)
 {
-	this->size = size;
-	data = ::duplicate(in, size);
+	pool_block_ref(block);
+}
 
-	this->header_size = header_size;
-	this->header = header_size ? ::duplicate(header, header_size) : nullptr;
+// the contents are never altered after construction, so copies share the buffer
+packet::packet(const packet & other) :
+	ts(other.ts),
+	src_mac_addr(other.src_mac_addr), src_addr(other.src_addr), dst_addr(other.dst_addr),
+	block(other.block),
+	data(other.data),
+	size(other.size),
+	log_prefix(other.log_prefix),
+	header(other.header),
+	header_size(other.header_size),
+	is_forwarded(other.is_forwarded),
+	bytes_copied(other.bytes_copied)
+{
+	pool_block_ref(block);
+}
+
+void packet::fill(buffer_pool *const pool, const uint8_t *const in, const uint8_t *const header_in)
+{
+	block = pool_allocate(pool, header_size + size);
+
+	uint8_t *p = pool_block_data(block);
+
+	if (header_size) {
+		memcpy(p, header_in, header_size);
+		header = p;
+	}
+	else {
+		header = nullptr;
+	}
+
+	data = p + header_size;
+
+	if (size)
+		memcpy(data, in, size);
+
+	bytes_copied = header_size + size;
 }
 
 packet::~packet()
 {
-	delete [] header;
-	delete [] data;
+	pool_block_unref(block);
 }
 
 packet *packet::duplicate() const
 {
-	return new packet(ts, src_mac_addr, src_addr, dst_addr, data, size, header, header_size, log_prefix, is_forwarded);
+	return new packet(*this);
+}
+
+packet *packet::view(const any_addr & src_addr, const any_addr & dst_addr, const uint8_t *const in, const int size, const uint8_t *const header, const int header_size) const
+{
+	packet *p = new packet(ts, src_mac_addr, src_addr, dst_addr, block, in, size, header, header_size, log_prefix);
+
+	p->bytes_copied = bytes_copied;
+
+	return p;
 }
@@ -6,6 +6,8 @@
 #include <sys/time.h>
 
 #include "any_addr.h"
+#include "buffer_pool.h"
+#include "log_context.h"
 
 class packet
 {
@@ -17,10 +19,13 @@ private:
 	const any_addr src_addr;
 	const any_addr dst_addr;
 
+	// header and data are stored in one (pooled, reference counted) block
+	pool_block_t  *block;
+
 	uint8_t       *data;
 	int            size;
 
-	std::string    log_prefix;
+	log_context    log_prefix;
 
 	// this is required for ICMP: it needs certain fields from the source (IP-)header
 	uint8_t       *header;
@@ -28,11 +33,23 @@ private:
 
 	const bool     is_forwarded;
 
+	int            bytes_copied { 0 };  // memcpy'd to build this packet (including its parents)
+
+	void fill(buffer_pool *const pool, const uint8_t *const in, const uint8_t *const header_in);
+
 public:
-	packet(const timespec & ts, const any_addr & src_addr, const any_addr & dst_addr, const uint8_t *const in, const int size, const uint8_t *const header, const int header_size, const std::string & log_prefix, const bool is_forwarded = false);
-	packet(const timespec & ts, const any_addr & src_mac_addr, const any_addr & src_addr, const any_addr & dst_addr, const uint8_t *const in, const int size, const uint8_t *const header, const int header_size, const std::string & log_prefix, const bool is_forwarded = false);
+	packet(const timespec & ts, const any_addr & src_addr, const any_addr & dst_addr, const uint8_t *const in, const int size, const uint8_t *const header, const int header_size, const log_context & log_prefix, const bool is_forwarded = false, buffer_pool *const pool = nullptr);
+	packet(const timespec & ts, const any_addr & src_mac_addr, const any_addr & src_addr, const any_addr & dst_addr, const uint8_t *const in, const int size, const uint8_t *const header, const int header_size, const log_context & log_prefix, const bool is_forwarded = false, buffer_pool *const pool = nullptr);
+	// view into an existing buffer: takes a reference instead of copying
+	packet(const timespec & ts, const any_addr & src_mac_addr, const any_addr & src_addr, const any_addr & dst_addr, pool_block_t *const block, const uint8_t *const in, const int size, const uint8_t *const header, const int header_size, const log_context & log_prefix, const bool is_forwarded = false);
+	packet(const packet & other);
 	virtual ~packet();
 
+	pool_block_t *get_block() const { return block; }
+
+	// pool the buffer of this packet came from (nullptr if from the heap)
+	buffer_pool *get_buffer_pool() const { return block->pool; }
+
 	uint8_t *get_data() const { return data; }
 	std::pair<const uint8_t *, int> get_payload() const { return { data, size }; }
 
@@ -40,9 +57,14 @@ public:
 
 	int get_size() const { return size; }
 
-	void add_to_log_prefix(const std::string & what) { log_prefix += what; }
+	// each layer adds its tag (addresses, ports) here; that is cheap as
+	// the text is only produced by get_log_prefix()
+	log_context & get_log_context() { return log_prefix; }
+	const log_context & get_log_context() const { return log_prefix; }
 
-	std::string get_log_prefix() const { return log_prefix; }
+	// only call this when a log-message is actually emitted (e.g. in the
+	// arguments of DOLOG/CDOLOG which are not evaluated otherwise)
+	std::string get_log_prefix() const { return log_prefix.to_str(); }
 
 	const any_addr & get_src_mac_addr() const { return src_mac_addr; }
 
@@ -54,5 +76,10 @@ public:
 
 	struct timespec get_recv_ts() const { return ts; }
 
+	int get_bytes_copied() const { return bytes_copied; }
+
 	packet *duplicate() const;
+
+	// packet for the next layer, pointing into the same buffer
+	packet *view(const any_addr & src_addr, const any_addr & dst_addr, const uint8_t *const in, const int size, const uint8_t *const header, const int header_size) const;
 };
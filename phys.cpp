@@ -20,7 +20,10 @@
 #include "str.h"
 
 
+constexpr int pool_n_blocks { 1024 };
+
 phys::phys(const size_t dev_index, stats *const s, const std::string & name, router *const r) :
+	s(s),
 	r(r),
 	dev_index(dev_index),  // used for SNMP
 	name(name)
@@ -51,6 +54,19 @@ phys::~phys()
 		th->join();
 		delete th;
 	}
+
+	// 'pool' is not freed: packets from it may still be queued in
+	// other layers that are not stopped before the devices are
+}
+
+buffer_pool *phys::get_buffer_pool()
+{
+	std::call_once(pool_once, [this] {
+			// Ethernet header + MTU sized payload
+			pool = new buffer_pool(s, name, mtu_size + 14, pool_n_blocks);
+		});
+
+	return pool;
 }
 
 void phys::start()
@@ -160,6 +176,23 @@ bool phys::transmit_packet(const any_addr & dst_mac, const any_addr & src_mac, c
 	return false;
 }
 
+bool phys::transmit_packet(const any_addr & dst_mac, const any_addr & src_mac, const uint16_t ether_type, const buffer_chain & payload)
+{
+	if (payload.get_n_segments() == 1)
+		return transmit_packet(dst_mac, src_mac, ether_type, payload.get_segment_data(0), payload.get_segment_size(0));
+
+	size_t   out_size = payload.get_size();
+	uint8_t *out      = new uint8_t[out_size + 1];
+
+	payload.copy_to(out);
+
+	bool rc = transmit_packet(dst_mac, src_mac, ether_type, out, out_size);
+
+	delete [] out;
+
+	return rc;
+}
+
 void phys::operator()()
 {
 	CDOLOG(ll_info, "[phys]", "thread stopped\n");
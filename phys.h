@@ -8,6 +8,8 @@
 #include <thread>
 
 #include "any_addr.h"
+#include "buffer_chain.h"
+#include "buffer_pool.h"
 #include "network_layer.h"
 #include "stats.h"
 
@@ -37,6 +39,8 @@ protected:
 
 	int       mtu_size         { 0 };
 
+	stats    *const s;
+
 	router   *const r;
 	std::map<uint16_t, network_layer *> prot_map;
 
@@ -48,6 +52,9 @@ protected:
 
 	bool      SIOCGSTAMPNS_OLD_error_emitted = false;
 
+	std::once_flag pool_once;
+	buffer_pool   *pool           { nullptr };
+
 	std::mutex pcap_lock;
 	pcap_t   *ph                  { nullptr };
 	pcap_dumper_t *pdh            { nullptr };
@@ -79,9 +86,15 @@ public:
 	network_layer *get_protocol(const uint16_t p);
 
 	virtual bool transmit_packet(const any_addr & dest_mac, const any_addr & src_mac, const uint16_t ether_type, const uint8_t *payload, const size_t pl_size) = 0;
+	// the default implementation flattens the chain (when it has more than one segment)
+	virtual bool transmit_packet(const any_addr & dest_mac, const any_addr & src_mac, const uint16_t ether_type, const buffer_chain & payload);
 
 	int get_max_packet_size() const { return mtu_size - 14 /* 14 = size of Ethernet header */; }
 
+	// MTU sized packet buffers for this interface; created on first use
+	// as the MTU is only known after the constructor of the sub-class ran
+	buffer_pool *get_buffer_pool();
+
 	std::string to_str() const { return name; }
 
 	virtual any_addr::addr_family get_phys_type() = 0;
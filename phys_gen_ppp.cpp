@@ -624,7 +624,7 @@ void phys_gen_ppp::process_incoming_packet(std::vector<uint8_t> packet_buffer, c
 			CDOLOG(ll_warning, "[ppp]", "no IPv4 stack attached to PPP device (yet)\n");
 		else {
 			// 4 ppp header, 2 fcs (=crc)
-			packet *p = new packet(ts, src_mac, my_mac, packet_buffer.data() + 4, packet_buffer.size() - (4 + 2), NULL, 0, "PPP[]");
+			packet *p = new packet(ts, src_mac, my_mac, packet_buffer.data() + 4, packet_buffer.size() - (4 + 2), NULL, 0, "PPP[]", false, get_buffer_pool());
 
 			it->second->queue_incoming_packet(this, p);
 		}
@@ -388,7 +388,8 @@ bool process_kiss_packet(const timespec & ts, const std::vector<uint8_t> & in, s
 		if (source_phys)
 			r->add_ax25_route(ap.get_from().get_any_addr(), { source_phys }, { });
 
-		std::string log_prefix = "KISS[" + ap.get_from().get_any_addr().to_str() + "]";
+		log_context log_prefix;
+		log_prefix.add_addr("KISS", ap.get_from().get_any_addr());
 		CDOLOG(ll_info, "[kiss]", "%s: received packet of %zu bytes\n", ap.to_str().c_str(), in.size());
 
 		if (ap.get_type() == ax25_packet::frame_type::TYPE_I || ap.get_type() == ax25_packet::frame_type::TYPE_UI) {
@@ -404,7 +405,7 @@ bool process_kiss_packet(const timespec & ts, const std::vector<uint8_t> & in, s
 				auto payload = ap.get_data();
 				int  pl_size = payload.get_n_bytes_left();
 
-				packet *p = new packet(ts, ap.get_from().get_any_addr(), ap.get_from().get_any_addr(), ap.get_to().get_any_addr(), payload.get_bytes(pl_size), pl_size, nullptr, 0, log_prefix);
+				packet *p = new packet(ts, ap.get_from().get_any_addr(), ap.get_from().get_any_addr(), ap.get_to().get_any_addr(), payload.get_bytes(pl_size), pl_size, nullptr, 0, log_prefix, false, source_phys->get_buffer_pool());
 
 				int ip_version = p->get_data()[0] >> 4;
 
@@ -434,7 +435,7 @@ bool process_kiss_packet(const timespec & ts, const std::vector<uint8_t> & in, s
 				auto payload = ap.get_data();
 				int  pl_size = payload.get_n_bytes_left();
 
-				packet *p = new packet(ts, ap.get_from().get_any_addr(), ap.get_from().get_any_addr(), ap.get_to().get_any_addr(), payload.get_bytes(pl_size), pl_size, nullptr, 0, log_prefix);
+				packet *p = new packet(ts, ap.get_from().get_any_addr(), ap.get_from().get_any_addr(), ap.get_to().get_any_addr(), payload.get_bytes(pl_size), pl_size, nullptr, 0, log_prefix, false, source_phys->get_buffer_pool());
 
 				auto it = prot_map->find(0x0806);
 				if (it != prot_map->end())
@@ -477,7 +478,14 @@ bool process_kiss_packet(const timespec & ts, const std::vector<uint8_t> & in, s
 	}
 	else {
 		if (in.size() >= 6 + 6 + 2 + 46) {  // could be Ethernet over AX.25 (see eoax)
-			if (process_ethernet_frame(ts, in, prot_map, r, source_phys)) {
+			pool_block_t *frame = pool_allocate(source_phys->get_buffer_pool(), in.size());
+			memcpy(pool_block_data(frame), in.data(), in.size());
+
+			bool ok = process_ethernet_frame(ts, frame, pool_block_data(frame), in.size(), prot_map, r, source_phys);
+
+			pool_block_unref(frame);
+
+			if (ok) {
 				CDOLOG(ll_info, "[kiss]", "failed processing Ethernet frame\n");
 				rc = false;
 			}
@@ -46,7 +46,7 @@ bool phys_ppp::transmit_low(const std::vector<uint8_t> & payload, const uint16_t
 		CDOLOG(ll_error, "[ppp]", "problem sending packet (%d for %zu bytes): %s\n", rc, out_wrapped.size(), strerror(errno));
 
 		if (rc == -1)
-			CDOLOG(ll_error, "%s\n", strerror(errno));
+			CDOLOG(ll_error, "[ppp]", "%s\n", strerror(errno));
 
 		ok = false;
 	}
@@ -150,8 +150,7 @@ void phys_promiscuous::operator()()
 
 	struct pollfd fds[] = { { fd, POLLIN, 0 } };
 
-	// unfortunately the MTU gives no guarantees about the size of received packets
-	uint8_t buffer[65536];
+	buffer_pool *pool = get_buffer_pool();
 
 	while(!stop_flag) {
 		int rc = poll(fds, 1, 150);
@@ -166,7 +165,19 @@ void phys_promiscuous::operator()()
 		if (rc == 0)
 			continue;
 
-		int size = read(fd, reinterpret_cast<char *>(buffer), sizeof buffer);
+		// unfortunately the MTU gives no guarantees about the size of received
+		// packets: peek at the size first so that the frame can be read directly
+		// in a buffer that is then passed on to the upper layers
+		int peek_size = recv(fd, nullptr, 0, MSG_PEEK | MSG_TRUNC);
+		if (peek_size == -1) {
+			CDOLOG(ll_error, "[prom]", "recv: %s\n", strerror(errno));
+			continue;
+		}
+
+		pool_block_t *frame  = pool_allocate(pool, std::max(peek_size, 1));
+		uint8_t      *buffer = pool_block_data(frame);
+
+		int size = read(fd, reinterpret_cast<char *>(buffer), frame->size);
 
 		auto ts = gen_packet_timestamp(fd);
 
@@ -179,11 +190,14 @@ void phys_promiscuous::operator()()
 
 		if (size < 14) {
 			stats_inc_counter(phys_invl_frame);
+			pool_block_unref(frame);
 			continue;
 		}
 
-		if (process_ethernet_frame(ts, std::vector<uint8_t>(buffer, buffer + size), &prot_map, r, this) == false)
+		if (process_ethernet_frame(ts, frame, buffer, size, &prot_map, r, this) == false)
 			CDOLOG(ll_info, "[prom]", "failed processing Ethernet frame\n");
+
+		pool_block_unref(frame);
 	}
 
 	CDOLOG(ll_info, "[prom]", "thread stopped\n");
@@ -159,9 +159,10 @@ void phys_sctp_udp::operator()()
 		my_addr.get(&ip_buffer[16], 4);                    // TO (here)
 		memcpy(&ip_buffer[20], buffer, size);
 
-		std::string log_prefix = myformat("SCTP/UDP[%s]", host.value().c_str());
+		log_context log_prefix;
+		log_prefix.add_text("SCTP/UDP", host.value().c_str());
 
-		packet *p = new packet(ts, src_mac, src_mac, my_mac, ip_buffer, total_length, nullptr, 0, log_prefix);
+		packet *p = new packet(ts, src_mac, src_mac, my_mac, ip_buffer, total_length, nullptr, 0, log_prefix, false, get_buffer_pool());
 
 		it->second->queue_incoming_packet(this, p);
 	}
@@ -155,7 +155,7 @@ void phys_slip::operator()()
 			if (it == prot_map.end())
 				CDOLOG(ll_warning, "[slip]", "no IPv4 stack attached to SLIP device (yet)\n");
 			else {
-				packet *p = new packet(ts, src_mac, my_mac, packet_buffer.data(), packet_buffer.size(), NULL, 0, "SLIP[]");
+				packet *p = new packet(ts, src_mac, my_mac, packet_buffer.data(), packet_buffer.size(), NULL, 0, "SLIP[]", false, get_buffer_pool());
 
 				it->second->queue_incoming_packet(this, p);
 			}
@@ -13,6 +13,7 @@
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include "log.h"
 #include "phys_kiss.h"
@@ -105,24 +106,42 @@ phys_tap::~phys_tap()
 }
 
 bool phys_tap::transmit_packet(const any_addr & dst_mac, const any_addr & src_mac, const uint16_t ether_type, const uint8_t *payload, const size_t pl_size)
+{
+	return transmit_packet(dst_mac, src_mac, ether_type, buffer_chain(nullptr, payload, pl_size));
+}
+
+bool phys_tap::transmit_packet(const any_addr & dst_mac, const any_addr & src_mac, const uint16_t ether_type, const buffer_chain & payload)
 {
 	CDOLOG(ll_debug, "[tap]", "transmit packet %s -> %s\n", src_mac.to_str().c_str(), dst_mac.to_str().c_str());
 
-	size_t out_size = pl_size + 14;
+	uint8_t header[14];
 
-	if (out_size < 64)
-		out_size = 64;
+	dst_mac.get(&header[0], 6);
+
+	src_mac.get(&header[6], 6);
+
+	header[12] = ether_type >> 8;
+	header[13] = ether_type;
 
-	uint8_t *out = new uint8_t[out_size]();
+	// Ethernet header, the segments of the payload and padding: all
+	// written with a single writev() without copying the payload
+	struct iovec iov[max_chain_segments + 2];
+	iov[0].iov_base = header;
+	iov[0].iov_len  = sizeof header;
 
-	dst_mac.get(&out[0], 6);
+	int n_iov = 1 + payload.to_iovec(&iov[1]);
 
-	src_mac.get(&out[6], 6);
+	size_t out_size = payload.get_size() + sizeof header;
 
-	out[12] = ether_type >> 8;
-	out[13] = ether_type;
+	static const uint8_t padding[64] { 0 };
 
-	memcpy(&out[14], payload, pl_size);
+	if (out_size < 64) {
+		iov[n_iov].iov_base = const_cast<uint8_t *>(padding);
+		iov[n_iov].iov_len  = 64 - out_size;
+		n_iov++;
+
+		out_size = 64;
+	}
 
 	// crc32 is not included in a tap device
 
@@ -130,15 +149,24 @@ bool phys_tap::transmit_packet(const any_addr & dst_mac, const any_addr & src_ma
 	stats_add_counter(phys_ifHCOutOctets, out_size);
 	stats_inc_counter(phys_ifOutUcastPkts);
 
-	timespec ts { 0, 0 };
-	if (clock_gettime(CLOCK_REALTIME, &ts) == -1)
-		CDOLOG(ll_warning, "[tap]", "clock_gettime failed: %s\n", strerror(errno));
+	if (pcap_write_outgoing) {
+		timespec ts { 0, 0 };
+		if (clock_gettime(CLOCK_REALTIME, &ts) == -1)
+			CDOLOG(ll_warning, "[tap]", "clock_gettime failed: %s\n", strerror(errno));
 
-	pcap_write_packet_outgoing(ts, out, out_size);
+		uint8_t *out = new uint8_t[out_size]();
+
+		memcpy(out, header, sizeof header);
+		payload.copy_to(&out[sizeof header]);
+
+		pcap_write_packet_outgoing(ts, out, out_size);
+
+		delete [] out;
+	}
 
 	bool ok = true;
 
-	int rc = write(fd, out, out_size);
+	int rc = writev(fd, iov, n_iov);
 
 	if (size_t(rc) != out_size) {
 		CDOLOG(ll_error, "[tap]", "problem sending packet (%d for %zu bytes)\n", rc, out_size);
@@ -149,8 +177,6 @@ bool phys_tap::transmit_packet(const any_addr & dst_mac, const any_addr & src_ma
 		ok = false;
 	}
 
-	delete [] out;
-
 	return ok;
 }
 
@@ -162,7 +188,9 @@ void phys_tap::operator()()
 
 	struct pollfd fds[] = { { fd, POLLIN, 0 } };
 
-	uint8_t buffer[65536];
+	buffer_pool *pool = get_buffer_pool();
+
+	uint8_t overflow[65536];
 
 	while(!stop_flag) {
 		int rc = poll(fds, 1, 150);
@@ -177,7 +205,28 @@ void phys_tap::operator()()
 		if (rc == 0)
 			continue;
 
-		int size = read(fd, reinterpret_cast<char *>(buffer), sizeof buffer);
+		// read directly in the buffer that is passed on to the upper layers;
+		// frames can be bigger than the MTU (offloading, VLAN tags), the
+		// remainder of those goes in 'overflow'
+		pool_block_t *frame  = pool_allocate(pool, pool->get_block_size());
+		uint8_t      *buffer = pool_block_data(frame);
+
+		struct iovec iov[] { { buffer, frame->size }, { overflow, sizeof overflow } };
+
+		int size = readv(fd, iov, 2);
+
+		if (size > int(frame->size)) {
+			// rare: copy it into a buffer that fits (counted as a pool miss)
+			pool_block_t *big = pool_allocate(pool, size);
+
+			memcpy(pool_block_data(big), buffer, frame->size);
+			memcpy(pool_block_data(big) + frame->size, overflow, size - frame->size);
+
+			pool_block_unref(frame);
+
+			frame  = big;
+			buffer = pool_block_data(big);
+		}
 
 		auto ts = gen_packet_timestamp(fd);
 
@@ -190,23 +239,26 @@ void phys_tap::operator()()
 
 		if (size < 14) {
 			stats_inc_counter(phys_invl_frame);
+			pool_block_unref(frame);
 			continue;
 		}
 
-		if (process_ethernet_frame(ts, std::vector<uint8_t>(buffer, buffer + size), &prot_map, r, this) == false)
+		if (process_ethernet_frame(ts, frame, buffer, size, &prot_map, r, this) == false)
 			CDOLOG(ll_info, "[tap]", "failed processing Ethernet frame\n");
+
+		pool_block_unref(frame);
 	}
 
 	CDOLOG(ll_info, "[tap]", "thread stopped\n");
 }
 
-bool process_ethernet_frame(const timespec & ts, const std::vector<uint8_t> & buffer, std::map<uint16_t, network_layer *> *const prot_map, router *const r, phys *const source_phys)
+bool process_ethernet_frame(const timespec & ts, pool_block_t *const frame, const uint8_t *const buffer, const size_t size, std::map<uint16_t, network_layer *> *const prot_map, router *const r, phys *const source_phys)
 {
 	uint16_t ether_type = (buffer[12] << 8) | buffer[13];
 
 	if (ether_type == 0x08ff) {  // special case for BPQ
-		if (buffer.size() > 16) {
-			process_kiss_packet(ts, std::vector<uint8_t>(buffer.data() + 16, buffer.data() + buffer.size() - 16), prot_map, r, source_phys, { });
+		if (size > 16) {
+			process_kiss_packet(ts, std::vector<uint8_t>(buffer + 16, buffer + size - 16), prot_map, r, source_phys, { });
 			return true;
 		}
 
@@ -215,19 +267,21 @@ bool process_ethernet_frame(const timespec & ts, const std::vector<uint8_t> & bu
 
 	auto it = prot_map->find(ether_type);
 	if (it == prot_map->end()) {
-		CDOLOG(ll_info, "[tap]", "dropping ethernet packet with ether type %04x (= unknown) and size %zu\n", ether_type, buffer.size());
+		CDOLOG(ll_info, "[tap]", "dropping ethernet packet with ether type %04x (= unknown) and size %zu\n", ether_type, size);
 		return false;
 	}
 
-	any_addr dst_mac(any_addr::mac, buffer.data() + 0);
+	any_addr dst_mac(any_addr::mac, buffer + 0);
 
-	any_addr src_mac(any_addr::mac, buffer.data() + 6);
+	any_addr src_mac(any_addr::mac, buffer + 6);
 
-	CDOLOG(ll_debug, "[EthernetFrame]", "queing packet from %s to %s with ether type %04x and size %zu\n", src_mac.to_str().c_str(), dst_mac.to_str().c_str(), ether_type, buffer.size());
+	CDOLOG(ll_debug, "[EthernetFrame]", "queing packet from %s to %s with ether type %04x and size %zu\n", src_mac.to_str().c_str(), dst_mac.to_str().c_str(), ether_type, size);
 
-	std::string log_prefix = myformat("[MAC:%02x%02x%02x%02x%02x%02x]", buffer[6], buffer[7], buffer[8], buffer[9], buffer[10], buffer[11]);
+	log_context log_prefix;
+	log_prefix.add_mac("MAC", buffer + 6);
 
-	packet *p = new packet(ts, src_mac, src_mac, dst_mac, buffer.data() + 14, buffer.size() - 14, buffer.data(), 14, log_prefix);
+	// no copy: the packet refers to the received frame
+	packet *p = new packet(ts, src_mac, src_mac, dst_mac, frame, buffer + 14, size - 14, buffer, 14, log_prefix);
 
 	it->second->queue_incoming_packet(source_phys, p);
 
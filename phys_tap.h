@@ -7,6 +7,7 @@
 #include <thread>
 
 #include "any_addr.h"
+#include "buffer_pool.h"
 #include "phys.h"
 #include "network_layer.h"
 #include "stats.h"
@@ -23,10 +24,13 @@ public:
 	virtual ~phys_tap();
 
 	bool transmit_packet(const any_addr & dest_mac, const any_addr & src_mac, const uint16_t ether_type, const uint8_t *payload, const size_t pl_size) override;
+	bool transmit_packet(const any_addr & dest_mac, const any_addr & src_mac, const uint16_t ether_type, const buffer_chain & payload) override;
 
 	any_addr::addr_family get_phys_type() override { return any_addr::mac; }
 
 	void operator()() override;
 };
 
-bool process_ethernet_frame(const timespec & ts, const std::vector<uint8_t> & buffer, std::map<uint16_t, network_layer *> *const prot_map, router *const r, phys *const source_phys);
+// 'buffer' (of 'size' bytes) must be inside 'frame'; the packet(s) queued for
+// the network layer take their own reference to it
+bool process_ethernet_frame(const timespec & ts, pool_block_t *const frame, const uint8_t *const buffer, const size_t size, std::map<uint16_t, network_layer *> *const prot_map, router *const r, phys *const source_phys);
@@ -7,14 +7,14 @@
 #include <stdint.h>
 
 #include "session.h"
+#include "session_table.h"
 
 
 class pstream
 {
 protected:
-	mutable std::shared_mutex     sessions_lock;
 	// the key is an 'internal id'
-	std::map<uint64_t, session *> sessions;
+	session_table sessions;
 
 public:
 	pstream() { }
@@ -22,11 +22,33 @@ public:
 
 	virtual bool send_data(session *const s, const uint8_t *const data, const size_t len) = 0;
 
+	// while a session is corked, data is only sent in full sized segments;
+	// uncorking sends what is left
+	virtual void set_cork(session *const s, const bool on) { }
+
+	// the application holds 'n' received bytes that it did not process
+	// yet; that much less receive window is advertised
+	virtual void set_receive_backlog(session *const s, const size_t n) { }
+
 	virtual void end_session(session *const ts) = 0;
 
 	virtual json_t *get_state_json(session *const ts) = 0;
 
-	auto get_sessions_locked() const { sessions_lock.lock_shared(); return &sessions; }
+	session_table *get_sessions() { return &sessions; }
+};
+
+// corks a session for as long as it is in scope
+class pstream_cork
+{
+private:
+	session *const s { nullptr };
+
+public:
+	pstream_cork(session *const s) : s(s) {
+		s->get_stream_target()->set_cork(s, true);
+	}
 
-	void sessions_unlock() { sessions_lock.unlock_shared(); }
+	~pstream_cork() {
+		s->get_stream_target()->set_cork(s, false);
+	}
 };
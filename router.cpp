@@ -11,6 +11,7 @@
 #include "phys.h"
 #include "router.h"
 #include "str.h"
+#include "time.h"
 
 
 constexpr size_t pkts_max_size { 256 };
@@ -31,6 +32,8 @@ router::router(stats *const s, const int n_threads)
 {
 	pkts = new fifo<queued_packet *>(s, "router", pkts_max_size);
 
+	router_pmtu_updates = s->register_stat("router_pmtu_updates");
+
 	for(int i=0; i<n_threads; i++) {
 		std::thread *th = new std::thread(std::ref(*this));
 		assert(th);
@@ -132,8 +135,21 @@ void router::add_router_ipv6(const any_addr & local_ip, const any_addr & network
 
 bool router::route_packet(const std::optional<any_addr> & override_dst_mac, const uint16_t ether_type, const any_addr & dst_ip, const std::optional<any_addr> & src_mac, const any_addr & src_ip, const uint8_t *const payload, const size_t pl_size)
 {
-	queued_packet *qp = new queued_packet(payload, pl_size);
+	return queue_packet(new queued_packet(buffer_chain(nullptr, payload, pl_size)), override_dst_mac, ether_type, dst_ip, src_mac, src_ip);
+}
+
+bool router::route_packet(const std::optional<any_addr> & override_dst_mac, const uint16_t ether_type, const any_addr & dst_ip, const std::optional<any_addr> & src_mac, const any_addr & src_ip, pool_block_t *const block, const uint8_t *const payload, const size_t pl_size)
+{
+	return queue_packet(new queued_packet(buffer_chain(block, payload, pl_size)), override_dst_mac, ether_type, dst_ip, src_mac, src_ip);
+}
+
+bool router::route_packet(const std::optional<any_addr> & override_dst_mac, const uint16_t ether_type, const any_addr & dst_ip, const std::optional<any_addr> & src_mac, const any_addr & src_ip, const buffer_chain & payload)
+{
+	return queue_packet(new queued_packet(payload), override_dst_mac, ether_type, dst_ip, src_mac, src_ip);
+}
 
+bool router::queue_packet(queued_packet *const qp, const std::optional<any_addr> & override_dst_mac, const uint16_t ether_type, const any_addr & dst_ip, const std::optional<any_addr> & src_mac, const any_addr & src_ip)
+{
 	qp->ether_type = ether_type;
 
 	assert(override_dst_mac.has_value() == false || override_dst_mac.value().get_family() == any_addr::mac || override_dst_mac.value().get_family() == any_addr::ax25);
@@ -150,7 +166,55 @@ bool router::route_packet(const std::optional<any_addr> & override_dst_mac, cons
 		qp->src_ip     = src_ip;
 	}
 
-	return pkts->try_put(qp);
+	if (pkts->try_put(qp))
+		return true;
+
+	delete qp;
+
+	return false;
+}
+
+void router::update_pmtu(const any_addr & dst_ip, const int mtu)
+{
+	// minimum MTUs of IPv4 (RFC 791) and IPv6 (RFC 8200)
+	const int minimum = dst_ip.get_family() == any_addr::ipv6 ? 1280 : 68;
+
+	std::unique_lock<std::shared_mutex> lck(pmtu_lock);
+
+	auto it = pmtu_cache.find(dst_ip);
+
+	if (it != pmtu_cache.end() && it->second.mtu <= mtu && get_us() - it->second.ts < pmtu_expire_us)
+		return;
+
+	DOLOG(ll_debug, "router: path MTU to %s is %d\n", dst_ip.to_str().c_str(), std::max(mtu, minimum));
+
+	pmtu_cache[dst_ip] = { std::max(mtu, minimum), get_us() };
+
+	stats_inc_counter(router_pmtu_updates);
+}
+
+std::optional<int> router::get_pmtu(const any_addr & dst_ip)
+{
+	{
+		std::shared_lock<std::shared_mutex> lck(pmtu_lock);
+
+		auto it = pmtu_cache.find(dst_ip);
+
+		if (it == pmtu_cache.end())
+			return { };
+
+		if (get_us() - it->second.ts < pmtu_expire_us)
+			return it->second.mtu;
+	}
+
+	std::unique_lock<std::shared_mutex> lck(pmtu_lock);
+
+	auto it = pmtu_cache.find(dst_ip);
+
+	if (it != pmtu_cache.end() && get_us() - it->second.ts >= pmtu_expire_us)
+		pmtu_cache.erase(it);
+
+	return { };
 }
 
 void router::dump()
@@ -162,7 +226,7 @@ void router::dump()
 	std::shared_lock<std::shared_mutex> lck(table_lock);
 
 	for(auto & entry : ip_table) {
-		DOLOG(ll_debug, ("| " + entry.to_str() + "\n").c_str());
+		DOLOG(ll_debug, "| %s\n", entry.to_str().c_str());
 
 		interfaces.insert(entry.interface);
 	}
@@ -174,10 +238,10 @@ void router::dump()
 
 		for(auto & entry : ax25_table) {
 			if (entry.second.interface.has_value())
-				DOLOG(ll_debug, ("| " + entry.first.to_str() + " -> " + entry.second.interface.value()->to_str() + "\n").c_str());
+				DOLOG(ll_debug, "| %s -> %s\n", entry.first.to_str().c_str(), entry.second.interface.value()->to_str().c_str());
 
 			if (entry.second.via.has_value())
-				DOLOG(ll_debug, ("| " + entry.first.to_str() + " -> " + entry.second.via.value().to_str() + "\n").c_str());
+				DOLOG(ll_debug, "| %s -> %s\n", entry.first.to_str().c_str(), entry.second.via.value().to_str().c_str());
 		}
 	}
 
@@ -343,7 +407,7 @@ void router::operator()()
 					dst_mac.to_str().c_str(),
 					interface->to_str().c_str());
 
-			if (interface->transmit_packet(dst_mac, src_mac, po.value()->ether_type, po.value()->data, po.value()->data_len) == false) {
+			if (interface->transmit_packet(dst_mac, src_mac, po.value()->ether_type, po.value()->payload) == false) {
 				DOLOG(ll_debug, "router::operator: cannot transmit_packet (%s) via %s\n", po.value()->to_str().c_str(), interface->to_str().c_str());
 			}
 		}
@@ -7,6 +7,9 @@
 #include <thread>
 #include <vector>
 
+#include "buffer_chain.h"
+#include "buffer_pool.h"
+#include "fifo.h"
 #include "log.h"
 #include "stats.h"
 #include "utils.h"
@@ -16,6 +19,10 @@ class arp;
 class ndp;
 class phys;
 
+// RFC 1191, 6.3: a reduced path MTU is forgotten after a while, so that
+// an increase of it is noticed
+constexpr uint64_t pmtu_expire_us { 600000000 };
+
 class router
 {
 private:
@@ -71,16 +78,11 @@ private:
 
 		std::optional<phys *> interface;
 
-		uint8_t *data     { nullptr };
-		size_t   data_len { 0       };
-
-		queued_packet(const uint8_t *const data, const size_t data_len) {
-			this->data     = duplicate(data, data_len);
-			this->data_len = data_len;
-		}
+		buffer_chain payload;
 
-		~queued_packet() {
-			delete [] data;
+		// shares the refcounted segments, only borrowed ones are copied
+		queued_packet(const buffer_chain & payload) : payload(payload) {
+			this->payload.make_owned();
 		}
 
 		std::string to_str() {
@@ -96,6 +98,18 @@ private:
 
 	fifo<queued_packet *>  *pkts { nullptr };
 
+	typedef struct {
+		int      mtu;  // including the IP header
+		uint64_t ts;   // get_us() of the (last) update
+	} pmtu_entry_t;
+
+	// path MTU per destination; only known for paths that reported a
+	// smaller MTU than that of the interface
+	std::shared_mutex                 pmtu_lock;
+	std::map<any_addr, pmtu_entry_t>  pmtu_cache;
+
+	uint64_t *router_pmtu_updates { nullptr };
+
 	std::vector<std::thread *> router_ths;
 
 	std::atomic_bool stop_flag { false };
@@ -105,6 +119,8 @@ private:
 	std::optional<std::pair<phys *, any_addr> > resolve_mac_by_addr(ip_router_entry *const re, const any_addr & addr);
 	std::optional<phys *> find_interface_by_mac(ip_router_entry *const re, const any_addr & addr);
 
+	bool queue_packet(queued_packet *const qp, const std::optional<any_addr> & override_dst_mac, const uint16_t ether_type, const any_addr & dst_ip, const std::optional<any_addr> & src_mac, const any_addr & src_ip);
+
 public:
 	router(stats *const s, const int n_threads);
 	virtual ~router();
@@ -118,6 +134,13 @@ public:
 	void add_router_ipv6(const any_addr & local_ip, const any_addr & network, const int cidr, const int priority, phys *const interface, ndp *const indp);
 
 	bool route_packet(const std::optional<any_addr> & override_dst_mac, const uint16_t ether_type, const any_addr & dst_ip, const std::optional<any_addr> & src_mac, const any_addr & src_ip, const uint8_t *const payload, const size_t pl_size);
+	// 'payload' points into 'block'; the router takes its own reference
+	bool route_packet(const std::optional<any_addr> & override_dst_mac, const uint16_t ether_type, const any_addr & dst_ip, const std::optional<any_addr> & src_mac, const any_addr & src_ip, pool_block_t *const block, const uint8_t *const payload, const size_t pl_size);
+	bool route_packet(const std::optional<any_addr> & override_dst_mac, const uint16_t ether_type, const any_addr & dst_ip, const std::optional<any_addr> & src_mac, const any_addr & src_ip, const buffer_chain & payload);
+
+	// from ICMP "fragmentation needed" / "packet too big"
+	void update_pmtu(const any_addr & dst_ip, const int mtu);
+	std::optional<int> get_pmtu(const any_addr & dst_ip);
 
 	void dump();
 
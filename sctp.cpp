@@ -22,7 +22,7 @@
 // debug level
 constexpr log_level_t dl = ll_info;
 
-sctp::sctp(stats *const s, icmp *const icmp_, const int n_threads) : transport_layer(s, "sctp"), icmp_(icmp_)
+sctp::sctp(stats *const s, icmp *const icmp_, const int n_threads) : transport_layer(s, "sctp", n_threads), icmp_(icmp_)
 {
 	sctp_msgs        = s->register_stat("sctp_msgs");
 	sctp_failed_msgs = s->register_stat("sctp_failed_msgs");
@@ -36,7 +36,7 @@ sctp::sctp(stats *const s, icmp *const icmp_, const int n_threads) : transport_l
 
 sctp::~sctp()
 {
-	pkts->interrupt();
+	interrupt_queues();
 
 	for(auto & th : ths) {
 		th->join();
@@ -49,8 +49,7 @@ sctp::~sctp()
 			handler.second.deinit();
 	}
 
-	for(auto & s : sessions)
-		delete s.second;
+	sessions.for_each([](const uint64_t id, session *const s) { delete s; });
 }
 
 std::pair<uint16_t, buffer_in> sctp::get_parameter(const uint64_t hash, buffer_in & chunk_payload)
@@ -267,266 +266,272 @@ void sctp::operator()()
 {
 	set_thread_name("myip-sctp");
 
+	fifo<packet *> *const queue = claim_queue();
+
+	packet *batch[pkts_batch_size];
+
 	for(;;) {
-		auto po = pkts->get();
-		if (!po.has_value())
+		int n = queue->get_bulk(batch, pkts_batch_size, -1);
+		if (n == 0)
 			break;
 
-		packet              *pkt        = po.value();
+		for(int i=0; i<n; i++) {
+			packet              *pkt        = batch[i];
 
-		const any_addr       their_addr = pkt->get_src_addr();
+			const any_addr       their_addr = pkt->get_src_addr();
 
-		const uint8_t *const p          = pkt->get_data();
-		const int            size       = pkt->get_size();
+			const uint8_t *const p          = pkt->get_data();
+			const int            size       = pkt->get_size();
 
-		if (size < 12) {
-			DOLOG(dl, "SCTP(%s): packet too small (%d bytes)\n", their_addr.to_str().c_str(), size);
-			delete pkt;
-			continue;
-		}
+			if (size < 12) {
+				DOLOG(dl, "SCTP(%s): packet too small (%d bytes)\n", their_addr.to_str().c_str(), size);
+				delete pkt;
+				continue;
+			}
 
-		try {
-			buffer_in b(p, size);
+			try {
+				buffer_in b(p, size);
 
-			uint16_t source_port         = b.get_net_short();  // their port
-			uint16_t destination_port    = b.get_net_short();  // local port
-			uint32_t my_verification_tag = b.get_net_long();
-			uint32_t checksum            = b.get_net_long();
+				uint16_t source_port         = b.get_net_short();  // their port
+				uint16_t destination_port    = b.get_net_short();  // local port
+				uint32_t my_verification_tag = b.get_net_long();
+				uint32_t checksum            = b.get_net_long();
 
-			uint64_t hash                = session::get_hash(their_addr, source_port, destination_port);
+				uint64_t hash                = session::get_hash(their_addr, source_port, destination_port);
 
-			pkt->add_to_log_prefix(myformat("SCTP[%d->%d]", source_port, destination_port));
+				pkt->get_log_context().add_ports("SCTP", source_port, destination_port);
 
-			DOLOG(dl, "%s: source addr %s, source port %d, destination port %d, size: %d, verification tag: %08x\n", pkt->get_log_prefix().c_str(), their_addr.to_str().c_str(), source_port, destination_port, size, my_verification_tag);
+				DOLOG(dl, "%s: source addr %s, source port %d, destination port %d, size: %d, verification tag: %08x\n", pkt->get_log_prefix().c_str(), their_addr.to_str().c_str(), source_port, destination_port, size, my_verification_tag);
 
-			bool send_reply = true;
+				bool send_reply = true;
 
-			buffer_out reply;
+				buffer_out reply;
 
-			reply.add_net_short(destination_port);
-			reply.add_net_short(source_port);
-			size_t their_verification_tag_offset = reply.add_net_long(-1, -1);  // will be 0 in INIT, will be replaced by their verifiation/initial tag
-			size_t crc_offset = reply.add_net_long(0, -1);  // place-holder for crc
+				reply.add_net_short(destination_port);
+				reply.add_net_short(source_port);
+				size_t their_verification_tag_offset = reply.add_net_long(-1, -1);  // will be 0 in INIT, will be replaced by their verifiation/initial tag
+				size_t crc_offset = reply.add_net_long(0, -1);  // place-holder for crc
 
-			bool   terminate_session = false;
+				bool   terminate_session = false;
 
-			while(b.end_reached() == false) {
-				uint8_t  type      = b.get_net_byte();
-				uint8_t  flags     = b.get_net_byte();
-				uint16_t len       = b.get_net_short();
+				while(b.end_reached() == false) {
+					uint8_t  type      = b.get_net_byte();
+					uint8_t  flags     = b.get_net_byte();
+					uint16_t len       = b.get_net_short();
 
-				uint8_t  type_type = type & 63;
-				uint8_t  type_unh  = type >> 6;  // what to do when it can not be processed
+					uint8_t  type_type = type & 63;
+					uint8_t  type_unh  = type >> 6;  // what to do when it can not be processed
 
-				if (len < 4) {
-					DOLOG(dl, "%s: chunk too short\n", pkt->get_log_prefix().c_str());
+					if (len < 4) {
+						DOLOG(dl, "%s: chunk too short\n", pkt->get_log_prefix().c_str());
 
-					terminate_session = true;
-					break;
-				}
+						terminate_session = true;
+						break;
+					}
 
-				buffer_in chunk    = b.get_segment(len - 4);
+					buffer_in chunk    = b.get_segment(len - 4);
 
-				DOLOG(dl, "%s: type %d flags %d length %d\n", pkt->get_log_prefix().c_str(), type, flags, len);
+					DOLOG(dl, "%s: type %d flags %d length %d\n", pkt->get_log_prefix().c_str(), type, flags, len);
 
-				if (type == 0) {  // DATA
-					DOLOG(dl, "%s: DATA chunk of length %d\n", pkt->get_log_prefix().c_str(), chunk.get_n_bytes_left());
+					if (type == 0) {  // DATA
+						DOLOG(dl, "%s: DATA chunk of length %d\n", pkt->get_log_prefix().c_str(), chunk.get_n_bytes_left());
 
-					std::function<bool(pstream *const ps, session *const s, buffer_in data)> new_data_handler = nullptr;
+						std::function<bool(pstream *const ps, session *const s, buffer_in data)> new_data_handler = nullptr;
 
-					{
-						std::shared_lock<std::shared_mutex> lck(listeners_lock);
+						{
+							std::shared_lock<std::shared_mutex> lck(listeners_lock);
 
-						auto it = listeners.find(destination_port);
+							auto it = listeners.find(destination_port);
 
-						if (it != listeners.end())
-							new_data_handler = it->second.new_data;
-					}
+							if (it != listeners.end())
+								new_data_handler = it->second.new_data;
+						}
 
-					if (new_data_handler) {
-						std::shared_lock<std::shared_mutex> lck(sessions_lock);
+						if (new_data_handler) {
+							std::shared_lock<std::shared_mutex> lck(sessions.get_lock(hash));
 
-						auto it = sessions.find(hash);
+							sctp_session *const found_session = dynamic_cast<sctp_session *>(sessions.find(hash));
 
-						if (it != sessions.end()) {
-							auto handling_result = chunk_data(it->second, chunk, &reply, new_data_handler);
+							if (found_session != nullptr) {
+								auto handling_result = chunk_data(found_session, chunk, &reply, new_data_handler);
 
-							if (handling_result.first == dcb_abort) {
-								// abort session...
-								terminate_session = true;
-								// ...after sending abort chunk
-								reply.add_buffer_out(chunk_gen_abort());
+								if (handling_result.first == dcb_abort) {
+									// abort session...
+									terminate_session = true;
+									// ...after sending abort chunk
+									reply.add_buffer_out(chunk_gen_abort());
 
-								break;
-							}
-							else {
-								reply.add_buffer_out(handling_result.second);
+									break;
+								}
+								else {
+									reply.add_buffer_out(handling_result.second);
 
-								if (handling_result.first == dcb_close) 
-									reply.add_buffer_out(chunk_gen_shutdown());
+									if (handling_result.first == dcb_close) 
+										reply.add_buffer_out(chunk_gen_shutdown());
 
-								reply.add_net_long(it->second->get_their_verification_tag(), their_verification_tag_offset);
+									reply.add_net_long(found_session->get_their_verification_tag(), their_verification_tag_offset);
+								}
 							}
 						}
-					}
-					else {
-						DOLOG(dl, "%s: DATA: new_data_handler went away?\n", pkt->get_log_prefix().c_str());
+						else {
+							DOLOG(dl, "%s: DATA: new_data_handler went away?\n", pkt->get_log_prefix().c_str());
 
-						reply.add_buffer_out(chunk_gen_abort());
+							reply.add_buffer_out(chunk_gen_abort());
 
-						terminate_session = true;
+							terminate_session = true;
+						}
 					}
-				}
-				else if (type == 1) {  // INIT
-					DOLOG(dl, "%s: INIT chunk of length %d\n", pkt->get_log_prefix().c_str(), chunk.get_n_bytes_left());
+					else if (type == 1) {  // INIT
+						DOLOG(dl, "%s: INIT chunk of length %d\n", pkt->get_log_prefix().c_str(), chunk.get_n_bytes_left());
 
-					bool has_listener = false;
+						bool has_listener = false;
 
-					{
-						std::shared_lock<std::shared_mutex> lck(listeners_lock);
+						{
+							std::shared_lock<std::shared_mutex> lck(listeners_lock);
 
-						auto it = listeners.find(destination_port);
+							auto it = listeners.find(destination_port);
 
-						if (it != listeners.end())
-							has_listener = true;
-					}
+							if (it != listeners.end())
+								has_listener = true;
+						}
 
-					// also go through this when no listener is registered as we
-					// need the initial verification tag of the other side
-					uint32_t their_initial_verification_tag = 0;
+						// also go through this when no listener is registered as we
+						// need the initial verification tag of the other side
+						uint32_t their_initial_verification_tag = 0;
 
-					uint32_t my_new_verification_tag        = 0;
+						uint32_t my_new_verification_tag        = 0;
 
-					// verification tag may not be 0
-					do {
-						get_random(reinterpret_cast<uint8_t *>(&my_new_verification_tag), sizeof my_new_verification_tag);
-					} while(my_new_verification_tag == 0);
+						// verification tag may not be 0
+						do {
+							get_random(reinterpret_cast<uint8_t *>(&my_new_verification_tag), sizeof my_new_verification_tag);
+						} while(my_new_verification_tag == 0);
 
-					buffer_out temp;
-					chunk_init(hash, chunk, my_new_verification_tag, 4096 /* TODO */, their_addr, source_port, destination_port, &temp, &their_initial_verification_tag);
+						buffer_out temp;
+						chunk_init(hash, chunk, my_new_verification_tag, 4096 /* TODO */, their_addr, source_port, destination_port, &temp, &their_initial_verification_tag);
 
-					reply.add_net_long(their_initial_verification_tag, their_verification_tag_offset);
+						reply.add_net_long(their_initial_verification_tag, their_verification_tag_offset);
 
-					if (has_listener)
-						reply.add_buffer_out(temp);
-					else {
-						DOLOG(dl, "%s: no listener for port %d\n", pkt->get_log_prefix().c_str(), destination_port);
+						if (has_listener)
+							reply.add_buffer_out(temp);
+						else {
+							DOLOG(dl, "%s: no listener for port %d\n", pkt->get_log_prefix().c_str(), destination_port);
 
-						reply.add_buffer_out(chunk_gen_abort());
+							reply.add_buffer_out(chunk_gen_abort());
 
-						terminate_session = true;
+							terminate_session = true;
+						}
 					}
-				}
-				else if (type == 4) {  // HEARTBEAT (-request)
-					DOLOG(dl, "%s: heartbeat request received\n", pkt->get_log_prefix().c_str());
+					else if (type == 4) {  // HEARTBEAT (-request)
+						DOLOG(dl, "%s: heartbeat request received\n", pkt->get_log_prefix().c_str());
 
-					reply.add_buffer_out(chunk_heartbeat_request(chunk));
-				}
-				else if (type == 6) {  // ABORT
-					DOLOG(dl, "%s: abort request received\n", pkt->get_log_prefix().c_str());
+						reply.add_buffer_out(chunk_heartbeat_request(chunk));
+					}
+					else if (type == 6) {  // ABORT
+						DOLOG(dl, "%s: abort request received\n", pkt->get_log_prefix().c_str());
 
-					terminate_session = true;
+						terminate_session = true;
 
-					send_reply        = false;
+						send_reply        = false;
 
-					break;
-				}
-				else if (type == 10) {  // COOKIE ECHO
-					bool     cookie_ok              = false;
+						break;
+					}
+					else if (type == 10) {  // COOKIE ECHO
+						bool     cookie_ok              = false;
 
-					uint32_t their_verification_tag = 0;
-					uint32_t their_initial_tsn      = 0;
-					uint32_t my_initial_tsn         = 0;
+						uint32_t their_verification_tag = 0;
+						uint32_t their_initial_tsn      = 0;
+						uint32_t my_initial_tsn         = 0;
 
-					chunk_cookie_echo(chunk, their_addr, source_port, destination_port, &cookie_ok, &their_verification_tag, &their_initial_tsn, &my_initial_tsn);
+						chunk_cookie_echo(chunk, their_addr, source_port, destination_port, &cookie_ok, &their_verification_tag, &their_initial_tsn, &my_initial_tsn);
 
-					std::function<void(pstream *const ps, session *const s)> new_session_handler = nullptr;
-					private_data *application_private_data = nullptr;
+						std::function<void(pstream *const ps, session *const s)> new_session_handler = nullptr;
+						private_data *application_private_data = nullptr;
 
-					{
-						std::shared_lock<std::shared_mutex> lck(listeners_lock);
+						{
+							std::shared_lock<std::shared_mutex> lck(listeners_lock);
 
-						auto it = listeners.find(destination_port);
+							auto it = listeners.find(destination_port);
 
-						if (it != listeners.end()) {
-							application_private_data = it->second.pd;
-							new_session_handler      = it->second.new_session;
-						}
-						else {
-							DOLOG(dl, "%s: listener for port %d went away?\n", pkt->get_log_prefix().c_str(), destination_port);
+							if (it != listeners.end()) {
+								application_private_data = it->second.pd;
+								new_session_handler      = it->second.new_session;
+							}
+							else {
+								DOLOG(dl, "%s: listener for port %d went away?\n", pkt->get_log_prefix().c_str(), destination_port);
+							}
 						}
-					}
 
-					if (cookie_ok && new_session_handler) {
-						// register session
-						std::unique_lock<std::shared_mutex> lck(sessions_lock);
+						if (cookie_ok && new_session_handler) {
+							// register session
+							std::unique_lock<std::shared_mutex> lck(sessions.get_lock(hash));
 
-						if (sessions.find(hash) != sessions.end())
-							DOLOG(dl, "%s: session already on-going\n", pkt->get_log_prefix().c_str());
-						else {
-							DOLOG(dl, "%s: their initial tsn: %lu, my initial tsn: %lu\n", pkt->get_log_prefix().c_str(), their_initial_tsn, my_initial_tsn);
+							if (sessions.find(hash) != nullptr)
+								DOLOG(dl, "%s: session already on-going\n", pkt->get_log_prefix().c_str());
+							else {
+								DOLOG(dl, "%s: their initial tsn: %lu, my initial tsn: %lu\n", pkt->get_log_prefix().c_str(), their_initial_tsn, my_initial_tsn);
+
+								sctp_session *s = new sctp_session(this, their_addr, source_port, pkt->get_dst_addr(), destination_port, their_initial_tsn, my_initial_tsn, their_verification_tag, application_private_data);
+								new_session_handler(this, s);
+
+								sessions.insert(hash, s);
+							}
 
-							sctp_session *s = new sctp_session(this, their_addr, source_port, pkt->get_dst_addr(), destination_port, their_initial_tsn, my_initial_tsn, their_verification_tag, application_private_data);
-							new_session_handler(this, s);
+							// send ack
+							reply.add_buffer_out(chunk_gen_cookie_ack());
 
-							sessions.insert({ hash, s });
+							DOLOG(dl, "%s: COOKIE ECHO ACK\n", pkt->get_log_prefix().c_str());
 						}
+						else {
+							// send deny
+							reply.add_buffer_out(chunk_gen_abort());
+
+							DOLOG(dl, "%s: ABORT\n", pkt->get_log_prefix().c_str());
 
-						// send ack
-						reply.add_buffer_out(chunk_gen_cookie_ack());
+							terminate_session = true;
+						}
 
-						DOLOG(dl, "%s: COOKIE ECHO ACK\n", pkt->get_log_prefix().c_str());
+						reply.add_net_long(their_verification_tag, their_verification_tag_offset);
 					}
 					else {
-						// send deny
-						reply.add_buffer_out(chunk_gen_abort());
+						DOLOG(dl, "%s: %d is an unknown chunk type\n", pkt->get_log_prefix().c_str(), type);
 
-						DOLOG(dl, "%s: ABORT\n", pkt->get_log_prefix().c_str());
-
-						terminate_session = true;
+						send_reply = false;
 					}
 
-					reply.add_net_long(their_verification_tag, their_verification_tag_offset);
-				}
-				else {
-					DOLOG(dl, "%s: %d is an unknown chunk type\n", pkt->get_log_prefix().c_str(), type);
+					uint8_t  padding   = len & 3;
+					if (padding) {
+						padding = 4 - padding;
+
+						DOLOG(dl, "%s: chunk padding: %d bytes\n", pkt->get_log_prefix().c_str(), padding);
 
-					send_reply = false;
+						b.seek(padding);
+					}
 				}
 
-				uint8_t  padding   = len & 3;
-				if (padding) {
-					padding = 4 - padding;
+				if (send_reply) {
+					// calculate & set crc in 'reply'
+					uint32_t crc32c = generate_crc32c(reply.get_content(), reply.get_size());
+					reply.add_net_long(crc32c, crc_offset);
 
-					DOLOG(dl, "%s: chunk padding: %d bytes\n", pkt->get_log_prefix().c_str(), padding);
+					DOLOG(dl, "%s: CRC32c over %zu bytes: %08lx\n", pkt->get_log_prefix().c_str(), reply.get_size(), crc32c);
 
-					b.seek(padding);
+					// transmit 'reply' (0x84 is SCTP protocol number)
+					if (transmit_packet(their_addr, pkt->get_dst_addr(), reply.get_content(), reply.get_size()) == false)
+						DOLOG(ll_info, "%s: failed to transmit reply packet\n", pkt->get_log_prefix().c_str());
 				}
-			}
-
-			if (send_reply) {
-				// calculate & set crc in 'reply'
-				uint32_t crc32c = generate_crc32c(reply.get_content(), reply.get_size());
-				reply.add_net_long(crc32c, crc_offset);
 
-				DOLOG(dl, "%s: CRC32c over %zu bytes: %08lx\n", pkt->get_log_prefix().c_str(), reply.get_size(), crc32c);
+				if (terminate_session) {
+					std::unique_lock<std::shared_mutex> lck(sessions.get_lock(hash));
 
-				// transmit 'reply' (0x84 is SCTP protocol number)
-				if (transmit_packet(their_addr, pkt->get_dst_addr(), reply.get_content(), reply.get_size()) == false)
-					DOLOG(ll_info, "%s: failed to transmit reply packet\n", pkt->get_log_prefix().c_str());
+					sessions.erase(hash);
+				}
 			}
-
-			if (terminate_session) {
-				std::unique_lock<std::shared_mutex> lck(sessions_lock);
-
-				sessions.erase(hash);
+			catch(std::out_of_range & e) {
+				DOLOG(dl, "SCTP(%s): truncated\n", their_addr.to_str().c_str());
 			}
-		}
-		catch(std::out_of_range & e) {
-			DOLOG(dl, "SCTP(%s): truncated\n", their_addr.to_str().c_str());
-		}
 
-		delete pkt;
+			delete pkt;
+		}
 	}
 }
 
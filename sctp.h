@@ -75,9 +75,6 @@ public:
 	};
 
 private:
-	std::shared_mutex                  sessions_lock;
-	std::map<uint64_t, sctp_session *> sessions;
-
 	uint8_t state_cookie_key[32]       { 0 };
 	time_t  state_cookie_key_timestamp { 0 };
 
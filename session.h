@@ -30,6 +30,7 @@ protected:
 	std::atomic_bool is_terminating { false };
 
 	int            session_timeout { 300 };
+	int            send_timeout    { 60  };  // seconds send_data() may wait for room in the send buffer
 
 	session(pstream *const t, const any_addr & my_addr, const int my_port, const any_addr & their_addr, const int their_port, private_data *const application_private_data);
 
@@ -72,4 +73,8 @@ public:
 	void set_session_timeout(const int duration) { session_timeout = duration; }
 
 	int get_session_timeout() const { return session_timeout; }
+
+	void set_send_timeout(const int duration) { send_timeout = duration; }
+
+	int get_send_timeout() const { return send_timeout; }
 };
@@ -0,0 +1,204 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#include <mutex>
+
+#include "session_table.h"
+
+
+constexpr size_t initial_capacity { 16 };
+
+session_table::session_table()
+{
+}
+
+session_table::~session_table()
+{
+	for(auto & sh : shards)
+		delete [] sh.entries;
+}
+
+// ids may be xor-ed hashes with structure in them: spread them out
+uint64_t session_table::mix(uint64_t id)
+{
+	id ^= id >> 33;
+	id *= 0xff51afd7ed558ccdllu;
+	id ^= id >> 33;
+	id *= 0xc4ceb9fe1a85ec53llu;
+	id ^= id >> 33;
+
+	return id;
+}
+
+// returns the slot holding 'id' or the free slot where it would go
+size_t session_table::find_slot(const shard & sh, const uint64_t id)
+{
+	const size_t mask = sh.capacity - 1;
+
+	size_t slot = (mix(id) >> 8) & mask;  // the low bits selected the shard
+
+	while(sh.entries[slot].s && sh.entries[slot].id != id)
+		slot = (slot + 1) & mask;
+
+	return slot;
+}
+
+void session_table::grow(shard & sh)
+{
+	entry_t *old_entries  = sh.entries;
+	size_t   old_capacity = sh.capacity;
+
+	sh.capacity = old_capacity ? old_capacity * 2 : initial_capacity;
+	sh.entries  = new entry_t[sh.capacity]();
+
+	for(size_t i=0; i<old_capacity; i++) {
+		if (old_entries[i].s)
+			sh.entries[find_slot(sh, old_entries[i].id)] = old_entries[i];
+	}
+
+	delete [] old_entries;
+}
+
+// backward shift deletion: keeps probe sequences intact without tombstones
+void session_table::erase_slot(shard & sh, size_t slot)
+{
+	const size_t mask = sh.capacity - 1;
+
+	size_t next = slot;
+
+	for(;;) {
+		next = (next + 1) & mask;
+
+		if (sh.entries[next].s == nullptr)
+			break;
+
+		size_t ideal = (mix(sh.entries[next].id) >> 8) & mask;
+
+		// can the entry at 'next' be moved to 'slot'? (i.e. is 'ideal'
+		// not cyclically in (slot, next])
+		bool move = slot <= next ? (ideal <= slot || ideal > next) : (ideal <= slot && ideal > next);
+
+		if (move) {
+			sh.entries[slot] = sh.entries[next];
+			slot = next;
+		}
+	}
+
+	sh.entries[slot] = { 0, nullptr };
+
+	sh.n--;
+}
+
+session *session_table::find(const uint64_t id) const
+{
+	const shard & sh = get_shard(id);
+
+	if (sh.n == 0)
+		return nullptr;
+
+	return sh.entries[find_slot(sh, id)].s;
+}
+
+bool session_table::reserve(const size_t max)
+{
+	size_t n = n_sessions.load();
+
+	do {
+		if (n >= max)
+			return false;
+	}
+	while(!n_sessions.compare_exchange_weak(n, n + 1));
+
+	return true;
+}
+
+void session_table::release()
+{
+	n_sessions--;
+}
+
+bool session_table::insert(const uint64_t id, session *const s, const bool reserved)
+{
+	shard & sh = get_shard(id);
+
+	// keep the load factor below 50%
+	if ((sh.n + 1) * 2 > sh.capacity)
+		grow(sh);
+
+	size_t slot = find_slot(sh, id);
+
+	if (sh.entries[slot].s)
+		return false;
+
+	sh.entries[slot] = { id, s };
+	sh.n++;
+
+	if (!reserved)
+		n_sessions++;
+
+	return true;
+}
+
+session *session_table::erase(const uint64_t id)
+{
+	shard & sh = get_shard(id);
+
+	if (sh.n == 0)
+		return nullptr;
+
+	size_t   slot = find_slot(sh, id);
+	session *s    = sh.entries[slot].s;
+
+	if (s) {
+		erase_slot(sh, slot);
+
+		n_sessions--;
+	}
+
+	return s;
+}
+
+void session_table::for_each(const std::function<void(const uint64_t id, session *const s)> & f)
+{
+	for(auto & sh : shards) {
+		std::shared_lock<std::shared_mutex> lck(sh.lock);
+
+		for(size_t i=0; i<sh.capacity; i++) {
+			if (sh.entries[i].s)
+				f(sh.entries[i].id, sh.entries[i].s);
+		}
+	}
+}
+
+void session_table::erase_if(const std::function<bool(const uint64_t id, session *const s)> & f)
+{
+	for(auto & sh : shards) {
+		std::unique_lock<std::shared_mutex> lck(sh.lock);
+
+		if (sh.n == 0)
+			continue;
+
+		const size_t mask = sh.capacity - 1;
+
+		// start right after a free slot (the load factor is below 50% so
+		// there always is one): entries are then never moved by
+		// erase_slot() from a slot that was already visited to one that
+		// is still to come, so each entry is seen once
+		size_t start = 0;
+
+		while(sh.entries[start].s)
+			start++;
+
+		for(size_t i=1; i<=sh.capacity;) {
+			size_t slot = (start + i) & mask;
+
+			// after erase_slot() an other entry may have moved into this slot
+			if (sh.entries[slot].s && f(sh.entries[slot].id, sh.entries[slot].s)) {
+				erase_slot(sh, slot);
+
+				n_sessions--;
+			}
+			else {
+				i++;
+			}
+		}
+	}
+}
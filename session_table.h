@@ -0,0 +1,73 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#pragma once
+#include <atomic>
+#include <functional>
+#include <shared_mutex>
+#include <stdint.h>
+
+#include "session.h"
+
+
+constexpr int session_table_n_shards { 64 };  // must be a power of 2
+
+/* sessions by id (e.g. session::get_hash()), spread over independently
+ * locked shards so that connections handled by different threads do not
+ * contend; each shard is an open addressing (linear probing) hash table
+ */
+class session_table
+{
+private:
+	typedef struct {
+		uint64_t  id;
+		session  *s;  // nullptr: free slot
+	} entry_t;
+
+	struct alignas(64) shard {
+		std::shared_mutex lock;
+		entry_t          *entries  { nullptr };
+		size_t            capacity { 0       };
+		size_t            n        { 0       };
+	};
+
+	shard                shards[session_table_n_shards];
+	std::atomic<size_t>  n_sessions { 0 };
+
+	static uint64_t mix(const uint64_t id);
+
+	shard       & get_shard(const uint64_t id)       { return shards[mix(id) & (session_table_n_shards - 1)]; }
+	const shard & get_shard(const uint64_t id) const { return shards[mix(id) & (session_table_n_shards - 1)]; }
+
+	static size_t find_slot(const shard & sh, const uint64_t id);
+	static void   grow(shard & sh);
+	static void   erase_slot(shard & sh, size_t slot);
+
+public:
+	session_table();
+	session_table(const session_table &) = delete;
+	virtual ~session_table();
+
+	// lock of the shard that 'id' lives in; hold it (shared for find,
+	// exclusive for insert/erase) while using a session found in it
+	std::shared_mutex & get_lock(const uint64_t id) { return get_shard(id).lock; }
+
+	// counts a session that is about to be inserted, unless there are 'max'
+	// (or more) already; the count is atomic so that concurrent inserts in
+	// different shards cannot go over the limit
+	// insert() with 'reserved' set uses the reservation, else release() it
+	bool     reserve(const size_t max);
+	void     release();
+
+	// the caller holds the lock of the shard
+	session *find  (const uint64_t id) const;
+	bool     insert(const uint64_t id, session *const s, const bool reserved = false);
+	session *erase (const uint64_t id);
+
+	size_t size() const { return n_sessions; }  // includes reservations
+
+	// visits all sessions while (shared) locking one shard at a time
+	void for_each(const std::function<void(const uint64_t id, session *const s)> & f);
+
+	// removes the sessions for which 'f' returns true, one shard
+	// (exclusively locked) at a time
+	void erase_if(const std::function<bool(const uint64_t id, session *const s)> & f);
+};
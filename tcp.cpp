@@ -7,6 +7,7 @@
 #include <unistd.h>
 #include <vector>
 
+#include "checksum.h"
 #include "icmp.h"
 #include "ipv4.h"
 #include "log.h"
@@ -45,8 +46,6 @@ void tcp::free_tcp_session(tcp_session *const p)
 
 	release_listener_lock(false);
 
-	free(p->unacked);
-
 	delete p;
 }
 
@@ -77,8 +76,19 @@ std::string flags_to_str(const uint8_t flags)
 	return out;
 }
 
-tcp::tcp(stats *const s, icmp *const icmp_, const int n_threads) : transport_layer(s, "tcp"), icmp_(icmp_)
+tcp::tcp(stats *const s, icmp *const icmp_, const int n_threads, const int max_sessions, const size_t send_buffer_size, const size_t receive_buffer_size, const tcp_cc_algorithm_t cc_algorithm, const uint64_t delayed_ack_us) :
+	transport_layer(s, "tcp", n_threads),
+	icmp_(icmp_),
+	max_sessions(max_sessions),
+	send_buffer_size(send_buffer_size),
+	receive_buffer_size(std::min(receive_buffer_size, size_t(65535) << 14)),
+	cc_algorithm(cc_algorithm),
+	delayed_ack_us(delayed_ack_us)
 {
+	// smallest shift with which the receive buffer fits in the 16 bit window field
+	while((this->receive_buffer_size >> my_window_shift) > 65535)
+		my_window_shift++;
+
 	tcp_packets           = s->register_stat("tcp_packets");
 	tcp_errors            = s->register_stat("tcp_errors", "1.3.6.1.2.1.6.7");  // tcpAttemptFails
 	tcp_succ_estab        = s->register_stat("tcp_succ_estab");
@@ -91,6 +101,12 @@ tcp::tcp(stats *const s, icmp *const icmp_, const int n_threads) : transport_lay
 	tcp_sessions_closed_2 = s->register_stat("tcp_sessions_closed2");
 	tcp_rst               = s->register_stat("tcp_rst");
 	tcp_cur_n_sessions    = s->register_stat("tcp_cur_n_sessions");
+	tcp_ooo_queued        = s->register_stat("tcp_ooo_queued");
+	tcp_ooo_dropped       = s->register_stat("tcp_ooo_dropped");
+	tcp_fast_retransmits  = s->register_stat("tcp_fast_retransmits");
+	tcp_rto_retransmits   = s->register_stat("tcp_rto_retransmits", "1.3.6.1.2.1.6.12");  // tcpRetransSegs
+	tcp_acks_pure         = s->register_stat("tcp_acks_pure");
+	tcp_acks_piggybacked  = s->register_stat("tcp_acks_piggybacked");
 
 	tcp_unacked_duration_max = s->register_stat("tcp_unack_t_max", "1.3.6.1.4.1.57850.1.14.1");
 	tcp_phandle_duration_max = s->register_stat("tcp_phandle_t_max", "1.3.6.1.4.1.57850.1.14.3");
@@ -100,9 +116,7 @@ tcp::tcp(stats *const s, icmp *const icmp_, const int n_threads) : transport_lay
 	for(int i=0; i<n_threads; i++)
 		th_enders.push_back(new std::thread(&tcp::session_ender, this));
 
-	th_cleaner = new std::thread(&tcp::session_cleaner, this);
-
-	th_unacked_sender = new std::thread(&tcp::unacked_sender, this);
+	th_timers = new std::thread(&tcp::timer_thread, this);
 
 	for(int i=0; i<n_threads; i++)
 		ths.push_back(new std::thread(std::ref(*this)));
@@ -110,7 +124,7 @@ tcp::tcp(stats *const s, icmp *const icmp_, const int n_threads) : transport_lay
 
 tcp::~tcp()
 {
-	pkts->interrupt();
+	interrupt_queues();
 
 	stop_flag = true;
 
@@ -120,11 +134,13 @@ tcp::~tcp()
 		delete th;
 	}
 
-	th_unacked_sender->join();
-	delete th_unacked_sender;
+	{
+		std::unique_lock<std::mutex> lck(timer_lock);
+		timer_cv.notify_one();
+	}
 
-	th_cleaner->join();
-	delete th_cleaner;
+	th_timers->join();
+	delete th_timers;
 
 	for(auto & th : th_enders) {
 		th->join();
@@ -141,8 +157,7 @@ tcp::~tcp()
 		delete session.value();
 	}
 
-	for(auto & s : sessions)
-		free_tcp_session(dynamic_cast<tcp_session *>(s.second));
+	sessions.for_each([this](const uint64_t id, session *const s) { free_tcp_session(dynamic_cast<tcp_session *>(s)); });
 }
 
 int rel_seqnr(const tcp_session *const ts, const bool mine, const uint32_t nr)
@@ -150,18 +165,124 @@ int rel_seqnr(const tcp_session *const ts, const bool mine, const uint32_t nr)
 	return mine ? nr - ts->initial_my_seq_nr : nr - ts->initial_their_seq_nr;
 }
 
-bool tcp::send_segment(tcp_session *const ts, const uint64_t session_id, const any_addr & my_addr, const int my_port, const any_addr & peer_addr, const int peer_port, const int org_len, const uint8_t flags, const uint32_t ack_to, uint32_t *const my_seq_nr, const uint8_t *const data, const size_t data_len, const uint32_t TSecr)
+static void put_uint32(uint8_t *const out, const uint32_t v)
+{
+	out[0] = v >> 24;
+	out[1] = v >> 16;
+	out[2] = v >>  8;
+	out[3] = v;
+}
+
+// the session whose data this thread is handing to new_data()
+static thread_local const tcp_session *delivering_to = nullptr;
+
+// the number of bytes advertised to the peer; the right edge of the window
+// is never moved to the left (RFC 7323, 2.4)
+uint32_t tcp::get_receive_window(tcp_session *const ts, const bool syn)
+{
+	// in-order data is handed to the application directly: only data that
+	// was received out-of-order and what the application did not process
+	// yet occupy the receive buffer
+	const size_t queued  = ts->reassembly.get_size() + ts->receive_backlog;
+	uint32_t     window  = queued >= receive_buffer_size ? 0 : receive_buffer_size - queued;
+
+	const uint32_t current = ts->rcv_right_edge - ts->their_seq_nr;
+
+	if (current <= receive_buffer_size && current > window)
+		window = current;
+
+	if (syn)  // the window in a SYN is never scaled
+		window = std::min(window, uint32_t(65535));
+	else {
+		const uint32_t unit = uint32_t(1) << ts->my_window_shift;
+
+		window = std::min((window + unit - 1) / unit, uint32_t(65535)) * unit;
+	}
+
+	ts->rcv_right_edge = ts->their_seq_nr + window;
+
+	return window;
+}
+
+// returns the number of bytes, a multiple of 4 and at most 40
+size_t tcp::generate_options(const tcp_session *const ts, const uint8_t flags, const uint32_t TSecr, uint8_t *const out)
+{
+	size_t n = 0;
+
+	if (flags & FLAG_SYN) {
+		// what fits in a packet on our side (RFC 9293, 3.7.1)
+		int mss = idev->get_max_packet_size() - 20;
+
+		out[n++] = 2;  // MSS
+		out[n++] = 4;
+		out[n++] = mss >> 8;
+		out[n++] = mss;
+	}
+
+	// timestamp
+	out[n++] = 8;
+	out[n++] = 10;
+	put_uint32(&out[n], get_us());
+	put_uint32(&out[n + 4], TSecr);
+	n += 8;
+
+	if (flags & FLAG_SYN) {
+		// SYN+ACK: only when the peer asked for it (RFC 2018)
+		if ((flags & FLAG_ACK) == 0 || ts->sack_permitted) {
+			out[n++] = 4;  // SACK permitted
+			out[n++] = 2;
+		}
+
+		// same for the window scale (RFC 7323)
+		if ((flags & FLAG_ACK) == 0 || ts->window_scaling) {
+			out[n++] = 1;  // NOP (alignment)
+			out[n++] = 3;  // window scale
+			out[n++] = 3;
+			out[n++] = ts->my_window_shift;
+		}
+	}
+	else if ((flags & FLAG_ACK) && ts->sack_permitted && ts->reassembly.empty() == false) {
+		// next to the timestamp there is room for 3 blocks
+		auto blocks = ts->reassembly.get_blocks(ts->their_seq_nr, 3);
+
+		out[n++] = 1;  // NOP (alignment)
+		out[n++] = 1;
+		out[n++] = 5;  // SACK
+		out[n++] = 2 + blocks.size() * 8;
+
+		for(auto & block : blocks) {
+			put_uint32(&out[n], block.first);
+			put_uint32(&out[n + 4], block.second);
+			n += 8;
+		}
+	}
+
+	while(n & 3)
+		out[n++] = 1;  // NOP
+
+	return n;
+}
+
+bool tcp::send_segment(tcp_session *const ts, const uint64_t session_id, const any_addr & my_addr, const int my_port, const any_addr & peer_addr, const int peer_port, const int org_len, const uint8_t flags, const uint32_t ack_to, uint32_t *const my_seq_nr, buffer_chain *const payload, const uint32_t TSecr)
 {
-	std::string flag_str = flags_to_str(flags);
-	DOLOG(ll_debug, "TCP[%012" PRIx64 "]: Sending segment (flags: %02x (%s)), ack to: %u, my seq: %u, len: %zu)\n", session_id, flags, flag_str.c_str(), rel_seqnr(ts, false, ack_to), my_seq_nr ? rel_seqnr(ts, true, *my_seq_nr) : -1, data_len);
+	const size_t data_len = payload ? payload->get_size() : 0;
+
+	DOLOG(ll_debug, "TCP[%012" PRIx64 "]: Sending segment (flags: %02x (%s)), ack to: %u, my seq: %u, len: %zu)\n", session_id, flags, flags_to_str(flags).c_str(), rel_seqnr(ts, false, ack_to), my_seq_nr ? rel_seqnr(ts, true, *my_seq_nr) : -1, data_len);
 
 	if (!idev) {
 		DOLOG(ll_info, "TCP[%012" PRIx64 "]: Dropping packet, no physical device assigned (yet)\n", session_id);
 		return false;
 	}
 
-	size_t temp_len = 20 + 12 + data_len;
-	uint8_t *temp = new uint8_t[temp_len];
+	uint8_t options[40];
+	size_t  options_len = generate_options(ts, flags, TSecr, options);
+
+	// the header goes in a pooled buffer, the payload (if any) is referred
+	// to where it is: the layers below prepend their headers without
+	// copying it again
+	size_t        header_len = 20 + options_len;
+	pool_block_t *block      = pool_allocate(idev->get_buffer_pool(), header_len);
+	uint8_t      *temp       = pool_block_data(block);
 
 	temp[0] = my_port >> 8;
 	temp[1] = my_port & 255;
@@ -183,46 +304,56 @@ bool tcp::send_segment(tcp_session *const ts, const uint64_t session_id, const a
 	temp[10] = ack_to >> 8;
 	temp[11] = ack_to;
 
-	temp[12] = 8 << 4; // header len, 5 = basic, 3 = timestamp
+	temp[12] = (header_len / 4) << 4; // header len in 32 bit words
 	temp[13] = flags;
 
-	temp[14] = 255;  // window size
-	temp[15] = 255;
+	uint32_t window = get_receive_window(ts, flags & FLAG_SYN) >> ((flags & FLAG_SYN) ? 0 : ts->my_window_shift);
+	temp[14] = window >> 8;  // window size
+	temp[15] = window;
 
 	temp[16] = temp[17] = 0; // checksum
 	temp[18] = temp[19] = 0; // urgent pointer
 
-	// timestamp option
-	temp[20] = 8;  // code for timestamp
-	temp[21] = 10;  // length of option
-	uint64_t us = get_us();
-	temp[22] = us >> 24;
-	temp[23] = us >> 16;
-	temp[24] = us >>  8;
-	temp[25] = us;
-	temp[26] = TSecr >> 24;
-	temp[27] = TSecr >> 16;
-	temp[28] = TSecr >>  8;
-	temp[29] = TSecr;
+	memcpy(&temp[20], options, options_len);
+
+	checksum_state_t state;
+	checksum_init(&state);
+
+	checksum_add_pseudo_header(&state, peer_addr, my_addr, 0x06, header_len + data_len);
+
+	checksum_add(&state, temp, header_len);
 
-	// padding
-	temp[30] = 1;
-	temp[31] = 0;
+	// the header is prepended to the payload chain
+	buffer_chain  no_payload;
+	buffer_chain *chain = payload ? payload : &no_payload;
 
-	if (data_len)
-		memcpy(&temp[32], data, data_len);
+	for(int i=0; i<chain->get_n_segments(); i++)
+		checksum_add(&state, chain->get_segment_data(i), chain->get_segment_size(i));
 
-	uint16_t checksum = tcp_udp_checksum(peer_addr, my_addr, true, temp, temp_len);
+	uint16_t checksum = checksum_finish(&state);
 
 	temp[16] = checksum >> 8;
 	temp[17] = checksum;
 
-	bool rc = idev->transmit_packet({ }, peer_addr, my_addr, 0x06, temp, temp_len, nullptr);
+	chain->prepend(block, temp, header_len);
+
+	bool rc = idev->transmit_packet({ }, peer_addr, my_addr, 0x06, *chain, nullptr);
 
 	if (!rc)
-		DOLOG(ll_info, "TCP[%012" PRIx64 "]: Sending segment (flags: %02x (%s)), ack to: %u, my seq: %u, len: %zu) FAILED\n", session_id, flags, flag_str.c_str(), rel_seqnr(ts, false, ack_to), my_seq_nr ? rel_seqnr(ts, true, *my_seq_nr) : -1, data_len);
+		DOLOG(ll_info, "TCP[%012" PRIx64 "]: Sending segment (flags: %02x (%s)), ack to: %u, my seq: %u, len: %zu) FAILED\n", session_id, flags, flags_to_str(flags).c_str(), rel_seqnr(ts, false, ack_to), my_seq_nr ? rel_seqnr(ts, true, *my_seq_nr) : -1, data_len);
 
-	delete [] temp;
+	pool_block_unref(block);
+
+	if (flags & FLAG_ACK) {
+		if (data_len == 0 && flags == FLAG_ACK)
+			stats_inc_counter(tcp_acks_pure);
+		else if (data_len > 0 && ts->ack_pending_segments > 0)
+			stats_inc_counter(tcp_acks_piggybacked);
+
+		// every segment acknowledges all that was received
+		ts->ack_pending_segments = 0;
+		ts->timer_deadline[tcp_timer_delayed_ack] = 0;
+	}
 
 	if (my_seq_nr) {
 		(*my_seq_nr) += data_len;
@@ -236,7 +367,7 @@ bool tcp::send_segment(tcp_session *const ts, const uint64_t session_id, const a
 	return rc;
 }
 
-std::optional<port_handler_t> tcp::get_lock_listener(const int dst_port, const std::string & log_prefix, const bool write_lock)
+std::optional<port_handler_t> tcp::get_lock_listener(const int dst_port, const log_context & log_prefix, const bool write_lock)
 {
 	if (write_lock)
 		listeners_lock.lock();
@@ -246,7 +377,7 @@ std::optional<port_handler_t> tcp::get_lock_listener(const int dst_port, const s
 	auto cb_it = listeners.find(dst_port);
 
 	if (cb_it == listeners.end()) {
-		DOLOG(ll_debug, "%s: no listener for that (%d) port\n", log_prefix.c_str(), dst_port);
+		DOLOG(ll_debug, "%s: no listener for that (%d) port\n", log_prefix.to_str().c_str(), dst_port);
 
 		return { };
 	}
@@ -274,6 +405,11 @@ void tcp::set_state(tcp_session *const session, const tcp_state_t new_state)
 	session->state = new_state;
 	session->state_since = time(nullptr);
 
+	if (new_state == tcp_established)
+		arm_timer(session, tcp_timer_keepalive, get_us() + tcp_keepalive_idle_us);
+	else if (new_state > tcp_established)
+		arm_timer(session, tcp_timer_time_wait, get_us() + tcp_time_wait_us);
+
 	session->state_changed.notify_all();
 }
 
@@ -352,15 +488,14 @@ void tcp::packet_handler(packet *const pkt)
 	auto     src = pkt->get_src_addr();
 	uint64_t id  = hash_address(src, dst_port, src_port);
 
-	pkt->add_to_log_prefix(myformat("TCP[%d->%d]", src_port, dst_port));
+	pkt->get_log_context().add_ports("TCP", src_port, dst_port);
 
-	std::string flag_str = flags_to_str(p[13]);
-	DOLOG(ll_debug, "%s: packet [%s]:%d->[%s]:%d, flags: %02x (%s), their seq: %u, ack to: %u, chksum: 0x%04x, size: %d\n", pkt->get_log_prefix().c_str(), src.to_str().c_str(), src_port, pkt->get_dst_addr().to_str().c_str(), dst_port, p[13], flag_str.c_str(), their_seq_nr, ack_to, (p[16] << 8) | p[17], size);
+	DOLOG(ll_debug, "%s: packet [%s]:%d->[%s]:%d, flags: %02x (%s), their seq: %u, ack to: %u, chksum: 0x%04x, size: %d\n", pkt->get_log_prefix().c_str(), src.to_str().c_str(), src_port, pkt->get_dst_addr().to_str().c_str(), dst_port, p[13], flags_to_str(p[13]).c_str(), their_seq_nr, ack_to, (p[16] << 8) | p[17], size);
 
 	if (flag_syn) {  // new session
 		uint64_t start = get_us();
 
-		auto port_record  = get_lock_listener(dst_port, pkt->get_log_prefix(), false);
+		auto port_record  = get_lock_listener(dst_port, pkt->get_log_context(), false);
 		bool has_listener = port_record.has_value();
 		release_listener_lock(false);
 
@@ -376,24 +511,22 @@ void tcp::packet_handler(packet *const pkt)
 
 		start = get_us();
 
-		std::unique_lock<std::shared_mutex> lck(sessions_lock);
-
-		// check concuncurrent session count
-		if (sessions.size() >= 128) {
-			DOLOG(ll_warning, "%s: too many TCP sessions (%zu)\n", pkt->get_log_prefix().c_str(), sessions.size());
-			// drop packet
-			delete pkt;
-			new_session_handling2.insert(get_us() - start);
-			return;
-		}
+		std::unique_lock<std::shared_mutex> lck(sessions.get_lock(id));
 
 		new_session_handling2.insert(get_us() - start);
 
 		start = get_us();
 
-		auto cur_it = sessions.find(id);
+		if (sessions.find(id) == nullptr) {
+			// check concuncurrent session count
+			if (sessions.reserve(max_sessions) == false) {
+				DOLOG(ll_warning, "%s: too many TCP sessions (%zu)\n", pkt->get_log_prefix().c_str(), sessions.size());
+				// drop packet
+				delete pkt;
+				new_session_handling3.insert(get_us() - start);
+				return;
+			}
 
-		if (cur_it == sessions.end()) {
 			private_data *pd          = port_record.value().pd;
 
 			tcp_session  *new_session = new tcp_session(this, pkt->get_dst_addr(), dst_port, pkt->get_src_addr(), src_port, pd);
@@ -411,14 +544,19 @@ void tcp::packet_handler(packet *const pkt)
 
 			new_session->is_client    = false;
 
-			new_session->unacked      = nullptr;
 			new_session->unacked_start_seq_nr    = 0;
-			new_session->unacked_size = 0;
 			new_session->fin_after_unacked_empty = false;
 
 			new_session->window_size  = win_size;
 
-			sessions.insert({ id, new_session });
+			new_session->cc           = create_tcp_cc(cc_algorithm, get_segment_size(new_session));
+			new_session->recover      = new_session->my_seq_nr;
+
+			new_session->e_last_pkt_ts = new_session->r_last_pkt_ts = get_us();
+
+			arm_timer(new_session, tcp_timer_idle, new_session->e_last_pkt_ts + tcp_syn_rcvd_timeout_us);
+
+			sessions.insert(id, new_session, true);
 
 			stats_set(tcp_cur_n_sessions, sessions.size());
 
@@ -432,17 +570,15 @@ void tcp::packet_handler(packet *const pkt)
 
 	bool delete_entry = false;
 
-	bool notify_unacked_cv = false;
-
 	do
 	{
 		uint64_t start = get_us();
 
-		std::shared_lock<std::shared_mutex> lck(sessions_lock);
+		std::shared_lock<std::shared_mutex> lck(sessions.get_lock(id));
 
-		auto cur_it = sessions.find(id);
+		session *const found_session = sessions.find(id);
 
-		if (cur_it == sessions.end()) {
+		if (found_session == nullptr) {
 			delete_entry = true;
 
 			DOLOG(ll_debug, "%s: new sessions must start with SYN\n", pkt->get_log_prefix().c_str());
@@ -457,30 +593,80 @@ void tcp::packet_handler(packet *const pkt)
 		const uint8_t *cur_extra_headers_p     = &p[20];
 		const uint8_t *const extra_headers_end = &p[header_size];
 
-		uint32_t TSecr = 0;  // TSecr that will be returned if ACK flag is set
+		uint32_t TSecr   = 0;  // TSecr that will be returned if ACK flag is set
+		uint32_t ts_echo = 0;  // a timestamp of ours, for measuring the rtt
+
+		bool sack_permitted = false;
+		int  window_shift   = -1;
+		int  mss            = -1;
 
 		while(extra_headers_end - 2 >= cur_extra_headers_p) {
 			if (cur_extra_headers_p[0] == 8 && flag_ack && extra_headers_end - cur_extra_headers_p >= 6) {
 				TSecr = (cur_extra_headers_p[2] << 24) | (cur_extra_headers_p[3] << 16) | (cur_extra_headers_p[4] << 8) | cur_extra_headers_p[5];
 
 				DOLOG(ll_debug, "%s: will set TSecr to %08x\n", pkt->get_log_prefix().c_str(), TSecr);
+
+				if (extra_headers_end - cur_extra_headers_p >= 10)
+					ts_echo = (cur_extra_headers_p[6] << 24) | (cur_extra_headers_p[7] << 16) | (cur_extra_headers_p[8] << 8) | cur_extra_headers_p[9];
+			}
+			else if (cur_extra_headers_p[0] == 4 && flag_syn) {
+				sack_permitted = true;
+			}
+			else if (cur_extra_headers_p[0] == 2 && flag_syn && extra_headers_end - cur_extra_headers_p >= 4) {
+				mss = (cur_extra_headers_p[2] << 8) | cur_extra_headers_p[3];
+			}
+			else if (cur_extra_headers_p[0] == 3 && flag_syn && extra_headers_end - cur_extra_headers_p >= 3) {
+				window_shift = std::min(14, int(cur_extra_headers_p[2]));
 			}
 
 			if (cur_extra_headers_p[0] == 0 || cur_extra_headers_p[0] == 1) // 1-byte?
 				cur_extra_headers_p++;
+			else if (cur_extra_headers_p[1] < 2)  // invalid length
+				break;
 			else
 				cur_extra_headers_p += cur_extra_headers_p[1];
 		}
 
-		tcp_session *const cur_session = dynamic_cast<tcp_session *>(cur_it->second);
+		tcp_session *const cur_session = dynamic_cast<tcp_session *>(found_session);
 
 		std::unique_lock<std::mutex> cur_session_lock(cur_session->session_lock);
 
-		cur_session->e_last_pkt_ts = get_us();
+		uint64_t now = get_us();
+
+		cur_session->r_last_pkt_ts         = now;
+		cur_session->keepalive_probes_sent = 0;
+
+		// pure ACKs (e.g. the replies to keepalives) do not count as activity
+		if (size > header_size || (p[13] & ~FLAG_ACK))
+			cur_session->e_last_pkt_ts = now;
 
 		DOLOG(ll_debug, "%s: start processing TCP segment, state: %s, my seq nr %d, opponent seq nr %d\n", pkt->get_log_prefix().c_str(), states[cur_session->state], rel_seqnr(cur_session, true, cur_session->my_seq_nr), rel_seqnr(cur_session, false, cur_session->their_seq_nr));
 
-		cur_session->window_size = std::max(1, win_size);
+		if (flag_syn) {
+			cur_session->sack_permitted = sack_permitted;
+
+			// window scaling is only used when both SYNs have the option
+			cur_session->window_scaling     = window_shift >= 0;
+			cur_session->their_window_shift = cur_session->window_scaling ? window_shift : 0;
+			cur_session->my_window_shift    = cur_session->window_scaling ? my_window_shift : 0;
+
+			if (mss > 0)
+				cur_session->their_mss = mss;
+			else
+				cur_session->their_mss = cur_session->get_their_addr().get_family() == any_addr::ipv6 ? tcp_default_mss_ipv6 : tcp_default_mss_ipv4;
+
+			// its initial window depends on the segment size
+			delete cur_session->cc;
+			cur_session->cc = create_tcp_cc(cc_algorithm, get_segment_size(cur_session));
+		}
+
+		if (TSecr)
+			cur_session->ts_recent = TSecr;
+
+		const uint32_t prev_window_size = cur_session->window_size;
+
+		// the window in a SYN is never scaled
+		cur_session->window_size = std::max(uint32_t(1), flag_syn ? uint32_t(win_size) : uint32_t(win_size) << cur_session->their_window_shift);
 
 		bool fail = false;
 
@@ -508,7 +694,7 @@ void tcp::packet_handler(packet *const pkt)
 				if (cur_session->state == tcp_listen || cur_session->state == tcp_syn_rcvd) {
 					DOLOG(ll_debug, "%s: received SYN, send SYN + ACK\n", pkt->get_log_prefix().c_str());
 					// send SYN + ACK
-					send_segment(cur_session, id, cur_session->get_my_addr(), cur_session->get_my_port(), cur_session->get_their_addr(), cur_session->get_their_port(), win_size, FLAG_SYN | FLAG_ACK, cur_session->their_seq_nr, &cur_session->my_seq_nr, nullptr, 0, TSecr);
+					send_segment(cur_session, id, cur_session->get_my_addr(), cur_session->get_my_port(), cur_session->get_their_addr(), cur_session->get_their_port(), win_size, FLAG_SYN | FLAG_ACK, cur_session->their_seq_nr, &cur_session->my_seq_nr, nullptr, TSecr);
 
 					set_state(cur_session, tcp_syn_rcvd);
 				}
@@ -524,7 +710,7 @@ void tcp::packet_handler(packet *const pkt)
 
 					DOLOG(ll_debug, "%s: received ACK%s: session established, their seq: %u, my seq: %u\n", pkt->get_log_prefix().c_str(), flag_syn ? " and SYN" : "", cur_session->their_seq_nr, cur_session->my_seq_nr);
 
-					send_segment(cur_session, cur_session->id, cur_session->get_their_addr(), cur_session->get_their_port(), cur_session->get_my_addr(), cur_session->get_my_port(), win_size, FLAG_ACK, cur_session->their_seq_nr, &cur_session->my_seq_nr, nullptr, 0, TSecr);
+					send_segment(cur_session, cur_session->id, cur_session->get_their_addr(), cur_session->get_their_port(), cur_session->get_my_addr(), cur_session->get_my_port(), win_size, FLAG_ACK, cur_session->their_seq_nr, &cur_session->my_seq_nr, nullptr, TSecr);
 
 	//				cur_session->my_seq_nr += 1;
 
@@ -537,7 +723,7 @@ void tcp::packet_handler(packet *const pkt)
 
 					stats_inc_counter(tcp_succ_estab);
 
-					auto cb = get_lock_listener(dst_port, pkt->get_log_prefix(), false);
+					auto cb = get_lock_listener(dst_port, pkt->get_log_context(), false);
 
 					if (cb.has_value()) {
 						if (cb.value().new_session && cb.value().new_session(this, cur_session) == false) {
@@ -560,46 +746,101 @@ void tcp::packet_handler(packet *const pkt)
 				else if (cur_session->state == tcp_established) {
 					int ack_n = ack_to - cur_session->unacked_start_seq_nr;
 
-					if (ack_n > 0 && cur_session->unacked_size > 0) {
-						DOLOG(ll_debug, "%s: ack to: %u (last seq nr %u), size: %d), unacked currently: %zu\n", pkt->get_log_prefix().c_str(), rel_seqnr(cur_session, true, ack_to), rel_seqnr(cur_session, true, cur_session->my_seq_nr), ack_n, cur_session->unacked_size);
+					if (ack_n > 0 && cur_session->unacked.size() > 0) {
+						DOLOG(ll_debug, "%s: ack to: %u (last seq nr %u), size: %d), unacked currently: %zu\n", pkt->get_log_prefix().c_str(), rel_seqnr(cur_session, true, ack_to), rel_seqnr(cur_session, true, cur_session->my_seq_nr), ack_n, cur_session->unacked.size());
 
 						// delete acked
-						int left_n = cur_session->unacked_size - ack_n;
-						if (left_n > 0)
-							memmove(&cur_session->unacked[0], &cur_session->unacked[ack_n], left_n);
-						else if (left_n < 0) {
+						int left_n = cur_session->unacked.size() - ack_n;
+						if (left_n < 0) {
 							DOLOG(ll_warning, "%s: ack underrun? %d\n", pkt->get_log_prefix().c_str(), left_n);
 							// terminate this invalid session
 							// can happen for data coming in after finished
 							delete_entry = fail = true;
 						}
 
-						cur_session->unacked_size -= ack_n;
+						cur_session->unacked.trim(ack_n);
 						cur_session->unacked_start_seq_nr += ack_n;
 
-						DOLOG(ll_debug, "%s: unacked left: %zu, fin after empty: %d\n", pkt->get_log_prefix().c_str(), cur_session->unacked_size, cur_session->fin_after_unacked_empty);
+						// room in the send buffer
+						cur_session->unacked_sent_cv.notify_all();
+
+						DOLOG(ll_debug, "%s: unacked left: %zu, fin after empty: %d\n", pkt->get_log_prefix().c_str(), cur_session->unacked.size(), cur_session->fin_after_unacked_empty);
 
 						cur_session->my_seq_nr += ack_n;
 
-						if (cur_session->unacked_size == 0 && cur_session->fin_after_unacked_empty) {
+						cur_session->bytes_in_flight -= std::min(size_t(ack_n), cur_session->bytes_in_flight);
+
+						// RFC 7323: the echoed timestamp tells when the acknowledged segment was sent
+						if (ts_echo) {
+							uint32_t rtt = uint32_t(now) - ts_echo;
+
+							if (rtt < tcp_rto_max_us)
+								update_rto(cur_session, rtt);
+						}
+
+						if (cur_session->in_recovery) {
+							if (int32_t(ack_to - cur_session->recover) >= 0) {
+								DOLOG(ll_debug, "%s: fast recovery finished\n", pkt->get_log_prefix().c_str());
+
+								cur_session->in_recovery = false;
+								cur_session->cc->on_recovery_end();
+							}
+							else {  // partial ACK: the next segment was lost as well
+								cur_session->cc->on_partial_ack(ack_n);
+
+								retransmit_first(cur_session);
+							}
+						}
+						else {
+							cur_session->cc->on_ack(ack_n, now, cur_session->srtt_us);
+						}
+
+						cur_session->dup_acks = 0;
+
+						if (cur_session->unacked.size() == 0 && cur_session->fin_after_unacked_empty) {
 							DOLOG(ll_debug, "%s: unacked buffer empty, FIN\n", pkt->get_log_prefix().c_str());
 
-							send_segment(cur_session, cur_session->id, cur_session->get_my_addr(), cur_session->get_my_port(), cur_session->get_their_addr(), cur_session->get_their_port(), win_size, FLAG_ACK | FLAG_FIN /* ACK, FIN */, cur_session->their_seq_nr, &cur_session->my_seq_nr, nullptr, 0, TSecr);
+							send_segment(cur_session, cur_session->id, cur_session->get_my_addr(), cur_session->get_my_port(), cur_session->get_their_addr(), cur_session->get_their_port(), win_size, FLAG_ACK | FLAG_FIN /* ACK, FIN */, cur_session->their_seq_nr, &cur_session->my_seq_nr, nullptr, TSecr);
 
 							set_state(cur_session, tcp_fin_wait_1);
 						}
+					}
+
+					// duplicate ACK (RFC 5681): the peer received a segment beyond a missing one
+					else if (ack_n == 0 && cur_session->bytes_in_flight > 0 && size == header_size && flag_fin == false && cur_session->window_size == prev_window_size) {
+						cur_session->dup_acks++;
+
+						if (cur_session->in_recovery)
+							cur_session->cc->on_dup_ack();
+						// not for losses of data that was sent before the previous recovery (RFC 6582, 3.2)
+						else if (cur_session->dup_acks == tcp_dup_ack_threshold && int32_t(ack_to - cur_session->recover) > 0) {
+							DOLOG(ll_debug, "%s: %d duplicate ACKs, fast retransmit\n", pkt->get_log_prefix().c_str(), cur_session->dup_acks);
+
+							cur_session->cc->on_loss(cur_session->bytes_in_flight, now, false);
+
+							cur_session->in_recovery = true;
+							cur_session->recover     = cur_session->my_seq_nr + cur_session->bytes_in_flight;
+
+							stats_inc_counter(tcp_fast_retransmits);
 
-						if (cur_session->unacked_size > 0)
-							cur_session->r_last_pkt_ts = 0;  // force send asap
+							retransmit_first(cur_session);
+						}
 					}
 
-					notify_unacked_cv = true;
+					if (cur_session->unacked.size() > 0) {
+						// restart the retransmission timer when something was acknowledged (RFC 6298, 5.3)
+						if (ack_n > 0)
+							arm_timer(cur_session, tcp_timer_rto, now + cur_session->rto_us);
+
+						transmit_unacked(cur_session);
+					}
+					else {
+						cur_session->timer_deadline[tcp_timer_rto] = 0;
+					}
 				}
 				else {
 					DOLOG(ll_debug, "%s: unexpected ACK\n", pkt->get_log_prefix().c_str());
 				}
-
-				cur_session->data_since_last_ack = 0;
 			}
 
 			if (flag_fin) {
@@ -624,7 +865,7 @@ void tcp::packet_handler(packet *const pkt)
 				DOLOG(ll_debug, "%s: ack FIN after all data has been received\n", pkt->get_log_prefix().c_str());
 
 				// send ACK + FIN
-				send_segment(cur_session, id, cur_session->get_my_addr(), cur_session->get_my_port(), cur_session->get_their_addr(), cur_session->get_their_port(), win_size, FLAG_ACK | FLAG_FIN, cur_session->their_seq_nr + 1, &cur_session->my_seq_nr, nullptr, 0, TSecr);
+				send_segment(cur_session, id, cur_session->get_my_addr(), cur_session->get_my_port(), cur_session->get_their_addr(), cur_session->get_their_port(), win_size, FLAG_ACK | FLAG_FIN, cur_session->their_seq_nr + 1, &cur_session->my_seq_nr, nullptr, TSecr);
 
 				set_state(cur_session, tcp_fin_wait_2);
 
@@ -641,54 +882,93 @@ void tcp::packet_handler(packet *const pkt)
 
 			// DOLOG(ll_debug, "%s: %s\n", pkt->get_log_prefix().c_str(), std::string((const char *)&p[header_size], data_len).c_str());
 
-			if (their_seq_nr == cur_session->their_seq_nr) {
+			// > 0: (partially) received before, < 0: a segment in front of it is missing
+			int32_t offset = cur_session->their_seq_nr - their_seq_nr;
+
+			bool gap_filled = false;
+
+			if (offset >= 0 && offset < data_len) {
 				// std::string content = bin_to_text(data_start, data_len, false);
 				// DOLOG(ll_debug, "%s: Received content: %s\n", pkt->get_log_prefix().c_str(), content.c_str());
 
-				auto cb = get_lock_listener(dst_port, pkt->get_log_prefix(), false);
+				auto cb = get_lock_listener(dst_port, pkt->get_log_context(), false);
+
+				delivering_to = cur_session;
 
 				if (cb.has_value()) {
-					if (cb.value().new_data(this, cur_session, buffer_in(data_start, data_len)) == false) {
+					if (cb.value().new_data(this, cur_session, buffer_in(data_start + offset, data_len - offset)) == false) {
 						DOLOG(ll_error, "%s: layer 7 indicated an error\n", pkt->get_log_prefix().c_str());
 						fail = true;
 					}
+					else {
+						cur_session->their_seq_nr += data_len - offset;
+					}
+
+					// segments that were received out-of-order and continue here
+					std::vector<uint8_t> queued;
+
+					gap_filled = cur_session->reassembly.empty() == false;
+
+					while(fail == false && cur_session->reassembly.get(cur_session->their_seq_nr, &queued)) {
+						DOLOG(ll_debug, "%s: delivering %zu bytes that were received out-of-order\n", pkt->get_log_prefix().c_str(), queued.size());
+
+						if (cb.value().new_data(this, cur_session, buffer_in(queued.data(), queued.size())) == false) {
+							DOLOG(ll_error, "%s: layer 7 indicated an error\n", pkt->get_log_prefix().c_str());
+							fail = true;
+						}
+						else {
+							cur_session->their_seq_nr += queued.size();
+						}
+					}
 				}
 				else {
 					fail = true;
 				}
 
+				delivering_to = nullptr;
+
 				release_listener_lock(false);
 
 				if (fail == false) {
-					cur_session->their_seq_nr += data_len;
+					cur_session->ack_pending_segments++;
 
-					// will be acked in the 'unacked_sender'-thread
-					if (cur_session->unacked_size == 0) {
-						DOLOG(ll_debug, "%s: acknowledging received content\n", pkt->get_log_prefix().c_str());
+					// the ACK goes with data if there is any that may be sent
+					if (transmit_unacked(cur_session) == 0) {
+						// at least every second segment, immediately when a gap was filled (RFC 5681, 4.2)
+						if (cur_session->ack_pending_segments >= 2 || gap_filled || delayed_ack_us == 0) {
+							DOLOG(ll_debug, "%s: acknowledging received content\n", pkt->get_log_prefix().c_str());
 
-						send_segment(cur_session, id, cur_session->get_my_addr(), cur_session->get_my_port(), cur_session->get_their_addr(), cur_session->get_their_port(), win_size, FLAG_ACK, cur_session->their_seq_nr, &cur_session->my_seq_nr, nullptr, 0, TSecr);
+							send_ack(cur_session);
+						}
+						else if (cur_session->timer_deadline[tcp_timer_delayed_ack] == 0) {
+							arm_timer(cur_session, tcp_timer_delayed_ack, now + delayed_ack_us);
+						}
 					}
 				}
 			}
 			else {
-				DOLOG(ll_info, "%s: unexpected sequence nr %u, expected: %u\n", pkt->get_log_prefix().c_str(), rel_seqnr(cur_session, false, their_seq_nr), rel_seqnr(cur_session, false, cur_session->their_seq_nr));
+				if (offset < 0) {
+					// only what fits in the window that was advertised
+					uint32_t window = std::min(uint32_t(receive_buffer_size), cur_session->rcv_right_edge - cur_session->their_seq_nr);
 
-				uint32_t ack_to = 0;
+					if (cur_session->reassembly.add(cur_session->their_seq_nr, their_seq_nr, data_start, data_len, window))
+						stats_inc_counter(tcp_ooo_queued);
+					else
+						stats_inc_counter(tcp_ooo_dropped);
 
-				if (their_seq_nr > cur_session->their_seq_nr)
-					ack_to = cur_session->their_seq_nr;
-				else if (their_seq_nr < cur_session->their_seq_nr)
-					ack_to = their_seq_nr;
+					DOLOG(ll_info, "%s: out-of-order sequence nr %u, expected: %u (%zu bytes queued)\n", pkt->get_log_prefix().c_str(), rel_seqnr(cur_session, false, their_seq_nr), rel_seqnr(cur_session, false, cur_session->their_seq_nr), cur_session->reassembly.get_size());
+				}
 				else {
-					// internal error
+					DOLOG(ll_info, "%s: already received sequence nr %u, expected: %u\n", pkt->get_log_prefix().c_str(), rel_seqnr(cur_session, false, their_seq_nr), rel_seqnr(cur_session, false, cur_session->their_seq_nr));
 				}
 
-				send_segment(cur_session, id, cur_session->get_my_addr(), cur_session->get_my_port(), cur_session->get_their_addr(), cur_session->get_their_port(), win_size, FLAG_ACK, ack_to, &cur_session->my_seq_nr, nullptr, 0, TSecr);
+				// duplicate ACK: tells the peer what is missing, the SACK blocks what is not
+				send_ack(cur_session);
 			}
 		}
 
 		if (fail) {
-			auto cb = get_lock_listener(dst_port, pkt->get_log_prefix(), false);
+			auto cb = get_lock_listener(dst_port, pkt->get_log_context(), false);
 
 			if (cb.has_value())
 				cb.value().session_closed_1(this, cur_session);
@@ -702,7 +982,7 @@ void tcp::packet_handler(packet *const pkt)
 			delete_entry = true;
 
 			DOLOG(ll_info, "%s: sending fail packet [IC]\n", pkt->get_log_prefix().c_str());
-			send_segment(cur_session, id, cur_session->get_my_addr(), cur_session->get_my_port(), cur_session->get_their_addr(), cur_session->get_their_port(), win_size, FLAG_RST | FLAG_ACK, their_seq_nr + 1, nullptr, nullptr, 0, TSecr);
+			send_segment(cur_session, id, cur_session->get_my_addr(), cur_session->get_my_port(), cur_session->get_their_addr(), cur_session->get_their_port(), win_size, FLAG_RST | FLAG_ACK, their_seq_nr + 1, nullptr, nullptr, TSecr);
 		}
 
 		if (delete_entry)
@@ -717,152 +997,339 @@ void tcp::packet_handler(packet *const pkt)
 
 		stats_inc_counter(tcp_sessions_rem);
 
-		std::unique_lock<std::shared_mutex> lck(sessions_lock);
+		std::unique_lock<std::shared_mutex> lck(sessions.get_lock(id));
 
-		if (auto cur_it = sessions.find(id); cur_it != sessions.end()) {
-			tcp_session *session_pointer = dynamic_cast<tcp_session *>(cur_it->second);
+		if (session *found_session = sessions.find(id); found_session != nullptr) {
+			tcp_session *session_pointer = dynamic_cast<tcp_session *>(found_session);
 
 			if (session_pointer->in_init == false) {
 				DOLOG(ll_debug, "%s: cleaning up session\n", pkt->get_log_prefix().c_str());
 
-				ending_sessions->put(session_pointer);
-
-				sessions.erase(cur_it);
-
-				stats_set(tcp_cur_n_sessions, sessions.size());
+				remove_session(id, session_pointer);
 			}
 		}
 
 		delete_session.insert(get_us() - start);
 	}
 
-	if (notify_unacked_cv) {
-		uint64_t start = get_us();
+	delete pkt;
+}
+
+// the shard of the session table must be locked exclusively
+void tcp::remove_session(const uint64_t id, tcp_session *const s)
+{
+	if (s->is_client) {
+		std::unique_lock<std::mutex> lck_clients(clients_lock);
+
+		tcp_clients.erase(s->get_my_port());
+	}
+
+	sessions.erase(id);
+
+	stats_set(tcp_cur_n_sessions, sessions.size());
+
+	// wake up senders that wait for room in the send buffer
+	std::unique_lock<std::mutex> session_lck(s->session_lock);
+
+	s->set_is_terminating();
+
+	s->unacked_sent_cv.notify_all();
+
+	session_lck.unlock();
+
+	ending_sessions->put(s);
+}
+
+// session must be locked
+void tcp::arm_timer(tcp_session *const s, const tcp_timer_t timer, const uint64_t deadline)
+{
+	uint64_t start = get_us();
+
+	s->timer_deadline[timer] = deadline;
+
+	timers.add(s->id, timer, deadline);
+
+	std::unique_lock<std::mutex> lck(timer_lock);
+
+	if (deadline < timer_next_wakeup)
+		timer_cv.notify_one();
+
+	arm_timer_de.insert(get_us() - start);
+}
+
+// what fits in a packet next to the tcp header: limited by the path MTU
+// and by the MSS of the peer, which does not count the options (RFC 6691)
+size_t tcp::get_segment_size(const tcp_session *const s)
+{
+	uint8_t options[40];
+	int     options_len = generate_options(s, FLAG_ACK, 0, options);
+	int     size        = std::min(idev->get_path_max_packet_size(s->get_their_addr()) - 20, s->their_mss) - options_len;
 
-		std::unique_lock<std::shared_mutex> lck(sessions_lock);
+	return std::max(size, 1);
+}
+
+// sends what is in the unacked buffer and was not sent before, as far as
+// the congestion window and the window of the peer allow; force sends a
+// small last segment even when data is in flight (like TCP_NAGLE_PUSH)
+// returns the number of segments sent; session must be locked
+int tcp::transmit_unacked(tcp_session *const s, const bool force)
+{
+	const size_t window       = std::min(s->cc->get_cwnd(), size_t(s->window_size));
+	const size_t segment_size = get_segment_size(s);
+
+	uint32_t seq_nr = s->my_seq_nr + s->bytes_in_flight;
+	int      n      = 0;
+
+	while(s->bytes_in_flight < s->unacked.size() && s->bytes_in_flight < window) {
+		const size_t left   = s->unacked.size() - s->bytes_in_flight;
+		const size_t send_n = std::min(std::min(segment_size, left), window - s->bytes_in_flight);
+
+		// Nagle (RFC 896): a last, small segment waits until everything
+		// in flight is acknowledged (so that more data can be added to
+		// it), or until the session is uncorked; not when the session ends
+		if (send_n == left && left < segment_size && (s->bytes_in_flight > 0 || s->corked) && s->fin_after_unacked_empty == false && force == false)
+			break;
+
+		DOLOG(ll_debug, "TCP[%012" PRIx64 "]: SEND %zu bytes for sequence nr %u (win size: %u, cwnd: %zu, unacked: %zu, in flight: %zu)\n", s->id, send_n, rel_seqnr(s, true, seq_nr), s->window_size, s->cc->get_cwnd(), s->unacked.size(), s->bytes_in_flight);
+
+		// refers to the data in the send queue, no copy
+		buffer_chain payload;
+		s->unacked.get(s->bytes_in_flight, send_n, &payload);
 
-		unacked_cv.notify_one();
+		if (send_segment(s, s->id, s->get_my_addr(), s->get_my_port(), s->get_their_addr(), s->get_their_port(), 0, FLAG_ACK, s->their_seq_nr, &seq_nr, &payload, s->ts_recent) == false) {
+			DOLOG(ll_debug, "TCP[%012" PRIx64 "]: SEND %zu bytes for sequence nr %u FAILED\n", s->id, send_n, rel_seqnr(s, true, seq_nr));
+			break;
+		}
+
+		s->bytes_in_flight += send_n;
 
-		notify_unacked.insert(get_us() - start);
+		n++;
 	}
 
-	delete pkt;
+	if (n > 0 && s->timer_deadline[tcp_timer_rto] == 0)
+		arm_timer(s, tcp_timer_rto, get_us() + s->rto_us);
+
+	return n;
 }
 
-void tcp::session_cleaner()
+// a segment without data that acknowledges all that was received
+void tcp::send_ack(tcp_session *const s)
 {
-	set_thread_name("myip-tcp-clnr");
+	uint32_t snd_nxt = s->my_seq_nr + s->bytes_in_flight;
 
-	while(!stop_flag) {
-		using namespace std::chrono_literals;
+	send_segment(s, s->id, s->get_my_addr(), s->get_my_port(), s->get_their_addr(), s->get_their_port(), 0, FLAG_ACK, s->their_seq_nr, &snd_nxt, nullptr, s->ts_recent);
+}
 
-		myusleep(2500000);
+// re-sends the segment at the start of the unacked buffer
+void tcp::retransmit_first(tcp_session *const s)
+{
+	size_t   send_n = std::min(get_segment_size(s), s->unacked.size());
+	uint32_t seq_nr = s->my_seq_nr;
 
-		uint64_t start = get_us();
+	DOLOG(ll_debug, "TCP[%012" PRIx64 "]: re-send %zu bytes for sequence nr %u\n", s->id, send_n, rel_seqnr(s, true, seq_nr));
 
-		std::unique_lock<std::shared_mutex> lck(sessions_lock);
+	buffer_chain payload;
+	s->unacked.get(0, send_n, &payload);
 
-		uint64_t now = get_us();
+	send_segment(s, s->id, s->get_my_addr(), s->get_my_port(), s->get_their_addr(), s->get_their_port(), 0, FLAG_ACK, s->their_seq_nr, &seq_nr, &payload, s->ts_recent);
 
-		for(auto it = sessions.cbegin(); it != sessions.cend();) {
-			tcp_session *const s = dynamic_cast<tcp_session *>(it->second);
+	s->bytes_in_flight = std::max(s->bytes_in_flight, send_n);
+}
 
-			std::unique_lock<std::mutex> cur_session_lock(s->session_lock);
+// Jacobson/Karels (RFC 6298, 2)
+void tcp::update_rto(tcp_session *const s, const uint64_t rtt)
+{
+	if (s->srtt_us == 0) {
+		s->srtt_us   = std::max(rtt, uint64_t(1));
+		s->rttvar_us = rtt / 2;
+	}
+	else {
+		uint64_t delta = rtt > s->srtt_us ? rtt - s->srtt_us : s->srtt_us - rtt;
 
-			// client sessions take care of cleaning-up themselves during session setup
-			if (s->in_init)
-				continue;
+		s->rttvar_us = (3 * s->rttvar_us + delta) / 4;
+		s->srtt_us   = std::max((7 * s->srtt_us + rtt) / 8, uint64_t(1));
+	}
 
-			std::string log_prefix = myformat("TCP[%012" PRIx64 "]", it->first);
+	s->rto_us = std::min(std::max(s->srtt_us + std::max(tcp_timer_tick_us, 4 * s->rttvar_us), tcp_rto_min_us), tcp_rto_max_us);
+}
 
-			uint64_t age = (now - s->e_last_pkt_ts) / 1000000;
+// nothing was acknowledged in time: start again at the first unacknowledged byte
+void tcp::handle_rto(tcp_session *const s, const uint64_t now)
+{
+	if (s->unacked.size() == 0)
+		return;
 
-			if (age >= s->get_session_timeout() || s->state > tcp_established || (s->state == tcp_syn_rcvd && age >= 5)) {
-				if (s->state > tcp_established)
-					DOLOG(ll_debug, "%s: session closed (state: %s)\n", log_prefix.c_str(), states[s->state]);
-				else if (age >= s->get_session_timeout())
-					DOLOG(ll_debug, "%s: session timed out\n", log_prefix.c_str());
-				else
-					DOLOG(ll_debug, "%s: delete session in SYN state for 5 or more seconds\n", log_prefix.c_str());
+	uint64_t now_send_unacked = get_us();
 
-				stats_inc_counter(tcp_sessions_to);
+	DOLOG(ll_debug, "TCP[%012" PRIx64 "]: retransmission time-out (rto: %" PRIu64 " us, in flight: %zu)\n", s->id, s->rto_us, s->bytes_in_flight);
 
-				if (s->is_client)
-					tcp_clients.erase(s->get_my_port());
+	s->cc->on_loss(s->bytes_in_flight, now, true);
 
-				ending_sessions->put(it->second);
+	s->in_recovery     = false;
+	s->recover         = s->my_seq_nr + s->bytes_in_flight;
+	s->dup_acks        = 0;
+	s->bytes_in_flight = 0;
 
-				it = sessions.erase(it);
-			}
-			else {
-				++it;
-			}
+	// back off (RFC 6298, 5.5)
+	s->rto_us = std::min(s->rto_us * 2, tcp_rto_max_us);
+
+	stats_inc_counter(tcp_rto_retransmits);
+
+	if (transmit_unacked(s) == 0)
+		arm_timer(s, tcp_timer_rto, now + s->rto_us);
+
+	send_segment_de.insert(get_us() - now_send_unacked);
+}
+
+// returns true when the session must be removed
+bool tcp::handle_timeout(tcp_session *const s, const tcp_timer_t timer, const uint64_t now)
+{
+	// client sessions take care of cleaning-up themselves during session setup
+	if (s->in_init) {
+		arm_timer(s, timer, now + 1000000);
+
+		return false;
+	}
+
+	if (timer == tcp_timer_time_wait) {
+		DOLOG(ll_debug, "TCP[%012" PRIx64 "]: session closed (state: %s)\n", s->id, states[s->state]);
+
+		return true;
+	}
+
+	if (timer == tcp_timer_keepalive) {
+		if (s->state != tcp_established)
+			return false;
+
+		if (now - s->r_last_pkt_ts < tcp_keepalive_idle_us) {
+			arm_timer(s, timer, s->r_last_pkt_ts + tcp_keepalive_idle_us);
+
+			return false;
 		}
 
-		stats_set(tcp_cur_n_sessions, sessions.size());
+		if (s->keepalive_probes_sent >= tcp_keepalive_probes) {
+			DOLOG(ll_debug, "TCP[%012" PRIx64 "]: peer does not respond to keepalives\n", s->id);
+
+			return true;
+		}
+
+		DOLOG(ll_debug, "TCP[%012" PRIx64 "]: send keepalive\n", s->id);
+
+		// an already acknowledged sequence number makes the peer send an ACK (RFC 1122, 4.2.3.6)
+		uint32_t probe_seq_nr  = s->my_seq_nr - 1;
+		uint64_t e_last_pkt_ts = s->e_last_pkt_ts;
+
+		send_segment(s, s->id, s->get_my_addr(), s->get_my_port(), s->get_their_addr(), s->get_their_port(), 0, FLAG_ACK, s->their_seq_nr, &probe_seq_nr, nullptr, 0);
+
+		s->e_last_pkt_ts = e_last_pkt_ts;
+
+		s->keepalive_probes_sent++;
+
+		arm_timer(s, timer, now + tcp_keepalive_interval_us);
 
-		session_cleaner_de.insert(get_us() - start);
+		return false;
 	}
+
+	// tcp_timer_idle
+	uint64_t limit = s->state == tcp_listen || s->state == tcp_syn_rcvd ? tcp_syn_rcvd_timeout_us : s->get_session_timeout() * uint64_t(1000000);
+
+	if (now - s->e_last_pkt_ts >= limit) {
+		if (s->state == tcp_listen || s->state == tcp_syn_rcvd)
+			DOLOG(ll_debug, "TCP[%012" PRIx64 "]: delete session in SYN state for %d or more seconds\n", s->id, int(tcp_syn_rcvd_timeout_us / 1000000));
+		else
+			DOLOG(ll_debug, "TCP[%012" PRIx64 "]: session timed out\n", s->id);
+
+		return true;
+	}
+
+	arm_timer(s, timer, s->e_last_pkt_ts + limit);
+
+	return false;
 }
 
-void tcp::unacked_sender()
+// retransmissions, keepalives and time-outs; only expired timers are looked at
+void tcp::timer_thread()
 {
-	set_thread_name("myip-tcp-us");
+	set_thread_name("myip-tcp-tmr");
 
-	std::shared_lock<std::shared_mutex> lck(sessions_lock);
+	std::vector<timer_entry_t> expired;
 
 	while(!stop_flag) {
-		using namespace std::chrono_literals;
+		{
+			std::unique_lock<std::mutex> lck(timer_lock);
+
+			uint64_t now = get_us();
 
-		if (unacked_cv.wait_for(lck, 800ms) == std::cv_status::timeout)
-			continue;
+			// wake up at least once a second to check the stop_flag
+			timer_next_wakeup = std::min(timers.get_next_wakeup(), now + 1000000);
+
+			if (timer_next_wakeup > now)
+				timer_cv.wait_for(lck, std::chrono::microseconds(timer_next_wakeup - now));
+
+			// everything armed from here on is seen by get_next_wakeup
+			timer_next_wakeup = 0;
+		}
 
-		// go through all sessions and find if any has segments to resend
 		uint64_t now = get_us();
 
-		for(auto it = sessions.cbegin(); it != sessions.cend(); it++) {
-			tcp_session *const s = dynamic_cast<tcp_session *>(it->second);
+		expired.clear();
 
-			std::unique_lock<std::mutex> cur_session_lock(s->session_lock);
+		timers.advance(now, &expired);
 
-			uint64_t now_send_unacked = get_us();
+		for(auto & e : expired) {
+			// these do not end the session: a shared lock on the table suffices
+			if (e.event == tcp_timer_rto || e.event == tcp_timer_delayed_ack) {
+				std::shared_lock<std::shared_mutex> lck(sessions.get_lock(e.id));
 
-			// last packet >= 1s ago?
-			if (now - s->r_last_pkt_ts >= 1000000) {
-				int to_send = std::min(s->window_size - s->data_since_last_ack, s->unacked_size);
-				int packet_size = idev->get_max_packet_size() - (20 + 12 /* timestamp option + padding */);
+				tcp_session *const s = dynamic_cast<tcp_session *>(sessions.find(e.id));
+				if (!s)
+					continue;
 
-				uint32_t resend_nr = s->my_seq_nr;
+				std::unique_lock<std::mutex> cur_session_lock(s->session_lock);
 
-				for(int i=0; i<to_send; i += packet_size) {
-					size_t send_n = std::min(packet_size, to_send - i);
+				// re-armed or cancelled?
+				if (s->timer_deadline[e.event] != e.deadline)
+					continue;
 
-					DOLOG(ll_debug, "TCP[%012" PRIx64 "]: unack SEND %zu bytes for sequence nr %u (win size: %d, unacked: %zu, data since ack: %ld)\n", it->first, send_n, rel_seqnr(s, true, s->my_seq_nr), s->window_size, s->unacked_size, s->data_since_last_ack);
+				s->timer_deadline[e.event] = 0;
 
-					if (send_segment(s, s->id, s->get_my_addr(), s->get_my_port(), s->get_their_addr(), s->get_their_port(), 0, FLAG_ACK, s->their_seq_nr, &resend_nr, &s->unacked[i], send_n, 0) == false) {
-						DOLOG(ll_debug, "TCP[%012" PRIx64 "]: unack SEND %zu bytes for sequence nr %u FAILED\n", it->first, send_n, rel_seqnr(s, true, s->my_seq_nr));
-						break;
-					}
+				if (e.event == tcp_timer_rto)
+					handle_rto(s, now);
+				else if (s->ack_pending_segments > 0)
+					send_ack(s);
+			}
+			else {
+				std::unique_lock<std::shared_mutex> lck(sessions.get_lock(e.id));
 
-					s->data_since_last_ack += send_n;
-				}
+				tcp_session *const s = dynamic_cast<tcp_session *>(sessions.find(e.id));
+				if (!s)
+					continue;
+
+				std::unique_lock<std::mutex> cur_session_lock(s->session_lock);
 
-				if (to_send > 0) {
-					s->unacked_sent_cv.notify_one();
+				if (s->timer_deadline[e.event] != e.deadline)
+					continue;
 
-					s->r_last_pkt_ts = now;
+				s->timer_deadline[e.event] = 0;
+
+				bool remove = handle_timeout(s, tcp_timer_t(e.event), now);
+
+				cur_session_lock.unlock();
+
+				if (remove) {
+					stats_inc_counter(tcp_sessions_to);
+
+					remove_session(e.id, s);
 				}
 			}
-
-			send_segment_de.insert(get_us() - now_send_unacked);
 		}
 
 		uint64_t end_now = get_us();
 
-		// operation is not atomic but the sessions_lock is held
+		// operation is not atomic but there is only one timer thread
 		stats_set(tcp_unacked_duration_max, std::max(*tcp_unacked_duration_max, end_now - now));
 
-		unacked_sender_de.insert(get_us() - now);
+		timers_de.insert(end_now - now);
 	}
 }
 
@@ -881,6 +1348,14 @@ void tcp::session_ender()
 
 		DOLOG(ll_debug, "tcp::session_ender: ending \"%s\"\n", session->to_str().c_str());
 
+		// senders that were woken up by remove_session() must have left
+		// send_data() before the session is freed
+		std::unique_lock<std::mutex> session_lck(session->session_lock);
+
+		session->unacked_sent_cv.wait(session_lck, [session] { return session->n_blocked_senders == 0; });
+
+		session_lck.unlock();
+
 		// call session_closed_2
 		int close_port       = session->get_my_port();
 
@@ -905,21 +1380,27 @@ void tcp::operator()()
 {
 	set_thread_name("myip-tcp");
 
+	fifo<packet *> *const queue = claim_queue();
+
+	packet *batch[pkts_batch_size];
+
 	for(;;) {
-		auto po = pkts->get();
-		if (!po.has_value())
+		int n = queue->get_bulk(batch, pkts_batch_size, -1);
+		if (n == 0)
 			break;
 
-		uint64_t now_start = get_us();
+		for(int i=0; i<n; i++) {
+			uint64_t now_start = get_us();
 
-		packet *pkt = po.value();
+			packet *pkt = batch[i];
 
-		stats_inc_counter(tcp_packets);
+			stats_inc_counter(tcp_packets);
 
-		packet_handler(pkt);
+			packet_handler(pkt);
 
-		uint64_t now_end = get_us();
-		stats_set(tcp_phandle_duration_max, std::max(*tcp_phandle_duration_max, now_end - now_start));
+			uint64_t now_end = get_us();
+			stats_set(tcp_phandle_duration_max, std::max(*tcp_phandle_duration_max, now_end - now_start));
+		}
 	}
 }
 
@@ -935,6 +1416,8 @@ void tcp::add_handler(const int port, port_handler_t & tph)
 	listeners_lock.unlock();
 }
 
+// waits (at most the send timeout of the session) for room in the send buffer
+// returns false if the data was not queued
 bool tcp::send_data(session *const ts_in, const uint8_t *const data, const size_t len)
 {
 	uint64_t start = get_us();
@@ -943,70 +1426,121 @@ bool tcp::send_data(session *const ts_in, const uint8_t *const data, const size_
 
 	DOLOG(ll_debug, "TCP[%012" PRIx64 "]: send frame, %zu bytes, %lu packets\n", ts->id, len, (len + ts->window_size - 1) / ts->window_size);
 
+	const uint64_t deadline = start + ts->get_send_timeout() * uint64_t(1000000);
+
+	bool queued = false;
+
 	std::unique_lock<std::mutex> lck(ts->session_lock);
 
+	ts->n_blocked_senders++;
+
 	for(;;) {
 		// lock for unacked and for my_seq_nr
-		if (ts->unacked_size < 1024 * 1024) {  // max 1MB queued
+		if (ts->unacked.size() < send_buffer_size) {
 			if (ts->state == tcp_established) {
-				if (ts->unacked_size == 0)
+				if (ts->unacked.size() == 0)
 					ts->unacked_start_seq_nr = ts->my_seq_nr;
 
-				ts->unacked = reinterpret_cast<uint8_t *>(realloc(ts->unacked, ts->unacked_size + len));
-				memcpy(&ts->unacked[ts->unacked_size], data, len);
-				ts->unacked_size += len;
+				ts->unacked.append(data, len);
 
 				// new data was added, try sending immediately
-				ts->r_last_pkt_ts = 0;
+				transmit_unacked(ts);
 
-				lck.unlock();
-
-				std::unique_lock<std::shared_mutex> lck_s(sessions_lock);
-				unacked_cv.notify_one();
+				queued = true;
 			}
 
 			break;
 		}
 
-		if (ts->state != tcp_established) {
+		if (ts->state != tcp_established || ts->get_is_terminating()) {
 			DOLOG(ll_debug, "TCP[%012" PRIx64 "]: send_data interrupted by session end\n", ts->id);
-			lck.unlock();
 			break;
 		}
 
-		if (ts->get_is_terminating() == false) {
-			lck.unlock();
+		if (get_us() >= deadline) {
+			DOLOG(ll_info, "TCP[%012" PRIx64 "]: send_data: peer did not acknowledge data in time\n", ts->id);
 			break;
 		}
 
+		// wait for the peer to acknowledge data
 		DOLOG(ll_debug, "TCP[%012" PRIx64 "]: unacked-buffer full\n", ts->id);
 
 		ts->unacked_sent_cv.wait_for(lck, 100ms);
 	}
 
+	// the session_ender waits for this
+	if (--ts->n_blocked_senders == 0 && ts->get_is_terminating())
+		ts->unacked_sent_cv.notify_all();
+
+	lck.unlock();
+
 	send_data_de.insert(get_us() - start);
 
-	return true;
+	return queued;
+}
+
+void tcp::set_cork(session *const ts_in, const bool on)
+{
+	tcp_session *const ts = dynamic_cast<tcp_session *>(ts_in);
+
+	std::unique_lock<std::mutex> lck(ts->session_lock);
+
+	ts->corked = on;
+
+	// what was held back goes out now, also when data is still in flight
+	if (on == false && ts->state == tcp_established)
+		transmit_unacked(ts, true);
+}
+
+void tcp::set_receive_backlog(session *const ts_in, const size_t n)
+{
+	tcp_session *const ts = dynamic_cast<tcp_session *>(ts_in);
+
+	// from within new_data() the session is locked already; the ACK for
+	// that data advertises the window
+	if (ts->receive_backlog.exchange(n) <= n || ts == delivering_to)
+		return;
+
+	std::unique_lock<std::mutex> lck(ts->session_lock);
+
+	if (ts->state != tcp_established)
+		return;
+
+	const size_t   queued     = ts->reassembly.get_size() + n;
+	const uint32_t window     = queued >= receive_buffer_size ? 0 : receive_buffer_size - queued;
+	const uint32_t advertised = ts->rcv_right_edge - ts->their_seq_nr;
+
+	// a window update only when the window opens by a full segment or half
+	// of the buffer (RFC 9293, 3.8.6.2.2)
+	if (window > advertised && window - advertised >= std::min(get_segment_size(ts), receive_buffer_size / 2)) {
+		DOLOG(ll_debug, "TCP[%012" PRIx64 "]: window update, %u bytes\n", ts->id, window);
+
+		send_ack(ts);
+	}
 }
 
-// this method requires tcp_session to be already locked
 void tcp::end_session(session *const ts_in)
 {
 	uint64_t start = get_us();
 
 	tcp_session *const ts = dynamic_cast<tcp_session *>(ts_in);
 
-	if (ts->unacked_size == 0) {
+	std::unique_lock<std::mutex> lck(ts->session_lock);
+
+	if (ts->unacked.size() == 0) {
 		DOLOG(ll_debug, "TCP[%012" PRIx64 "]: end session, seq %u\n", ts->id, rel_seqnr(ts, true, ts->my_seq_nr));
 
-		send_segment(ts, ts->id, ts->get_my_addr(), ts->get_my_port(), ts->get_their_addr(), ts->get_their_port(), 1, FLAG_FIN, ts->their_seq_nr, &ts->my_seq_nr, nullptr, 0, 0);
+		send_segment(ts, ts->id, ts->get_my_addr(), ts->get_my_port(), ts->get_their_addr(), ts->get_their_port(), 1, FLAG_FIN, ts->their_seq_nr, &ts->my_seq_nr, nullptr, 0);
 
 		set_state(ts, tcp_fin_wait_1);
 	}
 	else {
-		DOLOG(ll_debug, "TCP[%012" PRIx64 "]: schedule end session, after %ld bytes\n", ts->id, ts->unacked_size);
+		DOLOG(ll_debug, "TCP[%012" PRIx64 "]: schedule end session, after %ld bytes\n", ts->id, ts->unacked.size());
 
 		ts->fin_after_unacked_empty = true;
+
+		// a small segment that was held back can go now
+		transmit_unacked(ts);
 	}
 
 	end_session_de.insert(get_us() - start);
@@ -1024,8 +1558,7 @@ int tcp::allocate_client_session(const std::function<bool(pstream *const ps, ses
 	// generate id/port mapping
 	uint16_t local_port = 0;
 
-	// lock all sesions
-	std::unique_lock<std::shared_mutex> lck(sessions_lock);
+	std::unique_lock<std::mutex> lck_clients(clients_lock);
 
 	// allocate free port
 	for(;;) {
@@ -1041,6 +1574,8 @@ int tcp::allocate_client_session(const std::function<bool(pstream *const ps, ses
 
 	tcp_clients.insert({ local_port, id });
 
+	lck_clients.unlock();
+
 	// generate tcp session
 	tcp_session *new_session = new tcp_session(this, src, local_port, dst_addr, dst_port, nullptr);
 	new_session->state       = tcp_syn_sent;
@@ -1058,21 +1593,30 @@ int tcp::allocate_client_session(const std::function<bool(pstream *const ps, ses
 
 	new_session->id = id;
 
-	new_session->unacked                 = nullptr;
 	new_session->unacked_start_seq_nr    = 0;
-	new_session->unacked_size            = 0;
 	new_session->fin_after_unacked_empty = false;
 
 	new_session->seq_for_fin_when_all_received = 0;
 
 	new_session->window_size = idev->get_max_packet_size();
 
+	new_session->my_window_shift = my_window_shift;  // announced in the SYN
+
+	new_session->cc      = create_tcp_cc(cc_algorithm, get_segment_size(new_session));
+	new_session->recover = new_session->my_seq_nr;
+
 	new_session->set_callback_private_data(sd);
 
+	new_session->e_last_pkt_ts = new_session->r_last_pkt_ts = get_us();
+
+	arm_timer(new_session, tcp_timer_idle, new_session->e_last_pkt_ts + new_session->get_session_timeout() * uint64_t(1000000));
+
 	stats_inc_counter(tcp_new_sessions);
 
 	// connect id to session data
-	sessions.insert({ id, new_session });
+	std::unique_lock<std::shared_mutex> lck(sessions.get_lock(id));
+
+	sessions.insert(id, new_session);
 	stats_set(tcp_cur_n_sessions, sessions.size());
 
 	add_handler(local_port, handler);
@@ -1082,7 +1626,7 @@ int tcp::allocate_client_session(const std::function<bool(pstream *const ps, ses
 	// start session
 	std::unique_lock<std::mutex> session_lck(new_session->session_lock);
 
-	send_segment(new_session, id, new_session->get_my_addr(), new_session->get_my_port(), new_session->get_their_addr(), new_session->get_their_port(), 512, FLAG_SYN, new_session->their_seq_nr, &new_session->my_seq_nr, nullptr, 0, 0);
+	send_segment(new_session, id, new_session->get_my_addr(), new_session->get_my_port(), new_session->get_their_addr(), new_session->get_their_port(), 512, FLAG_SYN, new_session->their_seq_nr, &new_session->my_seq_nr, nullptr, 0);
 
 	DOLOG(ll_debug, "TCP[%012" PRIx64 "]: SYN sent\n");
 
@@ -1091,33 +1635,43 @@ int tcp::allocate_client_session(const std::function<bool(pstream *const ps, ses
 	return local_port;
 }
 
+bool tcp::get_client_session_id(const int port, uint64_t *const id)
+{
+	std::unique_lock<std::mutex> lck_clients(clients_lock);
+
+	auto it = tcp_clients.find(port);
+	if (it == tcp_clients.end())
+		return false;
+
+	*id = it->second;
+
+	return true;
+}
+
 void tcp::close_client_session(const int port)
 {
 	uint64_t start = get_us();
 
-	// lock all sessions
-	std::shared_lock<std::shared_mutex> lck(sessions_lock);
-
 	// find id of the session
-	auto it_id = tcp_clients.find(port);
-	if (it_id == tcp_clients.end()) {
+	uint64_t id = 0;
+	if (get_client_session_id(port, &id) == false) {
 		close_client.insert(get_us() - start);
 		return;
 	}
 
 	// find session data
-	auto sd_it = sessions.find(it_id->second);
-	if (sd_it == sessions.end()) {
+	std::shared_lock<std::shared_mutex> lck(sessions.get_lock(id));
+
+	session *const found_session = sessions.find(id);
+	if (found_session == nullptr) {
 		close_client.insert(get_us() - start);
 		return;
 	}
 
 	// send FIN
-	tcp_session *const s = dynamic_cast<tcp_session *>(sd_it->second);
+	tcp_session *const s = dynamic_cast<tcp_session *>(found_session);
 
-	std::unique_lock<std::mutex> cur_session_lock(s->session_lock);
-
-	end_session(s);
+	end_session(s);  // locks the session
 
 	close_client.insert(get_us() - start);
 }
@@ -1127,27 +1681,26 @@ bool tcp::wait_for_client_connected_state(const int local_port)
 	bool rc      = true;
 	int  counter = 0;
 
-	// lock all sessions
-	std::shared_lock<std::shared_mutex> lck(sessions_lock);
-
 	DOLOG(ll_debug, "wait_for_client_connected_state: find session id for %d\n", local_port);
 
 	// find id of the session
-	auto it_id = tcp_clients.find(local_port);
-	if (it_id == tcp_clients.end()) {
+	uint64_t id = 0;
+	if (get_client_session_id(local_port, &id) == false) {
 		DOLOG(ll_debug, "wait_for_client_connected_state: session id not found\n");
 		return false;
 	}
 
-	DOLOG(ll_debug, "wait_for_client_connected_state: session id: [%012" PRIx64 "]\n", it_id->second);
+	DOLOG(ll_debug, "wait_for_client_connected_state: session id: [%012" PRIx64 "]\n", id);
 
-	auto sd_it = sessions.find(it_id->second);
-	if (sd_it == sessions.end())
+	std::shared_lock<std::shared_mutex> lck(sessions.get_lock(id));
+
+	session *const found_session = sessions.find(id);
+	if (found_session == nullptr)
 		return false;
 
 	DOLOG(ll_debug, "wait_for_client_connected_state: found session-data, send_data\n");
 
-	tcp_session *const cur_session = dynamic_cast<tcp_session *>(sd_it->second);
+	tcp_session *const cur_session = dynamic_cast<tcp_session *>(found_session);
 
 	lck.unlock();
 
@@ -1174,7 +1727,7 @@ bool tcp::wait_for_client_connected_state(const int local_port)
 
 			uint32_t temp = cur_session->my_seq_nr;
 
-			send_segment(cur_session, cur_session->id, cur_session->get_their_addr(), cur_session->get_their_port(), cur_session->get_my_addr(), cur_session->get_my_port(), 512, FLAG_SYN, cur_session->their_seq_nr, &temp, nullptr, 0, 0);
+			send_segment(cur_session, cur_session->id, cur_session->get_their_addr(), cur_session->get_their_port(), cur_session->get_my_addr(), cur_session->get_my_port(), 512, FLAG_SYN, cur_session->their_seq_nr, &temp, nullptr, 0);
 		}
 
 		DOLOG(ll_debug, "wait_for_client_connected_state: client waiting for 'established': STATE NOW IS %s\n", states[cur_session->state]);
@@ -1193,29 +1746,26 @@ bool tcp::wait_for_client_connected_state(const int local_port)
 
 bool tcp::client_session_send_data(const int local_port, const uint8_t *const data, const size_t len)
 {
-	DOLOG(ll_debug, "client_session_send_data: lock all sessions\n");
-
-	// lock all sessions
-	std::shared_lock<std::shared_mutex> lck(sessions_lock);
-
 	DOLOG(ll_debug, "client_session_send_data: find session id for %d\n", local_port);
 
 	// find id of the session
-	auto it_id = tcp_clients.find(local_port);
-	if (it_id == tcp_clients.end()) {
+	uint64_t id = 0;
+	if (get_client_session_id(local_port, &id) == false) {
 		DOLOG(ll_debug, "client_session_send_data: session id not found\n");
 		return false;
 	}
 
-	DOLOG(ll_debug, "client_session_send_data: session id: [%012" PRIx64 "]\n", it_id->second);
+	DOLOG(ll_debug, "client_session_send_data: session id: [%012" PRIx64 "]\n", id);
+
+	std::shared_lock<std::shared_mutex> lck(sessions.get_lock(id));
 
-	auto sd_it = sessions.find(it_id->second);
-	if (sd_it == sessions.end())
+	session *const found_session = sessions.find(id);
+	if (found_session == nullptr)
 		return false;
 
 	DOLOG(ll_debug, "client_session_send_data: found session-data, send_data\n");
 
-	tcp_session *const cur_session = dynamic_cast<tcp_session *>(sd_it->second);
+	tcp_session *const cur_session = dynamic_cast<tcp_session *>(found_session);
 
 	bool rc = send_data(cur_session, data, len);
 
@@ -1233,9 +1783,27 @@ json_t *tcp::get_state_json(session *const ts_in)
 	json_object_set(out, "state", json_string(ts->get_state_name().c_str()));
 	json_object_set(out, "state-duration", json_integer(time(nullptr) - ts->state_since));
 
-	json_object_set(out, "unacked_size", json_integer(ts->unacked_size));
+	json_object_set(out, "unacked_size", json_integer(ts->unacked.size()));
+
+	json_object_set(out, "sack_permitted", json_string(ts->sack_permitted ? "true" : "false"));
+	json_object_set(out, "window_scaling", json_string(ts->window_scaling ? "true" : "false"));
+	json_object_set(out, "their_window", json_integer(ts->window_size));
+	json_object_set(out, "their_mss", json_integer(ts->their_mss));
+	json_object_set(out, "my_window", json_integer(ts->rcv_right_edge - ts->their_seq_nr));
+	json_object_set(out, "out_of_order_size", json_integer(ts->reassembly.get_size()));
+
+	if (ts->cc) {
+		json_object_set(out, "congestion_control", json_string(ts->cc->get_name().c_str()));
+		json_object_set(out, "cwnd", json_integer(ts->cc->get_cwnd()));
+		json_object_set(out, "ssthresh", json_integer(std::min(ts->cc->get_ssthresh(), size_t(INT64_MAX))));
+	}
+
+	json_object_set(out, "in_recovery", json_string(ts->in_recovery ? "true" : "false"));
+	json_object_set(out, "srtt_us", json_integer(ts->srtt_us));
+	json_object_set(out, "rttvar_us", json_integer(ts->rttvar_us));
+	json_object_set(out, "rto_us", json_integer(ts->rto_us));
 
-	if (ts->unacked_size) {
+	if (ts->unacked.size()) {
 		json_object_set(out, "unacked_start_seq_nr", json_integer(ts->unacked_start_seq_nr));
 		json_object_set(out, "unacked_time_pending", json_real((get_us() - ts->r_last_pkt_ts) / 1000.));
 	}
@@ -1244,7 +1812,7 @@ json_t *tcp::get_state_json(session *const ts_in)
 		json_object_set(out, "unacked_time_pending", json_real(0.));
 	}
 
-        json_object_set(out, "data_since_last_ack", json_integer(ts->data_since_last_ack));
+        json_object_set(out, "bytes_in_flight", json_integer(ts->bytes_in_flight));
         json_object_set(out, "fin_after_unacked_empty", json_string(ts->fin_after_unacked_empty ? "true" : "false"));
 
         json_object_set(out, "seq_for_fin_when_all_received", json_integer(ts->seq_for_fin_when_all_received));
@@ -17,16 +17,35 @@
 #include "pstream.h"
 #include "session.h"
 #include "stats.h"
+#include "time.h"
+#include "tcp_cc.h"
+#include "tcp_reassembly.h"
+#include "tcp_send_queue.h"
+#include "timer_wheel.h"
 #include "types.h"
 
 
 class ipv4;
 class tcp;
 
-constexpr int clean_interval = 1; // in seconds
+constexpr uint64_t tcp_timer_tick_us          {     1000 };
+constexpr uint64_t tcp_rto_us                 {  1000000 };  // until an rtt was measured
+constexpr uint64_t tcp_rto_min_us             {   200000 };
+constexpr uint64_t tcp_rto_max_us             { 60000000 };
+constexpr int      tcp_dup_ack_threshold      {        3 };
+constexpr uint64_t tcp_delayed_ack_max_us     {   500000 };  // RFC 1122, 4.2.3.2
+constexpr int      tcp_default_mss_ipv4       {      536 };  // when the peer sends no MSS option
+constexpr int      tcp_default_mss_ipv6       {     1220 };
+constexpr uint64_t tcp_syn_rcvd_timeout_us    {  5000000 };
+constexpr uint64_t tcp_time_wait_us           {  1000000 };  // linger for late segments
+constexpr uint64_t tcp_keepalive_idle_us      { 60000000 };
+constexpr uint64_t tcp_keepalive_interval_us  { 10000000 };
+constexpr int      tcp_keepalive_probes       {        3 };
 
 typedef enum { tcp_closed, tcp_listen, tcp_syn_rcvd, tcp_syn_sent, tcp_established, tcp_fin_wait_1, tcp_fin_wait_2, tcp_close_wait, tcp_last_ack, tcp_closing, tcp_time_wait, tcp_rst_act } tcp_state_t;
 
+typedef enum { tcp_timer_rto, tcp_timer_keepalive, tcp_timer_idle, tcp_timer_time_wait, tcp_timer_delayed_ack, tcp_timer_n } tcp_timer_t;
+
 class tcp_session : public session
 {
 public:
@@ -35,35 +54,65 @@ public:
 
 	uint64_t id          { 0 };
 
-	uint16_t window_size { 512 };
+	uint32_t window_size { 512 };  // of the peer, scaled
+
+	// RFC 7323 window scaling; both 0 when not negotiated
+	bool     window_scaling     { false };
+	uint8_t  my_window_shift    { 0 };
+	uint8_t  their_window_shift { 0 };
+	uint32_t rcv_right_edge     { 0 };  // their_seq_nr + the advertised window
+
+	int      their_mss          { tcp_default_mss_ipv4 };
 
 	tcp_state_t state    { tcp_closed };
 	time_t state_since   { 0 };
 
 	std::condition_variable_any state_changed;
-	uint64_t e_last_pkt_ts{ 0 };  // ts of last packet (transmitted or received)
+	uint64_t e_last_pkt_ts{ 0 };  // ts of last packet (transmitted or received, keepalives excluded)
 	uint64_t r_last_pkt_ts{ 0 };  // ts of last received packet
 	uint32_t my_seq_nr    { 0 };
 	uint32_t their_seq_nr { 0 };
 	uint32_t initial_my_seq_nr    { 0 };
 	uint32_t initial_their_seq_nr { 0 };
 
-	uint8_t *unacked                 { nullptr };
+	tcp_send_queue unacked;
 	uint32_t unacked_start_seq_nr    { 0       };
-	size_t   data_since_last_ack     { 0       };
-	size_t   unacked_size            { 0       };
+	size_t   bytes_in_flight         { 0       };  // sent but not acknowledged
 	bool     fin_after_unacked_empty { false   };
+	bool     corked                  { false   };
 	std::condition_variable unacked_sent_cv;
+	int      n_blocked_senders       { 0       };  // threads in send_data() (which may wait for room)
 
 	uint32_t seq_for_fin_when_all_received { 0     };
 	bool     flag_fin_when_all_received    { false };
 
+	bool           sack_permitted { false };
+	tcp_reassembly reassembly;
+	std::atomic<size_t> receive_backlog { 0 };  // see pstream::set_receive_backlog()
+
+	uint32_t ts_recent            { 0 };  // last timestamp of the peer, echoed
+	int      ack_pending_segments { 0 };  // received in-order but not acknowledged yet (delayed ACK)
+
+	// congestion control, fast recovery and rtt estimation
+	tcp_cc  *cc              { nullptr };
+	int      dup_acks        { 0       };
+	bool     in_recovery     { false   };
+	uint32_t recover         { 0       };  // highest sequence number sent when the loss was detected
+	uint64_t srtt_us         { 0       };  // 0 = not measured yet
+	uint64_t rttvar_us       { 0       };
+	uint64_t rto_us          { tcp_rto_us };
+
+	// deadline of each timer in the wheel of the tcp instance, 0 = not armed
+	uint64_t timer_deadline[tcp_timer_n]   { 0     };
+	int      keepalive_probes_sent         { 0     };
+
 public:
 	tcp_session(pstream *const t, const any_addr & my_addr, const int my_port, const any_addr & their_addr, const int their_port, private_data *app_private_data) :
 		session(t, my_addr, my_port, their_addr, their_port, app_private_data) {
 	}
 
 	~tcp_session() {
+		delete cc;
 	}
 
 	std::string get_state_name() const {
@@ -88,20 +137,30 @@ class tcp : public transport_layer, public pstream
 private:
 	icmp        *const icmp_       { nullptr };
 
-	std::thread *th_unacked_sender { nullptr };
+	std::thread *th_timers         { nullptr };
 
 	fifo<session *> *ending_sessions     { nullptr };
 	std::vector<std::thread *> th_enders { nullptr };
 
-	std::thread *th_cleaner        { nullptr };
+	timer_wheel                 timers      { tcp_timer_tick_us, get_us() };
+	std::mutex                  timer_lock;
+	std::condition_variable     timer_cv;
+	uint64_t                    timer_next_wakeup { 0 };
 
-	std::condition_variable_any unacked_cv;
+	const int                   max_sessions { 128 };
+	const size_t                send_buffer_size    { 1024 * 1024 };  // per session
+	const size_t                receive_buffer_size { 65535 };
+	uint8_t                     my_window_shift     { 0 };
+	const tcp_cc_algorithm_t    cc_algorithm        { tcp_cc_alg_newreno };
+	const uint64_t              delayed_ack_us      { 40000 };  // 0: acknowledge every segment
 
 	// listen port -> handler
 	std::shared_mutex             listeners_lock;
 	std::map<int, port_handler_t> listeners;
 
 	// client port -> session
+	// never acquire a session table lock while holding clients_lock
+	std::mutex                    clients_lock;
 	std::map<int, uint64_t>       tcp_clients;
 
 	uint64_t *tcp_packets           { nullptr };
@@ -116,6 +175,12 @@ private:
 	uint64_t *tcp_sessions_closed_1 { nullptr };
 	uint64_t *tcp_sessions_closed_2 { nullptr };
 	uint64_t *tcp_cur_n_sessions    { nullptr };
+	uint64_t *tcp_ooo_queued        { nullptr };
+	uint64_t *tcp_ooo_dropped       { nullptr };
+	uint64_t *tcp_fast_retransmits  { nullptr };
+	uint64_t *tcp_rto_retransmits   { nullptr };
+	uint64_t *tcp_acks_pure         { nullptr };
+	uint64_t *tcp_acks_piggybacked  { nullptr };
 
 	uint64_t *tcp_unacked_duration_max { nullptr };
 	uint64_t *tcp_phandle_duration_max { nullptr };
@@ -125,9 +190,8 @@ private:
 	duration_events new_session_handling3 { "new session3",    8 };
 	duration_events main_packet_handling  { "main packet",     8 };
 	duration_events delete_session        { "delete session",  8 };
-	duration_events notify_unacked        { "notify unacked",  8 };
-	duration_events session_cleaner_de    { "session cleaner", 8 };
-	duration_events unacked_sender_de     { "unacked sender",  8 };
+	duration_events arm_timer_de          { "arm timer",       8 };
+	duration_events timers_de             { "timers",          8 };
 	duration_events session_ender_de      { "session ender",   8 };
 	duration_events send_data_de          { "send data",       8 };
 	duration_events end_session_de        { "end session",     8 };
@@ -137,23 +201,35 @@ private:
 
 	void send_rst_for_port(const packet *const pkt, const int dst_port, const int src_port);
 
-	bool send_segment(tcp_session *const ts, const uint64_t session_id, const any_addr & my_addr, const int my_port, const any_addr & peer_addr, const int peer_port, const int org_len, const uint8_t flags, const uint32_t ack_to, uint32_t *const my_seq_nr, const uint8_t *const data, const size_t data_len, const uint32_t TSencr);
+	uint32_t get_receive_window(tcp_session *const ts, const bool syn);
+	size_t generate_options(const tcp_session *const ts, const uint8_t flags, const uint32_t TSecr, uint8_t *const out);
+	bool send_segment(tcp_session *const ts, const uint64_t session_id, const any_addr & my_addr, const int my_port, const any_addr & peer_addr, const int peer_port, const int org_len, const uint8_t flags, const uint32_t ack_to, uint32_t *const my_seq_nr, buffer_chain *const payload, const uint32_t TSencr);
 
 	void packet_handler(packet *const pkt);
-	void cleanup_session_helper(std::map<uint64_t, tcp_session *>::iterator *it);
-	void session_cleaner();
-	void unacked_sender();
 	void session_ender();
 
+	void arm_timer(tcp_session *const s, const tcp_timer_t timer, const uint64_t deadline);
+	void timer_thread();
+	size_t get_segment_size(const tcp_session *const s);
+	int  transmit_unacked(tcp_session *const s, const bool force = false);
+	void send_ack(tcp_session *const s);
+	void retransmit_first(tcp_session *const s);
+	void update_rto(tcp_session *const s, const uint64_t rtt);
+	void handle_rto(tcp_session *const s, const uint64_t now);
+	bool handle_timeout(tcp_session *const s, const tcp_timer_t timer, const uint64_t now);
+	void remove_session(const uint64_t id, tcp_session *const s);
+
 	void set_state(tcp_session *const session, const tcp_state_t new_state);
 
-	std::optional<port_handler_t> get_lock_listener(const int dst_port, const std::string & log_prefix, const bool write_lock);
+	std::optional<port_handler_t> get_lock_listener(const int dst_port, const log_context & log_prefix, const bool write_lock);
 	void release_listener_lock(const bool write_lock);
 
 	void free_tcp_session(tcp_session *const p);
 
+	bool get_client_session_id(const int port, uint64_t *const id);
+
 public:
-	tcp(stats *const s, icmp *const icmp_, const int n_threads);
+	tcp(stats *const s, icmp *const icmp_, const int n_threads, const int max_sessions, const size_t send_buffer_size, const size_t receive_buffer_size, const tcp_cc_algorithm_t cc_algorithm, const uint64_t delayed_ack_us);
 	virtual ~tcp();
 
 	json_t *get_state_json(session *const ts) override;
@@ -161,6 +237,8 @@ public:
 	void add_handler(const int port, port_handler_t & tph);
 
 	bool send_data(session *const ts, const uint8_t *const data, const size_t len) override;
+	void set_cork(session *const ts, const bool on) override;
+	void set_receive_backlog(session *const ts, const size_t n) override;
 	void end_session(session *const ts) override;
 
 	// returns a port number
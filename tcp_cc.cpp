@@ -0,0 +1,68 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#include <algorithm>
+#include <stdint.h>
+
+#include "tcp_cc.h"
+#include "tcp_cc_cubic.h"
+#include "tcp_cc_newreno.h"
+
+
+// initial window of RFC 6928
+tcp_cc::tcp_cc(const size_t mss) : mss(mss), cwnd(std::min(10 * mss, std::max(2 * mss, size_t(14600)))), ssthresh(SIZE_MAX)
+{
+}
+
+tcp_cc::~tcp_cc()
+{
+}
+
+size_t tcp_cc::slow_start(const size_t acked)
+{
+	if (cwnd >= ssthresh)
+		return acked;
+
+	size_t grow = std::min(std::min(acked, mss), ssthresh - cwnd);
+
+	cwnd += grow;
+
+	// a stretch ACK below ssthresh is still slow start (at most 1 mss)
+	if (cwnd < ssthresh)
+		return 0;
+
+	return acked - grow;
+}
+
+void tcp_cc::on_dup_ack()
+{
+	cwnd += mss;
+}
+
+void tcp_cc::on_partial_ack(const size_t acked)
+{
+	// deflate by what was acknowledged, the retransmitted segment is let in
+	cwnd = (cwnd > acked ? cwnd - acked : 0) + mss;
+}
+
+void tcp_cc::on_recovery_end()
+{
+	cwnd = std::max(ssthresh, mss);
+}
+
+std::optional<tcp_cc_algorithm_t> tcp_cc_from_name(const std::string & name)
+{
+	if (name == "newreno")
+		return tcp_cc_alg_newreno;
+
+	if (name == "cubic")
+		return tcp_cc_alg_cubic;
+
+	return { };
+}
+
+tcp_cc *create_tcp_cc(const tcp_cc_algorithm_t algorithm, const size_t mss)
+{
+	if (algorithm == tcp_cc_alg_cubic)
+		return new tcp_cc_cubic(mss);
+
+	return new tcp_cc_newreno(mss);
+}
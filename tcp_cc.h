@@ -0,0 +1,50 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#pragma once
+
+#include <optional>
+#include <stdint.h>
+#include <string>
+
+
+typedef enum { tcp_cc_alg_newreno, tcp_cc_alg_cubic } tcp_cc_algorithm_t;
+
+/* congestion control of one tcp session; all sizes are in bytes
+ * the algorithms differ in how the window grows when data is acknowledged
+ * and in how much it shrinks when a loss is detected; fast recovery
+ * (RFC 6582) is the same for all of them
+ */
+class tcp_cc
+{
+protected:
+	const size_t mss      { 536 };
+	size_t       cwnd     { 0   };
+	size_t       ssthresh { 0   };
+
+	// slow start (RFC 5681, 3.1); returns the bytes that were not used
+	// when cwnd reached ssthresh, these are for congestion avoidance
+	size_t slow_start(const size_t acked);
+
+public:
+	tcp_cc(const size_t mss);
+	virtual ~tcp_cc();
+
+	virtual std::string get_name() const = 0;
+
+	// new data was acknowledged (outside of fast recovery); srtt is in us
+	virtual void on_ack(const size_t acked, const uint64_t now, const uint64_t srtt) = 0;
+
+	// a loss was detected by 3 duplicate ACKs or by a retransmission time-out
+	virtual void on_loss(const size_t in_flight, const uint64_t now, const bool timeout) = 0;
+
+	// fast recovery: every duplicate ACK means a segment has left the network
+	void on_dup_ack();
+	void on_partial_ack(const size_t acked);
+	void on_recovery_end();
+
+	size_t get_cwnd()     const { return cwnd;     }
+	size_t get_ssthresh() const { return ssthresh; }
+};
+
+std::optional<tcp_cc_algorithm_t> tcp_cc_from_name(const std::string & name);
+
+tcp_cc *create_tcp_cc(const tcp_cc_algorithm_t algorithm, const size_t mss);
@@ -0,0 +1,77 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#include <algorithm>
+#include <cmath>
+
+#include "tcp_cc_cubic.h"
+
+
+constexpr double cubic_c    { 0.4 };
+constexpr double cubic_beta { 0.7 };
+
+tcp_cc_cubic::tcp_cc_cubic(const size_t mss) : tcp_cc(mss)
+{
+}
+
+tcp_cc_cubic::~tcp_cc_cubic()
+{
+}
+
+void tcp_cc_cubic::on_ack(const size_t acked, const uint64_t now, const uint64_t srtt)
+{
+	size_t left = slow_start(acked);
+
+	if (left == 0)
+		return;
+
+	const double cwnd_segments = double(cwnd) / mss;
+
+	if (epoch_start == 0) {
+		epoch_start = now;
+
+		if (cwnd_segments < w_max) {
+			k      = std::cbrt((w_max - cwnd_segments) / cubic_c);
+			origin = w_max;
+		}
+		else {
+			k      = 0.;
+			origin = cwnd_segments;
+		}
+
+		w_est = cwnd_segments;
+	}
+
+	// where the window should be one rtt from now
+	const double t      = (now - epoch_start + srtt) / 1000000.;
+	double       target = origin + cubic_c * std::pow(t - k, 3.);
+
+	w_est += 3. * (1. - cubic_beta) / (1. + cubic_beta) * double(left) / cwnd;
+
+	// tcp-friendly region: cwnd is set to W_est (RFC 9438, 4.3)
+	if (w_est > target) {
+		if (w_est > cwnd_segments)
+			cwnd = size_t(w_est * mss);
+
+		return;
+	}
+
+	target = std::min(target, cwnd_segments * 1.5);
+
+	if (target > cwnd_segments)
+		cwnd += size_t((target - cwnd_segments) / cwnd_segments * left);
+}
+
+void tcp_cc_cubic::on_loss(const size_t in_flight, const uint64_t now, const bool timeout)
+{
+	const double cwnd_segments = double(cwnd) / mss;
+
+	// fast convergence: give up bandwidth for new flows
+	if (cwnd_segments < w_max)
+		w_max = cwnd_segments * (1. + cubic_beta) / 2.;
+	else
+		w_max = cwnd_segments;
+
+	epoch_start = 0;
+
+	ssthresh    = std::max(size_t(cwnd * cubic_beta), 2 * mss);
+	cwnd        = timeout ? mss : ssthresh + 3 * mss;
+}
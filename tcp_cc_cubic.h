@@ -0,0 +1,25 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#pragma once
+
+#include "tcp_cc.h"
+
+
+// RFC 9438; the window is computed in segments
+class tcp_cc_cubic : public tcp_cc
+{
+private:
+	double   w_max       { 0. };  // window before the last reduction
+	double   w_est       { 0. };  // what newreno would have had (tcp-friendly region)
+	double   k           { 0. };  // seconds until w_max is reached again
+	double   origin      { 0. };
+	uint64_t epoch_start { 0  };  // 0: no congestion avoidance epoch started
+
+public:
+	tcp_cc_cubic(const size_t mss);
+	virtual ~tcp_cc_cubic();
+
+	std::string get_name() const override { return "cubic"; }
+
+	void on_ack(const size_t acked, const uint64_t now, const uint64_t srtt) override;
+	void on_loss(const size_t in_flight, const uint64_t now, const bool timeout) override;
+};
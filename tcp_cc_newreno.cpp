@@ -0,0 +1,38 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#include <algorithm>
+
+#include "tcp_cc_newreno.h"
+
+
+tcp_cc_newreno::tcp_cc_newreno(const size_t mss) : tcp_cc(mss)
+{
+}
+
+tcp_cc_newreno::~tcp_cc_newreno()
+{
+}
+
+void tcp_cc_newreno::on_ack(const size_t acked, const uint64_t now, const uint64_t srtt)
+{
+	size_t left = slow_start(acked);
+
+	if (left == 0)
+		return;
+
+	bytes_acked += left;
+
+	if (bytes_acked >= cwnd) {
+		bytes_acked -= cwnd;
+
+		cwnd += mss;
+	}
+}
+
+void tcp_cc_newreno::on_loss(const size_t in_flight, const uint64_t now, const bool timeout)
+{
+	ssthresh    = std::max(in_flight / 2, 2 * mss);
+	bytes_acked = 0;
+
+	// the 3 segments that caused the duplicate ACKs have left the network
+	cwnd        = timeout ? mss : ssthresh + 3 * mss;
+}
@@ -0,0 +1,21 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#pragma once
+
+#include "tcp_cc.h"
+
+
+// RFC 5681 / RFC 6582
+class tcp_cc_newreno : public tcp_cc
+{
+private:
+	size_t bytes_acked { 0 };  // congestion avoidance: cwnd grows by 1 mss per cwnd acked
+
+public:
+	tcp_cc_newreno(const size_t mss);
+	virtual ~tcp_cc_newreno();
+
+	std::string get_name() const override { return "newreno"; }
+
+	void on_ack(const size_t acked, const uint64_t now, const uint64_t srtt) override;
+	void on_loss(const size_t in_flight, const uint64_t now, const bool timeout) override;
+};
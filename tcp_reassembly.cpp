@@ -0,0 +1,144 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#include <algorithm>
+
+#include "tcp_reassembly.h"
+
+
+tcp_reassembly::tcp_reassembly()
+{
+}
+
+tcp_reassembly::~tcp_reassembly()
+{
+}
+
+bool tcp_reassembly::add(const uint32_t expected, const uint32_t seq, const uint8_t *const data, const size_t len, const uint32_t window)
+{
+	if (len == 0 || int32_t(seq - expected) <= 0)
+		return true;
+
+	const uint32_t offset = seq - expected;
+
+	if (offset + len > window)
+		return false;
+
+	// find the first segment that starts at or after this one
+	auto it = std::find_if(segments.begin(), segments.end(), [expected, offset](const segment_t & s) { return s.seq - expected >= offset; });
+
+	// retransmission of something already queued
+	if (it != segments.end() && it->seq == seq && it->data.size() >= len)
+		return true;
+
+	// skip what the previous segment already covers
+	size_t skip = 0;
+
+	if (it != segments.begin()) {
+		auto prev = it - 1;
+
+		uint32_t prev_end_offset = prev->seq + prev->data.size() - expected;
+
+		if (prev_end_offset >= offset + len)
+			return true;
+
+		if (prev_end_offset > offset)
+			skip = prev_end_offset - offset;
+	}
+
+	// drop queued segments that this one covers completely and stop in
+	// front of one that it overlaps partially: the queued data then never
+	// overlaps, so it can not be more than the window
+	size_t end = len;
+
+	while(it != segments.end()) {
+		uint32_t it_offset = it->seq - expected;
+
+		if (it_offset >= offset + len)
+			break;
+
+		if (it_offset + it->data.size() <= offset + len) {
+			n_bytes -= it->data.size();
+
+			it = segments.erase(it);
+
+			continue;
+		}
+
+		end = it_offset - offset;
+
+		break;
+	}
+
+	if (end <= skip)
+		return true;
+
+	segments.insert(it, { seq + uint32_t(skip), std::vector<uint8_t>(data + skip, data + end) });
+
+	n_bytes += end - skip;
+
+	last_seq = seq;
+
+	return true;
+}
+
+bool tcp_reassembly::get(const uint32_t expected, std::vector<uint8_t> *const out)
+{
+	while(segments.empty() == false) {
+		segment_t & s = segments.front();
+
+		// still a gap?
+		if (int32_t(s.seq - expected) > 0)
+			return false;
+
+		const uint32_t skip = expected - s.seq;
+
+		if (skip >= s.data.size()) {  // completely overlapped by what was delivered
+			n_bytes -= s.data.size();
+			segments.erase(segments.begin());
+			continue;
+		}
+
+		n_bytes -= s.data.size();
+
+		if (skip == 0)
+			out->swap(s.data);
+		else
+			out->assign(s.data.begin() + skip, s.data.end());
+
+		segments.erase(segments.begin());
+
+		return true;
+	}
+
+	return false;
+}
+
+std::vector<std::pair<uint32_t, uint32_t> > tcp_reassembly::get_blocks(const uint32_t expected, const size_t max_n) const
+{
+	std::vector<std::pair<uint32_t, uint32_t> > blocks;
+
+	for(auto & s : segments) {
+		uint32_t begin = s.seq;
+		uint32_t end   = s.seq + s.data.size();
+
+		if (blocks.empty() == false && int32_t(begin - blocks.back().second) <= 0) {
+			if (int32_t(end - blocks.back().second) > 0)
+				blocks.back().second = end;
+		}
+		else {
+			blocks.push_back({ begin, end });
+		}
+	}
+
+	// RFC 2018: the first block must contain the most recently received segment
+	for(size_t i=1; i<blocks.size(); i++) {
+		if (last_seq - blocks[i].first < blocks[i].second - blocks[i].first) {
+			std::rotate(blocks.begin(), blocks.begin() + i, blocks.begin() + i + 1);
+			break;
+		}
+	}
+
+	if (blocks.size() > max_n)
+		blocks.resize(max_n);
+
+	return blocks;
+}
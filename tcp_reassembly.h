@@ -0,0 +1,45 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+
+/* segments that were received ahead of the sequence number that is
+ * expected next; kept ordered so that they can be delivered as soon as
+ * the gap in front of them is filled
+ * sequence numbers are compared relative to the expected sequence number
+ * so that wrap-arounds are handled
+ */
+class tcp_reassembly
+{
+private:
+	typedef struct {
+		uint32_t             seq;
+		std::vector<uint8_t> data;
+	} segment_t;
+
+	std::vector<segment_t> segments;
+	size_t                 n_bytes   { 0 };
+	uint32_t               last_seq  { 0 };  // most recently added
+
+public:
+	tcp_reassembly();
+	virtual ~tcp_reassembly();
+
+	// returns false if the segment does not fit in the receive window
+	// ('window' bytes starting at 'expected'); overlapping parts are only
+	// stored once, so memory use is bound by the window
+	bool add(const uint32_t expected, const uint32_t seq, const uint8_t *const data, const size_t len, const uint32_t window);
+
+	// pops the data that continues at 'expected' (if any)
+	bool get(const uint32_t expected, std::vector<uint8_t> *const out);
+
+	// merged [begin, end) ranges, the most recently received one first
+	std::vector<std::pair<uint32_t, uint32_t> > get_blocks(const uint32_t expected, const size_t max_n) const;
+
+	size_t get_size() const { return n_bytes; }
+
+	bool empty() const { return segments.empty(); }
+};
@@ -0,0 +1,91 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#include <algorithm>
+#include <string.h>
+
+#include "tcp_send_queue.h"
+
+
+tcp_send_queue::tcp_send_queue()
+{
+}
+
+tcp_send_queue::~tcp_send_queue()
+{
+	clear();
+}
+
+void tcp_send_queue::append(const uint8_t *const data, const size_t len)
+{
+	size_t offset = 0;
+
+	while(offset < len) {
+		if (chunks.empty() || tail == tcp_send_queue_chunk_size) {
+			chunks.push_back(pool_allocate(nullptr, tcp_send_queue_chunk_size));
+			tail = 0;
+		}
+
+		size_t n = std::min(len - offset, tcp_send_queue_chunk_size - tail);
+
+		memcpy(pool_block_data(chunks.back()) + tail, &data[offset], n);
+
+		tail   += n;
+		offset += n;
+	}
+
+	n_bytes += len;
+}
+
+void tcp_send_queue::trim(const size_t n)
+{
+	if (n >= n_bytes) {
+		clear();
+		return;
+	}
+
+	head    += n;
+	n_bytes -= n;
+
+	while(head >= tcp_send_queue_chunk_size) {
+		pool_block_unref(chunks.front());
+		chunks.pop_front();
+
+		head -= tcp_send_queue_chunk_size;
+	}
+}
+
+bool tcp_send_queue::get(const size_t offset, const size_t len, buffer_chain *const out) const
+{
+	if (offset + len > n_bytes)
+		return false;
+
+	// all chunks but the last one are full
+	size_t index = (head + offset) / tcp_send_queue_chunk_size;
+	size_t start = (head + offset) % tcp_send_queue_chunk_size;
+	size_t todo  = len;
+
+	while(todo > 0) {
+		pool_block_t *const chunk = chunks[index];
+		size_t              n     = std::min(todo, tcp_send_queue_chunk_size - start);
+
+		if (out->append(chunk, pool_block_data(chunk) + start, n) == false)
+			return false;
+
+		todo  -= n;
+		start  = 0;
+		index++;
+	}
+
+	return true;
+}
+
+void tcp_send_queue::clear()
+{
+	for(auto & chunk : chunks)
+		pool_block_unref(chunk);
+
+	chunks.clear();
+
+	head    = 0;
+	tail    = 0;
+	n_bytes = 0;
+}
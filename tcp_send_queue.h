@@ -0,0 +1,45 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#pragma once
+#include <deque>
+#include <stdint.h>
+
+#include "buffer_chain.h"
+#include "buffer_pool.h"
+
+
+constexpr size_t tcp_send_queue_chunk_size { 65536 };
+
+/* data that was handed to tcp but is not acknowledged yet
+ * kept in a list of reference counted chunks: appending and trimming
+ * acknowledged data never move bytes around, and segments refer to the
+ * chunks instead of copying them (a chunk stays alive for as long as a
+ * packet that was built from it is queued somewhere)
+ * bytes of a chunk are never written to again once they were appended
+ */
+class tcp_send_queue
+{
+private:
+	std::deque<pool_block_t *> chunks;
+	size_t                     head    { 0 };  // offset of the first byte in the first chunk
+	size_t                     tail    { 0 };  // bytes in use in the last chunk
+	size_t                     n_bytes { 0 };
+
+public:
+	tcp_send_queue();
+	tcp_send_queue(const tcp_send_queue &) = delete;
+	virtual ~tcp_send_queue();
+
+	void append(const uint8_t *const data, const size_t len);
+
+	// drops the first 'n' bytes (acknowledged)
+	void trim(const size_t n);
+
+	// adds 'len' bytes, starting at 'offset', to 'out' as one or more segments
+	bool get(const size_t offset, const size_t len, buffer_chain *const out) const;
+
+	void clear();
+
+	size_t size() const { return n_bytes; }
+
+	bool empty() const { return n_bytes == 0; }
+};
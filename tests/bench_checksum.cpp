@@ -0,0 +1,118 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+// TCP/UDP checksum: the previous copy-then-sum implementation against the
+// checksum engine (every kernel the CPU supports), 64 to 9000 byte payloads
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <arpa/inet.h>
+
+#include "checksum.h"
+#include "time.h"
+
+
+// the previous implementation, kept here as the reference
+static uint16_t ip_checksum(const uint16_t *const p, const size_t n)
+{
+	uint32_t cksum = 0;
+
+	for(size_t i=0; i<n; i++)
+		cksum += htons(p[i]);
+
+	cksum = (cksum >> 16) + (cksum & 0xffff);
+	cksum += cksum >> 16;
+
+	return ~cksum;
+}
+
+static uint16_t old_tcp_udp_checksum(const any_addr & src_addr, const any_addr & dst_addr, const uint8_t *const tcp_payload, const int len)
+{
+	size_t temp_len = 12 + len + (len & 1);
+	uint8_t *temp = new uint8_t[temp_len]();
+
+	src_addr.get(&temp[0], 4);
+
+	dst_addr.get(&temp[4], 4);
+
+	temp[9] = 0x06;
+
+	temp[10] = len >> 8;
+	temp[11] = len;
+
+	memcpy(&temp[12], tcp_payload, len);
+
+	uint16_t checksum = ip_checksum((const uint16_t *)temp, temp_len / 2);
+
+	delete [] temp;
+
+	return checksum;
+}
+
+static uint16_t new_tcp_udp_checksum(const any_addr & src_addr, const any_addr & dst_addr, const uint8_t *const tcp_payload, const int len)
+{
+	checksum_state_t state;
+
+	checksum_init(&state);
+	checksum_add_pseudo_header(&state, src_addr, dst_addr, 0x06, len);
+	checksum_add(&state, tcp_payload, len);
+
+	return checksum_finish(&state);
+}
+
+int main(int argc, char *argv[])
+{
+	const uint64_t total_bytes = argc >= 2 ? atoll(argv[1]) : 1000000000ll;
+
+	const uint8_t a[] = { 192, 168, 0, 1 };
+	const uint8_t b[] = { 192, 168, 0, 2 };
+
+	any_addr src(any_addr::ipv4, a);
+	any_addr dst(any_addr::ipv4, b);
+
+	std::vector<uint8_t> payload(9000);
+
+	for(auto & byte : payload)
+		byte = rand();
+
+	std::vector<std::string> kernels = checksum_kernels();
+
+	printf("%6s %10s", "bytes", "old");
+
+	for(auto & k : kernels)
+		printf(" %10s", k.c_str());
+
+	printf("   (MB/s)\n");
+
+	volatile uint16_t sink = 0;
+
+	for(int len : { 64, 128, 256, 576, 1024, 1460, 4096, 9000 }) {
+		const int n = std::max(uint64_t(1), total_bytes / len);
+
+		printf("%6d", len);
+
+		uint64_t start = get_us();
+
+		for(int i=0; i<n; i++)
+			sink = old_tcp_udp_checksum(src, dst, payload.data(), len);
+
+		printf(" %10.1f", double(n) * len / (get_us() - start));
+
+		for(auto & k : kernels) {
+			checksum_select_kernel(k);
+
+			start = get_us();
+
+			for(int i=0; i<n; i++)
+				sink = new_tcp_udp_checksum(src, dst, payload.data(), len);
+
+			printf(" %10.1f", double(n) * len / (get_us() - start));
+		}
+
+		printf("\n");
+	}
+
+	(void)sink;
+
+	return 0;
+}
@@ -0,0 +1,90 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+// CRC-32C: the previous byte-at-a-time table implementation against every
+// implementation of the CRC engine the CPU supports
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "crc.h"
+#include "time.h"
+
+
+// the previous implementation (draft-ietf-tsvwg-sctpcsum-03), kept here as
+// the reference
+static uint32_t crc_c[256];
+
+static void init_crc_c()
+{
+	for(uint32_t i=0; i<256; i++) {
+		uint32_t crc = i;
+
+		for(int j=0; j<8; j++)
+			crc = (crc >> 1) ^ (crc & 1 ? crc32c_polynomial : 0);
+
+		crc_c[i] = crc;
+	}
+}
+
+static uint32_t old_crc32c(const uint8_t *const buffer, const size_t length)
+{
+	uint32_t crc32 = ~0;
+
+	for(size_t i=0; i<length; i++)
+		crc32 = (crc32 >> 8) ^ crc_c[(crc32 ^ buffer[i]) & 0xff];
+
+	return ~crc32;
+}
+
+int main(int argc, char *argv[])
+{
+	const uint64_t total_bytes = argc >= 2 ? atoll(argv[1]) : 1000000000ll;
+
+	init_crc_c();
+
+	std::vector<uint8_t> data(9000);
+
+	for(auto & byte : data)
+		byte = rand();
+
+	std::vector<std::string> kernels = crc32c_kernels();
+
+	printf("%6s %12s", "bytes", "old");
+
+	for(auto & k : kernels)
+		printf(" %12s", k.c_str());
+
+	printf("   (MB/s)\n");
+
+	volatile uint32_t sink = 0;
+
+	for(int len : { 64, 128, 256, 576, 1024, 1460, 4096, 9000 }) {
+		const int n = std::max(uint64_t(1), total_bytes / len);
+
+		printf("%6d", len);
+
+		uint64_t start = get_us();
+
+		for(int i=0; i<n; i++)
+			sink = old_crc32c(data.data(), len);
+
+		printf(" %12.1f", double(n) * len / (get_us() - start));
+
+		for(auto & k : kernels) {
+			crc32c_select_kernel(k);
+
+			start = get_us();
+
+			for(int i=0; i<n; i++)
+				sink = crc32c(data.data(), len);
+
+			printf(" %12.1f", double(n) * len / (get_us() - start));
+		}
+
+		printf("\n");
+	}
+
+	(void)sink;
+
+	return 0;
+}
@@ -0,0 +1,195 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+// contention benchmark: the lock-free fifo against the mutex/condvar fifo it
+// replaced, for a couple of producer/consumer thread counts
+#include <atomic>
+#include <optional>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#include "fifo.h"
+#include "stats.h"
+#include "time.h"
+
+
+// the previous implementation, kept here as the reference
+template <typename T>
+class fifo_mutex
+{
+private:
+	T        *data       { nullptr };
+	const int n_elements { 0       };
+
+	int  read_pointer    { 0       };
+	int  write_pointer   { 0       };
+	bool full            { false   };
+
+	pthread_mutex_t lock;
+	pthread_cond_t  cond_push;
+	pthread_cond_t  cond_pull;
+
+	fifo_stats *fs   { nullptr };
+	uint64_t    n_in { 0       };
+
+	uint64_t   *fifo_n_in_stats { nullptr };
+
+public:
+	fifo_mutex(stats *const s, const std::string & name, const int n_elements) : n_elements(n_elements)
+	{
+		data = new T[n_elements];
+
+		fifo_n_in_stats = s->register_stat(name + "_n_in");
+
+		fs = new fifo_stats(n_elements);
+
+		pthread_mutex_init(&lock, NULL);
+
+		pthread_cond_init(&cond_push, NULL);
+		pthread_cond_init(&cond_pull, NULL);
+	}
+
+	~fifo_mutex()
+	{
+		delete fs;
+
+		delete [] data;
+	}
+
+	void put(const T & element)
+	{
+		pthread_mutex_lock(&lock);
+
+		while(full)
+			pthread_cond_wait(&cond_pull, &lock);
+
+		data[write_pointer] = element;
+
+		write_pointer++;
+		write_pointer %= n_elements;
+
+		n_in++;
+
+		fs->count(n_in);
+
+		stats_set(fifo_n_in_stats, n_in);
+
+		full = write_pointer == read_pointer;
+
+		pthread_cond_signal(&cond_push);
+
+		pthread_mutex_unlock(&lock);
+	}
+
+	std::optional<T> get(const int ms)
+	{
+		struct timespec ts { 0, 0 };
+		clock_gettime(CLOCK_REALTIME, &ts);
+
+		ts.tv_nsec += (ms % 1000) * 1000000ll;
+		ts.tv_sec += ms / 1000;
+
+		if (ts.tv_nsec >= 1000000000ll) {
+			ts.tv_nsec -= 1000000000ll;
+			ts.tv_sec++;
+		}
+
+		pthread_mutex_lock(&lock);
+
+		while(read_pointer == write_pointer && !full) {
+			if (pthread_cond_timedwait(&cond_push, &lock, &ts)) {
+				pthread_mutex_unlock(&lock);
+
+				return { };
+			}
+		}
+
+		T copy = data[read_pointer];
+
+		read_pointer++;
+		read_pointer %= n_elements;
+
+		n_in--;
+
+		full = 0;
+
+		pthread_cond_signal(&cond_pull);
+
+		pthread_mutex_unlock(&lock);
+
+		return copy;
+	}
+};
+
+// returns false when not every element came out exactly once
+template <typename Q>
+bool run(stats *const s, const char *const name, const int n_producers, const int n_consumers, const int n_per_producer)
+{
+	Q q(s, name, 256);
+
+	const uint64_t     n_total  = uint64_t(n_producers) * n_per_producer;
+	std::atomic_uint64_t n_got  { 0 };
+	std::atomic_uint64_t sum    { 0 };
+
+	uint64_t start = get_us();
+
+	std::vector<std::thread *> threads;
+
+	for(int i=0; i<n_consumers; i++) {
+		threads.push_back(new std::thread([&] {
+			uint64_t local_sum = 0;
+
+			while(n_got < n_total) {
+				auto v = q.get(10);
+
+				if (v.has_value()) {
+					local_sum += v.value();
+					n_got++;
+				}
+			}
+
+			sum += local_sum;
+		}));
+	}
+
+	for(int i=0; i<n_producers; i++) {
+		threads.push_back(new std::thread([&, i] {
+			for(int j=0; j<n_per_producer; j++)
+				q.put(uint64_t(i) * n_per_producer + j + 1);
+		}));
+	}
+
+	for(auto th : threads) {
+		th->join();
+		delete th;
+	}
+
+	uint64_t took = get_us() - start;
+
+	printf("%-12s %2d producers %2d consumers: %8.3f M elements/s\n", name, n_producers, n_consumers, n_total / double(took));
+
+	return n_got == n_total && sum == n_total * (n_total + 1) / 2;
+}
+
+int main(int argc, char *argv[])
+{
+	int n = argc >= 2 ? atoi(argv[1]) : 1000000;
+
+	stats s(65536, nullptr);
+
+	bool ok = true;
+
+	for(int threads : { 1, 2, 4, 8 }) {
+		ok &= run<fifo_mutex<uint64_t> >(&s, "mutex", threads, threads, n / threads);
+		ok &= run<fifo<uint64_t>       >(&s, "lock-free", threads, threads, n / threads);
+	}
+
+	if (!ok) {
+		printf("elements were lost or duplicated\n");
+
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,157 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+// UDP packets through ipv4 and udp: heap allocations and packets/s per log
+// level. Apart from the packet objects themselves (the views each layer
+// creates), nothing may be allocated per packet when the log level filters
+// out the debug messages: the log prefixes are only rendered when logged.
+#include <atomic>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+#include "arp.h"
+#include "ipv4.h"
+#include "log.h"
+#include "packet.h"
+#include "snmp_data.h"
+#include "stats.h"
+#include "time.h"
+#include "udp.h"
+
+
+// allocations by the ipv4/udp threads; the main thread (which plays the
+// network interface and creates the incoming packets) is not counted
+static std::atomic_uint64_t n_allocations        { 0 };
+static std::atomic_uint64_t n_packet_allocations { 0 };
+static thread_local bool    count_allocations    { true };
+
+void *operator new(size_t size)
+{
+	if (count_allocations) {
+		if (size == sizeof(packet))
+			n_packet_allocations++;
+		else
+			n_allocations++;
+	}
+
+	void *p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept
+{
+	free(p);
+}
+
+static std::atomic_uint64_t n_received { 0 };
+
+// returns the number of allocations per packet that were not packet objects
+static double run(ipv4 *const ip, const any_addr & src_mac, const any_addr & dst_mac, const any_addr & src_ip, const any_addr & dst_ip, const int n, const char *const name)
+{
+	uint8_t frame[20 + 8 + 64] { 0 };
+
+	frame[0]  = 0x45;
+	frame[2]  = sizeof frame >> 8;
+	frame[3]  = sizeof frame;
+	frame[8]  = 64;  // TTL
+	frame[9]  = 0x11;  // UDP
+	src_ip.get(&frame[12], 4);
+	dst_ip.get(&frame[16], 4);
+
+	frame[20] = 1234 >> 8;  // source port
+	frame[21] = 1234 & 255;
+	frame[22] = 9 >> 8;  // destination port (discard)
+	frame[23] = 9;
+	frame[24] = (8 + 64) >> 8;
+	frame[25] = 8 + 64;
+
+	const uint64_t received_before = n_received;
+	const uint64_t allocs_before   = n_allocations;
+	const uint64_t pallocs_before  = n_packet_allocations;
+
+	timespec ts { 0, 0 };
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	uint64_t start = get_us();
+
+	for(int i=0; i<n; i++) {
+		// stay below the size of the ipv4 queue: a full queue drops packets
+		while(received_before + i - n_received >= 128)
+			std::this_thread::yield();
+
+		ip->queue_incoming_packet(nullptr, new packet(ts, src_mac, src_mac, dst_mac, frame, sizeof frame, nullptr, 0, log_context()));
+	}
+
+	while(n_received - received_before < uint64_t(n))
+		std::this_thread::yield();
+
+	uint64_t took = get_us() - start;
+
+	double other_per_packet  = double(n_allocations        - allocs_before ) / n;
+	double packet_per_packet = double(n_packet_allocations - pallocs_before) / n;
+
+	printf("%-6s %8d packets: %8.3f M packets/s, %5.2f packet objects and %5.2f other allocations per packet\n", name, n, n / double(took), packet_per_packet, other_per_packet);
+
+	return other_per_packet;
+}
+
+int main(int argc, char *argv[])
+{
+	count_allocations = false;
+
+	int n = argc >= 2 ? atoi(argv[1]) : 1000000;
+
+	setlog("/dev/null", ll_error, ll_error);
+
+	snmp_data sd;
+	stats     s(65536, &sd);
+
+	const uint8_t my_mac_bytes [] { 0x52, 0x34, 0x84, 0x00, 0x00, 0x01 };
+	const uint8_t src_mac_bytes[] { 0x52, 0x34, 0x84, 0x00, 0x00, 0x02 };
+	const uint8_t my_ip_bytes  [] { 10, 0, 0, 1 };
+	const uint8_t src_ip_bytes [] { 10, 0, 0, 2 };
+
+	any_addr my_mac (any_addr::mac,  my_mac_bytes );
+	any_addr src_mac(any_addr::mac,  src_mac_bytes);
+	any_addr my_ip  (any_addr::ipv4, my_ip_bytes  );
+	any_addr src_ip (any_addr::ipv4, src_ip_bytes );
+
+	arp  a(&s, nullptr, my_mac, my_ip);
+	ipv4 ip(&s, &a, my_ip, nullptr, false, 1);
+	udp  u(&s, nullptr, 1);
+
+	ip.register_protocol(0x11, &u);
+
+	u.add_handler(9, [](const any_addr &, int, const any_addr &, int, packet *, session_data *const) { n_received++; }, nullptr);
+
+	// warm up: caches, first-time allocations of the threads
+	run(&ip, src_mac, my_mac, src_ip, my_ip, 1000, "warmup");
+
+	double per_packet = run(&ip, src_mac, my_mac, src_ip, my_ip, n, "error");
+
+	setlog("/dev/null", ll_debug, ll_error);
+
+	run(&ip, src_mac, my_mac, src_ip, my_ip, std::max(1, n / 10), "debug");
+
+	setlog("/dev/null", ll_error, ll_error);
+
+	ip.ask_to_stop();
+	u.ask_to_stop();
+
+	// a handful can come from (re)sizing structures, not from every packet
+	if (per_packet >= 0.01) {
+		printf("allocations per packet at log level error\n");
+
+		return 1;
+	}
+
+	return 0;
+}
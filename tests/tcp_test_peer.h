@@ -0,0 +1,285 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+// a fake IP layer and a scripted TCP peer for testing tcp (and the
+// applications on top of it) without a network
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string.h>
+#include <thread>
+#include <time.h>
+#include <tuple>
+#include <vector>
+
+#include "log_context.h"
+#include "network_layer.h"
+#include "packet.h"
+#include "tcp.h"
+
+
+constexpr uint8_t test_flag_fin { 1 << 0 };
+constexpr uint8_t test_flag_syn { 1 << 1 };
+constexpr uint8_t test_flag_rst { 1 << 2 };
+constexpr uint8_t test_flag_psh { 1 << 3 };
+constexpr uint8_t test_flag_ack { 1 << 4 };
+
+// what tcp transmits is queued per destination port, for the peer that
+// uses that port; both directions can be given a delay
+class test_ip : public network_layer
+{
+private:
+	typedef std::chrono::steady_clock clock;
+
+	const any_addr my_addr;
+
+	std::mutex              lock;
+	std::condition_variable cv;
+	clock::duration         delay { 0 };  // one-way
+	std::map<int, std::deque<std::pair<clock::time_point, std::vector<uint8_t> > > > segments;
+	std::deque<std::tuple<clock::time_point, transport_layer *, packet *> >          to_tcp;
+	bool                    stop  { false };
+	std::thread            *th    { nullptr };
+
+	// hands the packets of the peers to tcp once their delay has passed
+	void deliverer()
+	{
+		std::unique_lock<std::mutex> lck(lock);
+
+		while(!stop) {
+			if (to_tcp.empty()) {
+				cv.wait(lck);
+				continue;
+			}
+
+			auto [ due, t, p ] = to_tcp.front();
+
+			if (clock::now() < due) {
+				cv.wait_until(lck, due);
+				continue;
+			}
+
+			to_tcp.pop_front();
+
+			t->queue_packet(p);
+		}
+	}
+
+public:
+	test_ip(stats *const s, const any_addr & my_addr) : network_layer(s, "test-ip", nullptr), my_addr(my_addr)
+	{
+		th = new std::thread(&test_ip::deliverer, this);
+	}
+
+	virtual ~test_ip()
+	{
+		{
+			std::unique_lock<std::mutex> lck(lock);
+			stop = true;
+			cv.notify_all();
+		}
+
+		th->join();
+		delete th;
+	}
+
+	void set_delay(const int ms)
+	{
+		std::unique_lock<std::mutex> lck(lock);
+
+		delay = std::chrono::milliseconds(ms);
+	}
+
+	any_addr get_addr() const override { return my_addr; }
+
+	bool transmit_packet(const std::optional<any_addr> & dst_mac, const any_addr & dst_ip, const any_addr & src_ip, const uint8_t protocol, const uint8_t *payload, const size_t pl_size, const uint8_t *const header_template) override
+	{
+		if (pl_size < 20)
+			return false;
+
+		std::unique_lock<std::mutex> lck(lock);
+
+		segments[(payload[2] << 8) | payload[3]].push_back({ clock::now() + delay, std::vector<uint8_t>(payload, payload + pl_size) });
+
+		cv.notify_all();
+
+		return true;
+	}
+
+	// from a peer to tcp
+	void deliver(transport_layer *const t, packet *const p)
+	{
+		std::unique_lock<std::mutex> lck(lock);
+
+		if (delay == clock::duration(0) && to_tcp.empty()) {
+			t->queue_packet(p);
+			return;
+		}
+
+		to_tcp.push_back({ clock::now() + delay, t, p });
+
+		cv.notify_all();
+	}
+
+	int get_max_packet_size() const override { return 1500 - 20; }
+
+	void operator()() override { }
+
+	std::optional<std::vector<uint8_t> > get(const int port, const int ms)
+	{
+		std::unique_lock<std::mutex> lck(lock);
+
+		auto & queue    = segments[port];
+		auto   deadline = clock::now() + std::chrono::milliseconds(ms);
+
+		for(;;) {
+			auto now = clock::now();
+
+			if (queue.empty() == false && queue.front().first <= now) {
+				auto out = std::move(queue.front().second);
+				queue.pop_front();
+
+				return out;
+			}
+
+			if (now >= deadline)
+				return { };
+
+			cv.wait_until(lck, queue.empty() ? deadline : std::min(deadline, queue.front().first));
+		}
+	}
+};
+
+typedef struct {
+	uint32_t             seq;
+	uint32_t             ack;
+	uint8_t              flags;
+	uint16_t             window;        // not scaled
+	int                  window_shift;  // -1: no option
+	std::vector<uint8_t> data;
+} test_segment_t;
+
+inline test_segment_t test_parse_segment(const std::vector<uint8_t> & p)
+{
+	test_segment_t s { 0, 0, 0, 0, -1, { } };
+
+	s.seq    = (p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+	s.ack    = (p[8] << 24) | (p[9] << 16) | (p[10] << 8) | p[11];
+	s.flags  = p[13];
+	s.window = (p[14] << 8) | p[15];
+
+	size_t header_size = (p[12] >> 4) * 4;
+
+	for(size_t o = 20; o < header_size;) {
+		if (p[o] == 0 || p[o] == 1) {
+			o++;
+			continue;
+		}
+
+		if (p[o] == 3)
+			s.window_shift = p[o + 2];
+
+		o += std::max(2, int(p[o + 1]));
+	}
+
+	s.data.assign(p.begin() + header_size, p.end());
+
+	return s;
+}
+
+// the remote end of one session; it only does what the test tells it to
+class test_peer
+{
+private:
+	tcp     *const t;
+	test_ip *const ip;
+	const any_addr my_addr;
+	const any_addr their_addr;
+	const int      my_port;
+	const int      their_port;
+
+public:
+	uint32_t my_seq    { 1000 };
+	uint32_t their_seq { 0    };
+
+	test_peer(tcp *const t, test_ip *const ip, const any_addr & my_addr, const int my_port, const int their_port) :
+		t(t), ip(ip),
+		my_addr(my_addr), their_addr(ip->get_addr()),
+		my_port(my_port), their_port(their_port)
+	{
+	}
+
+	void send(const uint8_t flags, const uint8_t *const data = nullptr, const size_t len = 0, const bool syn_options = false)
+	{
+		const size_t header_size = syn_options ? 28 : 20;
+
+		std::vector<uint8_t> buffer(header_size + len);
+
+		buffer[0]  = my_port >> 8;
+		buffer[1]  = my_port;
+		buffer[2]  = their_port >> 8;
+		buffer[3]  = their_port;
+		buffer[4]  = my_seq >> 24;
+		buffer[5]  = my_seq >> 16;
+		buffer[6]  = my_seq >> 8;
+		buffer[7]  = my_seq;
+		buffer[8]  = their_seq >> 24;
+		buffer[9]  = their_seq >> 16;
+		buffer[10] = their_seq >> 8;
+		buffer[11] = their_seq;
+		buffer[12] = (header_size / 4) << 4;
+		buffer[13] = flags;
+		buffer[14] = 0xff;  // window: 65535 << 7
+		buffer[15] = 0xff;
+
+		if (syn_options) {
+			// MSS 1460, NOP, window scale 7
+			const uint8_t options[] = { 2, 4, 0x05, 0xb4, 1, 3, 3, 7 };
+			memcpy(&buffer[20], options, sizeof options);
+		}
+
+		if (len)
+			memcpy(&buffer[header_size], data, len);
+
+		my_seq += len;
+
+		uint8_t ip_header[20] { 0 };
+
+		timespec ts { 0, 0 };
+		clock_gettime(CLOCK_REALTIME, &ts);
+
+		ip->deliver(t, new packet(ts, my_addr, their_addr, buffer.data(), buffer.size(), ip_header, sizeof ip_header, log_context()));
+	}
+
+	std::optional<test_segment_t> receive(const int ms)
+	{
+		auto segment = ip->get(my_port, ms);
+
+		if (segment.has_value() == false)
+			return { };
+
+		return test_parse_segment(segment.value());
+	}
+
+	// returns the SYN/ACK, or nothing if there was none
+	std::optional<test_segment_t> handshake()
+	{
+		send(test_flag_syn, nullptr, 0, true);
+
+		auto syn_ack = receive(1000);
+
+		if (syn_ack.has_value() == false || syn_ack.value().flags != (test_flag_syn | test_flag_ack))
+			return { };
+
+		my_seq++;
+		their_seq = syn_ack.value().seq + 1;
+
+		send(test_flag_ack);
+
+		return syn_ack;
+	}
+};
@@ -0,0 +1,171 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+// known-answer test for the internet checksum engine: every kernel the CPU
+// supports against a plain RFC 1071 implementation, for random lengths,
+// alignments and ways of splitting the data
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "checksum.h"
+
+
+// sums 16 bit big-endian words, an odd last byte is padded with a zero
+static uint32_t reference_sum(const uint8_t *const data, const size_t len, uint32_t sum = 0)
+{
+	for(size_t i=0; i<len; i += 2) {
+		sum += data[i] << 8;
+
+		if (i + 1 < len)
+			sum += data[i + 1];
+	}
+
+	return sum;
+}
+
+static uint16_t reference_finish(uint32_t sum)
+{
+	while(sum >> 16)
+		sum = (sum >> 16) + (sum & 0xffff);
+
+	return ~sum;
+}
+
+static int n_errors = 0;
+
+static void check(const uint16_t got, const uint16_t expected, const std::string & what)
+{
+	if (got == expected)
+		return;
+
+	if (++n_errors <= 10)
+		printf("FAIL %s: %04x, expected %04x\n", what.c_str(), got, expected);
+}
+
+int main(int argc, char *argv[])
+{
+	std::mt19937 rng(argc >= 2 ? atoi(argv[1]) : 1);
+
+	constexpr size_t max_len = 9000;
+	constexpr size_t max_ofs = 64;
+
+	std::vector<uint8_t> buffer(max_len + max_ofs);
+
+	for(auto & b : buffer)
+		b = rng();
+
+	// all 0xff makes sure the carries are handled
+	std::vector<uint8_t> ones(max_len + max_ofs, 0xff);
+
+	for(auto & kernel : checksum_kernels()) {
+		checksum_select_kernel(kernel);
+
+		printf("kernel: %s\n", checksum_kernel_name());
+
+		for(int i=0; i<20000; i++) {
+			const std::vector<uint8_t> & data = i % 10 == 0 ? ones : buffer;
+
+			size_t len = i < 100 ? i : rng() % (max_len + 1);
+			size_t ofs = rng() % max_ofs;
+
+			const uint8_t *p = data.data() + ofs;
+
+			uint16_t expected = reference_finish(reference_sum(p, len));
+
+			std::string what = kernel + " len " + std::to_string(len) + " offset " + std::to_string(ofs);
+
+			checksum_state_t state;
+			checksum_init(&state);
+			checksum_add(&state, p, len);
+
+			check(checksum_finish(&state), expected, what);
+
+			// in pieces, which can start at odd offsets in the data
+			checksum_init(&state);
+
+			for(size_t done = 0; done < len;) {
+				size_t n = std::min(len - done, size_t(rng() % 200));
+
+				checksum_add(&state, p + done, n);
+
+				done += n;
+			}
+
+			check(checksum_finish(&state), expected, what + " (in pieces)");
+
+			// pseudo header
+			uint8_t addresses[32];
+
+			for(auto & b : addresses)
+				b = rng();
+
+			uint8_t pseudo[40] { 0 };
+
+			for(int v6 = 0; v6 < 2; v6++) {
+				any_addr src(v6 ? any_addr::ipv6 : any_addr::ipv4, &addresses[0]);
+				any_addr dst(v6 ? any_addr::ipv6 : any_addr::ipv4, &addresses[16]);
+
+				size_t pseudo_len = 0;
+
+				if (v6) {
+					memcpy(&pseudo[0], &addresses[0], 32);
+					pseudo[34] = len >> 8;
+					pseudo[35] = len;
+					pseudo[39] = 6;
+					pseudo_len = 40;
+				}
+				else {
+					memcpy(&pseudo[0], &addresses[0], 4);
+					memcpy(&pseudo[4], &addresses[16], 4);
+					pseudo[9]  = 6;
+					pseudo[10] = len >> 8;
+					pseudo[11] = len;
+					pseudo_len = 12;
+				}
+
+				checksum_init(&state);
+				checksum_add_pseudo_header(&state, src, dst, 6, len);
+				checksum_add(&state, p, len);
+
+				check(checksum_finish(&state), reference_finish(reference_sum(p, len, reference_sum(pseudo, pseudo_len))), what + (v6 ? " (IPv6 pseudo header)" : " (IPv4 pseudo header)"));
+			}
+		}
+	}
+
+	// RFC 1624 incremental updates against recomputing the whole sum
+	for(int i=0; i<100000; i++) {
+		uint8_t data[64];
+
+		for(auto & b : data)
+			b = rng();
+
+		uint16_t before = reference_finish(reference_sum(data, sizeof data));
+
+		size_t   word   = (rng() % (sizeof data / 4)) * 4;
+		uint32_t old_v  = (data[word] << 24) | (data[word + 1] << 16) | (data[word + 2] << 8) | data[word + 3];
+		uint32_t new_v  = rng();
+
+		data[word + 0] = new_v >> 24;
+		data[word + 1] = new_v >> 16;
+		data[word + 2] = new_v >> 8;
+		data[word + 3] = new_v;
+
+		uint16_t after = reference_finish(reference_sum(data, sizeof data));
+
+		check(checksum_update32(before, old_v, new_v), after, "update32");
+		check(checksum_update16(checksum_update16(before, old_v >> 16, new_v >> 16), old_v & 0xffff, new_v & 0xffff), after, "update16");
+	}
+
+	if (n_errors) {
+		printf("%d errors\n", n_errors);
+
+		return 1;
+	}
+
+	printf("all ok\n");
+
+	return 0;
+}
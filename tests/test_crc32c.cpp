@@ -0,0 +1,122 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+// known-answer test for the CRC engine: the RFC 3720 (iSCSI) CRC-32C
+// vectors for every implementation the CPU supports, and those
+// implementations against a bitwise CRC for random lengths and alignments
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "crc.h"
+
+
+static uint32_t reference_crc(const uint8_t *const data, const size_t n, const uint32_t polynomial)
+{
+	uint32_t crc = 0xffffffff;
+
+	for(size_t i=0; i<n; i++) {
+		crc ^= data[i];
+
+		for(int j=0; j<8; j++)
+			crc = (crc >> 1) ^ (crc & 1 ? polynomial : 0);
+	}
+
+	return ~crc;
+}
+
+static int n_errors = 0;
+
+static void check(const uint32_t got, const uint32_t expected, const std::string & what)
+{
+	if (got == expected)
+		return;
+
+	if (++n_errors <= 10)
+		printf("FAIL %s: %08x, expected %08x\n", what.c_str(), got, expected);
+}
+
+int main(int argc, char *argv[])
+{
+	std::mt19937 rng(argc >= 2 ? atoi(argv[1]) : 1);
+
+	// RFC 3720, appendix B.4
+	uint8_t zeros[32] { 0 };
+
+	uint8_t ones[32];
+	memset(ones, 0xff, sizeof ones);
+
+	uint8_t incrementing[32];
+	uint8_t decrementing[32];
+
+	for(int i=0; i<32; i++) {
+		incrementing[i] = i;
+		decrementing[i] = 31 - i;
+	}
+
+	const uint8_t iscsi_read[48] {
+		0x01, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00,
+		0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x18,
+		0x28, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+	};
+
+	const uint8_t check_string[] = "123456789";
+
+	constexpr size_t max_len = 20000;
+	constexpr size_t max_ofs = 64;
+
+	std::vector<uint8_t> buffer(max_len + max_ofs);
+
+	for(auto & b : buffer)
+		b = rng();
+
+	for(auto & kernel : crc32c_kernels()) {
+		crc32c_select_kernel(kernel);
+
+		printf("kernel: %s\n", crc32c_kernel_name());
+
+		check(crc32c(zeros,        sizeof zeros       ), 0x8a9136aa, kernel + " 32 bytes of zeros");
+		check(crc32c(ones,         sizeof ones        ), 0x62a8ab43, kernel + " 32 bytes of 0xff");
+		check(crc32c(incrementing, sizeof incrementing), 0x46dd794e, kernel + " 32 incrementing bytes");
+		check(crc32c(decrementing, sizeof decrementing), 0x113fdb5c, kernel + " 32 decrementing bytes");
+		check(crc32c(iscsi_read,   sizeof iscsi_read  ), 0xd9963a56, kernel + " iSCSI read command");
+		check(crc32c(check_string, 9                  ), 0xe3069283, kernel + " \"123456789\"");
+
+		// lengths that cover the 3-stream paths (256 and 8192 byte blocks)
+		for(int i=0; i<5000; i++) {
+			size_t len = i < 100 ? i : rng() % (max_len + 1);
+			size_t ofs = rng() % max_ofs;
+
+			const uint8_t *p = buffer.data() + ofs;
+
+			check(crc32c(p, len), reference_crc(p, len, crc32c_polynomial), kernel + " len " + std::to_string(len) + " offset " + std::to_string(ofs));
+		}
+	}
+
+	// the other (ethernet, zip) polynomial and one without a table
+	check(crc32_generic(check_string, 9, crc32_polynomial), 0xcbf43926, "crc32 \"123456789\"");
+
+	for(int i=0; i<1000; i++) {
+		size_t len = rng() % 2000;
+		size_t ofs = rng() % max_ofs;
+
+		const uint8_t *p = buffer.data() + ofs;
+
+		check(crc32_generic(p, len, crc32_polynomial), reference_crc(p, len, crc32_polynomial), "crc32 len " + std::to_string(len));
+		check(crc32_generic(p, len, 0xeb31d82e), reference_crc(p, len, 0xeb31d82e), "crc32k len " + std::to_string(len));
+	}
+
+	if (n_errors) {
+		printf("%d errors\n", n_errors);
+
+		return 1;
+	}
+
+	printf("all ok\n");
+
+	return 0;
+}
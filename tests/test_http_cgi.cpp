@@ -0,0 +1,112 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+// the reply header for CGI (PHP) requests: parsed like a client does, it
+// must contain the status line, the server's and the CGI binary's header
+// lines and end with exactly one empty line
+#include <ctype.h>
+#include <map>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "http.h"
+
+
+static int n_errors = 0;
+
+static void check(const bool ok, const std::string & what)
+{
+	if (ok)
+		return;
+
+	printf("FAIL: %s\n", what.c_str());
+
+	n_errors++;
+}
+
+typedef struct {
+	std::string                        status_line;
+	std::map<std::string, std::string> headers;  // names in lower case
+	std::string                        invalid;  // a line that is not a header
+	bool                               complete;  // empty line seen
+	std::string                        rest;  // after the empty line
+} response_t;
+
+static response_t parse(const std::string & in)
+{
+	response_t r { "", { }, "", false, "" };
+
+	size_t offset = 0;
+
+	for(;;) {
+		size_t crlf = in.find("\r\n", offset);
+		if (crlf == std::string::npos)
+			break;
+
+		std::string line = in.substr(offset, crlf - offset);
+		offset = crlf + 2;
+
+		if (line.empty()) {
+			r.complete = true;
+			break;
+		}
+
+		if (r.status_line.empty()) {
+			r.status_line = line;
+			continue;
+		}
+
+		size_t colon = line.find(':');
+		if (colon == std::string::npos) {
+			r.invalid = line;
+			continue;
+		}
+
+		std::string name = line.substr(0, colon);
+		for(auto & c : name)
+			c = tolower(c);
+
+		size_t value = line.find_first_not_of(' ', colon + 1);
+
+		r.headers[name] = value == std::string::npos ? "" : line.substr(value);
+	}
+
+	r.rest = in.substr(offset);
+
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	for(int keep_alive = 0; keep_alive < 2; keep_alive++) {
+		for(int chunked = 0; chunked < 2; chunked++) {
+			for(auto & cgi_header : std::vector<std::string> { "Content-Type: text/html", "X-Powered-By: PHP/8.2\r\nContent-type: text/html; charset=UTF-8", "" }) {
+				std::string what = std::string(keep_alive ? "keep-alive" : "close") + (chunked ? ", chunked" : "") + ", CGI header \"" + cgi_header + "\"";
+
+				response_t r = parse(http_cgi_response_header("HTTP/1.1", keep_alive, chunked, cgi_header));
+
+				check(r.status_line == "HTTP/1.1 200 OK", what + ": status line \"" + r.status_line + "\"");
+				check(r.complete, what + ": no empty line at the end of the header");
+				check(r.rest.empty(), what + ": " + std::to_string(r.rest.size()) + " bytes after the header");
+				check(r.invalid.empty(), what + ": invalid header line \"" + r.invalid + "\"");
+				check(r.headers["server"] == "MyIP", what + ": server");
+				check(r.headers["connection"] == (keep_alive ? "keep-alive" : "close"), what + ": connection");
+				check(r.headers.count("transfer-encoding") == size_t(chunked), what + ": transfer-encoding");
+
+				if (cgi_header.empty() == false)
+					check(r.headers.count("content-type") == 1, what + ": content-type of the CGI binary missing");
+				if (cgi_header.find("X-Powered-By") != std::string::npos)
+					check(r.headers["x-powered-by"] == "PHP/8.2", what + ": x-powered-by of the CGI binary missing");
+			}
+		}
+	}
+
+	if (n_errors) {
+		printf("%d errors\n", n_errors);
+
+		return 1;
+	}
+
+	printf("all ok\n");
+
+	return 0;
+}
@@ -0,0 +1,158 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+// clients that stop reading must not keep the HTTP workers: as many such
+// clients as there are workers each request a large file twice (pipelined)
+// and never acknowledge anything; a next client must still be answered
+// before its session times out
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "http.h"
+#include "log.h"
+#include "snmp_data.h"
+#include "stats.h"
+#include "tcp.h"
+#include "tcp_test_peer.h"
+#include "time.h"
+
+
+constexpr int    server_port { 80 };
+constexpr int    n_workers   { 4  };
+constexpr size_t large_size  { 1024 * 1024 };
+
+static bool write_file(const std::string & name, const std::string & data)
+{
+	FILE *fh = fopen(name.c_str(), "w");
+	if (!fh)
+		return false;
+
+	bool ok = fwrite(data.c_str(), 1, data.size(), fh) == data.size();
+
+	return fclose(fh) == 0 && ok;
+}
+
+int main(int argc, char *argv[])
+{
+	setlog("/dev/null", ll_error, ll_error);
+
+	char web_root[] = "/tmp/myip-test-http-XXXXXX";
+
+	if (!mkdtemp(web_root) || mkdir((std::string(web_root) + "/default").c_str(), 0700) == -1) {
+		printf("cannot create web root: %s\n", strerror(errno));
+		return 1;
+	}
+
+	const std::string large_name = std::string(web_root) + "/default/large.bin";
+	const std::string small_name = std::string(web_root) + "/default/small.html";
+
+	if (!write_file(large_name, std::string(large_size, 'x')) || !write_file(small_name, "hello")) {
+		printf("cannot create files: %s\n", strerror(errno));
+		return 1;
+	}
+
+	snmp_data sd;
+	stats     s(65536, &sd);
+
+	const uint8_t my_ip   [] { 10, 0, 0, 1 };
+	const uint8_t their_ip[] { 10, 0, 0, 2 };
+
+	any_addr my_addr   (any_addr::ipv4, my_ip   );
+	any_addr their_addr(any_addr::ipv4, their_ip);
+
+	test_ip ip(&s, my_addr);
+
+	tcp *t = new tcp(&s, nullptr, 1, 16, 64 * 1024, 64 * 1024, tcp_cc_alg_newreno, 0);
+
+	ip.register_protocol(0x06, t);
+
+	port_handler_t handler = http_get_handler(&s, web_root, "/dev/null", false, "", n_workers, 16 * 1024 * 1024);
+
+	t->add_handler(server_port, handler);
+
+	int rc = 0;
+
+	// the second response does not fit in the send buffer: the worker waits
+	const std::string twice = "GET /large.bin HTTP/1.1\r\n\r\nGET /large.bin HTTP/1.1\r\n\r\n";
+
+	std::vector<test_peer *> stalled;
+
+	for(int i=0; i<n_workers; i++) {
+		test_peer *p = new test_peer(t, &ip, their_addr, 2000 + i, server_port);
+
+		if (p->handshake().has_value() == false) {
+			printf("FAIL: no connection for stalled client %d\n", i);
+			return 1;
+		}
+
+		p->send(test_flag_ack | test_flag_psh, reinterpret_cast<const uint8_t *>(twice.c_str()), twice.size());
+
+		stalled.push_back(p);
+	}
+
+	// let every worker get stuck
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+
+	uint64_t start = get_us();
+
+	test_peer   p(t, &ip, their_addr, 3000, server_port);
+	std::string reply;
+	bool        fin = false;
+
+	if (p.handshake().has_value() == false) {
+		printf("FAIL: no connection for the client that reads\n");
+		return 1;
+	}
+
+	const std::string request = "GET /small.html HTTP/1.1\r\nConnection: close\r\n\r\n";
+
+	p.send(test_flag_ack | test_flag_psh, reinterpret_cast<const uint8_t *>(request.c_str()), request.size());
+
+	while(!fin && get_us() - start < 20000000) {
+		auto segment = p.receive(100);
+
+		if (segment.has_value() == false)
+			continue;
+
+		if (segment.value().seq != p.their_seq)  // retransmission
+			continue;
+
+		reply       += std::string(segment.value().data.begin(), segment.value().data.end());
+		p.their_seq += segment.value().data.size();
+
+		if (segment.value().flags & test_flag_fin) {
+			p.their_seq++;
+			fin = true;
+		}
+
+		p.send(test_flag_ack);
+	}
+
+	double took = (get_us() - start) / 1000000.;
+
+	printf("client that reads was answered after %.3f s\n", took);
+
+	if (reply.find("HTTP/1.1 200 OK\r\n") != 0 || reply.size() < 5 || reply.substr(reply.size() - 5) != "hello") {
+		printf("FAIL: unexpected reply \"%s\"\n", reply.c_str());
+		rc = 1;
+	}
+	else if (took >= 5) {  // a new session that waits longer for its reply times out
+		printf("FAIL: the workers were kept by the clients that do not read\n");
+		rc = 1;
+	}
+
+	unlink(large_name.c_str());
+	unlink(small_name.c_str());
+	rmdir((std::string(web_root) + "/default").c_str());
+	rmdir(web_root);
+
+	if (rc == 0)
+		printf("all ok\n");
+
+	return rc;
+}
@@ -0,0 +1,283 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+// congestion control with known answers: the initial window, slow start,
+// congestion avoidance, fast recovery and ssthresh after a loss for
+// newreno (exact, in bytes) and the cubic curve (K, W_max with fast
+// convergence, the tcp-friendly W_est) against the formulas of RFC 9438
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdio.h>
+#include <string>
+
+#include "tcp_cc.h"
+
+
+static int n_errors = 0;
+
+static void check(const bool ok, const std::string & what)
+{
+	if (ok)
+		return;
+
+	printf("FAIL: %s\n", what.c_str());
+
+	n_errors++;
+}
+
+static void check_eq(const size_t got, const size_t expected, const std::string & what)
+{
+	check(got == expected, what + ": " + std::to_string(got) + " instead of " + std::to_string(expected));
+}
+
+constexpr size_t mss { 1000 };
+
+// acknowledges one window (cwnd bytes) in ACKs of at most 'ack_size'
+// bytes, spread over 'rtt' us
+static void ack_window(tcp_cc *const cc, uint64_t *const now, const uint64_t rtt, const size_t ack_size)
+{
+	const size_t window = cc->get_cwnd();
+
+	for(size_t offset=0; offset<window; offset += ack_size) {
+		const size_t n = std::min(ack_size, window - offset);
+
+		*now += rtt * n / window;
+
+		cc->on_ack(n, *now, rtt);
+	}
+}
+
+static void test_initial_window()
+{
+	// RFC 6928: min(10 * mss, max(2 * mss, 14600))
+	const std::pair<size_t, size_t> expected[] { { 536, 5360 }, { 1460, 14600 }, { 9000, 18000 } };
+
+	for(auto & e : expected) {
+		std::unique_ptr<tcp_cc> cc(create_tcp_cc(tcp_cc_alg_newreno, e.first));
+
+		check_eq(cc->get_cwnd(), e.second, "initial window for mss " + std::to_string(e.first));
+		check_eq(cc->get_ssthresh(), SIZE_MAX, "initial ssthresh");
+	}
+}
+
+static void test_newreno()
+{
+	std::unique_ptr<tcp_cc> cc(create_tcp_cc(tcp_cc_alg_newreno, mss));
+
+	check(cc->get_name() == "newreno", "newreno: name " + cc->get_name());
+
+	// slow start: 1 mss per ACK
+	for(int i=0; i<10; i++)
+		cc->on_ack(mss, 1000000, 100000);
+
+	check_eq(cc->get_cwnd(), 20000, "newreno: slow start");
+
+	// a stretch ACK also counts as 1 mss
+	cc->on_ack(2 * mss, 1000000, 100000);
+	check_eq(cc->get_cwnd(), 21000, "newreno: stretch ACK in slow start");
+
+	// 3 duplicate ACKs with 20000 bytes in flight
+	cc->on_loss(20000, 1000000, false);
+	check_eq(cc->get_ssthresh(), 10000, "newreno: ssthresh after 3 duplicate ACKs");
+	check_eq(cc->get_cwnd(), 13000, "newreno: cwnd at the start of fast recovery");
+
+	cc->on_dup_ack();
+	cc->on_dup_ack();
+	check_eq(cc->get_cwnd(), 15000, "newreno: cwnd inflated by duplicate ACKs");
+
+	cc->on_partial_ack(3000);
+	check_eq(cc->get_cwnd(), 13000, "newreno: cwnd after a partial ACK");
+
+	cc->on_recovery_end();
+	check_eq(cc->get_cwnd(), 10000, "newreno: cwnd after fast recovery");
+
+	// congestion avoidance: 1 mss per cwnd acknowledged
+	for(int i=0; i<9; i++)
+		cc->on_ack(mss, 1000000, 100000);
+
+	check_eq(cc->get_cwnd(), 10000, "newreno: congestion avoidance, less than cwnd acknowledged");
+
+	cc->on_ack(mss, 1000000, 100000);
+	check_eq(cc->get_cwnd(), 11000, "newreno: congestion avoidance, cwnd acknowledged");
+
+	for(int i=0; i<11; i++)
+		cc->on_ack(mss, 1000000, 100000);
+
+	check_eq(cc->get_cwnd(), 12000, "newreno: congestion avoidance, second window");
+
+	// ssthresh is never below 2 mss
+	cc->on_loss(3000, 1000000, false);
+	check_eq(cc->get_ssthresh(), 2000, "newreno: ssthresh with little in flight");
+	cc->on_recovery_end();
+
+	// time-out: back to 1 mss
+	cc->on_loss(9000, 1000000, true);
+	check_eq(cc->get_ssthresh(), 4500, "newreno: ssthresh after a time-out");
+	check_eq(cc->get_cwnd(), mss, "newreno: cwnd after a time-out");
+
+	for(int i=0; i<3; i++)
+		cc->on_ack(mss, 1000000, 100000);
+
+	check_eq(cc->get_cwnd(), 4000, "newreno: slow start after a time-out");
+
+	// crosses ssthresh: 500 bytes for slow start, 500 for congestion avoidance
+	cc->on_ack(mss, 1000000, 100000);
+	check_eq(cc->get_cwnd(), 4500, "newreno: slow start up to ssthresh");
+
+	for(int i=0; i<3; i++)
+		cc->on_ack(mss, 1000000, 100000);
+
+	check_eq(cc->get_cwnd(), 4500, "newreno: congestion avoidance after crossing ssthresh");
+
+	cc->on_ack(mss, 1000000, 100000);
+	check_eq(cc->get_cwnd(), 5500, "newreno: bytes left over from slow start count for congestion avoidance");
+}
+
+// stretch ACKs in slow start must not count for congestion avoidance
+static void test_newreno_stretch_acks()
+{
+	std::unique_ptr<tcp_cc> cc(create_tcp_cc(tcp_cc_alg_newreno, mss));
+
+	cc->on_loss(24000, 1000000, true);
+
+	for(int i=0; i<11; i++)
+		cc->on_ack(2 * mss, 1000000, 100000);
+
+	check_eq(cc->get_cwnd(), 12000, "newreno stretch ACKs: slow start up to ssthresh");
+
+	cc->on_ack(2 * mss, 1000000, 100000);
+	check_eq(cc->get_cwnd(), 12000, "newreno stretch ACKs: first ACK of congestion avoidance");
+}
+
+static double w_cubic(const double t, const double w_max, const double k)
+{
+	return w_max + 0.4 * std::pow(t - k, 3.);
+}
+
+static void test_cubic()
+{
+	std::unique_ptr<tcp_cc> cc(create_tcp_cc(tcp_cc_alg_cubic, mss));
+
+	check(cc->get_name() == "cubic", "cubic: name " + cc->get_name());
+
+	const uint64_t rtt = 100000;
+	uint64_t       now = 1000000;
+
+	// slow start up to 100 segments
+	while(cc->get_cwnd() < 100 * mss)
+		cc->on_ack(mss, now += 1000, rtt);
+
+	check_eq(cc->get_cwnd(), 100 * mss, "cubic: slow start");
+
+	// beta = 0.7
+	cc->on_loss(100 * mss, now, false);
+	check_eq(cc->get_ssthresh(), 70 * mss, "cubic: ssthresh after 3 duplicate ACKs");
+	check_eq(cc->get_cwnd(), 73 * mss, "cubic: cwnd at the start of fast recovery");
+
+	cc->on_recovery_end();
+	check_eq(cc->get_cwnd(), 70 * mss, "cubic: cwnd after fast recovery");
+
+	// K = cbrt((W_max - cwnd) / C) = cbrt(75)
+	const double   k           = std::cbrt((100. - 70.) / 0.4);
+	const uint64_t epoch_start = now;
+	double         max_diff    = 0.;
+
+	while(now - epoch_start < uint64_t(k * 1000000) + 5 * rtt) {
+		ack_window(cc.get(), &now, rtt, mss);
+
+		// after each window, cwnd is on the curve
+		const double t        = (now - epoch_start) / 1000000.;
+		const double expected = w_cubic(t, 100., k);
+		const double cwnd     = double(cc->get_cwnd()) / mss;
+
+		max_diff = std::max(max_diff, std::abs(cwnd - expected));
+	}
+
+	check(max_diff < .5, "cubic: cwnd is up to " + std::to_string(max_diff) + " segments away from W_cubic");
+
+	// concave, then convex: around K the window is W_max
+	const double at_k = double(cc->get_cwnd()) / mss;
+	check(std::abs(at_k - 100.) < .5, "cubic: cwnd " + std::to_string(at_k) + " just after K instead of 100");
+
+	// fast convergence: a loss below W_max lowers W_max to cwnd * (1 + beta) / 2
+	std::unique_ptr<tcp_cc> cc2(create_tcp_cc(tcp_cc_alg_cubic, mss));
+
+	while(cc2->get_cwnd() < 100 * mss)
+		cc2->on_ack(mss, now += 1000, rtt);
+
+	cc2->on_loss(100 * mss, now, false);
+	cc2->on_recovery_end();
+
+	while(cc2->get_cwnd() < 90 * mss)
+		ack_window(cc2.get(), &now, rtt, mss);
+
+	const double w = double(cc2->get_cwnd()) / mss;
+	cc2->on_loss(cc2->get_cwnd(), now, false);
+	check_eq(cc2->get_ssthresh(), size_t(cc2->get_cwnd() - 3 * mss), "cubic: ssthresh and cwnd during fast recovery");
+	check(std::abs(double(cc2->get_ssthresh()) / mss - w * 0.7) < 0.01, "cubic: ssthresh after the second loss");
+	cc2->on_recovery_end();
+
+	const double   w_max2       = w * (1. + 0.7) / 2.;
+	const double   k2           = std::cbrt((w_max2 - double(cc2->get_cwnd()) / mss) / 0.4);
+	const uint64_t epoch_start2 = now;
+
+	// a longer rtt: W_est stays below the curve
+	while(now - epoch_start2 < uint64_t(k2 * 1000000))
+		ack_window(cc2.get(), &now, 3 * rtt, mss);
+
+	const double at_k2 = double(cc2->get_cwnd()) / mss;
+	check(std::abs(at_k2 - w_max2) < .5, "cubic: cwnd " + std::to_string(at_k2) + " at K after fast convergence instead of " + std::to_string(w_max2));
+
+	// time-out: back to 1 mss, ssthresh still beta * cwnd
+	const size_t before = cc2->get_cwnd();
+	cc2->on_loss(before, now, true);
+	check_eq(cc2->get_cwnd(), mss, "cubic: cwnd after a time-out");
+	check_eq(cc2->get_ssthresh(), size_t(before * 0.7), "cubic: ssthresh after a time-out");
+}
+
+// with a short rtt the curve is slower than newreno would be: cwnd then
+// follows W_est, which grows by 3 * (1 - beta) / (1 + beta) per rtt
+static void test_cubic_tcp_friendly()
+{
+	std::unique_ptr<tcp_cc> cc(create_tcp_cc(tcp_cc_alg_cubic, mss));
+
+	const uint64_t rtt = 10000;
+	uint64_t       now = 1000000;
+
+	while(cc->get_cwnd() < 10 * mss)
+		cc->on_ack(mss, now += 1000, rtt);
+
+	cc->on_loss(10 * mss, now, false);
+	cc->on_recovery_end();
+
+	check_eq(cc->get_cwnd(), 7 * mss, "cubic tcp-friendly: cwnd after fast recovery");
+
+	const double alpha = 3. * (1. - 0.7) / (1. + 0.7);
+
+	for(int i=0; i<50; i++)
+		ack_window(cc.get(), &now, rtt, mss);
+
+	const double w_est = 7. + 50 * alpha;
+	const double cwnd  = double(cc->get_cwnd()) / mss;
+
+	// W_cubic would be below W_max (10) still
+	check(std::abs(cwnd - w_est) < .5, "cubic tcp-friendly: cwnd " + std::to_string(cwnd) + " after 50 rtts instead of W_est " + std::to_string(w_est));
+}
+
+int main(int argc, char *argv[])
+{
+	test_initial_window();
+	test_newreno();
+	test_newreno_stretch_acks();
+	test_cubic();
+	test_cubic_tcp_friendly();
+
+	if (n_errors) {
+		printf("%d errors\n", n_errors);
+
+		return 1;
+	}
+
+	printf("all ok\n");
+
+	return 0;
+}
@@ -0,0 +1,274 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+// the out-of-order queue of tcp: overlaps are stored once, segments beyond
+// the window are refused, data is handed out when the gap in front of it
+// is filled and the SACK blocks are merged with the most recent one first;
+// every byte is a function of its sequence number so that misplaced data
+// is noticed
+#include <stdio.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tcp_reassembly.h"
+
+
+static int n_errors = 0;
+
+static void check(const bool ok, const std::string & what)
+{
+	if (ok)
+		return;
+
+	printf("FAIL: %s\n", what.c_str());
+
+	n_errors++;
+}
+
+static uint8_t byte_at(const uint32_t seq)
+{
+	return seq ^ (seq >> 8) ^ (seq >> 16);
+}
+
+static std::vector<uint8_t> data_for(const uint32_t begin, const uint32_t end)
+{
+	std::vector<uint8_t> out;
+
+	for(uint32_t seq = begin; seq != end; seq++)
+		out.push_back(byte_at(seq));
+
+	return out;
+}
+
+static bool add(tcp_reassembly *const r, const uint32_t expected, const uint32_t begin, const uint32_t end, const uint32_t window = 65536)
+{
+	auto data = data_for(begin, end);
+
+	return r->add(expected, begin, data.data(), data.size(), window);
+}
+
+// get() must return exactly [begin, end)
+static void check_get(tcp_reassembly *const r, const uint32_t begin, const uint32_t end, const std::string & what)
+{
+	std::vector<uint8_t> out;
+
+	if (r->get(begin, &out) == false) {
+		check(false, what + ": nothing at " + std::to_string(begin));
+		return;
+	}
+
+	check(out == data_for(begin, end), what + ": " + std::to_string(out.size()) + " bytes at " + std::to_string(begin) + ", expected " + std::to_string(end - begin));
+}
+
+static void check_no_get(tcp_reassembly *const r, const uint32_t expected, const std::string & what)
+{
+	std::vector<uint8_t> out;
+
+	check(r->get(expected, &out) == false, what + ": data at " + std::to_string(expected) + " while there is a gap");
+}
+
+static std::string blocks_to_str(const std::vector<std::pair<uint32_t, uint32_t> > & blocks)
+{
+	std::string out;
+
+	for(auto & b : blocks)
+		out += "[" + std::to_string(b.first) + ", " + std::to_string(b.second) + ")";
+
+	return out;
+}
+
+static void test_in_order_hand_off()
+{
+	tcp_reassembly r;
+
+	check(add(&r, 1000, 1100, 1200), "hand-off: add");
+	check(add(&r, 1000, 1300, 1400), "hand-off: add");
+	check(r.get_size() == 200, "hand-off: size");
+
+	check_no_get(&r, 1000, "hand-off");
+
+	// tcp delivers [1000, 1100) itself, then asks for what follows
+	check_get(&r, 1100, 1200, "hand-off");
+	check_no_get(&r, 1200, "hand-off");
+	check(r.get_size() == 100, "hand-off: size after the first get");
+
+	check_get(&r, 1300, 1400, "hand-off");
+	check(r.empty() && r.get_size() == 0, "hand-off: not empty at the end");
+}
+
+static void test_overlaps()
+{
+	{
+		tcp_reassembly r;
+
+		add(&r, 1000, 1100, 1200);
+		add(&r, 1000, 1150, 1250);  // the start is queued already
+
+		check(r.get_size() == 150, "overlap with the previous segment: size " + std::to_string(r.get_size()));
+		check_get(&r, 1100, 1200, "overlap with the previous segment");
+		check_get(&r, 1200, 1250, "overlap with the previous segment");
+	}
+
+	{
+		tcp_reassembly r;
+
+		add(&r, 1000, 1200, 1300);
+		add(&r, 1000, 1150, 1250);  // the end is queued already
+
+		check(r.get_size() == 150, "overlap with the next segment: size " + std::to_string(r.get_size()));
+		check_get(&r, 1150, 1200, "overlap with the next segment");
+		check_get(&r, 1200, 1300, "overlap with the next segment");
+	}
+
+	{
+		tcp_reassembly r;
+
+		add(&r, 1000, 1100, 1150);
+		add(&r, 1000, 1200, 1250);
+		add(&r, 1000, 1050, 1300);  // covers both
+
+		check(r.get_size() == 250, "covering segment: size " + std::to_string(r.get_size()));
+		check_get(&r, 1050, 1300, "covering segment");
+		check(r.empty(), "covering segment: not empty");
+	}
+
+	{
+		tcp_reassembly r;
+
+		add(&r, 1000, 1100, 1300);
+		add(&r, 1000, 1150, 1200);  // within the queued one
+		add(&r, 1000, 1100, 1300);  // retransmission
+		add(&r, 1000, 1100, 1200);  // same start, shorter
+
+		check(r.get_size() == 200, "duplicates: size " + std::to_string(r.get_size()));
+		check_get(&r, 1100, 1300, "duplicates");
+	}
+
+	{
+		tcp_reassembly r;
+
+		add(&r, 1000, 1100, 1200);
+		add(&r, 1000, 1200, 1300);
+		add(&r, 1000, 1150, 1250);  // nothing new
+
+		check(r.get_size() == 200, "overlap with both neighbours: size " + std::to_string(r.get_size()));
+	}
+}
+
+static void test_window()
+{
+	tcp_reassembly r;
+
+	check(add(&r, 1000, 1900, 2000, 1000), "window: a segment that ends at the right edge was refused");
+	check(add(&r, 1000, 1950, 2050, 1000) == false, "window: a segment beyond the right edge was accepted");
+	check(r.get_size() == 100, "window: size " + std::to_string(r.get_size()));
+
+	// at or before what is expected: that is for tcp itself
+	check(add(&r, 1000, 1000, 1100, 1000), "window: segment at the expected sequence number");
+	check(add(&r, 1000, 900, 1100, 1000), "window: segment before the expected sequence number");
+	check(r.get_size() == 100, "window: data at or before the expected sequence number was queued");
+}
+
+static void test_delivered_meanwhile()
+{
+	tcp_reassembly r;
+
+	add(&r, 1000, 1100, 1200);
+	add(&r, 1000, 1300, 1400);
+
+	// a retransmission of [1000, 1150) arrived in order
+	check_get(&r, 1150, 1200, "partially delivered");
+
+	// and later one of [1200, 1350): [1300, 1350) was delivered already
+	check_get(&r, 1350, 1400, "partially delivered");
+	check(r.empty() && r.get_size() == 0, "partially delivered: not empty");
+
+	add(&r, 2000, 2100, 2200);
+	add(&r, 2000, 2300, 2400);
+
+	// the first one was delivered completely
+	check_no_get(&r, 2250, "completely delivered");
+	check(r.get_size() == 100, "completely delivered: size " + std::to_string(r.get_size()));
+}
+
+static void test_sack_blocks()
+{
+	tcp_reassembly r;
+
+	add(&r, 1000, 1100, 1200);
+	add(&r, 1000, 1200, 1300);  // adjacent: one block
+	add(&r, 1000, 1500, 1600);
+	add(&r, 1000, 1800, 1900);
+
+	auto blocks = r.get_blocks(1000, 4);
+	std::vector<std::pair<uint32_t, uint32_t> > expected { { 1800, 1900 }, { 1100, 1300 }, { 1500, 1600 } };
+
+	check(blocks == expected, "SACK blocks: " + blocks_to_str(blocks));
+
+	// the most recent one is in the middle of a merged block
+	add(&r, 1000, 1300, 1400);
+
+	blocks   = r.get_blocks(1000, 4);
+	expected = { { 1100, 1400 }, { 1500, 1600 }, { 1800, 1900 } };
+
+	check(blocks == expected, "SACK blocks after extending: " + blocks_to_str(blocks));
+
+	// filling a hole merges three blocks into one
+	add(&r, 1000, 1400, 1500);
+	add(&r, 1000, 1600, 1800);
+
+	blocks   = r.get_blocks(1000, 4);
+	expected = { { 1100, 1900 } };
+
+	check(blocks == expected, "SACK blocks after filling the holes: " + blocks_to_str(blocks));
+
+	add(&r, 1000, 2000, 2100);
+	add(&r, 1000, 2200, 2300);
+	add(&r, 1000, 2400, 2500);
+
+	blocks   = r.get_blocks(1000, 2);
+	expected = { { 2400, 2500 }, { 1100, 1900 } };
+
+	check(blocks == expected, "SACK blocks, at most 2: " + blocks_to_str(blocks));
+}
+
+static void test_wrap_around()
+{
+	tcp_reassembly r;
+
+	const uint32_t expected = 0xffffff00;
+
+	check(add(&r, expected, 0x00000100, 0x00000180), "wrap-around: add after zero");
+	check(add(&r, expected, 0xffffff80, 0x00000080), "wrap-around: add across zero");
+	check(r.get_size() == 0x180, "wrap-around: size " + std::to_string(r.get_size()));
+
+	auto blocks = r.get_blocks(expected, 4);
+	std::vector<std::pair<uint32_t, uint32_t> > expected_blocks { { 0xffffff80, 0x00000080 }, { 0x00000100, 0x00000180 } };
+
+	check(blocks == expected_blocks, "wrap-around: SACK blocks " + blocks_to_str(blocks));
+
+	check_no_get(&r, expected, "wrap-around");
+	check_get(&r, 0xffffff80, 0x00000080, "wrap-around");
+	check_no_get(&r, 0x00000080, "wrap-around");
+	check_get(&r, 0x00000100, 0x00000180, "wrap-around");
+	check(r.empty(), "wrap-around: not empty");
+}
+
+int main(int argc, char *argv[])
+{
+	test_in_order_hand_off();
+	test_overlaps();
+	test_window();
+	test_delivered_meanwhile();
+	test_sack_blocks();
+	test_wrap_around();
+
+	if (n_errors) {
+		printf("%d errors\n", n_errors);
+
+		return 1;
+	}
+
+	printf("all ok\n");
+
+	return 0;
+}
@@ -0,0 +1,484 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+// tcp send path against a scripted peer on a fake IP layer:
+// - window scaling is negotiated and a large transfer arrives complete and
+//   in order (the throughput is printed)
+// - over a link with a delay, more than 64 kB is in flight per round trip
+// - an application that processes received data slowly shrinks the
+//   advertised window and the window opens again when it catches up
+// - a sender that waits for room in the send buffer of a session whose
+//   peer went away is woken up when the session times out
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "log.h"
+#include "snmp_data.h"
+#include "stats.h"
+#include "tcp.h"
+#include "tcp_test_peer.h"
+#include "time.h"
+
+
+constexpr int    server_port    { 80 };
+constexpr size_t receive_buffer { 256 * 1024 };
+
+static int n_errors = 0;
+
+static void fail(const char *const what)
+{
+	printf("FAIL: %s\n", what);
+
+	n_errors++;
+}
+
+std::mutex              sessions_lock;
+std::condition_variable sessions_cv;
+std::deque<session *>   new_sessions;
+std::atomic_int         n_closed { 0 };
+
+static session *wait_for_session()
+{
+	std::unique_lock<std::mutex> lck(sessions_lock);
+
+	if (sessions_cv.wait_for(lck, std::chrono::seconds(5), [] { return new_sessions.empty() == false; }) == false)
+		return nullptr;
+
+	session *s = new_sessions.front();
+	new_sessions.pop_front();
+
+	return s;
+}
+
+// returns false if the 3-way handshake did not complete
+static bool handshake(test_peer *const p)
+{
+	auto syn_ack = p->handshake();
+
+	if (syn_ack.has_value() == false) {
+		fail("no SYN/ACK");
+		return false;
+	}
+
+	if (syn_ack.value().window_shift <= 0)
+		fail("window scaling was not negotiated");
+
+	return true;
+}
+
+static void test_throughput(tcp *const t, test_ip *const ip, const any_addr & their_addr)
+{
+	test_peer p(t, ip, their_addr, 1001, server_port);
+
+	if (!handshake(&p))
+		return;
+
+	session *s = wait_for_session();
+	if (!s) {
+		fail("session not established");
+		return;
+	}
+
+	constexpr size_t total = 32 * 1024 * 1024;
+	constexpr size_t chunk = 16 * 1024;
+
+	uint64_t start = get_us();
+
+	std::thread sender([t, s] {
+		std::vector<uint8_t> buffer(chunk);
+
+		for(size_t offset = 0; offset < total; offset += chunk) {
+			for(size_t i=0; i<chunk; i++)
+				buffer[i] = (offset + i) * 7;
+
+			if (t->send_data(s, buffer.data(), chunk) == false) {
+				fail("send_data refused data");
+				break;
+			}
+		}
+	});
+
+	const uint32_t first_seq = p.their_seq;
+	size_t         received  = 0;
+
+	while(received < total) {
+		auto data = p.receive(5000);
+
+		if (data.has_value() == false) {
+			fail("transfer stalled");
+			break;
+		}
+
+		test_segment_t & seg = data.value();
+
+		if (seg.data.empty())
+			continue;
+
+		// in order (this link does not lose or reorder); retransmissions are skipped
+		if (seg.seq != p.their_seq)
+			continue;
+
+		for(size_t i=0; i<seg.data.size(); i++) {
+			if (seg.data[i] != uint8_t((seg.seq - first_seq + i) * 7)) {
+				fail("data corrupted");
+				received = total;
+				break;
+			}
+		}
+
+		received    += seg.data.size();
+		p.their_seq += seg.data.size();
+
+		p.send(test_flag_ack);
+	}
+
+	sender.join();
+
+	printf("%zu MB in %.3f s: %.1f MB/s\n", total / 1024 / 1024, (get_us() - start) / 1000000., total / double(get_us() - start));
+}
+
+// the peer acknowledges everything it gets; returns the number of bytes
+// that arrived in each 'bucket_ms'
+static std::vector<size_t> receive_all(test_peer *const p, const size_t total, const int bucket_ms)
+{
+	std::vector<size_t> buckets;
+
+	const uint64_t start    = get_us();
+	size_t         received = 0;
+
+	while(received < total) {
+		auto data = p->receive(5000);
+
+		if (data.has_value() == false) {
+			fail("transfer stalled");
+			break;
+		}
+
+		test_segment_t & seg = data.value();
+
+		if (seg.data.empty() || seg.seq != p->their_seq)
+			continue;
+
+		size_t bucket = (get_us() - start) / (bucket_ms * 1000);
+
+		if (buckets.size() <= bucket)
+			buckets.resize(bucket + 1);
+
+		buckets[bucket] += seg.data.size();
+
+		received     += seg.data.size();
+		p->their_seq += seg.data.size();
+
+		p->send(test_flag_ack);
+	}
+
+	return buckets;
+}
+
+static void test_delayed_throughput(tcp *const t, test_ip *const ip, const any_addr & their_addr)
+{
+	constexpr int one_way_ms = 50;
+
+	ip->set_delay(one_way_ms);
+
+	test_peer p(t, ip, their_addr, 1003, server_port);
+
+	if (handshake(&p)) {
+		session *s = wait_for_session();
+
+		if (!s)
+			fail("session not established");
+		else {
+			constexpr size_t total = 8 * 1024 * 1024;
+
+			uint64_t start = get_us();
+
+			std::thread sender([t, s] {
+				std::vector<uint8_t> buffer(64 * 1024);
+
+				for(size_t offset = 0; offset < total; offset += buffer.size()) {
+					if (t->send_data(s, buffer.data(), buffer.size()) == false) {
+						fail("send_data refused data");
+						break;
+					}
+				}
+			});
+
+			// what arrives within one round trip was in flight at the same time
+			auto   per_rtt = receive_all(&p, total, one_way_ms * 2);
+			size_t largest = per_rtt.empty() ? 0 : *std::max_element(per_rtt.begin(), per_rtt.end());
+
+			sender.join();
+
+			printf("%d ms round trip: %zu MB in %.3f s, at most %zu kB per round trip\n", one_way_ms * 2, total / 1024 / 1024, (get_us() - start) / 1000000., largest / 1024);
+
+			// without window scaling it would be at most 64 kB
+			if (largest < 4 * 65536)
+				fail("not more than 64 kB in flight per round trip");
+		}
+	}
+
+	ip->set_delay(0);
+}
+
+std::mutex slow_lock;
+size_t     slow_backlog  { 0 };
+size_t     slow_received { 0 };
+
+static void test_slow_consumer(tcp *const t, test_ip *const ip, const any_addr & their_addr)
+{
+	test_peer p(t, ip, their_addr, 1004, server_port);
+
+	auto syn_ack = p.handshake();
+
+	if (syn_ack.has_value() == false || syn_ack.value().window_shift < 0) {
+		fail("no SYN/ACK with window scaling");
+		return;
+	}
+
+	session *s = wait_for_session();
+	if (!s) {
+		fail("session not established");
+		return;
+	}
+
+	constexpr size_t total = 1024 * 1024;
+
+	// processes 8 kB per 10 ms of what new_data() queued
+	std::atomic_bool stop { false };
+
+	std::thread consumer([t, s, &stop] {
+		while(!stop) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+			size_t backlog = 0;
+
+			{
+				std::unique_lock<std::mutex> lck(slow_lock);
+
+				slow_backlog -= std::min(slow_backlog, size_t(8 * 1024));
+				backlog = slow_backlog;
+			}
+
+			t->set_receive_backlog(s, backlog);
+		}
+	});
+
+	const int shift      = syn_ack.value().window_shift;
+	uint32_t  right_edge = syn_ack.value().ack + syn_ack.value().window;  // not scaled in a SYN
+	uint32_t  smallest   = receive_buffer;
+	size_t    sent       = 0;
+	uint32_t  acked      = syn_ack.value().ack;
+	uint64_t  acked_ts   = get_us();
+
+	auto process_ack = [&](const test_segment_t & seg) {
+		const uint32_t window = uint32_t(seg.window) << shift;
+
+		if (int32_t(seg.ack - acked) > 0) {
+			acked    = seg.ack;
+			acked_ts = get_us();
+		}
+
+		smallest = std::min(smallest, window);
+
+		if (int32_t(seg.ack + window - right_edge) < 0)
+			fail("right edge of the window moved to the left");
+		else
+			right_edge = seg.ack + window;
+	};
+
+	std::vector<uint8_t> data(1400);
+
+	while(sent < total) {
+		// the ACKs that are there already
+		while(auto seg = p.receive(0))
+			process_ack(seg.value());
+
+		// the queue of tcp drops segments when it is full: go back to what
+		// was acknowledged
+		if (acked != p.my_seq && get_us() - acked_ts > 200000) {
+			sent    -= p.my_seq - acked;
+			p.my_seq = acked;
+
+			acked_ts = get_us();
+		}
+
+		size_t room = int32_t(right_edge - p.my_seq) > 0 ? right_edge - p.my_seq : 0;
+
+		if (room == 0) {
+			auto seg = p.receive(acked == p.my_seq ? 2000 : 100);
+
+			if (seg.has_value())
+				process_ack(seg.value());
+			else if (acked == p.my_seq) {
+				fail("window did not open again when the application caught up");
+				break;
+			}
+
+			continue;
+		}
+
+		size_t n = std::min({ room, data.size(), total - sent });
+
+		p.send(test_flag_ack | test_flag_psh, data.data(), n);
+
+		sent += n;
+	}
+
+	uint64_t start = get_us();
+
+	for(;;) {
+		std::unique_lock<std::mutex> lck(slow_lock);
+
+		if (slow_received == total || get_us() - start > 5000000)
+			break;
+
+		lck.unlock();
+
+		p.receive(100);
+	}
+
+	stop = true;
+	consumer.join();
+
+	printf("slow consumer: smallest window advertised %u bytes\n", smallest);
+
+	if (slow_received != total)
+		fail("not all data was received");
+
+	if (smallest > receive_buffer / 4)
+		fail("the window did not shrink while the application lagged");
+}
+
+static void test_blocked_sender(tcp *const t, test_ip *const ip, const any_addr & their_addr)
+{
+	test_peer p(t, ip, their_addr, 1002, server_port);
+
+	if (!handshake(&p))
+		return;
+
+	session *s = wait_for_session();
+	if (!s) {
+		fail("session not established");
+		return;
+	}
+
+	int closed_before = n_closed;
+
+	std::atomic_bool sender_done { false };
+
+	// the peer never acknowledges anything: the send buffer fills up
+	std::thread sender([t, s, &sender_done] {
+		uint8_t buffer[16384] { 0 };
+
+		while(t->send_data(s, buffer, sizeof buffer)) {
+		}
+
+		sender_done = true;
+	});
+
+	// the session times out (idle) once the retransmissions back off
+	uint64_t start = get_us();
+
+	while(!sender_done && get_us() - start < 30000000)
+		p.receive(100);
+
+	if (!sender_done) {
+		fail("blocked sender was not woken up when the session was removed");
+		sender.detach();
+		return;
+	}
+
+	sender.join();
+
+	printf("blocked sender returned after %.3f s\n", (get_us() - start) / 1000000.);
+
+	while(n_closed == closed_before && get_us() - start < 30000000)
+		p.receive(100);
+
+	if (n_closed == closed_before)
+		fail("session was not closed");
+}
+
+int main(int argc, char *argv[])
+{
+	setlog("/dev/null", ll_error, ll_error);
+
+	snmp_data sd;
+
+	stats s(65536, &sd);
+
+	const uint8_t my_ip   [] { 10, 0, 0, 1 };
+	const uint8_t their_ip[] { 10, 0, 0, 2 };
+
+	any_addr my_addr   (any_addr::ipv4, my_ip   );
+	any_addr their_addr(any_addr::ipv4, their_ip);
+
+	test_ip ip(&s, my_addr);
+
+	tcp *t = new tcp(&s, nullptr, 1, 16, 1024 * 1024, receive_buffer, tcp_cc_alg_newreno, 0);
+
+	ip.register_protocol(0x06, t);
+
+	port_handler_t handler { };
+
+	handler.new_session = [](pstream *const ps, session *const s) {
+		// the session of test_blocked_sender must time out quickly
+		if (s->get_their_port() == 1002)
+			s->set_session_timeout(1);
+
+		std::unique_lock<std::mutex> lck(sessions_lock);
+		new_sessions.push_back(s);
+		sessions_cv.notify_all();
+
+		return true;
+	};
+
+	handler.new_data         = [](pstream *const ps, session *const s, buffer_in data) {
+		// test_slow_consumer processes it later
+		if (s->get_their_port() == 1004) {
+			size_t backlog = 0;
+
+			{
+				std::unique_lock<std::mutex> lck(slow_lock);
+
+				slow_backlog  += data.get_n_bytes_left();
+				slow_received += data.get_n_bytes_left();
+				backlog = slow_backlog;
+			}
+
+			ps->set_receive_backlog(s, backlog);
+		}
+
+		return true;
+	};
+	handler.session_closed_1 = [](pstream *const ps, session *const s) { return true; };
+	handler.session_closed_2 = [](pstream *const ps, session *const s) { n_closed++; return true; };
+
+	t->add_handler(server_port, handler);
+
+	test_throughput(t, &ip, their_addr);
+
+	test_delayed_throughput(t, &ip, their_addr);
+
+	test_slow_consumer(t, &ip, their_addr);
+
+	test_blocked_sender(t, &ip, their_addr);
+
+	if (n_errors) {
+		printf("%d errors\n", n_errors);
+
+		return 1;
+	}
+
+	printf("all ok\n");
+
+	return 0;
+}
@@ -0,0 +1,243 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+// the send queue of tcp (64 kB chunks): appends and reads that cross chunk
+// boundaries, acknowledging part of the first chunk and peeking at offsets
+// that span chunks; every byte is a function of its position in the
+// stream so that misplaced data is noticed
+#include <algorithm>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "buffer_chain.h"
+#include "tcp_send_queue.h"
+
+
+static int n_errors = 0;
+
+static void check(const bool ok, const std::string & what)
+{
+	if (ok)
+		return;
+
+	printf("FAIL: %s\n", what.c_str());
+
+	n_errors++;
+}
+
+constexpr size_t chunk { tcp_send_queue_chunk_size };
+
+static uint8_t byte_at(const size_t stream_offset)
+{
+	return stream_offset ^ (stream_offset >> 8) ^ (stream_offset >> 16);
+}
+
+// 'written' is the stream offset of the next byte to append
+static void append(tcp_send_queue *const q, size_t *const written, const size_t len)
+{
+	std::vector<uint8_t> data;
+
+	for(size_t i=0; i<len; i++)
+		data.push_back(byte_at(*written + i));
+
+	q->append(data.data(), data.size());
+
+	*written += len;
+}
+
+// 'acked' is the stream offset of the first byte in the queue
+static void check_get(const tcp_send_queue & q, const size_t acked, const size_t offset, const size_t len, const int n_segments, const std::string & what)
+{
+	std::string name = what + ": " + std::to_string(len) + " bytes at " + std::to_string(offset);
+
+	buffer_chain out;
+
+	if (q.get(offset, len, &out) == false) {
+		check(false, name + " not available");
+		return;
+	}
+
+	check(out.get_size() == len, name + ": got " + std::to_string(out.get_size()) + " bytes");
+
+	if (n_segments >= 0)
+		check(out.get_n_segments() == n_segments, name + ": " + std::to_string(out.get_n_segments()) + " segments instead of " + std::to_string(n_segments));
+
+	std::vector<uint8_t> data(out.get_size());
+	out.copy_to(data.data());
+
+	for(size_t i=0; i<data.size(); i++) {
+		if (data[i] != byte_at(acked + offset + i)) {
+			check(false, name + ": wrong data at " + std::to_string(offset + i));
+			break;
+		}
+	}
+}
+
+static void test_chunk_boundaries()
+{
+	tcp_send_queue q;
+	size_t         written = 0;
+
+	check(q.empty() && q.size() == 0, "boundaries: new queue is not empty");
+
+	append(&q, &written, 1000);
+	append(&q, &written, chunk);  // fills the first chunk and continues in the second
+	append(&q, &written, 3);
+	append(&q, &written, 2 * chunk - 1003 - 1);  // up to 1 byte before the end of the third
+	append(&q, &written, 2);  // the last byte of the third, the first of the fourth
+
+	check(q.size() == written && q.size() == 3 * chunk + 1, "boundaries: size " + std::to_string(q.size()));
+
+	check_get(q, 0, 0, 100, 1, "boundaries, within the first chunk");
+	check_get(q, 0, chunk - 10, 10, 1, "boundaries, up to the end of the first chunk");
+	check_get(q, 0, chunk - 10, 20, 2, "boundaries, spanning 2 chunks");
+	check_get(q, 0, chunk, 10, 1, "boundaries, the start of the second chunk");
+	check_get(q, 0, chunk - 10, chunk + 20, 3, "boundaries, spanning 3 chunks");
+	check_get(q, 0, 0, q.size(), 4, "boundaries, everything");
+	check_get(q, 0, q.size() - 1, 1, 1, "boundaries, the last byte");
+
+	buffer_chain out;
+	check(q.get(q.size() - 10, 11, &out) == false, "boundaries: get beyond the end succeeded");
+	check(q.get(q.size(), 0, &out) && out.get_size() == 0, "boundaries: 0 bytes at the end");
+}
+
+static void test_partial_ack()
+{
+	tcp_send_queue q;
+	size_t         written = 0;
+	size_t         acked   = 0;
+
+	append(&q, &written, 3 * chunk + 500);
+
+	// a part of the first chunk
+	q.trim(100);
+	acked += 100;
+
+	check(q.size() == written - acked, "partial ack: size " + std::to_string(q.size()));
+	check_get(q, acked, 0, 100, 1, "partial ack, the start");
+
+	// offsets are relative to the first unacknowledged byte now
+	check_get(q, acked, chunk - 100 - 10, 10, 1, "partial ack, up to the end of the first chunk");
+	check_get(q, acked, chunk - 100 - 10, 20, 2, "partial ack, spanning 2 chunks");
+	check_get(q, acked, chunk - 100 - 5, 2 * chunk, 3, "partial ack, spanning 3 chunks");
+
+	// all but the last byte of the first chunk
+	q.trim(chunk - 100 - 1);
+	acked += chunk - 100 - 1;
+
+	check_get(q, acked, 0, 1, 1, "partial ack, the last byte of the first chunk");
+	check_get(q, acked, 0, 2, 2, "partial ack, the last byte of the first chunk and the next");
+
+	// exactly up to a chunk boundary
+	q.trim(1);
+	acked += 1;
+
+	check(q.size() == written - acked, "partial ack at a boundary: size " + std::to_string(q.size()));
+	check_get(q, acked, 0, chunk, 1, "partial ack at a boundary");
+
+	// over a boundary
+	q.trim(chunk + 200);
+	acked += chunk + 200;
+
+	check_get(q, acked, 0, chunk - 200, 1, "partial ack over a boundary");
+	check_get(q, acked, 0, q.size(), 2, "partial ack over a boundary, everything");
+
+	// appended data continues in the last chunk
+	append(&q, &written, chunk);
+
+	check(q.size() == written - acked, "partial ack, append: size " + std::to_string(q.size()));
+	check_get(q, acked, 0, q.size(), 3, "partial ack, append");
+
+	// everything acknowledged: the queue starts over
+	q.trim(q.size());
+	acked = written;
+
+	check(q.empty(), "acknowledged everything: not empty");
+
+	append(&q, &written, 10);
+	check_get(q, acked, 0, 10, 1, "append after acknowledging everything");
+}
+
+// segments keep referring to the chunks after they were acknowledged
+static void test_get_outlives_trim()
+{
+	tcp_send_queue q;
+	size_t         written = 0;
+
+	append(&q, &written, chunk + 100);
+
+	buffer_chain out;
+	check(q.get(chunk - 50, 100, &out), "outlives trim: get");
+
+	q.trim(chunk + 100);
+	q.clear();
+
+	std::vector<uint8_t> data(out.get_size());
+	out.copy_to(data.data());
+
+	bool ok = data.size() == 100;
+
+	for(size_t i=0; i<data.size() && ok; i++)
+		ok = data[i] == byte_at(chunk - 50 + i);
+
+	check(ok, "outlives trim: data changed after the queue was cleared");
+}
+
+static uint32_t next_random(uint32_t *const state)
+{
+	*state = *state * 1103515245 + 12345;
+
+	return *state >> 8;
+}
+
+// appends, acknowledgements and reads of random sizes
+static void test_random()
+{
+	tcp_send_queue q;
+	size_t         written = 0;
+	size_t         acked   = 0;
+	uint32_t       state   = 1;
+
+	for(int i=0; i<500; i++) {
+		append(&q, &written, next_random(&state) % (2 * chunk));
+
+		if (q.size() != written - acked) {
+			check(false, "random: size after append");
+			break;
+		}
+
+		for(int j=0; j<4; j++) {
+			size_t offset = next_random(&state) % (q.size() + 1);
+			size_t len    = next_random(&state) % (std::min(q.size() - offset, 3 * chunk) + 1);
+
+			check_get(q, acked, offset, len, -1, "random");
+		}
+
+		size_t n = next_random(&state) % (q.size() + 1);
+
+		q.trim(n);
+		acked += n;
+
+		if (q.size() != written - acked) {
+			check(false, "random: size after trim");
+			break;
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	test_chunk_boundaries();
+	test_partial_ack();
+	test_get_outlives_trim();
+	test_random();
+
+	if (n_errors) {
+		printf("%d errors\n", n_errors);
+
+		return 1;
+	}
+
+	printf("all ok\n");
+
+	return 0;
+}
@@ -0,0 +1,231 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+// the timing wheel with a clock that is only moved by the test: timers
+// fire in deadline order, never early and never later than the first
+// advance() past their deadline, also when they start in a higher level
+// and are cascaded down or are beyond the span of the wheel; cancelled
+// and re-armed timers are handled lazily, like tcp does
+#include <map>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "timer_wheel.h"
+
+
+static int n_errors = 0;
+
+static void check(const bool ok, const std::string & what)
+{
+	if (ok)
+		return;
+
+	printf("FAIL: %s\n", what.c_str());
+
+	n_errors++;
+}
+
+constexpr uint64_t tick_us { 1000 };
+
+// not on a tick boundary and just before the first cascade of level 2
+constexpr uint64_t start   { (4096 - 3) * tick_us + 400 };
+
+static uint64_t ticks(const uint64_t n)
+{
+	return n * tick_us;
+}
+
+static uint64_t due_tick(const uint64_t deadline)
+{
+	return (deadline + tick_us - 1) / tick_us;
+}
+
+static uint32_t next_random(uint32_t *const state)
+{
+	*state = *state * 1103515245 + 12345;
+
+	return *state >> 8;
+}
+
+// timers around the boundaries of each level, advanced in steps of
+// varying size
+static void test_order()
+{
+	timer_wheel tw(tick_us, start);
+
+	std::vector<uint64_t> deadlines;
+
+	for(int level=0; level<timer_wheel_levels; level++) {
+		uint64_t span = uint64_t(1) << (timer_wheel_bits * level);
+
+		for(int d=-2; d<=2; d++)
+			deadlines.push_back(start + ticks(span + d) + (d & 1 ? 0 : 700));
+	}
+
+	uint32_t state = 1;
+
+	for(int i=0; i<500; i++)
+		deadlines.push_back(start + next_random(&state) % ticks(300000));
+
+	deadlines.push_back(start);  // due right away
+	deadlines.push_back(start - ticks(10));  // in the past
+
+	for(size_t i=0; i<deadlines.size(); i++)
+		tw.add(i, i & 3, deadlines.at(i));
+
+	check(tw.size() == deadlines.size(), "order: size " + std::to_string(tw.size()));
+
+	std::vector<bool> fired(deadlines.size());
+	size_t   n_fired   = 0;
+	uint64_t prev_now  = start - tick_us;
+	uint64_t prev_tick = 0;
+	uint64_t now       = start;
+	size_t   step      = 0;
+
+	while(n_fired < deadlines.size() && now < start + ticks(400000)) {
+		std::vector<timer_entry_t> expired;
+		tw.advance(now, &expired);
+
+		for(auto & e : expired) {
+			std::string name = "order: timer " + std::to_string(e.id) + " (deadline " + std::to_string(e.deadline) + ")";
+
+			if (e.id >= deadlines.size() || fired.at(e.id)) {
+				check(false, name + " fired twice or unknown");
+				continue;
+			}
+
+			fired.at(e.id) = true;
+			n_fired++;
+
+			check(e.deadline == deadlines.at(e.id) && e.event == int(e.id & 3), name + ": entry changed");
+			check(due_tick(e.deadline) <= now / tick_us, name + ": fired early at " + std::to_string(now));
+			check(due_tick(e.deadline) > prev_now / tick_us || e.deadline < start, name + ": fired late at " + std::to_string(now));
+			check(due_tick(e.deadline) >= prev_tick, name + ": out of order");
+
+			prev_tick = due_tick(e.deadline);
+		}
+
+		check(tw.size() == deadlines.size() - n_fired, "order: size " + std::to_string(tw.size()) + " at " + std::to_string(now));
+
+		prev_now = now;
+
+		// 1 tick, less than a tick, a level 0 rotation, a few ticks
+		const uint64_t steps[] { tick_us, 300, ticks(64), ticks(5) };
+		now += steps[step++ % 4];
+	}
+
+	check(n_fired == deadlines.size(), "order: " + std::to_string(deadlines.size() - n_fired) + " timers did not fire");
+	check(tw.size() == 0, "order: not empty at the end");
+}
+
+// an event loop that sleeps until get_next_wakeup() must see every timer
+// in the tick it is due
+static void test_next_wakeup()
+{
+	timer_wheel tw(tick_us, start);
+
+	check(tw.get_next_wakeup() > start + ticks(1000000), "next wakeup: without timers");
+
+	const uint64_t span = uint64_t(1) << (timer_wheel_bits * timer_wheel_levels);
+
+	std::vector<uint64_t> deadlines { start + ticks(1) + 1, start + ticks(63), start + ticks(64), start + ticks(4100) + 5, start + ticks(300000), start + ticks(span + 100) };
+
+	for(size_t i=0; i<deadlines.size(); i++)
+		tw.add(i, 0, deadlines.at(i));
+
+	uint64_t now       = start;
+	size_t   n_fired   = 0;
+	int      n_wakeups = 0;
+
+	while(n_fired < deadlines.size() && n_wakeups < 10000) {
+		std::vector<timer_entry_t> expired;
+		tw.advance(now, &expired);
+
+		for(auto & e : expired) {
+			check(due_tick(e.deadline) == now / tick_us, "next wakeup: timer " + std::to_string(e.id) + " fired at " + std::to_string(now) + " instead of " + std::to_string(due_tick(e.deadline) * tick_us));
+			n_fired++;
+		}
+
+		uint64_t next = tw.get_next_wakeup();
+
+		if (next <= now) {
+			check(false, "next wakeup: " + std::to_string(next) + " is not after " + std::to_string(now));
+			break;
+		}
+
+		now = next;
+		n_wakeups++;
+	}
+
+	check(n_fired == deadlines.size(), "next wakeup: " + std::to_string(deadlines.size() - n_fired) + " timers did not fire");
+}
+
+// the owner keeps the deadline it expects per (id, event), 0 = not armed
+static void test_lazy_cancellation()
+{
+	timer_wheel tw(tick_us, start);
+
+	std::map<uint64_t, uint64_t> armed;
+
+	auto arm = [&](const uint64_t id, const uint64_t deadline) {
+		armed[id] = deadline;
+		tw.add(id, 0, deadline);
+	};
+
+	arm(1, start + ticks(10));
+	arm(2, start + ticks(100));  // level 1
+	arm(3, start + ticks(5000));  // level 2
+	arm(4, start + ticks(20));
+
+	armed[1] = 0;  // cancelled
+	arm(2, start + ticks(6000));  // re-armed later, to level 2
+	arm(3, start + ticks(30));  // re-armed earlier, to level 0
+	arm(4, start + ticks(20));  // re-armed to the same deadline
+
+	std::map<uint64_t, uint64_t> handled;
+	size_t n_stale = 0;
+
+	for(uint64_t now=start; now<=start + ticks(7000); now += ticks(3)) {
+		std::vector<timer_entry_t> expired;
+		tw.advance(now, &expired);
+
+		for(auto & e : expired) {
+			auto it = armed.find(e.id);
+
+			if (it->second != e.deadline) {
+				n_stale++;
+				continue;
+			}
+
+			it->second = 0;
+
+			check(handled.find(e.id) == handled.end(), "lazy cancellation: timer " + std::to_string(e.id) + " handled twice");
+			handled[e.id] = now;
+		}
+	}
+
+	check(handled.find(1) == handled.end(), "lazy cancellation: cancelled timer was handled");
+	check(handled.find(2) != handled.end() && handled[2] >= start + ticks(6000) && handled[2] <= start + ticks(6003), "lazy cancellation: timer re-armed to later");
+	check(handled.find(3) != handled.end() && handled[3] >= start + ticks(30) && handled[3] <= start + ticks(33), "lazy cancellation: timer re-armed to earlier");
+	check(handled.find(4) != handled.end() && handled[4] >= start + ticks(20) && handled[4] <= start + ticks(23), "lazy cancellation: timer re-armed to the same deadline");
+
+	// the stale entries went through the wheel as well
+	check(n_stale == 4, "lazy cancellation: " + std::to_string(n_stale) + " stale entries instead of 4");
+	check(tw.size() == 0, "lazy cancellation: not empty at the end");
+}
+
+int main(int argc, char *argv[])
+{
+	test_order();
+	test_next_wakeup();
+	test_lazy_cancellation();
+
+	if (n_errors) {
+		printf("%d errors\n", n_errors);
+
+		return 1;
+	}
+
+	printf("all ok\n");
+
+	return 0;
+}
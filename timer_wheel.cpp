@@ -0,0 +1,163 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#include "timer_wheel.h"
+
+
+constexpr uint64_t slot_mask { timer_wheel_slots - 1 };
+
+// number of ticks covered by the complete wheel
+constexpr uint64_t wheel_span { uint64_t(1) << (timer_wheel_bits * timer_wheel_levels) };
+
+timer_wheel::timer_wheel(const uint64_t tick_us, const uint64_t now) : tick_us(tick_us), cur_tick(now / tick_us)
+{
+}
+
+timer_wheel::~timer_wheel()
+{
+}
+
+// lock must be held
+void timer_wheel::place(const timer_entry_t & e)
+{
+	// round up: a timer never fires early
+	uint64_t tick = (e.deadline + tick_us - 1) / tick_us;
+
+	if (tick <= cur_tick) {
+		slots[0][cur_tick & slot_mask].push_back(e);
+		return;
+	}
+
+	uint64_t delta = tick - cur_tick;
+
+	// too far away: re-placed when it "expires" in level 0
+	if (delta >= wheel_span) {
+		tick  = cur_tick + wheel_span - 1;
+		delta = wheel_span - 1;
+	}
+
+	int level = 0;
+
+	while(delta >= uint64_t(1) << (timer_wheel_bits * (level + 1)))
+		level++;
+
+	slots[level][(tick >> (timer_wheel_bits * level)) & slot_mask].push_back(e);
+}
+
+// lock must be held; 'tick' is at a level 0 boundary
+void timer_wheel::cascade(const uint64_t tick)
+{
+	for(int level=1; level<timer_wheel_levels; level++) {
+		uint64_t index = (tick >> (timer_wheel_bits * level)) & slot_mask;
+
+		std::vector<timer_entry_t> move;
+		move.swap(slots[level][index]);
+
+		for(auto & e : move)
+			place(e);
+
+		if (index)
+			break;
+	}
+}
+
+// lock must be held
+bool timer_wheel::has_cascade_work(const uint64_t tick) const
+{
+	for(int level=1; level<timer_wheel_levels; level++) {
+		uint64_t index = (tick >> (timer_wheel_bits * level)) & slot_mask;
+
+		if (slots[level][index].empty() == false)
+			return true;
+
+		if (index)
+			break;
+	}
+
+	return false;
+}
+
+void timer_wheel::add(const uint64_t id, const int event, const uint64_t deadline)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	place({ id, event, deadline });
+
+	n_entries++;
+}
+
+void timer_wheel::advance(const uint64_t now, std::vector<timer_entry_t> *const expired)
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	const uint64_t target = now / tick_us;
+
+	while(cur_tick <= target) {
+		if (n_entries == 0) {
+			cur_tick = target + 1;
+			break;
+		}
+
+		if ((cur_tick & slot_mask) == 0)
+			cascade(cur_tick);
+
+		std::vector<timer_entry_t> due;
+		due.swap(slots[0][cur_tick & slot_mask]);
+
+		for(auto & e : due) {
+			// clamped in place()
+			if ((e.deadline + tick_us - 1) / tick_us > cur_tick) {
+				place(e);
+				continue;
+			}
+
+			expired->push_back(e);
+
+			n_entries--;
+		}
+
+		// give the slot its allocated memory back
+		if (slots[0][cur_tick & slot_mask].empty()) {
+			due.clear();
+			due.swap(slots[0][cur_tick & slot_mask]);
+		}
+
+		cur_tick++;
+	}
+}
+
+uint64_t timer_wheel::get_next_wakeup()
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	if (n_entries == 0)
+		return (cur_tick + wheel_span) * tick_us;
+
+	// level 0: expiring entries and cascades in the coming rotation
+	for(uint64_t tick=cur_tick; tick<cur_tick + timer_wheel_slots; tick++) {
+		if (slots[0][tick & slot_mask].empty() == false)
+			return tick * tick_us;
+
+		if ((tick & slot_mask) == 0 && has_cascade_work(tick))
+			return tick * tick_us;
+	}
+
+	// further away: the first boundary at which a non-empty slot is cascaded
+	for(int level=1; level<timer_wheel_levels; level++) {
+		const int shift = timer_wheel_bits * level;
+
+		for(uint64_t i=1; i<=timer_wheel_slots; i++) {
+			uint64_t tick = ((cur_tick >> shift) + i) << shift;
+
+			if (has_cascade_work(tick))
+				return tick * tick_us;
+		}
+	}
+
+	return (cur_tick + wheel_span) * tick_us;
+}
+
+size_t timer_wheel::size()
+{
+	std::unique_lock<std::mutex> lck(lock);
+
+	return n_entries;
+}
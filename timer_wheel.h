@@ -0,0 +1,61 @@
+// (C) 2024 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#pragma once
+
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+
+/* hierarchical timing wheel (Varghese & Lauck)
+ * level 0 has one slot per tick, each slot of level n spans all slots of
+ * level n - 1; when level 0 wraps around, the next slot of level 1 is
+ * cascaded (re-distributed) into level 0, and so on
+ * expiring timers costs O(expired), not O(timers)
+ *
+ * timers cannot be cancelled: the owner keeps the deadline it expects
+ * for an (id, event) pair and ignores expired entries with a different
+ * deadline (lazy cancellation); the wheel never refers to the owner's
+ * objects, so these can be deleted at any time
+ */
+
+constexpr int timer_wheel_levels { 4 };
+constexpr int timer_wheel_bits   { 6 };
+constexpr int timer_wheel_slots  { 1 << timer_wheel_bits };
+
+typedef struct {
+	uint64_t id;
+	int      event;
+	uint64_t deadline;  // get_us()
+} timer_entry_t;
+
+class timer_wheel
+{
+private:
+	const uint64_t tick_us   { 1000 };
+
+	std::mutex     lock;
+
+	uint64_t       cur_tick  { 0 };  // next tick to process
+	size_t         n_entries { 0 };
+
+	std::vector<timer_entry_t> slots[timer_wheel_levels][timer_wheel_slots];
+
+	void place(const timer_entry_t & e);
+	void cascade(const uint64_t tick);
+	bool has_cascade_work(const uint64_t tick) const;
+
+public:
+	timer_wheel(const uint64_t tick_us, const uint64_t now);
+	virtual ~timer_wheel();
+
+	void add(const uint64_t id, const int event, const uint64_t deadline);
+
+	// moves all entries that expired at 'now' to 'expired'
+	void advance(const uint64_t now, std::vector<timer_entry_t> *const expired);
+
+	// when advance() needs to be invoked again; a time far in the future
+	// when there are no timers
+	uint64_t get_next_wakeup();
+
+	size_t size();
+};
@@ -1,78 +1,143 @@
 // (C) 2020-2023 by folkert van heusden <mail@vanheusden.com>, released under Apache License v2.0
+#include <algorithm>
 #include <chrono>
 
+#include "checksum.h"
 #include "transport_layer.h"
 #include "log.h"
 
 
 constexpr size_t pkts_max_size { 128 };
 
-transport_layer::transport_layer(stats *const s, const std::string & stats_name)
+transport_layer::transport_layer(stats *const s, const std::string & stats_name, const int n_queues)
 {
-	pkts = new fifo<packet *>(s, stats_name, pkts_max_size);
+	for(int i=0; i<std::max(1, n_queues); i++)
+		pkts.push_back(new fifo<packet *>(s, i == 0 ? stats_name : stats_name + "-" + std::to_string(i), pkts_max_size));
+
+	// average number of bytes memcpy'd on the receive path per packet
+	rx_copied = s->register_stat(stats_name + "_rx_copied");
 }
 
 transport_layer::~transport_layer()
 {
-	delete pkts;
+	for(auto & q : pkts)
+		delete q;
 }
 
-void transport_layer::queue_packet(packet *p)
+// called once by each worker thread when it starts
+fifo<packet *> *transport_layer::claim_queue()
 {
-	if (pkts->try_put(p) == false) {
-		DOLOG(ll_debug, "IP-Protocol: queue full, packet dropped\n");
+	return pkts.at(next_queue++ % pkts.size());
+}
 
-		delete p;
+void transport_layer::interrupt_queues()
+{
+	for(auto & q : pkts)
+		q->interrupt();
+}
+
+// tcp, udp and sctp all have the source- and destination port in the
+// first 4 bytes of their header
+uint64_t transport_layer::get_flow_hash(const packet *const p) const
+{
+	uint64_t hash = p->get_src_addr().get_hash() ^ (p->get_dst_addr().get_hash() << 1);
+
+	if (p->get_size() >= 4) {
+		const uint8_t *const data = p->get_data();
+
+		hash ^= (uint64_t(data[0]) << 56) | (uint64_t(data[1]) << 48) | (uint64_t(data[2]) << 40) | (uint64_t(data[3]) << 32);
 	}
+
+	// murmur3 finalizer
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdllu;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53llu;
+	hash ^= hash >> 33;
+
+	return hash;
 }
 
-uint16_t tcp_udp_checksum(const any_addr & src_addr, const any_addr & dst_addr, const bool tcp, const uint8_t *const tcp_payload, const int len)
+static void put_bulk_or_drop(fifo<packet *> *const q, packet *const *const p, const int n)
 {
-	uint16_t checksum { 0 };
+	int n_put = q->put_bulk(p, n);
 
-	if (dst_addr.get_family() == any_addr::ipv6) {  // IPv6
-		size_t temp_len = 40 + len + (len & 1);
-		uint8_t *temp = new uint8_t[temp_len]();
+	if (n_put < n) {
+		DOLOG(ll_debug, "IP-Protocol: queue full, %d packet(s) dropped\n", n - n_put);
+
+		for(int i=n_put; i<n; i++)
+			delete p[i];
+	}
+}
 
-		src_addr.get(&temp[0], 16);
+void transport_layer::queue_packet(packet *p)
+{
+	stats_add_average(rx_copied, p->get_bytes_copied());
 
-		dst_addr.get(&temp[16], 16);
+	fifo<packet *> *q = pkts.size() == 1 ? pkts[0] : pkts[get_flow_hash(p) % pkts.size()];
 
-		temp[32] = len >> 24;
-		temp[33] = len >> 16;
-		temp[34] = len >>  8;
-		temp[35] = len;
+	if (q->try_put(p) == false) {
+		DOLOG(ll_debug, "IP-Protocol: queue full, packet dropped\n");
 
-		temp[39] = tcp ? 0x06 : 0x11;
+		delete p;
+	}
+}
 
-		memcpy(&temp[40], tcp_payload, len);
+void transport_layer::queue_packets(packet *const *const p, const int n)
+{
+	for(int i=0; i<n; i++)
+		stats_add_average(rx_copied, p[i]->get_bytes_copied());
 
-		checksum = ip_checksum((const uint16_t *)temp, temp_len / 2);
+	if (pkts.size() == 1) {
+		put_bulk_or_drop(pkts[0], p, n);
 
-		delete [] temp;
+		return;
 	}
-	else if (dst_addr.get_family() == any_addr::ipv4) {  // IPv4
-		size_t temp_len = 12 + len + (len & 1);
-		uint8_t *temp = new uint8_t[temp_len]();
 
-		src_addr.get(&temp[0], 4);
+	// group the packets per worker queue: still one put_bulk per queue
+	for(int offset=0; offset<n; offset += pkts_batch_size) {
+		const int n_chunk = std::min(n - offset, pkts_batch_size);
 
-		dst_addr.get(&temp[4], 4);
+		size_t  queue_nr[pkts_batch_size];
+		bool    done    [pkts_batch_size] { false };
+		packet *group   [pkts_batch_size];
 
-		temp[9] = tcp ? 0x06 : 0x11;
+		for(int i=0; i<n_chunk; i++)
+			queue_nr[i] = get_flow_hash(p[offset + i]) % pkts.size();
 
-		temp[10] = len >> 8; // TCP len
-		temp[11] = len;
+		for(int i=0; i<n_chunk; i++) {
+			if (done[i])
+				continue;
 
-		memcpy(&temp[12], tcp_payload, len);
+			int n_group = 0;
 
-		checksum = ip_checksum((const uint16_t *)temp, temp_len / 2);
+			for(int j=i; j<n_chunk; j++) {
+				if (queue_nr[j] == queue_nr[i]) {
+					group[n_group++] = p[offset + j];
+					done[j] = true;
+				}
+			}
 
-		delete [] temp;
+			put_bulk_or_drop(pkts[queue_nr[i]], group, n_group);
+		}
 	}
-	else {
+}
+
+uint16_t tcp_udp_checksum(const any_addr & src_addr, const any_addr & dst_addr, const bool tcp, const uint8_t *const tcp_payload, const int len)
+{
+	if (dst_addr.get_family() != any_addr::ipv6 && dst_addr.get_family() != any_addr::ipv4) {
 		DOLOG(ll_debug, "tcp_udp_checksum: cannot handle \"%s\" to \"%s\"\n", src_addr.to_str().c_str(), dst_addr.to_str().c_str());
+
+		return 0;
 	}
 
-	return checksum;
+	// pseudo header and segment are summed separately: no temporary copy
+	checksum_state_t state;
+	checksum_init(&state);
+
+	checksum_add_pseudo_header(&state, src_addr, dst_addr, tcp ? 0x06 : 0x11, len);
+
+	checksum_add(&state, tcp_payload, len);
+
+	return checksum_finish(&state);
 }
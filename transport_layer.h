@@ -20,12 +20,22 @@ protected:
 	std::vector<std::thread *> ths;
 	std::atomic_bool           stop_flag { false };
 
-	fifo<packet *>            *pkts      { nullptr };
+	// one queue per worker thread: packets of the same flow always end
+	// up in the same queue and thus are processed by the same thread
+	std::vector<fifo<packet *> *> pkts;
+	std::atomic_int            next_queue { 0 };
 
 	network_layer             *idev      { nullptr };
 
+	uint64_t                  *rx_copied { nullptr };
+
+	fifo<packet *> *claim_queue();
+	void interrupt_queues();
+
+	virtual uint64_t get_flow_hash(const packet *const p) const;
+
 public:
-	transport_layer(stats *const s, const std::string & stats_name);
+	transport_layer(stats *const s, const std::string & stats_name, const int n_queues);
 	virtual ~transport_layer();
 
 	void ask_to_stop() { stop_flag = true; }
@@ -35,6 +45,7 @@ public:
 	any_addr get_ip_address() const { return idev->get_addr(); }
 
 	void queue_packet(packet *p);
+	void queue_packets(packet *const *const p, const int n);
 
 	virtual void operator()() = 0;
 };
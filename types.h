@@ -6,12 +6,17 @@
 #include <mutex>
 #include <queue>
 #include <thread>
+#include <vector>
 #include <zlib.h>
 
+#include "fifo.h"
+#include "file_cache.h"
 #include "mqtt_client.h"
 #include "packet.h"
 #include "stats.h"
 
+class https_context;
+class session;
 
 class private_data
 {
@@ -23,6 +28,8 @@ public:
 class http_private_data : public private_data
 {
 public:
+	~http_private_data();
+
 	std::string logfile;
 	std::string web_root;
 	bool        is_https { false };
@@ -31,11 +38,20 @@ public:
 	std::string certificate;
 	std::string php_cgi;
 
+	fifo<session *>           *work { nullptr };
+	std::vector<std::thread *> workers;
+
+	file_cache                *fc   { nullptr };
+	https_context             *tls  { nullptr };  // certificate, key, session cache
+
 	uint64_t *http_requests { nullptr };
 	uint64_t *http_r_200 { nullptr };
 	uint64_t *http_r_404 { nullptr };
 	uint64_t *http_r_500 { nullptr };
 	uint64_t *http_r_err { nullptr };
+	uint64_t *http_r_keepalive { nullptr };  // requests on an already used connection
+	uint64_t *http_r_per_conn  { nullptr };
+	uint64_t *http_r_304       { nullptr };
 };
 
 class nrpe_private_data : public private_data
@@ -68,26 +84,23 @@ public:
 	std::string client_addr;
 };
 
+class https_engine;
+
 class http_session_data : public session_data
 {
 public:
-	~http_session_data() {
-		if (th) {
-			terminate = true;
-
-			th->join();
-			delete th;
-		}
-	}
-
-	std::thread     *th        { nullptr };
 	std::atomic_bool terminate { false   };
 
+	bool             scheduled { false   };  // queued for or being handled by a worker
+	bool             closing   { false   };
+	int              n_requests{ 0       };
+
         std::condition_variable r_cond;
         mutable std::mutex      r_lock;
 
-	char *req_data { nullptr };
-	size_t req_len { 0       };
+	std::string      req_data;  // received, not yet processed
+
+	https_engine    *tls       { nullptr };
 };
 
 class echo_session_data : public session_data
@@ -59,35 +59,31 @@ void ud_stats::emit_sessions(const int cfd)
 	json_t *out = json_array();
 
 	for(auto & stream : stream_session_handlers) {
-		auto sessions = stream->get_sessions_locked();
-
-		for(auto & session : *sessions) {
+		stream->get_sessions()->for_each([out](const uint64_t id, session *const s) {
 			json_t *record = json_object();
 
-			json_object_set(record, "their-addr", json_string(session.second->get_their_addr().to_str().c_str()));
-			json_object_set(record, "my-addr", json_string(session.second->get_my_addr().to_str().c_str()));
+			json_object_set(record, "their-addr", json_string(s->get_their_addr().to_str().c_str()));
+			json_object_set(record, "my-addr", json_string(s->get_my_addr().to_str().c_str()));
 
-			json_object_set(record, "their-port", json_integer(session.second->get_their_port()));
-			json_object_set(record, "my-port", json_integer(session.second->get_my_port()));
+			json_object_set(record, "their-port", json_integer(s->get_their_port()));
+			json_object_set(record, "my-port", json_integer(s->get_my_port()));
 
-			json_object_set(record, "session-hash", json_integer(session.second->get_hash()));
+			json_object_set(record, "session-hash", json_integer(s->get_hash()));
 
-			json_object_set(record, "terminating", json_integer(session.second->get_is_terminating()));
+			json_object_set(record, "terminating", json_integer(s->get_is_terminating()));
 
-			json_object_set(record, "state-name", json_string(session.second->get_state_name().c_str()));
+			json_object_set(record, "state-name", json_string(s->get_state_name().c_str()));
 
-			auto ts = session.second->get_session_creation_time();
+			auto ts = s->get_session_creation_time();
 
 			json_object_set(record, "created-at", json_integer(ts.tv_sec * 1000000ll + ts.tv_nsec / 1000));
 
-			auto p = session.second->get_stream_target();
+			auto p = s->get_stream_target();
 
-			json_object_set(record, "type-specific", p->get_state_json(session.second));
+			json_object_set(record, "type-specific", p->get_state_json(s));
 
 			json_array_append(out, record);
-		}
-
-		stream->sessions_unlock();
+		});
 	}
 
 	char *temp = json_dumps(out, 0);
@@ -10,7 +10,7 @@
 #include "utils.h"
 
 
-udp::udp(stats *const s, icmp *const icmp_, const int n_threads) : transport_layer(s, "udp"), icmp_(icmp_)
+udp::udp(stats *const s, icmp *const icmp_, const int n_threads) : transport_layer(s, "udp", n_threads), icmp_(icmp_)
 {
 	udp_requests = s->register_stat("udp_requests");
 	udp_refused  = s->register_stat("udp_refused");
@@ -21,7 +21,7 @@ udp::udp(stats *const s, icmp *const icmp_, const int n_threads) : transport_lay
 
 udp::~udp()
 {
-	pkts->interrupt();
+	interrupt_queues();
 
 	for(auto & th : ths) {
 		th->join();
@@ -34,59 +34,65 @@ void udp::operator()()
 {
 	set_thread_name("myip-udp");
 
+	fifo<packet *> *const queue = claim_queue();
+
+	packet *batch[pkts_batch_size];
+
 	for(;;) {
-		auto po = pkts->get();
-		if (!po.has_value())
+		int n = queue->get_bulk(batch, pkts_batch_size, -1);
+		if (n == 0)
 			break;
 
-		packet *pkt = po.value();
+		for(int i=0; i<n; i++) {
+			packet *pkt = batch[i];
 
-		const uint8_t *const p    = pkt->get_data();
-		const int            size = pkt->get_size();
+			const uint8_t *const p    = pkt->get_data();
+			const int            size = pkt->get_size();
 
-		if (size < 8) {
-			DOLOG(ll_debug, "UDP: packet too small (%d bytes)\n", size);
-			delete pkt;
-			continue;
-		}
+			if (size < 8) {
+				DOLOG(ll_debug, "UDP: packet too small (%d bytes)\n", size);
+				delete pkt;
+				continue;
+			}
 
-		uint16_t src_port = (p[0] << 8) | p[1];
-		uint16_t dst_port = (p[2] << 8) | p[3];
+			uint16_t src_port = (p[0] << 8) | p[1];
+			uint16_t dst_port = (p[2] << 8) | p[3];
 
-		stats_inc_counter(udp_requests);
+			stats_inc_counter(udp_requests);
 
-		DOLOG(ll_debug, "UDP: packet for port %d from port %d (%d bytes)\n", dst_port, src_port, size);
+			DOLOG(ll_debug, "UDP: packet for port %d from port %d (%d bytes)\n", dst_port, src_port, size);
 
-		cb_lock.lock_shared();
-		auto it = callbacks.find(dst_port);
+			cb_lock.lock_shared();
+			auto it = callbacks.find(dst_port);
 
-		if (it == callbacks.end()) {
-			if (icmp_)
-				icmp_->send_destination_port_unreachable(pkt->get_src_addr(), pkt->get_dst_addr(), pkt);
+			if (it == callbacks.end()) {
+				if (icmp_)
+					icmp_->send_destination_port_unreachable(pkt->get_src_addr(), pkt->get_dst_addr(), pkt);
 
-			stats_inc_counter(udp_refused);
+				stats_inc_counter(udp_refused);
 
-			cb_lock.unlock_shared();
-		}
-		else {
-			auto cb = it->second;
+				cb_lock.unlock_shared();
+			}
+			else {
+				auto cb = it->second;
 
-			auto src_addr = pkt->get_src_addr();
-			auto dst_addr = pkt->get_dst_addr();
+				auto src_addr = pkt->get_src_addr();
+				auto dst_addr = pkt->get_dst_addr();
 
-			auto header   = pkt->get_header();
+				auto header   = pkt->get_header();
 
-			pkt->add_to_log_prefix(myformat("UDP[%d->%d]", src_port, dst_port));
+				pkt->get_log_context().add_ports("UDP", src_port, dst_port);
 
-			packet *up    = new packet(pkt->get_recv_ts(), pkt->get_src_mac_addr(), src_addr, dst_addr, &p[8], size - 8, header.first, header.second, pkt->get_log_prefix());
+				packet *up    = pkt->view(src_addr, dst_addr, &p[8], size - 8, header.first, header.second);
 
-			cb.cb(pkt->get_src_addr(), src_port, pkt->get_dst_addr(), dst_port, up, cb.private_data);
-			cb_lock.unlock_shared();
+				cb.cb(pkt->get_src_addr(), src_port, pkt->get_dst_addr(), dst_port, up, cb.private_data);
+				cb_lock.unlock_shared();
 
-			delete up;
-		}
+				delete up;
+			}
 
-		delete pkt;
+			delete pkt;
+		}
 	}
 }
 
@@ -116,7 +122,11 @@ bool udp::transmit_packet(const any_addr & dst_ip, const int dst_port, const any
 
 	int out_size = 8 + pl_size;
 
-	uint8_t *out = new uint8_t[out_size + 1]();
+	// one buffer for header and payload; the IP layer prepends its header
+	// without copying it again
+	pool_block_t *block = pool_allocate(idev ? idev->get_buffer_pool() : nullptr, out_size);
+	uint8_t      *out   = pool_block_data(block);
+
 	out[0] = src_port >> 8;
 	out[1] = src_port;
 	out[2] = dst_port >> 8;
@@ -132,9 +142,9 @@ bool udp::transmit_packet(const any_addr & dst_ip, const int dst_port, const any
 
 	bool rc = false;
 	if (idev)
-		rc = idev->transmit_packet({ }, dst_ip, src_ip, 0x11, out, out_size, nullptr);
+		rc = idev->transmit_packet({ }, dst_ip, src_ip, 0x11, buffer_chain(block, out, out_size), nullptr);
 
-	delete [] out;
+	pool_block_unref(block);
 
 	return rc;
 }
@@ -114,6 +114,8 @@ void set_thread_name(std::string name)
 	DOLOG(ll_debug, "Set name of thread %d to \"%s\"\n", gettid(), name.c_str());
 
 	pthread_setname_np(pthread_self(), name.c_str());
+
+	setlog_thread_name(name.c_str());
 }
 
 std::string get_thread_name()